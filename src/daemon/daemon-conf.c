@@ -73,6 +73,7 @@ static const pa_daemon_conf default_conf = {
     .flat_volumes = TRUE,
     .exit_idle_time = 20,
     .scache_idle_time = 20,
+    .subscription_coalesce_msec = 0,
     .auto_log_target = 1,
     .script_commands = NULL,
     .dl_search_path = NULL,
@@ -96,6 +97,7 @@ static const pa_daemon_conf default_conf = {
     .disable_shm = FALSE,
     .lock_memory = FALSE,
     .deferred_volume = TRUE,
+    .enable_stats = TRUE,
     .default_n_fragments = 4,
     .default_fragment_size_msec = 25,
     .deferred_volume_safety_margin_usec = 8000,
@@ -579,8 +581,10 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "flat-volumes",               pa_config_parse_bool,     &c->flat_volumes, NULL },
         { "lock-memory",                pa_config_parse_bool,     &c->lock_memory, NULL },
         { "enable-deferred-volume",     pa_config_parse_bool,     &c->deferred_volume, NULL },
+        { "enable-stats",               pa_config_parse_bool,     &c->enable_stats, NULL },
         { "exit-idle-time",             pa_config_parse_int,      &c->exit_idle_time, NULL },
         { "scache-idle-time",           pa_config_parse_int,      &c->scache_idle_time, NULL },
+        { "subscription-coalesce-msec", pa_config_parse_unsigned, &c->subscription_coalesce_msec, NULL },
         { "realtime-priority",          parse_rtprio,             c, NULL },
         { "dl-search-path",             pa_config_parse_string,   &c->dl_search_path, NULL },
         { "default-script-file",        pa_config_parse_string,   &c->default_script_file, NULL },
@@ -782,8 +786,10 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "enable-shm = %s\n", pa_yes_no(!c->disable_shm));
     pa_strbuf_printf(s, "flat-volumes = %s\n", pa_yes_no(c->flat_volumes));
     pa_strbuf_printf(s, "lock-memory = %s\n", pa_yes_no(c->lock_memory));
+    pa_strbuf_printf(s, "enable-stats = %s\n", pa_yes_no(c->enable_stats));
     pa_strbuf_printf(s, "exit-idle-time = %i\n", c->exit_idle_time);
     pa_strbuf_printf(s, "scache-idle-time = %i\n", c->scache_idle_time);
+    pa_strbuf_printf(s, "subscription-coalesce-msec = %u\n", c->subscription_coalesce_msec);
     pa_strbuf_printf(s, "dl-search-path = %s\n", pa_strempty(c->dl_search_path));
     pa_strbuf_printf(s, "default-script-file = %s\n", pa_strempty(pa_daemon_conf_get_default_script_file(c)));
     pa_strbuf_printf(s, "load-default-script-file = %s\n", pa_yes_no(c->load_default_script_file));
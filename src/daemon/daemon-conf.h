@@ -76,7 +76,8 @@ typedef struct pa_daemon_conf {
         log_time,
         flat_volumes,
         lock_memory,
-        deferred_volume;
+        deferred_volume,
+        enable_stats;
     pa_server_type_t local_server_type;
     int exit_idle_time,
         scache_idle_time,
@@ -88,6 +89,7 @@ typedef struct pa_daemon_conf {
     pa_log_target_t log_target;
     pa_log_level_t log_level;
     unsigned log_backtrace;
+    unsigned subscription_coalesce_msec;
     char *config_file;
 
 #ifdef HAVE_SYS_RESOURCE_H
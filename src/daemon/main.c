@@ -340,6 +340,34 @@ static void set_all_rlimits(const pa_daemon_conf *conf) {
 }
 #endif
 
+/* Tells monitoring tools where to find the statistics */
+static void create_stats_id_file(pa_stats *s) {
+    char *fn;
+    FILE *f;
+
+    if (!(fn = pa_runtime_path(PA_STATS_ID_FILE)))
+        return;
+
+    if (!(f = pa_fopen_cloexec(fn, "w")))
+        pa_log_warn(_("Failed to create '%s': %s"), fn, pa_cstrerror(errno));
+    else {
+        fprintf(f, "%u\n", pa_stats_get_id(s));
+        fclose(f);
+    }
+
+    pa_xfree(fn);
+}
+
+static void remove_stats_id_file(void) {
+    char *fn;
+
+    if (!(fn = pa_runtime_path(PA_STATS_ID_FILE)))
+        return;
+
+    unlink(fn);
+    pa_xfree(fn);
+}
+
 static char *check_configured_address(void) {
     char *default_server = NULL;
     pa_client_conf *c = pa_client_conf_new();
@@ -1021,6 +1049,7 @@ int main(int argc, char *argv[]) {
     c->deferred_volume_extra_delay_usec = conf->deferred_volume_extra_delay_usec;
     c->exit_idle_time = conf->exit_idle_time;
     c->scache_idle_time = conf->scache_idle_time;
+    c->subscription_coalesce_usec = conf->subscription_coalesce_msec * PA_USEC_PER_MSEC;
     c->resample_method = conf->resample_method;
     c->realtime_priority = conf->realtime_priority;
     c->realtime_scheduling = !!conf->realtime_scheduling;
@@ -1034,6 +1063,11 @@ int main(int argc, char *argv[]) {
     c->server_type = conf->local_server_type;
 #endif
 
+    /* The statistics live in POSIX shared memory too */
+    if (conf->enable_stats && !conf->disable_shm)
+        if ((c->stats = pa_stats_new(PA_STATS_SLOTS_DEFAULT)))
+            create_stats_id_file(c->stats);
+
     c->cpu_info.cpu_type = PA_CPU_UNDEFINED;
     if (!getenv("PULSE_NO_SIMD")) {
         if (pa_cpu_init_x86(&(c->cpu_info.flags.x86)))
@@ -1165,6 +1199,9 @@ finish:
         pa_module_unload_all(c);
         pa_scache_free_all(c);
 
+        if (c->stats)
+            remove_stats_id_file();
+
         pa_core_unref(c);
         pa_log_info(_("Daemon terminated."));
     }
@@ -463,11 +463,17 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, pa_bool_t o
         PA_DEBUG_TRAP;
 #endif
 
-        if (!u->first && !u->after_rewind)
+        if (!u->first && !u->after_rewind) {
+            pa_stats_slot_inc(u->sink->stats, PA_STATS_UNDERRUNS);
+
             if (pa_log_ratelimit(PA_LOG_INFO))
                 pa_log_info("Underrun!");
+        }
     }
 
+    pa_stats_slot_set(u->sink->stats, PA_STATS_QUEUE_LENGTH, (uint32_t) left_to_play);
+    pa_stats_slot_set(u->sink->stats, PA_STATS_LATENCY, (uint32_t) pa_bytes_to_usec(left_to_play, &u->sink->sample_spec));
+
 #ifdef DEBUG_TIMING
     pa_log_debug("%0.2f ms left to play; inc threshold = %0.2f ms; dec threshold = %0.2f ms",
                  (double) pa_bytes_to_usec(left_to_play, &u->sink->sample_spec) / PA_USEC_PER_MSEC,
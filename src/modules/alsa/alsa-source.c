@@ -438,10 +438,15 @@ static size_t check_left_to_record(struct userdata *u, size_t n_bytes, pa_bool_t
         PA_DEBUG_TRAP;
 #endif
 
+        pa_stats_slot_inc(u->source->stats, PA_STATS_OVERRUNS);
+
         if (pa_log_ratelimit(PA_LOG_INFO))
             pa_log_info("Overrun!");
     }
 
+    pa_stats_slot_set(u->source->stats, PA_STATS_QUEUE_LENGTH, (uint32_t) (rec_space - left_to_record));
+    pa_stats_slot_set(u->source->stats, PA_STATS_LATENCY, (uint32_t) pa_bytes_to_usec(rec_space - left_to_record, &u->source->sample_spec));
+
 #ifdef DEBUG_TIMING
     pa_log_debug("%0.2f ms left to record", (double) pa_bytes_to_usec(left_to_record, &u->source->sample_spec) / PA_USEC_PER_MSEC);
 #endif
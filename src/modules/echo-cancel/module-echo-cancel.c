@@ -217,7 +217,7 @@ struct userdata {
 
     /* to wakeup the source I/O thread */
     pa_asyncmsgq *asyncmsgq;
-    pa_rtpoll_item *rtpoll_item_read, *rtpoll_item_write;
+    pa_rtpoll_item *rtpoll_item_read;
 
     pa_source *source;
     pa_bool_t source_auto_desc;
@@ -1286,11 +1286,6 @@ static void sink_input_attach_cb(pa_sink_input *i) {
 
     pa_log_debug("Sink input %d attach", i->index);
 
-    u->rtpoll_item_write = pa_rtpoll_item_new_asyncmsgq_write(
-            i->sink->thread_info.rtpoll,
-            PA_RTPOLL_LATE,
-            u->asyncmsgq);
-
     pa_sink_attach_within_thread(u->sink);
 }
 
@@ -1326,11 +1321,6 @@ static void sink_input_detach_cb(pa_sink_input *i) {
     pa_sink_set_rtpoll(u->sink, NULL);
 
     pa_log_debug("Sink input %d detach", i->index);
-
-    if (u->rtpoll_item_write) {
-        pa_rtpoll_item_free(u->rtpoll_item_write);
-        u->rtpoll_item_write = NULL;
-    }
 }
 
 /* Called from source I/O thread context. */
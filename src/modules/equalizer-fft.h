@@ -0,0 +1,114 @@
+#ifndef fooequalizerffthfoo
+#define fooequalizerffthfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* The transform of module-equalizer-sink. All channels are
+ * transformed at once, in place, in one work buffer with a row of
+ * eq_work_size() floats per channel. The rows are padded to whole
+ * vectors of EQ_V_SIZE bins, which eq_apply_filter() runs over too.
+ * Shared with the tests. */
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#endif
+
+#include <fftw3.h>
+
+#include <pulsecore/macro.h>
+
+#define EQ_V_SIZE 4
+
+/* Floats per channel in the work buffer, filter_size is the number
+ * of bins, i.e. fft_size / 2 + 1 */
+static inline size_t eq_work_size(size_t filter_size) {
+    return 2 * PA_ROUND_UP(filter_size, EQ_V_SIZE);
+}
+
+/* Windows the input of one channel into its row of the work buffer,
+ * and zero pads the remaining fft window and the row padding */
+static inline void eq_window_input(
+        float * restrict dst,
+        const float * restrict src,
+        const float * restrict W,
+        size_t window_size,
+        size_t work_size) {
+
+    size_t j;
+
+    for (j = 0; j < window_size; ++j)
+        dst[j] = W[j] * src[j];
+
+    memset(dst + window_size, 0, (work_size - window_size) * sizeof(float));
+}
+
+/* Filters a transformed row, purely magnitude based. The multiplier X
+ * is applied here as well, the transform is linear. H must be aligned
+ * and padded to EQ_V_SIZE bins. */
+static inline void eq_apply_filter(
+        float * restrict dst,
+        float X,
+        const float * restrict H,
+        size_t filter_size) {
+
+    size_t j;
+#ifdef __SSE2__
+    const __m128 x = _mm_set1_ps(X);
+
+    for (j = 0; j < filter_size; j += EQ_V_SIZE) {
+        __m128 h = _mm_mul_ps(x, _mm_load_ps(H + j));
+        __m128 *d = (__m128 *) (dst + 2 * j);
+
+        d[0] = _mm_mul_ps(d[0], _mm_unpacklo_ps(h, h));
+        d[1] = _mm_mul_ps(d[1], _mm_unpackhi_ps(h, h));
+    }
+#else
+    for (j = 0; j < filter_size; ++j) {
+        dst[2 * j] *= X * H[j];
+        dst[2 * j + 1] *= X * H[j];
+    }
+#endif
+}
+
+/* Plans the in place transforms of all rows of the work buffer */
+static inline void eq_plans_new(
+        float *work_buffer,
+        size_t fft_size,
+        size_t channels,
+        size_t work_size,
+        fftwf_plan *forward,
+        fftwf_plan *inverse) {
+
+    int n = (int) fft_size;
+
+    *forward = fftwf_plan_many_dft_r2c(1, &n, (int) channels,
+                                       work_buffer, NULL, 1, (int) work_size,
+                                       (fftwf_complex *) work_buffer, NULL, 1, (int) work_size / 2,
+                                       FFTW_ESTIMATE);
+    *inverse = fftwf_plan_many_dft_c2r(1, &n, (int) channels,
+                                       (fftwf_complex *) work_buffer, NULL, 1, (int) work_size / 2,
+                                       work_buffer, NULL, 1, (int) work_size,
+                                       FFTW_ESTIMATE);
+}
+
+#endif
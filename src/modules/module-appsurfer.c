@@ -24,109 +24,474 @@
 #endif
 
 #include <pulse/xmalloc.h>
-#include <string.h>
+
 #include <pulsecore/core.h>
 #include <pulsecore/sink-input.h>
 #include <pulsecore/source-output.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/log.h>
-#include <pulsecore/namereg.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
 
 #include "module-appsurfer-symdef.h"
 
 PA_MODULE_AUTHOR("Lennart Poettering");
-PA_MODULE_DESCRIPTION("When a sink/source is removed, try to move their streams to the default sink/source");
+PA_MODULE_DESCRIPTION("Route the streams of every application to a sink of its own");
 PA_MODULE_VERSION(PACKAGE_VERSION);
 PA_MODULE_LOAD_ONCE(TRUE);
+PA_MODULE_USAGE("pool_size=<number of idle sinks to keep ready for new applications>");
+
+#define DEFAULT_POOL_SIZE 4
+
+/* Most applications are silent most of the time, let their sinks
+ * stop rendering after a while */
+#define HIBERNATE_TIME "10"
 
 static const char* const valid_modargs[] = {
+    "pool_size",
     NULL,
 };
 
+/* Devices are owned by the application whose process id they carry
+ * in their proplist. This is what we route the streams by. */
+struct route {
+    char *pid;
+    void *device;
+};
+
 struct userdata {
-    pa_hook_slot
-	*new_sink_input_slot,
-	*sink_input_move_fail_slot;
+    pa_core *core;
 
+    pa_hook_slot
+        *sink_input_new_slot,
+        *sink_input_unlink_post_slot,
+        *sink_input_move_start_slot,
+        *sink_input_move_finish_slot,
+        *sink_input_move_fail_slot,
+        *source_output_new_slot,
+        *source_output_move_fail_slot,
+        *sink_put_slot,
+        *sink_unlink_slot,
+        *source_put_slot,
+        *source_unlink_slot;
+
+    /* application.process.id -> struct route */
+    pa_hashmap *sinks, *sources;
+
+    /* All sinks we loaded ourselves, and the subset of them that is
+     * suspended and not owned by any application yet */
+    pa_idxset *managed, *pool;
+    uint32_t pool_size;
+    unsigned sink_counter;
+    pa_defer_event *refill_event;
+
+    /* The sink we are loading right now, as seen by our SINK_PUT hook */
+    pa_bool_t loading;
+    pa_sink *loaded_sink;
+
+    /* Streams being moved -> the sink they came from (referenced) */
+    pa_hashmap *moving;
 };
 
+static void route_free(void *p, void *userdata) {
+    struct route *r = p;
 
-static pa_hook_result_t new_sink_input_callback(pa_core *c, pa_sink_input *i, void* userdata) {    
-    uint32_t idx;
-    char *pid;
-    char *module_name;
+    pa_xfree(r->pid);
+    pa_xfree(r);
+}
+
+static void origin_free(void *p, void *userdata) {
+    pa_sink_unref(p);
+}
+
+static void route_add(pa_hashmap *h, const char *pid, void *device) {
+    struct route *r;
+
+    pa_assert(h);
+    pa_assert(pid);
+    pa_assert(device);
+
+    r = pa_xnew(struct route, 1);
+    r->pid = pa_xstrdup(pid);
+    r->device = device;
+
+    if (pa_hashmap_put(h, r->pid, r) < 0) {
+        pa_log_warn("Application %s already has a device of its own, ignoring the new one.", pid);
+        route_free(r, NULL);
+    }
+}
+
+static void route_remove(pa_hashmap *h, const char *pid, void *device) {
+    struct route *r;
+
+    pa_assert(h);
+    pa_assert(pid);
+    pa_assert(device);
+
+    /* Only drop the route if it actually points to this device */
+    if (!(r = pa_hashmap_get(h, pid)) || r->device != device)
+        return;
+
+    pa_hashmap_remove(h, pid);
+    route_free(r, NULL);
+}
+
+static void *route_get(pa_hashmap *h, const char *pid) {
+    struct route *r;
+
+    pa_assert(h);
+
+    if (!pid || !(r = pa_hashmap_get(h, pid)))
+        return NULL;
+
+    return r->device;
+}
+
+static pa_sink *load_sink(struct userdata *u, const char *pid) {
+    char *args;
+    pa_module *m;
+    pa_sink *sink;
+
+    pa_assert(u);
+
+    /* Sinks move between applications through the pool, so their names
+     * don't say anything about who owns them. All per-application sinks
+     * share one rendering thread, so that the number of wakeups doesn't
+     * grow with the number of sinks. */
+    if (pid)
+        args = pa_sprintf_malloc("sink_name=appsurfer.%u sink_properties=" PA_PROP_APPLICATION_PROCESS_ID "=%s shared_clock=1 hibernate_time=" HIBERNATE_TIME, u->sink_counter++, pid);
+    else
+        args = pa_sprintf_malloc("sink_name=appsurfer.%u shared_clock=1 hibernate_time=" HIBERNATE_TIME, u->sink_counter++);
+
+    /* The name might have been taken and changed on registration, so
+     * don't look the sink up by it */
+    u->loading = TRUE;
+    u->loaded_sink = NULL;
+    m = pa_module_load(u->core, "module-null-sink", args);
+    sink = u->loaded_sink;
+    u->loading = FALSE;
+    u->loaded_sink = NULL;
+
+    pa_xfree(args);
+
+    if (!m || !sink || sink->module != m)
+        return NULL;
+
+    pa_idxset_put(u->managed, sink, NULL);
+    return sink;
+}
+
+static void refill_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    struct userdata *u = userdata;
+    pa_sink *sink;
+
+    pa_assert(u);
+
+    if (pa_idxset_size(u->pool) >= u->pool_size) {
+        u->core->mainloop->defer_enable(e, 0);
+        return;
+    }
+
+    /* Only load a single sink per main loop iteration, so that
+     * refilling the pool never stalls the clients for long */
+    if (!(sink = load_sink(u, NULL))) {
+        pa_log_warn("Failed to create a sink for the pool, not refilling it.");
+        u->core->mainloop->defer_enable(e, 0);
+        return;
+    }
+
+    pa_sink_suspend(sink, TRUE, PA_SUSPEND_IDLE);
+    pa_idxset_put(u->pool, sink, NULL);
+}
+
+static pa_sink *get_sink_for_pid(struct userdata *u, const char *pid) {
+    pa_sink *sink;
+    pa_proplist *pl;
+
+    pa_assert(u);
+    pa_assert(pid);
+
+    /* A new sink gets registered by our SINK_PUT hook while loading */
+    if (!(sink = pa_idxset_steal_first(u->pool, NULL)))
+        return load_sink(u, pid);
+
+    pl = pa_proplist_new();
+    pa_proplist_sets(pl, PA_PROP_APPLICATION_PROCESS_ID, pid);
+    pa_sink_update_proplist(sink, PA_UPDATE_REPLACE, pl);
+    pa_proplist_free(pl);
+
+    route_add(u->sinks, pid, sink);
+    pa_sink_suspend(sink, FALSE, PA_SUSPEND_IDLE);
+
+    if (u->pool_size > 0)
+        u->core->mainloop->defer_enable(u->refill_event, 1);
+
+    return sink;
+}
+
+/* Called when the last stream of an application is gone from its sink */
+static void release_sink(struct userdata *u, pa_sink *sink) {
+    const char *pid;
+
+    pa_assert(u);
+    pa_assert(sink);
+
+    if ((pid = pa_proplist_gets(sink->proplist, PA_PROP_APPLICATION_PROCESS_ID)))
+        route_remove(u->sinks, pid, sink);
+
+    if (pa_idxset_size(u->pool) >= u->pool_size) {
+        pa_module_unload_request(sink->module, TRUE);
+        return;
+    }
+
+    pa_proplist_unset(sink->proplist, PA_PROP_APPLICATION_PROCESS_ID);
+    pa_sink_update_proplist(sink, PA_UPDATE_REPLACE, NULL);
+
+    pa_sink_suspend(sink, TRUE, PA_SUSPEND_IDLE);
+    pa_idxset_put(u->pool, sink, NULL);
+}
+
+static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_new_data *new_data, struct userdata *u) {
+    const char *pid;
     pa_sink *target;
-    pa_module *null_sink;
+
     pa_assert(c);
-    pa_assert(i);
+    pa_assert(new_data);
+    pa_assert(u);
 
     /* There's no point in doing anything if the core is shut down anyway */
     if (c->state == PA_CORE_SHUTDOWN)
         return PA_HOOK_OK;
-    pid = pa_proplist_gets(i->proplist,PA_PROP_APPLICATION_PROCESS_ID);        
-    PA_IDXSET_FOREACH(target, c->sinks, idx) {        
-
-        if(pa_streq(pid,target->name))
-        {
-            if (pa_sink_input_move_to(i, target, FALSE) < 0)
-                pa_log_info("Failed to move sink input %u \"%s\" to %s.", i->index,
-                        pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), target->name);
-            else
-                pa_log_info("Successfully moved sink input %u \"%s\" to %s.", i->index,
-                        pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), target->name);
-            return PA_HOOK_OK;
-        }
-    }
-    module_name = pa_xmalloc(strlen(pid)+11);    
-    sprintf(module_name,"sink_name=%s",pid);
-    null_sink = pa_module_load(c,'module-null-sink',(const char*) module_name);
-    if(null_sink)
-    {
-        if (pa_sink_input_move_to(i, null_sink, FALSE) < 0)
-                pa_log_info("Failed to move sink input %u \"%s\" to %s.", i->index,
-                        pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), null_sink->name);
-            else
-                pa_log_info("Successfully moved sink input %u \"%s\" to %s.", i->index,
-                        pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), null_sink->name);
-            return PA_HOOK_OK;
+
+    if (new_data->sink)
+        return PA_HOOK_OK;
+
+    if (!(pid = pa_proplist_gets(new_data->proplist, PA_PROP_APPLICATION_PROCESS_ID)))
+        return PA_HOOK_OK;
+
+    if (!(target = route_get(u->sinks, pid)) && !(target = get_sink_for_pid(u, pid))) {
+        pa_log_info("Failed to create a sink for application %s.", pid);
+        return PA_HOOK_OK;
     }
+
+    if (pa_sink_input_new_data_set_sink(new_data, target, FALSE))
+        pa_log_info("Routing stream \"%s\" of application %s to %s.",
+                    pa_strnull(pa_proplist_gets(new_data->proplist, PA_PROP_APPLICATION_NAME)), pid, target->name);
+
     return PA_HOOK_OK;
 }
 
-static pa_hook_result_t sink_input_move_fail_hook_callback(pa_core *c, pa_sink_input *i, void *userdata) {
-    uint32_t *idx;
+static pa_hook_result_t sink_input_unlink_post_hook_callback(pa_core *c, pa_sink_input *i, struct userdata *u) {
+    pa_sink *origin;
+
+    pa_assert(c);
+    pa_assert(i);
+    pa_assert(u);
+
+    /* The stream got killed in the middle of a move */
+    if ((origin = pa_hashmap_remove(u->moving, i)))
+        pa_sink_unref(origin);
+
+    if (c->state == PA_CORE_SHUTDOWN)
+        return PA_HOOK_OK;
+
+    if (!i->sink || !PA_SINK_IS_LINKED(pa_sink_get_state(i->sink)))
+        return PA_HOOK_OK;
+
+    if (!pa_idxset_get_by_data(u->managed, i->sink, NULL))
+        return PA_HOOK_OK;
+
+    if (pa_idxset_size(i->sink->inputs) > 0)
+        return PA_HOOK_OK;
+
+    release_sink(u, i->sink);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_move_start_hook_callback(pa_core *c, pa_sink_input *i, struct userdata *u) {
+    pa_sink *origin;
+
+    pa_assert(c);
+    pa_assert(i);
+    pa_assert(u);
+
+    if (c->state == PA_CORE_SHUTDOWN)
+        return PA_HOOK_OK;
+
+    /* Remember where the stream came from, it isn't known anymore once
+     * the move is finished */
+    if (!pa_idxset_get_by_data(u->managed, i->sink, NULL))
+        return PA_HOOK_OK;
+
+    if ((origin = pa_hashmap_remove(u->moving, i)))
+        pa_sink_unref(origin);
+
+    pa_hashmap_put(u->moving, i, pa_sink_ref(i->sink));
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_move_finish_hook_callback(pa_core *c, pa_sink_input *i, struct userdata *u) {
+    pa_sink *origin;
+
+    pa_assert(c);
+    pa_assert(i);
+    pa_assert(u);
+
+    if (!(origin = pa_hashmap_remove(u->moving, i)))
+        return PA_HOOK_OK;
+
+    if (c->state != PA_CORE_SHUTDOWN &&
+        origin != i->sink &&
+        PA_SINK_IS_LINKED(pa_sink_get_state(origin)) &&
+        pa_idxset_size(origin->inputs) <= 0 &&
+        pa_idxset_get_by_data(u->managed, origin, NULL) &&
+        !pa_idxset_get_by_data(u->pool, origin, NULL))
+        release_sink(u, origin);
+
+    pa_sink_unref(origin);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_move_fail_hook_callback(pa_core *c, pa_sink_input *i, struct userdata *u) {
     pa_sink *target;
-    char *pid;
+
     pa_assert(c);
     pa_assert(i);
+    pa_assert(u);
 
     /* There's no point in doing anything if the core is shut down anyway */
     if (c->state == PA_CORE_SHUTDOWN)
         return PA_HOOK_OK;
 
-    pid = pa_proplist_gets(i->proplist,PA_PROP_APPLICATION_PROCESS_ID);        
-    PA_IDXSET_FOREACH(target, c->sinks, idx) {        
-
-        if(pa_streq(pid,target->name))
-        {
-            if (pa_sink_input_finish_move(i, target, FALSE) < 0) {
-                pa_log_info("Failed to move sink input %u \"%s\" to %s.", i->index,
-                        pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), target->name);
-                return PA_HOOK_OK;
+    if (!(target = route_get(u->sinks, pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_PROCESS_ID))))
+        return PA_HOOK_OK;
 
-            } else {
-                pa_log_info("Successfully moved sink input %u \"%s\" to %s.", i->index,
+    if (pa_sink_input_finish_move(i, target, FALSE) < 0) {
+        pa_log_info("Failed to move sink input %u \"%s\" to %s.", i->index,
                     pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), target->name);
-                return PA_HOOK_STOP;
-            }  
-        }
+        return PA_HOOK_OK;
+    }
+
+    pa_log_info("Successfully moved sink input %u \"%s\" to %s.", i->index,
+                pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), target->name);
+    return PA_HOOK_STOP;
+}
+
+static pa_hook_result_t source_output_new_hook_callback(pa_core *c, pa_source_output_new_data *new_data, struct userdata *u) {
+    pa_source *target;
+
+    pa_assert(c);
+    pa_assert(new_data);
+    pa_assert(u);
+
+    if (c->state == PA_CORE_SHUTDOWN)
+        return PA_HOOK_OK;
+
+    if (new_data->source)
+        return PA_HOOK_OK;
+
+    if (!(target = route_get(u->sources, pa_proplist_gets(new_data->proplist, PA_PROP_APPLICATION_PROCESS_ID))))
+        return PA_HOOK_OK;
+
+    pa_source_output_new_data_set_source(new_data, target, FALSE);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t source_output_move_fail_hook_callback(pa_core *c, pa_source_output *o, struct userdata *u) {
+    pa_source *target;
+
+    pa_assert(c);
+    pa_assert(o);
+    pa_assert(u);
+
+    if (c->state == PA_CORE_SHUTDOWN)
+        return PA_HOOK_OK;
+
+    if (!(target = route_get(u->sources, pa_proplist_gets(o->proplist, PA_PROP_APPLICATION_PROCESS_ID))))
+        return PA_HOOK_OK;
+
+    if (pa_source_output_finish_move(o, target, FALSE) < 0) {
+        pa_log_info("Failed to move source output %u \"%s\" to %s.", o->index,
+                    pa_strnull(pa_proplist_gets(o->proplist, PA_PROP_APPLICATION_NAME)), target->name);
+        return PA_HOOK_OK;
     }
+
+    pa_log_info("Successfully moved source output %u \"%s\" to %s.", o->index,
+                pa_strnull(pa_proplist_gets(o->proplist, PA_PROP_APPLICATION_NAME)), target->name);
+    return PA_HOOK_STOP;
+}
+
+static pa_hook_result_t sink_put_hook_callback(pa_core *c, pa_sink *sink, struct userdata *u) {
+    const char *pid;
+
+    pa_assert(c);
+    pa_assert(sink);
+    pa_assert(u);
+
+    if (u->loading && !u->loaded_sink)
+        u->loaded_sink = sink;
+
+    if ((pid = pa_proplist_gets(sink->proplist, PA_PROP_APPLICATION_PROCESS_ID)))
+        route_add(u->sinks, pid, sink);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_unlink_hook_callback(pa_core *c, pa_sink *sink, struct userdata *u) {
+    const char *pid;
+
+    pa_assert(c);
+    pa_assert(sink);
+    pa_assert(u);
+
+    if ((pid = pa_proplist_gets(sink->proplist, PA_PROP_APPLICATION_PROCESS_ID)))
+        route_remove(u->sinks, pid, sink);
+
+    pa_idxset_remove_by_data(u->pool, sink, NULL);
+    pa_idxset_remove_by_data(u->managed, sink, NULL);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t source_put_hook_callback(pa_core *c, pa_source *source, struct userdata *u) {
+    const char *pid;
+
+    pa_assert(c);
+    pa_assert(source);
+    pa_assert(u);
+
+    /* Monitors are reachable through their sinks already */
+    if (source->monitor_of)
+        return PA_HOOK_OK;
+
+    if ((pid = pa_proplist_gets(source->proplist, PA_PROP_APPLICATION_PROCESS_ID)))
+        route_add(u->sources, pid, source);
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t source_unlink_hook_callback(pa_core *c, pa_source *source, struct userdata *u) {
+    const char *pid;
+
+    pa_assert(c);
+    pa_assert(source);
+    pa_assert(u);
+
+    if (source->monitor_of)
+        return PA_HOOK_OK;
+
+    if ((pid = pa_proplist_gets(source->proplist, PA_PROP_APPLICATION_PROCESS_ID)))
+        route_remove(u->sources, pid, source);
+
+    return PA_HOOK_OK;
 }
 
 int pa__init(pa_module*m) {
     pa_modargs *ma;
     struct userdata *u;
+    pa_sink *sink;
+    pa_source *source;
+    uint32_t idx;
 
     pa_assert(m);
 
@@ -135,15 +500,56 @@ int pa__init(pa_module*m) {
         return -1;
     }
 
-    m->userdata = u = pa_xnew(struct userdata, 1);
+    m->userdata = u = pa_xnew0(struct userdata, 1);
+    u->core = m->core;
+
+    u->pool_size = DEFAULT_POOL_SIZE;
+    if (pa_modargs_get_value_u32(ma, "pool_size", &u->pool_size) < 0) {
+        pa_log("Failed to parse pool_size value");
+        goto fail;
+    }
+
+    u->sinks = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    u->sources = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    u->managed = pa_idxset_new(NULL, NULL);
+    u->pool = pa_idxset_new(NULL, NULL);
+    u->moving = pa_hashmap_new(NULL, NULL);
+
+    /* Pick up the devices that already exist */
+    PA_IDXSET_FOREACH(sink, m->core->sinks, idx)
+        if (PA_SINK_IS_LINKED(pa_sink_get_state(sink)))
+            sink_put_hook_callback(m->core, sink, u);
+
+    PA_IDXSET_FOREACH(source, m->core->sources, idx)
+        if (PA_SOURCE_IS_LINKED(pa_source_get_state(source)))
+            source_put_hook_callback(m->core, source, u);
+
+    u->sink_put_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_PUT], PA_HOOK_EARLY, (pa_hook_cb_t) sink_put_hook_callback, u);
+    u->sink_unlink_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_UNLINK], PA_HOOK_EARLY, (pa_hook_cb_t) sink_unlink_hook_callback, u);
+    u->source_put_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SOURCE_PUT], PA_HOOK_EARLY, (pa_hook_cb_t) source_put_hook_callback, u);
+    u->source_unlink_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SOURCE_UNLINK], PA_HOOK_EARLY, (pa_hook_cb_t) source_unlink_hook_callback, u);
 
     /* A little bit later than module-stream-restore, module-intended-roles... */
-    u->new_sink_input_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_NEW], PA_HOOK_EARLY, (pa_hook_cb_t) new_sink_input_callback, u);
+    u->sink_input_new_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_NEW], PA_HOOK_EARLY, (pa_hook_cb_t) sink_input_new_hook_callback, u);
+    u->sink_input_unlink_post_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_UNLINK_POST], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_unlink_post_hook_callback, u);
+    u->source_output_new_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SOURCE_OUTPUT_NEW], PA_HOOK_EARLY, (pa_hook_cb_t) source_output_new_hook_callback, u);
 
+    u->sink_input_move_start_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_START], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_start_hook_callback, u);
+    u->sink_input_move_finish_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_finish_hook_callback, u);
     u->sink_input_move_fail_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FAIL], PA_HOOK_LATE+20, (pa_hook_cb_t) sink_input_move_fail_hook_callback, u);
+    u->source_output_move_fail_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SOURCE_OUTPUT_MOVE_FAIL], PA_HOOK_LATE+20, (pa_hook_cb_t) source_output_move_fail_hook_callback, u);
+
+    /* The pool is filled from the main loop, not right away */
+    u->refill_event = m->core->mainloop->defer_new(m->core->mainloop, refill_cb, u);
+    m->core->mainloop->defer_enable(u->refill_event, u->pool_size > 0);
 
     pa_modargs_free(ma);
     return 0;
+
+fail:
+    pa_modargs_free(ma);
+    pa__done(m);
+    return -1;
 }
 
 void pa__done(pa_module*m) {
@@ -154,11 +560,50 @@ void pa__done(pa_module*m) {
     if (!(u = m->userdata))
         return;
 
-    if (u->new_sink_input_slot)
-        pa_hook_slot_free(u->new_sink_input_slot);
-
+    if (u->refill_event)
+        u->core->mainloop->defer_free(u->refill_event);
+
+    if (u->sink_input_new_slot)
+        pa_hook_slot_free(u->sink_input_new_slot);
+    if (u->sink_input_unlink_post_slot)
+        pa_hook_slot_free(u->sink_input_unlink_post_slot);
+    if (u->sink_input_move_start_slot)
+        pa_hook_slot_free(u->sink_input_move_start_slot);
+    if (u->sink_input_move_finish_slot)
+        pa_hook_slot_free(u->sink_input_move_finish_slot);
     if (u->sink_input_move_fail_slot)
         pa_hook_slot_free(u->sink_input_move_fail_slot);
+    if (u->source_output_new_slot)
+        pa_hook_slot_free(u->source_output_new_slot);
+    if (u->source_output_move_fail_slot)
+        pa_hook_slot_free(u->source_output_move_fail_slot);
+    if (u->sink_put_slot)
+        pa_hook_slot_free(u->sink_put_slot);
+    if (u->sink_unlink_slot)
+        pa_hook_slot_free(u->sink_unlink_slot);
+    if (u->source_put_slot)
+        pa_hook_slot_free(u->source_put_slot);
+    if (u->source_unlink_slot)
+        pa_hook_slot_free(u->source_unlink_slot);
+
+    if (u->sinks)
+        pa_hashmap_free(u->sinks, route_free, NULL);
+    if (u->sources)
+        pa_hashmap_free(u->sources, route_free, NULL);
+    if (u->moving)
+        pa_hashmap_free(u->moving, origin_free, NULL);
+
+    if (u->pool) {
+        pa_sink *sink;
+
+        /* Nobody is using the sinks in the pool, so get rid of them */
+        while ((sink = pa_idxset_steal_first(u->pool, NULL)))
+            pa_module_unload_request(sink->module, TRUE);
+
+        pa_idxset_free(u->pool, NULL, NULL);
+    }
+    if (u->managed)
+        pa_idxset_free(u->managed, NULL, NULL);
 
     pa_xfree(u);
 }
@@ -94,8 +94,8 @@ struct output {
 
     pa_asyncmsgq *inq,    /* Message queue from the sink thread to this sink input */
                  *outq;   /* Message queue from this sink input to the sink thread */
-    pa_rtpoll_item *inq_rtpoll_item_read, *inq_rtpoll_item_write;
-    pa_rtpoll_item *outq_rtpoll_item_read, *outq_rtpoll_item_write;
+    pa_rtpoll_item *inq_rtpoll_item_read;
+    pa_rtpoll_item *outq_rtpoll_item_read;
 
     pa_memblockq *memblockq;
 
@@ -500,18 +500,13 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_assert_se(o = i->userdata);
 
     /* Set up the queue from the sink thread to us */
-    pa_assert(!o->inq_rtpoll_item_read && !o->outq_rtpoll_item_write);
+    pa_assert(!o->inq_rtpoll_item_read);
 
     o->inq_rtpoll_item_read = pa_rtpoll_item_new_asyncmsgq_read(
             i->sink->thread_info.rtpoll,
             PA_RTPOLL_LATE,  /* This one is not that important, since we check for data in _peek() anyway. */
             o->inq);
 
-    o->outq_rtpoll_item_write = pa_rtpoll_item_new_asyncmsgq_write(
-            i->sink->thread_info.rtpoll,
-            PA_RTPOLL_EARLY,
-            o->outq);
-
     pa_sink_input_request_rewind(i, 0, FALSE, TRUE, TRUE);
 
     pa_atomic_store(&o->max_request, (int) pa_sink_input_get_max_request(i));
@@ -534,11 +529,6 @@ static void sink_input_detach_cb(pa_sink_input *i) {
         pa_rtpoll_item_free(o->inq_rtpoll_item_read);
         o->inq_rtpoll_item_read = NULL;
     }
-
-    if (o->outq_rtpoll_item_write) {
-        pa_rtpoll_item_free(o->outq_rtpoll_item_write);
-        o->outq_rtpoll_item_write = NULL;
-    }
 }
 
 /* Called from main context */
@@ -698,16 +688,12 @@ static void output_add_within_thread(struct output *o) {
 
     PA_LLIST_PREPEND(struct output, o->userdata->thread_info.active_outputs, o);
 
-    pa_assert(!o->outq_rtpoll_item_read && !o->inq_rtpoll_item_write);
+    pa_assert(!o->outq_rtpoll_item_read);
 
     o->outq_rtpoll_item_read = pa_rtpoll_item_new_asyncmsgq_read(
             o->userdata->rtpoll,
             PA_RTPOLL_EARLY-1,  /* This item is very important */
             o->outq);
-    o->inq_rtpoll_item_write = pa_rtpoll_item_new_asyncmsgq_write(
-            o->userdata->rtpoll,
-            PA_RTPOLL_EARLY,
-            o->inq);
 }
 
 /* Called from thread context of the io thread */
@@ -721,11 +707,6 @@ static void output_remove_within_thread(struct output *o) {
         pa_rtpoll_item_free(o->outq_rtpoll_item_read);
         o->outq_rtpoll_item_read = NULL;
     }
-
-    if (o->inq_rtpoll_item_write) {
-        pa_rtpoll_item_free(o->inq_rtpoll_item_write);
-        o->inq_rtpoll_item_write = NULL;
-    }
 }
 
 /* Called from thread context of the io thread */
@@ -924,13 +905,8 @@ static void output_free(struct output *o) {
 
     if (o->inq_rtpoll_item_read)
         pa_rtpoll_item_free(o->inq_rtpoll_item_read);
-    if (o->inq_rtpoll_item_write)
-        pa_rtpoll_item_free(o->inq_rtpoll_item_write);
-
     if (o->outq_rtpoll_item_read)
         pa_rtpoll_item_free(o->outq_rtpoll_item_read);
-    if (o->outq_rtpoll_item_write)
-        pa_rtpoll_item_free(o->outq_rtpoll_item_write);
 
     if (o->inq)
         pa_asyncmsgq_unref(o->inq);
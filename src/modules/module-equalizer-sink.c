@@ -38,11 +38,6 @@
 #include <stdint.h>
 
 //#undef __SSE2__
-#ifdef __SSE2__
-#include <xmmintrin.h>
-#include <emmintrin.h>
-#endif
-
 #include <fftw3.h>
 
 #include <pulse/xmalloc.h>
@@ -66,6 +61,8 @@
 #include <pulsecore/protocol-dbus.h>
 #include <pulsecore/dbus-util.h>
 
+#include "equalizer-fft.h"
+
 #include "module-equalizer-sink-symdef.h"
 
 PA_MODULE_AUTHOR("Jason Newton");
@@ -82,10 +79,13 @@ PA_MODULE_USAGE(
           "channel_map=<channel map> "
           "autoloaded=<set if this module is being loaded automatically> "
           "use_volume_sharing=<yes or no> "
+          "hop_size=<frames between windows, the latency of the filter> "
          ));
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 #define DEFAULT_AUTOLOADED FALSE
+#define DEFAULT_HOP_SIZE 8000U
+#define MIN_HOP_SIZE 64U
 
 struct userdata {
     pa_module *module;
@@ -110,8 +110,8 @@ struct userdata {
     //message
     float *W;//windowing function (time domain)
     float *work_buffer, **input, **overlap_accum;
-    fftwf_complex *output_window;
-    fftwf_plan forward_plan, inverse_plan;
+    size_t work_size;//floats per channel in work_buffer, room for the in-place transform
+    fftwf_plan forward_plan, inverse_plan;//for all channels at once
     //size_t samplings;
 
     float **Xs;
@@ -141,10 +141,10 @@ static const char* const valid_modargs[] = {
     "channel_map",
     "autoloaded",
     "use_volume_sharing",
+    "hop_size",
     NULL
 };
 
-#define v_size 4
 #define SINKLIST "equalized_sinklist"
 #define EQDB "equalizer_db"
 #define EQ_STATE_DB "equalizer-state"
@@ -210,12 +210,12 @@ static pa_bool_t is_monotonic(const uint32_t *xs, size_t length) {
     return TRUE;
 }
 
-/* ensures memory allocated is a multiple of v_size and aligned */
+/* ensures memory allocated is a multiple of EQ_V_SIZE and aligned */
 static void * alloc(size_t x, size_t s){
     size_t f;
     float *t;
 
-    f = PA_ROUND_UP(x*s, sizeof(float)*v_size);
+    f = PA_ROUND_UP(x*s, sizeof(float)*EQ_V_SIZE);
     pa_assert_se(t = fftwf_malloc(f));
     pa_memzero(t, f);
 
@@ -350,158 +350,17 @@ static void sink_set_mute_cb(pa_sink *s) {
     pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
 }
 
-#if 1
-//reference implementation
-static void dsp_logic(
-    float * restrict dst,//used as a temp array too, needs to be fft_length!
-    float * restrict src,/*input data w/ overlap at start,
-                               *automatically cycled in routine
-                               */
+//overlap add and preserve overlap component from this window (linear phase)
+static void overlap_add(
+    float * restrict dst,//inverse transformed row of the work buffer
     float * restrict overlap,
-    const float X,//multiplier
-    const float * restrict H,//The freq. magnitude scalers filter
-    const float * restrict W,//The windowing function
-    fftwf_complex * restrict output_window,//The transformed windowed src
     struct userdata *u){
 
-    //use a linear-phase sliding STFT and overlap-add method (for each channel)
-    //window the data
-    for(size_t j = 0; j < u->window_size; ++j){
-        dst[j] = X * W[j] * src[j];
-    }
-    //zero pad the remaining fft window
-    memset(dst + u->window_size, 0, (u->fft_size - u->window_size) * sizeof(float));
-    //Processing is done here!
-    //do fft
-    fftwf_execute_dft_r2c(u->forward_plan, dst, output_window);
-    //perform filtering
-    for(size_t j = 0; j < FILTER_SIZE(u); ++j){
-        u->output_window[j][0] *= H[j];
-        u->output_window[j][1] *= H[j];
-    }
-    //inverse fft
-    fftwf_execute_dft_c2r(u->inverse_plan, output_window, dst);
-    ////debug: tests overlapping add
-    ////and negates ALL PREVIOUS processing
-    ////yields a perfect reconstruction if COLA is held
-    //for(size_t j = 0; j < u->window_size; ++j){
-    //    u->work_buffer[j] = u->W[j] * u->input[c][j];
-    //}
-
-    //overlap add and preserve overlap component from this window (linear phase)
     for(size_t j = 0; j < u->overlap_size; ++j){
-        u->work_buffer[j] += overlap[j];
+        dst[j] += overlap[j];
         overlap[j] = dst[u->R + j];
     }
-    ////debug: tests if basic buffering works
-    ////shouldn't modify the signal AT ALL (beyond roundoff)
-    //for(size_t j = 0; j < u->window_size;++j){
-    //    u->work_buffer[j] = u->input[c][j];
-    //}
-
-    //preserve the needed input for the next window's overlap
-    memmove(src, src + u->R,
-        (u->samples_gathered - u->R) * sizeof(float)
-    );
-}
-#else
-typedef float v4sf __attribute__ ((__aligned__(v_size * sizeof(float))));
-typedef union float_vector {
-    float f[v_size];
-    v4sf v;
-    __m128 m;
-} float_vector_t;
-
-//regardless of sse enabled, the loops in here assume
-//16 byte aligned addresses and memory allocations divisible by v_size
-static void dsp_logic(
-    float * restrict dst,//used as a temp array too, needs to be fft_length!
-    float * restrict src,/*input data w/ overlap at start,
-                               *automatically cycled in routine
-                               */
-    float * restrict overlap,//The size of the overlap
-    const float X,//multiplier
-    const float * restrict H,//The freq. magnitude scalers filter
-    const float * restrict W,//The windowing function
-    fftwf_complex * restrict output_window,//The transformed windowed src
-    struct userdata *u){//Collection of constants
-    const size_t overlap_size = PA_ROUND_UP(u->overlap_size, v_size);
-    float_vector_t x;
-    x.f[0] = x.f[1] = x.f[2] = x.f[3] = X;
-
-    //assert(u->samples_gathered >= u->R);
-    //use a linear-phase sliding STFT and overlap-add method
-    for(size_t j = 0; j < u->window_size; j += v_size){
-        //dst[j] = W[j] * src[j];
-        float_vector_t *d = (float_vector_t*) (dst + j);
-        float_vector_t *w = (float_vector_t*) (W + j);
-        float_vector_t *s = (float_vector_t*) (src + j);
-//#if __SSE2__
-        d->m = _mm_mul_ps(x.m, _mm_mul_ps(w->m, s->m));
-//        d->v = x->v * w->v * s->v;
-//#endif
-    }
-    //zero pad the remaining fft window
-    memset(dst + u->window_size, 0, (u->fft_size - u->window_size) * sizeof(float));
-
-    //Processing is done here!
-    //do fft
-    fftwf_execute_dft_r2c(u->forward_plan, dst, output_window);
-    //perform filtering - purely magnitude based
-    for(size_t j = 0; j < FILTER_SIZE; j += v_size / 2){
-        //output_window[j][0]*=H[j];
-        //output_window[j][1]*=H[j];
-        float_vector_t *d = (float_vector_t*)( ((float *) output_window) + 2 * j);
-        float_vector_t h;
-        h.f[0] = h.f[1] = H[j];
-        h.f[2] = h.f[3] = H[j + 1];
-//#if __SSE2__
-        d->m = _mm_mul_ps(d->m, h.m);
-//#else
-//        d->v = d->v * h.v;
-//#endif
-    }
-
-    //inverse fft
-    fftwf_execute_dft_c2r(u->inverse_plan, output_window, dst);
-
-    ////debug: tests overlapping add
-    ////and negates ALL PREVIOUS processing
-    ////yields a perfect reconstruction if COLA is held
-    //for(size_t j = 0; j < u->window_size; ++j){
-    //    dst[j] = W[j] * src[j];
-    //}
-
-    //overlap add and preserve overlap component from this window (linear phase)
-    for(size_t j = 0; j < overlap_size; j += v_size){
-        //dst[j]+=overlap[j];
-        //overlap[j]+=dst[j+R];
-        float_vector_t *d = (float_vector_t*)(dst + j);
-        float_vector_t *o = (float_vector_t*)(overlap + j);
-//#if __SSE2__
-        d->m = _mm_add_ps(d->m, o->m);
-        o->m = ((float_vector_t*)(dst + u->R + j))->m;
-//#else
-//        d->v = d->v + o->v;
-//        o->v = ((float_vector_t*)(dst + u->R + j))->v;
-//#endif
-    }
-    //memcpy(overlap, dst+u->R, u->overlap_size * sizeof(float)); //overlap preserve (debug)
-    //zero out the bit beyond the real overlap so we don't add garbage next iteration
-    memset(overlap + u->overlap_size, 0, overlap_size - u->overlap_size);
-
-    ////debug: tests if basic buffering works
-    ////shouldn't modify the signal AT ALL (beyond roundoff)
-    //for(size_t j = 0; j < u->window_size; ++j){
-    //    dst[j] = src[j];
-    //}
-
-    //preserve the needed input for the next window's overlap
-    memmove(src, src + u->R,
-        (u->samples_gathered - u->R) * sizeof(float)
-    );
 }
-#endif
 
 static void flatten_to_memblockq(struct userdata *u){
     size_t mbs = pa_mempool_block_size_max(u->sink->core->mempool);
@@ -537,38 +396,43 @@ static void process_samples(struct userdata *u){
     }
     u->output_buffer_length = iterations * u->R * fs;
 
+    //use a linear-phase sliding STFT and overlap-add method, one
+    //transform per hop for all channels
     for(size_t iter = 0; iter < iterations; ++iter){
         offset = iter * u->R * fs;
-        for(size_t c = 0;c < u->channels; c++) {
+        for(size_t c = 0; c < u->channels; c++)
+            eq_window_input(u->work_buffer + c * u->work_size, u->input[c] + iter * u->R, u->W, u->window_size, u->work_size);
+        fftwf_execute(u->forward_plan);
+        for(size_t c = 0; c < u->channels; c++) {
             a_i = pa_aupdate_read_begin(u->a_H[c]);
             X = u->Xs[c][a_i];
             H = u->Hs[c][a_i];
-            dsp_logic(
-                u->work_buffer,
-                u->input[c],
-                u->overlap_accum[c],
-                X,
-                H,
-                u->W,
-                u->output_window,
-                u
-            );
+            eq_apply_filter(u->work_buffer + c * u->work_size, X, H, FILTER_SIZE(u));
             pa_aupdate_read_end(u->a_H[c]);
+        }
+        fftwf_execute(u->inverse_plan);
+        for(size_t c = 0; c < u->channels; c++) {
+            float *dst = u->work_buffer + c * u->work_size;
+            overlap_add(dst, u->overlap_accum[c], u);
             if(u->first_iteration){
                 /* The windowing function will make the audio ramped in, as a cheap fix we can
                  * undo the windowing (for non-zero window values)
                  */
                 for(size_t i = 0; i < u->overlap_size; ++i){
-                    u->work_buffer[i] = u->W[i] <= FLT_EPSILON ? u->work_buffer[i] : u->work_buffer[i] / u->W[i];
+                    dst[i] = u->W[i] <= FLT_EPSILON ? dst[i] : dst[i] / u->W[i];
                 }
             }
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, (uint8_t *) (((float *)u->output_buffer) + c) + offset, fs, u->work_buffer, sizeof(float), u->R);
+            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, (uint8_t *) (((float *)u->output_buffer) + c) + offset, fs, dst, sizeof(float), u->R);
         }
         if(u->first_iteration){
             u->first_iteration = FALSE;
         }
-        u->samples_gathered -= u->R;
     }
+    //preserve the needed input for the next window's overlap, once
+    //for all hops
+    u->samples_gathered -= iterations * u->R;
+    for(size_t c = 0; c < u->channels; c++)
+        memmove(u->input[c], u->input[c] + iterations * u->R, u->samples_gathered * sizeof(float));
     flatten_to_memblockq(u);
 }
 
@@ -1094,6 +958,8 @@ int pa__init(pa_module*m) {
     float *H;
     unsigned a_i;
     pa_bool_t use_volume_sharing = TRUE;
+    size_t fft_size;
+    uint32_t hop_size;
 
     pa_assert(m);
 
@@ -1122,16 +988,25 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    fft_size = pow(2, ceil(log(ss.rate) / log(2)));//probably unstable near corner cases of powers of 2
+
+    /* Smaller hops mean less latency, but more transforms of the
+     * same size per frame */
+    hop_size = PA_MIN(DEFAULT_HOP_SIZE, (fft_size + 1) / 2);
+    if (pa_modargs_get_value_u32(ma, "hop_size", &hop_size) < 0 ||
+        hop_size < MIN_HOP_SIZE || hop_size > (fft_size + 1) / 2) {
+        pa_log("hop_size= expects an integer between %u and %zd", MIN_HOP_SIZE, (fft_size + 1) / 2);
+        goto fail;
+    }
+
     u = pa_xnew0(struct userdata, 1);
     u->module = m;
     m->userdata = u;
 
     u->channels = ss.channels;
-    u->fft_size = pow(2, ceil(log(ss.rate) / log(2)));//probably unstable near corner cases of powers of 2
+    u->fft_size = fft_size;
     pa_log_debug("fft size: %zd", u->fft_size);
-    u->window_size = 15999;
-    if (u->window_size % 2 == 0)
-        u->window_size--;
+    u->window_size = 2 * hop_size - 1;
     u->R = (u->window_size + 1) / 2;
     u->overlap_size = u->window_size - u->R;
     u->samples_gathered = 0;
@@ -1144,12 +1019,15 @@ int pa__init(pa_module*m) {
     for (c = 0; c < u->channels; ++c) {
         u->Xs[c] = pa_xnew0(float, 2);
         u->Hs[c] = pa_xnew0(float *, 2);
+        //alloc() zeroes the padding up to EQ_V_SIZE, which is never written
+        //afterwards since filters are only ever copied FILTER_SIZE long
         for (i = 0; i < 2; ++i)
             u->Hs[c][i] = alloc(FILTER_SIZE(u), sizeof(float));
     }
 
     u->W = alloc(u->window_size, sizeof(float));
-    u->work_buffer = alloc(u->fft_size, sizeof(float));
+    u->work_size = eq_work_size(FILTER_SIZE(u));
+    u->work_buffer = alloc(u->work_size * u->channels, sizeof(float));
     u->input = pa_xnew0(float *, u->channels);
     u->overlap_accum = pa_xnew0(float *, u->channels);
     for (c = 0; c < u->channels; ++c) {
@@ -1157,9 +1035,7 @@ int pa__init(pa_module*m) {
         u->input[c] = NULL;
         u->overlap_accum[c] = alloc(u->overlap_size, sizeof(float));
     }
-    u->output_window = alloc(FILTER_SIZE(u), sizeof(fftwf_complex));
-    u->forward_plan = fftwf_plan_dft_r2c_1d(u->fft_size, u->work_buffer, u->output_window, FFTW_ESTIMATE);
-    u->inverse_plan = fftwf_plan_dft_c2r_1d(u->fft_size, u->output_window, u->work_buffer, FFTW_ESTIMATE);
+    eq_plans_new(u->work_buffer, u->fft_size, u->channels, u->work_size, &u->forward_plan, &u->inverse_plan);
 
     hanning_window(u->W, u->window_size);
     u->first_iteration = TRUE;
@@ -1341,7 +1217,6 @@ void pa__done(pa_module*m) {
 
     fftwf_destroy_plan(u->inverse_plan);
     fftwf_destroy_plan(u->forward_plan);
-    pa_xfree(u->output_window);
     for (c = 0; c < u->channels; ++c) {
         pa_aupdate_free(u->a_H[c]);
         pa_xfree(u->overlap_accum[c]);
@@ -0,0 +1,211 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/module.h>
+#include <pulsecore/protocol-http.h>
+
+#include "sbc.h"
+
+#include "module-http-sbc-encoder-symdef.h"
+
+PA_MODULE_DESCRIPTION("SBC encoder for the HTTP protocol");
+PA_MODULE_VERSION(PACKAGE_VERSION);
+PA_MODULE_LOAD_ONCE(TRUE);
+
+/* The A2DP recommendations for high quality */
+#define BITPOOL_MONO 31
+#define BITPOOL_STEREO 53
+
+struct userdata {
+    pa_http_protocol *protocol;
+    pa_bool_t registered;
+};
+
+static void sbc_fix_sample_spec(pa_sample_spec *ss, pa_channel_map *cm) {
+    pa_assert(ss);
+    pa_assert(cm);
+
+    /* SBC only knows these rates, pick the next better one */
+    if (ss->rate > 44100)
+        ss->rate = 48000;
+    else if (ss->rate > 32000)
+        ss->rate = 44100;
+    else if (ss->rate > 16000)
+        ss->rate = 32000;
+    else
+        ss->rate = 16000;
+
+    if (ss->channels > 2)
+        ss->channels = 2;
+
+    ss->format = PA_SAMPLE_S16NE;
+
+    pa_channel_map_init_auto(cm, ss->channels, PA_CHANNEL_MAP_DEFAULT);
+}
+
+static char *sbc_get_mime_type(const pa_sample_spec *ss, const pa_channel_map *cm) {
+    pa_assert(ss);
+
+    return pa_sprintf_malloc("audio/x-sbc;rate=%u;channels=%u", ss->rate, ss->channels);
+}
+
+static void *sbc_new(const pa_sample_spec *ss, size_t *block_size, size_t *frame_size) {
+    sbc_t *sbc;
+
+    pa_assert(ss);
+    pa_assert(ss->format == PA_SAMPLE_S16NE);
+    pa_assert(block_size);
+    pa_assert(frame_size);
+
+    sbc = pa_xnew0(sbc_t, 1);
+
+    if (sbc_init(sbc, 0) < 0) {
+        pa_xfree(sbc);
+        return NULL;
+    }
+
+    switch (ss->rate) {
+        case 16000:
+            sbc->frequency = SBC_FREQ_16000;
+            break;
+        case 32000:
+            sbc->frequency = SBC_FREQ_32000;
+            break;
+        case 44100:
+            sbc->frequency = SBC_FREQ_44100;
+            break;
+        case 48000:
+            sbc->frequency = SBC_FREQ_48000;
+            break;
+        default:
+            pa_assert_not_reached();
+    }
+
+    if (ss->channels == 1) {
+        sbc->mode = SBC_MODE_MONO;
+        sbc->bitpool = BITPOOL_MONO;
+    } else {
+        sbc->mode = SBC_MODE_JOINT_STEREO;
+        sbc->bitpool = BITPOOL_STEREO;
+    }
+
+    sbc->allocation = SBC_AM_LOUDNESS;
+    sbc->subbands = SBC_SB_8;
+    sbc->blocks = SBC_BLK_16;
+
+    *block_size = sbc_get_codesize(sbc);
+    *frame_size = sbc_get_frame_length(sbc);
+
+    return sbc;
+}
+
+static ssize_t sbc_encode_blocks(void *state, const void *src, size_t length, void *dst) {
+    sbc_t *sbc = state;
+    const uint8_t *p = src;
+    uint8_t *d = dst;
+    size_t frame_length;
+
+    pa_assert(sbc);
+
+    frame_length = sbc_get_frame_length(sbc);
+
+    while (length > 0) {
+        ssize_t encoded, written;
+
+        if ((encoded = sbc_encode(sbc, p, length, d, frame_length, &written)) <= 0) {
+            pa_log_error("SBC encoding error (%li)", (long) encoded);
+            return -1;
+        }
+
+        pa_assert((size_t) encoded <= length);
+        pa_assert((size_t) written <= frame_length);
+
+        p += encoded;
+        length -= (size_t) encoded;
+        d += written;
+    }
+
+    return d - (uint8_t*) dst;
+}
+
+static void sbc_free(void *state) {
+    sbc_t *sbc = state;
+
+    pa_assert(sbc);
+
+    sbc_finish(sbc);
+    pa_xfree(sbc);
+}
+
+static const pa_http_encoder sbc_encoder = {
+    .name = "sbc",
+    .fix_sample_spec = sbc_fix_sample_spec,
+    .get_mime_type = sbc_get_mime_type,
+    .new = sbc_new,
+    .encode = sbc_encode_blocks,
+    .free = sbc_free
+};
+
+int pa__init(pa_module *m) {
+    struct userdata *u;
+
+    pa_assert(m);
+
+    m->userdata = u = pa_xnew0(struct userdata, 1);
+    u->protocol = pa_http_protocol_get(m->core);
+
+    if (pa_http_protocol_add_encoder(u->protocol, &sbc_encoder) < 0)
+        goto fail;
+
+    u->registered = TRUE;
+
+    return 0;
+
+fail:
+    pa__done(m);
+
+    return -1;
+}
+
+void pa__done(pa_module *m) {
+    struct userdata *u;
+
+    pa_assert(m);
+
+    if (!(u = m->userdata))
+        return;
+
+    if (u->protocol) {
+        if (u->registered)
+            pa_http_protocol_remove_encoder(u->protocol, &sbc_encoder);
+
+        pa_http_protocol_unref(u->protocol);
+    }
+
+    pa_xfree(u);
+}
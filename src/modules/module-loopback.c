@@ -75,11 +75,18 @@ struct userdata {
     pa_asyncmsgq *asyncmsgq;
     pa_memblockq *memblockq;
 
-    pa_rtpoll_item *rtpoll_item_read, *rtpoll_item_write;
+    pa_rtpoll_item *rtpoll_item_read;
 
     pa_time_event *time_event;
     pa_usec_t adjust_time;
 
+    /* Latency snapshots are requested without waiting for the IO
+     * threads, their replies come in through this queue */
+    pa_asyncmsgq *reply_q;
+    pa_io_event *reply_event;
+    unsigned snapshots_pending;
+    pa_bool_t snapshot_failed;
+
     int64_t recv_counter;
     int64_t send_counter;
 
@@ -151,6 +158,11 @@ static void teardown(struct userdata *u) {
     if (u->source_output)
         pa_source_output_unlink(u->source_output);
 
+    /* The IO threads are done with our snapshot requests now, collect
+     * the replies that might still be waiting */
+    if (u->reply_q)
+        pa_asyncmsgq_flush(u->reply_q, TRUE);
+
     if (u->sink_input) {
         u->sink_input->parent.process_msg = pa_sink_input_process_msg;
         pa_sink_input_unref(u->sink_input);
@@ -164,8 +176,8 @@ static void teardown(struct userdata *u) {
     }
 }
 
-/* Called from main context */
-static void adjust_rates(struct userdata *u) {
+/* Called from main context, once both latency snapshots are in */
+static void update_rates(struct userdata *u) {
     size_t buffer, fs;
     uint32_t old_rate, base_rate, new_rate;
     pa_usec_t buffer_latency;
@@ -173,9 +185,6 @@ static void adjust_rates(struct userdata *u) {
     pa_assert(u);
     pa_assert_ctl_context();
 
-    pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT, NULL, 0, NULL);
-    pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, NULL, 0, NULL);
-
     buffer =
         u->latency_snapshot.sink_input_buffer +
         u->latency_snapshot.source_output_buffer;
@@ -221,10 +230,63 @@ static void adjust_rates(struct userdata *u) {
 
     pa_sink_input_set_rate(u->sink_input, new_rate);
     pa_log_debug("[%s] Updated sampling rate to %lu Hz.", u->sink_input->sink->name, (unsigned long) new_rate);
+}
+
+/* Called from main context */
+static void snapshot_cb(pa_msgobject *o, int code, int ret, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+    pa_assert(u->snapshots_pending > 0);
+    pa_assert_ctl_context();
+
+    if (ret < 0)
+        u->snapshot_failed = TRUE;
+
+    if (--u->snapshots_pending > 0)
+        return;
+
+    /* Torn down in the meantime */
+    if (!u->time_event)
+        return;
+
+    if (!u->snapshot_failed)
+        update_rates(u);
 
     pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
 }
 
+/* Called from main context */
+static void adjust_rates(struct userdata *u) {
+    pa_assert(u);
+    pa_assert_ctl_context();
+
+    /* The rates are updated once the last request is answered */
+    if (u->snapshots_pending > 0)
+        return;
+
+    u->snapshots_pending = 2;
+    u->snapshot_failed = FALSE;
+
+    pa_asyncmsgq_send_async(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT, NULL, 0, NULL, u->reply_q, snapshot_cb, u);
+    pa_asyncmsgq_send_async(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, NULL, 0, NULL, u->reply_q, snapshot_cb, u);
+}
+
+/* Called from main context */
+static void reply_cb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+    pa_assert(u->reply_event == e);
+
+    pa_asyncmsgq_read_after_poll(u->reply_q);
+
+    /* Only replies arrive here, getting them runs their callbacks */
+    do {
+        pa_asyncmsgq_flush(u->reply_q, TRUE);
+    } while (pa_asyncmsgq_read_before_poll(u->reply_q) != 0);
+}
+
 /* Called from main context */
 static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
     struct userdata *u = userdata;
@@ -297,34 +359,6 @@ static int source_output_process_msg_cb(pa_msgobject *obj, int code, void *data,
     return pa_source_output_process_msg(obj, code, data, offset, chunk);
 }
 
-/* Called from output thread context */
-static void source_output_attach_cb(pa_source_output *o) {
-    struct userdata *u;
-
-    pa_source_output_assert_ref(o);
-    pa_source_output_assert_io_context(o);
-    pa_assert_se(u = o->userdata);
-
-    u->rtpoll_item_write = pa_rtpoll_item_new_asyncmsgq_write(
-            o->source->thread_info.rtpoll,
-            PA_RTPOLL_LATE,
-            u->asyncmsgq);
-}
-
-/* Called from output thread context */
-static void source_output_detach_cb(pa_source_output *o) {
-    struct userdata *u;
-
-    pa_source_output_assert_ref(o);
-    pa_source_output_assert_io_context(o);
-    pa_assert_se(u = o->userdata);
-
-    if (u->rtpoll_item_write) {
-        pa_rtpoll_item_free(u->rtpoll_item_write);
-        u->rtpoll_item_write = NULL;
-    }
-}
-
 /* Called from output thread context */
 static void source_output_state_change_cb(pa_source_output *o, pa_source_output_state_t state) {
     struct userdata *u;
@@ -859,8 +893,6 @@ int pa__init(pa_module *m) {
     u->source_output->push = source_output_push_cb;
     u->source_output->process_rewind = source_output_process_rewind_cb;
     u->source_output->kill = source_output_kill_cb;
-    u->source_output->attach = source_output_attach_cb;
-    u->source_output->detach = source_output_detach_cb;
     u->source_output->state_change = source_output_state_change_cb;
     u->source_output->may_move_to = source_output_may_move_to_cb;
     u->source_output->moving = source_output_moving_cb;
@@ -883,6 +915,10 @@ int pa__init(pa_module *m) {
 
     u->asyncmsgq = pa_asyncmsgq_new(0);
 
+    u->reply_q = pa_asyncmsgq_new(0);
+    pa_assert_se(pa_asyncmsgq_read_before_poll(u->reply_q) == 0);
+    u->reply_event = m->core->mainloop->io_new(m->core->mainloop, pa_asyncmsgq_read_fd(u->reply_q), PA_IO_EVENT_INPUT, reply_cb, u);
+
     if (!pa_proplist_contains(u->source_output->proplist, PA_PROP_MEDIA_NAME))
         pa_proplist_setf(u->source_output->proplist, PA_PROP_MEDIA_NAME, "Loopback to %s",
                          pa_strnull(pa_proplist_gets(u->sink_input->sink->proplist, PA_PROP_DEVICE_DESCRIPTION)));
@@ -933,5 +969,11 @@ void pa__done(pa_module*m) {
     if (u->asyncmsgq)
         pa_asyncmsgq_unref(u->asyncmsgq);
 
+    if (u->reply_event)
+        u->core->mainloop->io_free(u->reply_event);
+
+    if (u->reply_q)
+        pa_asyncmsgq_unref(u->reply_q);
+
     pa_xfree(u);
 }
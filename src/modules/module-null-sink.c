@@ -30,11 +30,13 @@
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
+#include <pulse/util.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/i18n.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
 #include <pulsecore/module.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/modargs.h>
@@ -42,6 +44,8 @@
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/shared.h>
 
 #include "module-null-sink-symdef.h"
 
@@ -55,11 +59,43 @@ PA_MODULE_USAGE(
         "format=<sample format> "
         "rate=<sample rate> "
         "channels=<number of channels> "
-        "channel_map=<channel map>");
+        "channel_map=<channel map> "
+        "shared_clock=<render from the thread shared by all null sinks?> "
+        "hibernate_time=<seconds without any audio after which rendering is stopped, 0 to disable> "
+        "float_mixing=<mix in float and convert to the sink format only once?>");
 
 #define DEFAULT_SINK_NAME "null"
 #define BLOCK_USEC (PA_USEC_PER_SEC * 2)
 
+/* All sinks driven by the shared clock are rendered on multiples of
+ * this interval, so that their wakeups coalesce into one. */
+#define SHARED_CLOCK_TICK_USEC (20 * PA_USEC_PER_MSEC)
+#define SHARED_CLOCK_NAME "module-null-sink-shared-clock"
+
+/* One IO thread that renders any number of null sinks. It is
+ * registered as a shared property of the core, created by the first
+ * sink that asks for it and destroyed with the last one. */
+typedef struct shared_clock {
+    pa_msgobject parent;
+
+    pa_core *core;
+
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    pa_rtpoll *rtpoll;
+
+    /* Only accessed from the shared thread */
+    PA_LLIST_HEAD(struct userdata, sinks);
+} shared_clock;
+
+PA_DEFINE_PRIVATE_CLASS(shared_clock, pa_msgobject);
+#define SHARED_CLOCK(o) (shared_clock_cast(o))
+
+enum {
+    SHARED_CLOCK_MESSAGE_ADD_SINK,
+    SHARED_CLOCK_MESSAGE_REMOVE_SINK
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -69,8 +105,19 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    /* Only used in shared clock mode, instead of the thread and
+     * thread_mq above */
+    shared_clock *clock;
+    pa_asyncmsgq *asyncmsgq;
+    pa_rtpoll_item *rtpoll_item;
+    PA_LLIST_FIELDS(struct userdata);
+
     pa_usec_t block_usec;
     pa_usec_t timestamp;
+
+    pa_usec_t hibernate_usec;
+    pa_usec_t idle_since;
+    pa_bool_t hibernating;
 };
 
 static const char* const valid_modargs[] = {
@@ -80,9 +127,28 @@ static const char* const valid_modargs[] = {
     "rate",
     "channels",
     "channel_map",
+    "shared_clock",
+    "hibernate_time",
+    "float_mixing",
     NULL
 };
 
+/* Called from IO context */
+static void wake_up(struct userdata *u, pa_usec_t now) {
+    pa_assert(u);
+
+    u->idle_since = 0;
+
+    if (!u->hibernating)
+        return;
+
+    pa_log_debug("Waking up from hibernation.");
+
+    /* Nothing was rendered while we slept, so start over from now */
+    u->hibernating = FALSE;
+    u->timestamp = now;
+}
+
 static int sink_process_msg(
         pa_msgobject *o,
         int code,
@@ -95,11 +161,19 @@ static int sink_process_msg(
     switch (code) {
         case PA_SINK_MESSAGE_SET_STATE:
 
+            u->hibernating = FALSE;
+            u->idle_since = 0;
+
             if (PA_PTR_TO_UINT(data) == PA_SINK_RUNNING)
                 u->timestamp = pa_rtclock_now();
 
             break;
 
+        case PA_SINK_MESSAGE_ADD_INPUT:
+        case PA_SINK_MESSAGE_FINISH_MOVE:
+            wake_up(u, pa_rtclock_now());
+            break;
+
         case PA_SINK_MESSAGE_GET_LATENCY: {
             pa_usec_t now;
 
@@ -195,6 +269,78 @@ static void process_render(struct userdata *u, pa_usec_t now) {
 /*     pa_log_debug("Ate in sum %lu bytes (of %lu)", (unsigned long) ate, (unsigned long) nbytes); */
 }
 
+/* The sink is idle if none of its inputs have any data to play */
+static pa_bool_t sink_is_idle(struct userdata *u) {
+    pa_sink_input *i;
+    void *state = NULL;
+
+    pa_assert(u);
+
+    PA_HASHMAP_FOREACH(i, u->sink->thread_info.inputs, state)
+        if (i->thread_info.state != PA_SINK_INPUT_CORKED && i->thread_info.underrun_for == 0)
+            return FALSE;
+
+    return TRUE;
+}
+
+static void hibernate(struct userdata *u) {
+    pa_sink_input *i;
+    void *state = NULL;
+
+    pa_assert(u);
+
+    pa_log_debug("Idle for %0.1fs, hibernating.", (double) u->hibernate_usec / PA_USEC_PER_SEC);
+
+    /* Everything we have cached is silence, don't keep it around */
+    PA_HASHMAP_FOREACH(i, u->sink->thread_info.inputs, state)
+        pa_sink_input_drop_caches(i);
+
+    u->hibernating = TRUE;
+}
+
+static void update_hibernation(struct userdata *u, pa_usec_t now) {
+    pa_assert(u);
+
+    if (u->hibernate_usec <= 0)
+        return;
+
+    if (!sink_is_idle(u)) {
+        u->idle_since = 0;
+        return;
+    }
+
+    if (u->idle_since <= 0)
+        u->idle_since = now;
+    else if (now - u->idle_since >= u->hibernate_usec)
+        hibernate(u);
+}
+
+static void process_sink(struct userdata *u, pa_usec_t now) {
+    pa_assert(u);
+
+    /* A stream that gets data again after having been starved
+     * requests a rewind, that's what we wait for while hibernating.
+     * New streams are handled in sink_process_msg(). */
+    if (u->hibernating) {
+        if (!u->sink->thread_info.rewind_requested)
+            return;
+
+        wake_up(u, now);
+    }
+
+    if (u->sink->thread_info.rewind_requested) {
+        if (u->sink->thread_info.rewind_nbytes > 0)
+            process_rewind(u, now);
+        else
+            pa_sink_process_rewind(u->sink, 0);
+    }
+
+    if (u->timestamp <= now) {
+        process_render(u, now);
+        update_hibernation(u, now);
+    }
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
 
@@ -211,21 +357,12 @@ static void thread_func(void *userdata) {
 
         /* Render some data and drop it immediately */
         if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
-            pa_usec_t now;
-
-            now = pa_rtclock_now();
+            process_sink(u, pa_rtclock_now());
 
-            if (u->sink->thread_info.rewind_requested) {
-                if (u->sink->thread_info.rewind_nbytes > 0)
-                    process_rewind(u, now);
-                else
-                    pa_sink_process_rewind(u->sink, 0);
-            }
-
-            if (u->timestamp <= now)
-                process_render(u, now);
-
-            pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp);
+            if (u->hibernating)
+                pa_rtpoll_set_timer_disabled(u->rtpoll);
+            else
+                pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp);
         } else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
@@ -247,12 +384,163 @@ finish:
     pa_log_debug("Thread shutting down");
 }
 
+/* Called from the shared IO thread context */
+static int shared_clock_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    shared_clock *c = SHARED_CLOCK(o);
+    struct userdata *u = data;
+
+    pa_assert(c);
+    pa_assert(u);
+
+    switch (code) {
+        case SHARED_CLOCK_MESSAGE_ADD_SINK:
+            u->rtpoll_item = pa_rtpoll_item_new_asyncmsgq_read(c->rtpoll, PA_RTPOLL_EARLY, u->asyncmsgq);
+            u->timestamp = pa_rtclock_now();
+            PA_LLIST_PREPEND(struct userdata, c->sinks, u);
+            return 0;
+
+        case SHARED_CLOCK_MESSAGE_REMOVE_SINK:
+            PA_LLIST_REMOVE(struct userdata, c->sinks, u);
+            pa_rtpoll_item_free(u->rtpoll_item);
+            u->rtpoll_item = NULL;
+            return 0;
+    }
+
+    return 0;
+}
+
+static void shared_clock_thread_func(void *userdata) {
+    shared_clock *c = userdata;
+    pa_bool_t failed = FALSE;
+
+    pa_assert(c);
+
+    pa_log_debug("Shared clock thread starting up");
+
+    pa_thread_mq_install(&c->thread_mq);
+
+    for (;;) {
+        struct userdata *u;
+        pa_usec_t now, next = 0;
+        int ret;
+
+        now = pa_rtclock_now();
+
+        if (!failed)
+            PA_LLIST_FOREACH(u, c->sinks) {
+                if (!PA_SINK_IS_OPENED(u->sink->thread_info.state))
+                    continue;
+
+                process_sink(u, now);
+
+                if (u->hibernating)
+                    continue;
+
+                if (next == 0 || u->timestamp < next)
+                    next = u->timestamp;
+            }
+
+        /* Wake up on the next tick boundary only, so that all sinks
+         * due within the same tick are rendered in one go */
+        if (next > 0)
+            pa_rtpoll_set_timer_absolute(c->rtpoll, ((next + SHARED_CLOCK_TICK_USEC - 1) / SHARED_CLOCK_TICK_USEC) * SHARED_CLOCK_TICK_USEC);
+        else
+            pa_rtpoll_set_timer_disabled(c->rtpoll);
+
+        if ((ret = pa_rtpoll_run(c->rtpoll, TRUE)) == 0)
+            break;
+
+        if (ret < 0 && failed) {
+            /* Polling keeps failing. Pending messages are still
+             * dispatched before every poll, so don't spin but check
+             * for new ones once per tick only. */
+            pa_msleep(SHARED_CLOCK_TICK_USEC / PA_USEC_PER_MSEC);
+
+        } else if (ret < 0) {
+            /* Every sink attached to us is dead now, so have all of
+             * them unloaded. We need to keep dispatching their
+             * message queues until the last one is gone, since
+             * unlinking a sink talks to its IO thread. */
+            PA_LLIST_FOREACH(u, c->sinks)
+                pa_asyncmsgq_post(c->thread_mq.outq, PA_MSGOBJECT(c->core), PA_CORE_MESSAGE_UNLOAD_MODULE, u->module, 0, NULL, NULL);
+
+            failed = TRUE;
+        }
+    }
+
+    pa_log_debug("Shared clock thread shutting down");
+}
+
+static void shared_clock_free(pa_object *o) {
+    shared_clock *c = SHARED_CLOCK(o);
+
+    pa_assert(c);
+    pa_assert(!c->sinks);
+
+    pa_assert_se(pa_shared_remove(c->core, SHARED_CLOCK_NAME) >= 0);
+
+    if (c->thread) {
+        pa_asyncmsgq_send(c->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(c->thread);
+    }
+
+    pa_thread_mq_done(&c->thread_mq);
+
+    if (c->rtpoll)
+        pa_rtpoll_free(c->rtpoll);
+
+    pa_xfree(c);
+}
+
+static shared_clock *shared_clock_get(pa_core *core) {
+    shared_clock *c;
+
+    pa_assert(core);
+
+    if ((c = pa_shared_get(core, SHARED_CLOCK_NAME)))
+        return shared_clock_ref(c);
+
+    c = pa_msgobject_new(shared_clock);
+    c->parent.parent.free = shared_clock_free;
+    c->parent.process_msg = shared_clock_process_msg;
+    c->core = core;
+    PA_LLIST_HEAD_INIT(struct userdata, c->sinks);
+    c->rtpoll = pa_rtpoll_new();
+    pa_thread_mq_init(&c->thread_mq, core->mainloop, c->rtpoll);
+
+    pa_assert_se(pa_shared_set(core, SHARED_CLOCK_NAME, c) >= 0);
+
+    if (!(c->thread = pa_thread_new("null-sink-shared", shared_clock_thread_func, c))) {
+        pa_log("Failed to create shared clock thread.");
+        shared_clock_unref(c);
+        return NULL;
+    }
+
+    return c;
+}
+
+static void shared_clock_attach(shared_clock *c, struct userdata *u) {
+    pa_assert(c);
+    pa_assert(u);
+
+    pa_asyncmsgq_send(c->thread_mq.inq, PA_MSGOBJECT(c), SHARED_CLOCK_MESSAGE_ADD_SINK, u, 0, NULL);
+}
+
+static void shared_clock_detach(shared_clock *c, struct userdata *u) {
+    pa_assert(c);
+    pa_assert(u);
+
+    pa_asyncmsgq_send(c->thread_mq.inq, PA_MSGOBJECT(c), SHARED_CLOCK_MESSAGE_REMOVE_SINK, u, 0, NULL);
+}
+
 int pa__init(pa_module*m) {
     struct userdata *u = NULL;
     pa_sample_spec ss;
     pa_channel_map map;
     pa_modargs *ma = NULL;
     pa_sink_new_data data;
+    pa_bool_t use_shared_clock = FALSE, float_mixing = FALSE;
+    uint32_t hibernate_time = 0;
     size_t nbytes;
 
     pa_assert(m);
@@ -269,11 +557,35 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "shared_clock", &use_shared_clock) < 0) {
+        pa_log("shared_clock= expects a boolean argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "hibernate_time", &hibernate_time) < 0) {
+        pa_log("Failed to parse hibernate_time value");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "float_mixing", &float_mixing) < 0) {
+        pa_log("float_mixing= expects a boolean argument");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->rtpoll = pa_rtpoll_new();
-    pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+    u->hibernate_usec = hibernate_time * PA_USEC_PER_SEC;
+
+    if (use_shared_clock) {
+        if (!(u->clock = shared_clock_get(m->core)))
+            goto fail;
+
+        u->asyncmsgq = pa_asyncmsgq_new(0);
+    } else {
+        u->rtpoll = pa_rtpoll_new();
+        pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+    }
 
     pa_sink_new_data_init(&data);
     data.driver = __FILE__;
@@ -281,6 +593,7 @@ int pa__init(pa_module*m) {
     pa_sink_new_data_set_name(&data, pa_modargs_get_value(ma, "sink_name", DEFAULT_SINK_NAME));
     pa_sink_new_data_set_sample_spec(&data, &ss);
     pa_sink_new_data_set_channel_map(&data, &map);
+    data.float_mixing = float_mixing;
     pa_proplist_sets(data.proplist, PA_PROP_DEVICE_DESCRIPTION, _("Null Output"));
     pa_proplist_sets(data.proplist, PA_PROP_DEVICE_CLASS, "abstract");
 
@@ -302,20 +615,33 @@ int pa__init(pa_module*m) {
     u->sink->update_requested_latency = sink_update_requested_latency_cb;
     u->sink->userdata = u;
 
-    pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
-    pa_sink_set_rtpoll(u->sink, u->rtpoll);
+    if (u->clock) {
+        pa_sink_set_asyncmsgq(u->sink, u->asyncmsgq);
+        pa_sink_set_rtpoll(u->sink, u->clock->rtpoll);
+    } else {
+        pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
+        pa_sink_set_rtpoll(u->sink, u->rtpoll);
+    }
 
     u->block_usec = BLOCK_USEC;
     nbytes = pa_usec_to_bytes(u->block_usec, &u->sink->sample_spec);
     pa_sink_set_max_rewind(u->sink, nbytes);
     pa_sink_set_max_request(u->sink, nbytes);
 
-    if (!(u->thread = pa_thread_new("null-sink", thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
-    }
+    if (u->clock) {
+        shared_clock_attach(u->clock, u);
 
-    pa_sink_set_latency_range(u->sink, 0, BLOCK_USEC);
+        /* We are only woken up on tick boundaries, hence we need to
+         * have at least one tick worth of data queued */
+        pa_sink_set_latency_range(u->sink, SHARED_CLOCK_TICK_USEC, BLOCK_USEC);
+    } else {
+        if (!(u->thread = pa_thread_new("null-sink", thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
+
+        pa_sink_set_latency_range(u->sink, 0, BLOCK_USEC);
+    }
 
     pa_sink_put(u->sink);
 
@@ -357,11 +683,22 @@ void pa__done(pa_module*m) {
         pa_thread_free(u->thread);
     }
 
-    pa_thread_mq_done(&u->thread_mq);
+    if (u->rtpoll_item)
+        shared_clock_detach(u->clock, u);
+
+    /* Only set up when not running on the shared clock */
+    if (u->rtpoll)
+        pa_thread_mq_done(&u->thread_mq);
 
     if (u->sink)
         pa_sink_unref(u->sink);
 
+    if (u->asyncmsgq)
+        pa_asyncmsgq_unref(u->asyncmsgq);
+
+    if (u->clock)
+        shared_clock_unref(u->clock);
+
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
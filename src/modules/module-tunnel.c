@@ -794,6 +794,15 @@ static void stream_get_latency_callback(pa_pdispatch *pd, uint32_t command, uint
             goto fail;
         }
     }
+
+    if (u->version >= 28) {
+        uint32_t ring_index;
+
+        if (pa_tagstruct_getu32(t, &ring_index) < 0) {
+            pa_log("Invalid reply.");
+            goto fail;
+        }
+    }
 #endif
 
     if (!pa_tagstruct_eof(t)) {
@@ -1393,30 +1402,36 @@ static void command_subscribe_event(pa_pdispatch *pd,  uint32_t command,  uint32
     struct userdata *u = userdata;
     pa_subscription_event_type_t e;
     uint32_t idx;
+    pa_bool_t changed = FALSE;
 
     pa_assert(pd);
     pa_assert(t);
     pa_assert(u);
     pa_assert(command == PA_COMMAND_SUBSCRIBE_EVENT);
 
-    if (pa_tagstruct_getu32(t, &e) < 0 ||
-        pa_tagstruct_getu32(t, &idx) < 0) {
-        pa_log("Invalid protocol reply");
-        pa_module_unload_request(u->module, TRUE);
-        return;
-    }
+    /* Since protocol version 28 one packet may carry several events */
+    do {
+        if (pa_tagstruct_getu32(t, &e) < 0 ||
+            pa_tagstruct_getu32(t, &idx) < 0) {
+            pa_log("Invalid protocol reply");
+            pa_module_unload_request(u->module, TRUE);
+            return;
+        }
 
-    if (e != (PA_SUBSCRIPTION_EVENT_SERVER|PA_SUBSCRIPTION_EVENT_CHANGE) &&
+        if (e == (PA_SUBSCRIPTION_EVENT_SERVER|PA_SUBSCRIPTION_EVENT_CHANGE) ||
 #ifdef TUNNEL_SINK
-        e != (PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE) &&
-        e != (PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE)
+            e == (PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE) ||
+            e == (PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE)
 #else
-        e != (PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_CHANGE)
+            e == (PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_CHANGE)
 #endif
-        )
-        return;
+            )
+            changed = TRUE;
 
-    request_info(u);
+    } while (!pa_tagstruct_eof(t));
+
+    if (changed)
+        request_info(u);
 }
 
 /* Called from main context */
@@ -1526,6 +1541,16 @@ static void create_stream_callback(pa_pdispatch *pd, uint32_t command,  uint32_t
         pa_format_info_free(format);
     }
 
+#ifdef TUNNEL_SINK
+    if (u->version >= 28) {
+        uint32_t ring_id;
+
+        /* We never offer a ring */
+        if (pa_tagstruct_getu32(t, &ring_id) < 0)
+            goto parse_error;
+    }
+#endif
+
     if (!pa_tagstruct_eof(t))
         goto parse_error;
 
@@ -1731,6 +1756,12 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
         /* We're not using the extended API, so n_formats = 0 and that's that */
         pa_tagstruct_putu8(reply, 0);
     }
+
+    if (u->version >= 28) {
+        /* No shared memory ring, we're talking to a remote server */
+        pa_tagstruct_putu32(reply, 0);
+        pa_tagstruct_putu32(reply, 0);
+    }
 #else
     if (u->version >= 22) {
         /* We're not using the extended API, so n_formats = 0 and that's that */
@@ -42,6 +42,7 @@
 #include <pulsecore/memblockq.h>
 #include <pulsecore/hashmap.h>
 #include <pulsecore/refcnt.h>
+#include <pulsecore/shm-ring.h>
 #include <pulsecore/time-smoother.h>
 #ifdef HAVE_DBUS
 #include <pulsecore/dbus-util.h>
@@ -122,6 +123,7 @@ struct pa_context {
 typedef struct pa_index_correction {
     uint32_t tag;
     int64_t value;
+    uint32_t ring_index;
     pa_bool_t valid:1;
     pa_bool_t absolute:1;
     pa_bool_t corrupt:1;
@@ -171,6 +173,12 @@ struct pa_stream {
     void *write_data;
     int64_t latest_underrun_at_index;
 
+    /* Shared memory the server reads our audio from directly, see
+     * ring_fence() */
+    pa_shm_ring *ring;
+    pa_bool_t ring_fence_pending:1;
+    pa_bool_t ring_fence_dirty:1;
+
     /* recording */
     pa_memchunk peek_memchunk;
     void *peek_data;
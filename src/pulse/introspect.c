@@ -1151,6 +1151,37 @@ pa_operation* pa_context_get_module_info_list(pa_context *c, pa_module_info_cb_t
     return pa_context_send_simple_command(c, PA_COMMAND_GET_MODULE_INFO_LIST, context_get_module_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
+/*** Paged lists ***/
+
+static pa_operation* send_info_list_page_command(pa_context *c, uint32_t command, uint32_t cursor, uint32_t max, const char *key, const char *value, pa_pdispatch_cb_t internal_cb, pa_operation_cb_t cb, void *userdata) {
+    pa_tagstruct *t;
+    pa_operation *o;
+    uint32_t tag;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+    pa_assert(cb);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 28, PA_ERR_NOTSUPPORTED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, max > 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !key || pa_proplist_key_valid(key), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, key || !value, PA_ERR_INVALID);
+
+    o = pa_operation_new(c, NULL, cb, userdata);
+
+    t = pa_tagstruct_command(c, command, &tag);
+    pa_tagstruct_putu32(t, cursor);
+    pa_tagstruct_putu32(t, max);
+    pa_tagstruct_puts(t, key);
+    pa_tagstruct_puts(t, value);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, internal_cb, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    return o;
+}
+
 /*** Sink input info ***/
 
 static void context_get_sink_input_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -1256,6 +1287,10 @@ pa_operation* pa_context_get_sink_input_info_list(pa_context *c, void (*cb)(pa_c
     return pa_context_send_simple_command(c, PA_COMMAND_GET_SINK_INPUT_INFO_LIST, context_get_sink_input_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
+pa_operation* pa_context_get_sink_input_info_list_paged(pa_context *c, uint32_t cursor, uint32_t max, const char *key, const char *value, pa_sink_input_info_cb_t cb, void *userdata) {
+    return send_info_list_page_command(c, PA_COMMAND_GET_SINK_INPUT_INFO_LIST, cursor, max, key, value, context_get_sink_input_info_callback, (pa_operation_cb_t) cb, userdata);
+}
+
 /*** Source output info ***/
 
 static void context_get_source_output_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -1361,6 +1396,10 @@ pa_operation* pa_context_get_source_output_info_list(pa_context *c,  pa_source_o
     return pa_context_send_simple_command(c, PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST, context_get_source_output_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
+pa_operation* pa_context_get_source_output_info_list_paged(pa_context *c, uint32_t cursor, uint32_t max, const char *key, const char *value, pa_source_output_info_cb_t cb, void *userdata) {
+    return send_info_list_page_command(c, PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST, cursor, max, key, value, context_get_source_output_info_callback, (pa_operation_cb_t) cb, userdata);
+}
+
 /*** Volume manipulation ***/
 
 pa_operation* pa_context_set_sink_volume_by_index(pa_context *c, uint32_t idx, const pa_cvolume *volume, pa_context_success_cb_t cb, void *userdata) {
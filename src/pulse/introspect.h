@@ -108,6 +108,11 @@
  *                pa_context_get_source_output_info()
  * \li All - pa_context_get_sink_input_info_list() /
  *           pa_context_get_source_output_info_list()
+ * \li Page by page - pa_context_get_sink_input_info_list_paged() /
+ *                    pa_context_get_source_output_info_list_paged()
+ *
+ * With many streams the paged functions keep the replies small. They
+ * can also leave out all streams that don't have a certain property.
  *
  * The structure returned is the pa_sink_input_info or pa_source_output_info
  * structure.
@@ -543,6 +548,15 @@ pa_operation* pa_context_get_sink_input_info(pa_context *c, uint32_t idx, pa_sin
 /** Get the complete sink input list */
 pa_operation* pa_context_get_sink_input_info_list(pa_context *c, pa_sink_input_info_cb_t cb, void *userdata);
 
+/** Get a page of the sink input list. Returns at most max sink
+ * inputs in the order of their indexes, starting with the first one
+ * whose index is at least cursor. If key is not NULL only sink inputs
+ * that have this property are returned, and if value is not NULL
+ * only those where it is set to this string. Pass the index of the
+ * last sink input returned plus one as cursor to get the next page. A
+ * page with less than max sink inputs is the last one. \since 4.0 */
+pa_operation* pa_context_get_sink_input_info_list_paged(pa_context *c, uint32_t cursor, uint32_t max, const char *key, const char *value, pa_sink_input_info_cb_t cb, void *userdata);
+
 /** Move the specified sink input to a different sink. \since 0.9.5 */
 pa_operation* pa_context_move_sink_input_by_name(pa_context *c, uint32_t idx, const char *sink_name, pa_context_success_cb_t cb, void* userdata);
 
@@ -595,6 +609,10 @@ pa_operation* pa_context_get_source_output_info(pa_context *c, uint32_t idx, pa_
 /** Get the complete list of source outputs */
 pa_operation* pa_context_get_source_output_info_list(pa_context *c, pa_source_output_info_cb_t cb, void *userdata);
 
+/** Get a page of the source output list. Works like
+ * pa_context_get_sink_input_info_list_paged(). \since 4.0 */
+pa_operation* pa_context_get_source_output_info_list_paged(pa_context *c, uint32_t cursor, uint32_t max, const char *key, const char *value, pa_source_output_info_cb_t cb, void *userdata);
+
 /** Move the specified source output to a different source. \since 0.9.5 */
 pa_operation* pa_context_move_source_output_by_name(pa_context *c, uint32_t idx, const char *source_name, pa_context_success_cb_t cb, void* userdata);
 
@@ -51,6 +51,9 @@
 #define SMOOTHER_HISTORY_TIME (5000*PA_USEC_PER_MSEC)
 #define SMOOTHER_MIN_HISTORY (4)
 
+#define RING_SIZE_MIN (64U*1024U)
+#define RING_SIZE_MAX (4U*1024U*1024U)
+
 pa_stream *pa_stream_new(pa_context *c, const char *name, const pa_sample_spec *ss, const pa_channel_map *map) {
     return pa_stream_new_with_proplist(c, name, ss, map, NULL);
 }
@@ -172,6 +175,10 @@ static pa_stream *pa_stream_new_with_proplist_internal(
     s->write_memblock = NULL;
     s->write_data = NULL;
 
+    s->ring = NULL;
+    s->ring_fence_pending = FALSE;
+    s->ring_fence_dirty = FALSE;
+
     pa_memchunk_reset(&s->peek_memchunk);
     s->peek_data = NULL;
     s->record_memblockq = NULL;
@@ -298,6 +305,9 @@ static void stream_free(pa_stream *s) {
     if (s->record_memblockq)
         pa_memblockq_free(s->record_memblockq);
 
+    if (s->ring)
+        pa_shm_ring_free(s->ring);
+
     if (s->proplist)
         pa_proplist_free(s->proplist);
 
@@ -1132,6 +1142,21 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
         }
     }
 
+    if (s->context->version >= 28 && s->direction == PA_STREAM_PLAYBACK) {
+        uint32_t ring_id;
+
+        if (pa_tagstruct_getu32(t, &ring_id) < 0) {
+            pa_context_fail(s->context, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        /* If the server didn't take the ring we just send memblocks */
+        if (s->ring && (ring_id == 0 || pa_shm_ring_connect(s->ring, ring_id) < 0)) {
+            pa_shm_ring_free(s->ring);
+            s->ring = NULL;
+        }
+    }
+
     if (!pa_tagstruct_eof(t)) {
         pa_context_fail(s->context, PA_ERR_PROTOCOL);
         goto finish;
@@ -1161,6 +1186,18 @@ finish:
     pa_stream_unref(s);
 }
 
+/* Big enough to take everything the server asks for in one go */
+static size_t ring_size(pa_stream *s) {
+    size_t l = 0;
+
+    if (s->buffer_attr.tlength != (uint32_t) -1)
+        l = s->buffer_attr.tlength;
+    else if (pa_sample_spec_valid(&s->sample_spec))
+        l = pa_usec_to_bytes(2*PA_USEC_PER_SEC, &s->sample_spec);
+
+    return PA_CLAMP(l, RING_SIZE_MIN, RING_SIZE_MAX);
+}
+
 static int create_stream(
         pa_stream_direction_t direction,
         pa_stream *s,
@@ -1364,6 +1401,19 @@ static int create_stream(
         pa_tagstruct_put_boolean(t, flags & (PA_STREAM_PASSTHROUGH));
     }
 
+    if (s->context->version >= 28 && s->direction == PA_STREAM_PLAYBACK) {
+
+        /* If we share memory with the server anyway, offer it a ring
+         * to read our audio from, so that steady state playback
+         * doesn't need any socket traffic. */
+        pa_assert(!s->ring);
+        if (pa_pstream_get_shm(s->context->pstream))
+            s->ring = pa_shm_ring_new(ring_size(s));
+
+        pa_tagstruct_putu32(t, s->ring ? pa_shm_ring_get_id(s->ring) : 0);
+        pa_tagstruct_putu32(t, s->ring ? (uint32_t) pa_shm_ring_get_size(s->ring) : 0);
+    }
+
     pa_pstream_send_tagstruct(s->context->pstream, t);
     pa_pdispatch_register_reply(s->context->pdispatch, tag, DEFAULT_TIMEOUT, pa_create_stream_callback, s, NULL);
 
@@ -1456,6 +1506,43 @@ int pa_stream_cancel_write(
     return 0;
 }
 
+static void ring_fence_cb(pa_stream *s, int success, void *userdata);
+
+/* The server picks up data from the ring in its IO thread whenever it
+ * likes, while anything we send over the socket first passes its main
+ * loop. So after sending data or a flush over the socket we stop
+ * using the ring until a timing update, which passes both, comes
+ * back. Whatever we send while waiting for it needs another one. */
+static void ring_fence(pa_stream *s) {
+    pa_operation *o;
+
+    pa_assert(s);
+
+    if (!s->ring)
+        return;
+
+    if (s->ring_fence_pending) {
+        s->ring_fence_dirty = TRUE;
+        return;
+    }
+
+    /* If we cannot ask for a timing update the ring stays unused */
+    s->ring_fence_pending = TRUE;
+    s->ring_fence_dirty = FALSE;
+
+    if ((o = pa_stream_update_timing_info(s, ring_fence_cb, NULL)))
+        pa_operation_unref(o);
+}
+
+static void ring_fence_cb(pa_stream *s, int success, void *userdata) {
+    pa_assert(s);
+
+    s->ring_fence_pending = FALSE;
+
+    if (s->ring_fence_dirty)
+        ring_fence(s);
+}
+
 int pa_stream_write(
         pa_stream *s,
         const void *data,
@@ -1480,7 +1567,22 @@ int pa_stream_write(
                       PA_ERR_INVALID);
     PA_CHECK_VALIDITY(s->context, !free_cb || !s->write_memblock, PA_ERR_INVALID);
 
-    if (s->write_memblock) {
+    if (s->ring &&
+        !s->ring_fence_pending &&
+        seek == PA_SEEK_RELATIVE && offset == 0 &&
+        pa_shm_ring_writable(s->ring) >= length) {
+
+        pa_assert_se(pa_shm_ring_write(s->ring, data, length) == length);
+
+        if (s->write_memblock) {
+            pa_memblock_release(s->write_memblock);
+            pa_memblock_unref(s->write_memblock);
+            s->write_memblock = NULL;
+            s->write_data = NULL;
+        } else if (free_cb)
+            free_cb((void*) data);
+
+    } else if (s->write_memblock) {
         pa_memchunk chunk;
 
         /* pa_stream_write_begin() was called before */
@@ -1497,6 +1599,8 @@ int pa_stream_write(
         pa_pstream_send_memblock(s->context->pstream, s->channel, offset, seek, &chunk);
         pa_memblock_unref(chunk.memblock);
 
+        ring_fence(s);
+
     } else {
         pa_seek_mode_t t_seek = seek;
         int64_t t_offset = offset;
@@ -1537,6 +1641,8 @@ int pa_stream_write(
 
         if (free_cb && pa_pstream_get_shm(s->context->pstream))
             free_cb((void*) data);
+
+        ring_fence(s);
     }
 
     /* This is obviously wrong since we ignore the seeking index . But
@@ -1751,6 +1857,7 @@ static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command,
     pa_timing_info *i;
     pa_bool_t playing = FALSE;
     uint64_t underrun_for = 0, playing_for = 0;
+    uint32_t ring_index = 0;
 
     pa_assert(pd);
     pa_assert(o);
@@ -1792,6 +1899,12 @@ static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command,
                 goto finish;
             }
 
+        if (o->context->version >= 28 &&
+            o->stream->direction == PA_STREAM_PLAYBACK)
+            if (pa_tagstruct_getu32(t, &ring_index) < 0) {
+                pa_context_fail(o->context, PA_ERR_PROTOCOL);
+                goto finish;
+            }
 
         if (!pa_tagstruct_eof(t)) {
             pa_context_fail(o->context, PA_ERR_PROTOCOL);
@@ -1852,6 +1965,12 @@ static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command,
                 /* Make sure that everything is in order */
                 ctag = o->stream->write_index_corrections[j].tag+1;
 
+                /* The server might already have read data from the
+                 * ring that we wrote after asking, which the
+                 * correction value includes as well */
+                if (o->stream->ring && o->stream->write_index_corrections[j].tag == tag)
+                    i->write_index -= (int32_t) (ring_index - o->stream->write_index_corrections[j].ring_index);
+
                 /* Now fix the write index */
                 if (o->stream->write_index_corrections[j].corrupt) {
                     /* A corrupting seek was made */
@@ -1975,6 +2094,7 @@ pa_operation* pa_stream_update_timing_info(pa_stream *s, pa_stream_success_cb_t
         s->write_index_corrections[cidx].corrupt = FALSE;
         s->write_index_corrections[cidx].tag = tag;
         s->write_index_corrections[cidx].value = 0;
+        s->write_index_corrections[cidx].ring_index = s->ring ? pa_shm_ring_get_index(s->ring) : 0;
     }
 
     return o;
@@ -2307,6 +2427,10 @@ pa_operation* pa_stream_flush(pa_stream *s, pa_stream_success_cb_t cb, void *use
          * read index untouched. */
         invalidate_indexes(s, FALSE, TRUE);
 
+        /* Whatever we write after this must not end up in the ring
+         * before the server flushed */
+        ring_fence(s);
+
     } else
         /* For record streams this has no influence on the write
          * index, but the read index might jump. */
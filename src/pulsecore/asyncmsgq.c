@@ -31,8 +31,8 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/log.h>
 #include <pulsecore/semaphore.h>
-#include <pulsecore/macro.h>
-#include <pulsecore/mutex.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/fdsem.h>
 #include <pulsecore/flist.h>
 
 #include "asyncmsgq.h"
@@ -49,52 +49,225 @@ struct asyncmsgq_item {
     pa_memchunk memchunk;
     pa_semaphore *semaphore;
     int ret;
+
+    /* Only for pa_asyncmsgq_send_async(): the queue the completion
+     * is delivered to, and what to call there */
+    pa_asyncmsgq *reply_q;
+    pa_asyncmsgq_cb_t cb;
+    void *cb_userdata;
+    pa_bool_t completed;
+
+    pa_atomic_ptr_t next;
 };
 
+/* The items form an intrusive singly linked list. Writers append by
+ * atomically swapping themselves in as the head and then linking the
+ * previous head to themselves, so writing never takes a lock and the
+ * queue never fills up. The single reader consumes from the tail. A
+ * stub item keeps the list from ever becoming empty.
+ *
+ * n_pending counts the items that were completely appended but not
+ * yet taken out. Only the writer that makes it go from 0 to 1 posts
+ * the fdsem, so a burst of messages results in a single wakeup of the
+ * reader.
+ *
+ * A writer that was preempted between swapping in its item and
+ * linking it hides all items appended after it. The reader doesn't
+ * wait for it in that case: it sets reader_stalled and goes back to
+ * sleep, and the next writer to complete an append posts the fdsem
+ * again. */
 struct pa_asyncmsgq {
     PA_REFCNT_DECLARE;
-    pa_asyncq *asyncq;
-    pa_mutex *mutex; /* only for the writer side */
 
+    pa_atomic_ptr_t head; /* last appended item, shared by all writers */
+    struct asyncmsgq_item *tail; /* next item to take out, only for the reader */
+    struct asyncmsgq_item stub;
+
+    pa_atomic_t n_pending;
+    pa_atomic_t reader_stalled;
+    pa_fdsem *fdsem;
+
+    struct asyncmsgq_item *ready; /* taken out in read_before_poll() already */
     struct asyncmsgq_item *current;
 };
 
 pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
     pa_asyncmsgq *a;
 
-    a = pa_xnew(pa_asyncmsgq, 1);
+    a = pa_xnew0(pa_asyncmsgq, 1);
 
     PA_REFCNT_INIT(a);
-    pa_assert_se(a->asyncq = pa_asyncq_new(size));
-    pa_assert_se(a->mutex = pa_mutex_new(FALSE, TRUE));
+
+    if (!(a->fdsem = pa_fdsem_new())) {
+        pa_xfree(a);
+        return NULL;
+    }
+
+    pa_atomic_ptr_store(&a->stub.next, NULL);
+    pa_atomic_ptr_store(&a->head, &a->stub);
+    a->tail = &a->stub;
+    pa_atomic_store(&a->n_pending, 0);
+    pa_atomic_store(&a->reader_stalled, 0);
+    a->ready = NULL;
     a->current = NULL;
 
     return a;
 }
 
-static void asyncmsgq_free(pa_asyncmsgq *a) {
+static void append(pa_asyncmsgq *a, struct asyncmsgq_item *i) {
+    struct asyncmsgq_item *prev;
+
+    pa_atomic_ptr_store(&i->next, NULL);
+
+    do {
+        prev = pa_atomic_ptr_load(&a->head);
+    } while (!pa_atomic_ptr_cmpxchg(&a->head, prev, i));
+
+    /* Until this is done the reader can't see this item and any item
+     * appended after it */
+    pa_atomic_ptr_store(&prev->next, i);
+}
+
+/* Returns NULL if the queue is empty or if a writer is just in the
+ * middle of appending the next item */
+static struct asyncmsgq_item *take(pa_asyncmsgq *a) {
+    struct asyncmsgq_item *tail = a->tail, *next;
+
+    next = pa_atomic_ptr_load(&tail->next);
+
+    if (tail == &a->stub) {
+        if (!next)
+            return NULL;
+
+        a->tail = tail = next;
+        next = pa_atomic_ptr_load(&next->next);
+    }
+
+    if (next) {
+        a->tail = next;
+        return tail;
+    }
+
+    if (tail != pa_atomic_ptr_load(&a->head))
+        return NULL;
+
+    /* The tail is the last item, put the stub behind it so that we
+     * can take it out */
+    append(a, &a->stub);
+
+    if ((next = pa_atomic_ptr_load(&tail->next))) {
+        a->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+static void push(pa_asyncmsgq *a, struct asyncmsgq_item *i) {
+    append(a, i);
+
+    if (pa_atomic_inc(&a->n_pending) == 0 ||
+        pa_atomic_cmpxchg(&a->reader_stalled, 1, 0))
+        pa_fdsem_post(a->fdsem);
+}
+
+/* Never blocks. Returns NULL if nothing can be taken out right now. */
+static struct asyncmsgq_item *try_pop(pa_asyncmsgq *a) {
     struct asyncmsgq_item *i;
-    pa_assert(a);
 
-    while ((i = pa_asyncq_pop(a->asyncq, FALSE))) {
+    if ((i = a->ready)) {
+        a->ready = NULL;
+        return i;
+    }
 
-        pa_assert(!i->semaphore);
+    if (!(i = take(a))) {
+
+        if (pa_atomic_load(&a->n_pending) <= 0)
+            return NULL;
+
+        /* Something has been appended, but an earlier writer hasn't
+         * finished linking its item yet. Ask for another wakeup, and
+         * check again in case it finished in the meantime. */
+        pa_atomic_store(&a->reader_stalled, 1);
+
+        if (!(i = take(a)))
+            return NULL;
+
+        pa_atomic_store(&a->reader_stalled, 0);
+    }
+
+    pa_atomic_dec(&a->n_pending);
+    return i;
+}
+
+static struct asyncmsgq_item *pop(pa_asyncmsgq *a, pa_bool_t wait_op) {
+    struct asyncmsgq_item *i;
+
+    for (;;) {
+        if ((i = try_pop(a)))
+            return i;
+
+        if (!wait_op)
+            return NULL;
+
+        pa_fdsem_wait(a->fdsem);
+    }
+}
+
+static void free_item(struct asyncmsgq_item *i) {
+    if (i->free_cb)
+        i->free_cb(i->userdata);
+
+    if (i->object)
+        pa_msgobject_unref(i->object);
+
+    if (i->memchunk.memblock)
+        pa_memblock_unref(i->memchunk.memblock);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), i) < 0)
+        pa_xfree(i);
+}
+
+/* Hands an item of pa_asyncmsgq_send_async() over to the queue its
+ * completion callback is run from. The item keeps that queue alive
+ * until the callback has been run, so that the callback is never
+ * dropped, and never run from the thread that completed the item. */
+static void complete(struct asyncmsgq_item *i, int ret) {
+    i->ret = ret;
+    i->completed = TRUE;
 
-        if (i->object)
-            pa_msgobject_unref(i->object);
+    push(i->reply_q, i);
+}
+
+/* Runs the callback of a completed item and gets rid of it */
+static void run_completion(struct asyncmsgq_item *i) {
+    pa_asyncmsgq *r = i->reply_q;
+
+    i->cb(i->object, i->code, i->ret, i->cb_userdata);
+    free_item(i);
+
+    pa_asyncmsgq_unref(r);
+}
+
+static void asyncmsgq_free(pa_asyncmsgq *a) {
+    struct asyncmsgq_item *i;
+    pa_assert(a);
 
-        if (i->memchunk.memblock)
-            pa_memblock_unref(i->memchunk.memblock);
+    while ((i = pop(a, FALSE))) {
 
-        if (i->free_cb)
-            i->free_cb(i->userdata);
+        /* Senders hold a reference until they got their reply, and so
+         * do completions waiting for their callback */
+        pa_assert(!i->semaphore);
+        pa_assert(!i->completed);
 
-        if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), i) < 0)
-            pa_xfree(i);
+        /* Nobody is going to handle this one anymore */
+        if (i->reply_q)
+            complete(i, -1);
+        else
+            free_item(i);
     }
 
-    pa_asyncq_free(a->asyncq, NULL);
-    pa_mutex_free(a->mutex);
+    pa_fdsem_free(a->fdsem);
     pa_xfree(a);
 }
 
@@ -112,9 +285,8 @@ void pa_asyncmsgq_unref(pa_asyncmsgq* q) {
         asyncmsgq_free(q);
 }
 
-void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb) {
+static struct asyncmsgq_item *new_item(pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk) {
     struct asyncmsgq_item *i;
-    pa_assert(PA_REFCNT_VALUE(a) > 0);
 
     if (!(i = pa_flist_pop(PA_STATIC_FLIST_GET(asyncmsgq))))
         i = pa_xnew(struct asyncmsgq_item, 1);
@@ -122,7 +294,7 @@ void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const vo
     i->code = code;
     i->object = object ? pa_msgobject_ref(object) : NULL;
     i->userdata = (void*) userdata;
-    i->free_cb = free_cb;
+    i->free_cb = NULL;
     i->offset = offset;
     if (chunk) {
         pa_assert(chunk->memblock);
@@ -131,11 +303,23 @@ void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const vo
     } else
         pa_memchunk_reset(&i->memchunk);
     i->semaphore = NULL;
+    i->ret = -1;
+    i->reply_q = NULL;
+    i->cb = NULL;
+    i->cb_userdata = NULL;
+    i->completed = FALSE;
+
+    return i;
+}
+
+void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb) {
+    struct asyncmsgq_item *i;
+    pa_assert(PA_REFCNT_VALUE(a) > 0);
+
+    i = new_item(object, code, userdata, offset, chunk);
+    i->free_cb = free_cb;
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
-    pa_asyncq_post(a->asyncq, i);
-    pa_mutex_unlock(a->mutex);
+    push(a, i);
 }
 
 int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk) {
@@ -153,16 +337,17 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
         i.memchunk = *chunk;
     } else
         pa_memchunk_reset(&i.memchunk);
+    i.reply_q = NULL;
+    i.cb = NULL;
+    i.cb_userdata = NULL;
+    i.completed = FALSE;
 
     if (!(i.semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
         i.semaphore = pa_semaphore_new(0);
 
     pa_assert_se(i.semaphore);
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
-    pa_assert_se(pa_asyncq_push(a->asyncq, &i, TRUE) == 0);
-    pa_mutex_unlock(a->mutex);
+    push(a, &i);
 
     pa_semaphore_wait(i.semaphore);
 
@@ -172,13 +357,41 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
     return i.ret;
 }
 
+void pa_asyncmsgq_send_async(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_asyncmsgq *reply_q, pa_asyncmsgq_cb_t cb, void *cb_userdata) {
+    struct asyncmsgq_item *i;
+    pa_assert(PA_REFCNT_VALUE(a) > 0);
+    pa_assert(PA_REFCNT_VALUE(reply_q) > 0);
+    pa_assert(reply_q != a);
+    pa_assert(cb);
+
+    i = new_item(object, code, userdata, offset, chunk);
+    i->reply_q = pa_asyncmsgq_ref(reply_q);
+    i->cb = cb;
+    i->cb_userdata = cb_userdata;
+
+    push(a, i);
+}
+
 int pa_asyncmsgq_get(pa_asyncmsgq *a, pa_msgobject **object, int *code, void **userdata, int64_t *offset, pa_memchunk *chunk, pa_bool_t wait_op) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
     pa_assert(!a->current);
 
-    if (!(a->current = pa_asyncq_pop(a->asyncq, wait_op))) {
-/*         pa_log("failure"); */
-        return -1;
+    for (;;) {
+        struct asyncmsgq_item *i;
+
+        if (!(i = pop(a, wait_op))) {
+/*             pa_log("failure"); */
+            return -1;
+        }
+
+        if (!i->completed) {
+            a->current = i;
+            break;
+        }
+
+        /* A reply to one of our pa_asyncmsgq_send_async() calls. The
+         * caller holds a reference to a, so this doesn't free it. */
+        run_completion(i);
     }
 
 /*     pa_log("success"); */
@@ -215,20 +428,10 @@ void pa_asyncmsgq_done(pa_asyncmsgq *a, int ret) {
     if (a->current->semaphore) {
         a->current->ret = ret;
         pa_semaphore_post(a->current->semaphore);
-    } else {
-
-        if (a->current->free_cb)
-            a->current->free_cb(a->current->userdata);
-
-        if (a->current->object)
-            pa_msgobject_unref(a->current->object);
-
-        if (a->current->memchunk.memblock)
-            pa_memblock_unref(a->current->memchunk.memblock);
-
-        if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), a->current) < 0)
-            pa_xfree(a->current);
-    }
+    } else if (a->current->reply_q)
+        complete(a->current, ret);
+    else
+        free_item(a->current);
 
     a->current = NULL;
 }
@@ -283,37 +486,26 @@ int pa_asyncmsgq_process_one(pa_asyncmsgq *a) {
 int pa_asyncmsgq_read_fd(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    return pa_asyncq_read_fd(a->asyncq);
+    return pa_fdsem_get(a->fdsem);
 }
 
 int pa_asyncmsgq_read_before_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    return pa_asyncq_read_before_poll(a->asyncq);
-}
-
-void pa_asyncmsgq_read_after_poll(pa_asyncmsgq *a) {
-    pa_assert(PA_REFCNT_VALUE(a) > 0);
-
-    pa_asyncq_read_after_poll(a->asyncq);
-}
-
-int pa_asyncmsgq_write_fd(pa_asyncmsgq *a) {
-    pa_assert(PA_REFCNT_VALUE(a) > 0);
-
-    return pa_asyncq_write_fd(a->asyncq);
-}
-
-void pa_asyncmsgq_write_before_poll(pa_asyncmsgq *a) {
-    pa_assert(PA_REFCNT_VALUE(a) > 0);
+    for (;;) {
+        /* Keep what we take out for the next pa_asyncmsgq_get() */
+        if ((a->ready = try_pop(a)))
+            return -1;
 
-    pa_asyncq_write_before_poll(a->asyncq);
+        if (pa_fdsem_before_poll(a->fdsem) >= 0)
+            return 0;
+    }
 }
 
-void pa_asyncmsgq_write_after_poll(pa_asyncmsgq *a) {
+void pa_asyncmsgq_read_after_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    pa_asyncq_write_after_poll(a->asyncq);
+    pa_fdsem_after_poll(a->fdsem);
 }
 
 int pa_asyncmsgq_dispatch(pa_msgobject *object, int code, void *userdata, int64_t offset, pa_memchunk *memchunk) {
@@ -24,17 +24,15 @@
 
 #include <sys/types.h>
 
-#include <pulsecore/asyncq.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/msgobject.h>
 
-/* A simple asynchronous message queue, based on pa_asyncq. In
- * contrast to pa_asyncq this one is multiple-writer safe, though
- * still not multiple-reader safe. This queue is intended to be used
- * for controlling real-time threads from normal-priority
- * threads. Multiple-writer-safety is accomplished by using a mutex on
- * the writer side. This queue is thus not useful for communication
- * between several real-time threads.
+/* A simple asynchronous message queue. It is multiple-writer safe,
+ * though still not multiple-reader safe. This queue is intended to be
+ * used for controlling real-time threads from normal-priority
+ * threads. Writing is lock-free and never blocks, since the queue
+ * grows as needed. A burst of messages only wakes up the reader
+ * once.
  *
  * The queue takes messages consisting of:
  *    "Object" for which this messages is intended (may be NULL)
@@ -42,9 +40,16 @@
  *    Arbitrary userdata pointer (may be NULL)
  *    A memchunk (may be NULL)
  *
- * There are two functions for submitting messages: _post and
- * _send. The former just enqueues the message asynchronously, the
- * latter waits for completion, synchronously. */
+ * There are three functions for submitting messages: _post, _send
+ * and _send_async. The first just enqueues the message
+ * asynchronously, the second waits for completion, synchronously. The
+ * last one enqueues the message asynchronously too, but once it has
+ * been processed the callback is called with the return value of the
+ * handler from whoever reads the reply queue next. Like with _send
+ * the userdata needs to stay valid until then. If the queue is freed
+ * before the message was processed, the callback gets -1. A reply
+ * queue is kept alive by the replies in it, so it needs to be flushed
+ * before it can go away. */
 
 enum {
     PA_MESSAGE_SHUTDOWN = -1/* A generic message to inform the handler of this queue to quit */
@@ -52,6 +57,9 @@ enum {
 
 typedef struct pa_asyncmsgq pa_asyncmsgq;
 
+typedef void (*pa_asyncmsgq_cb_t)(pa_msgobject *object, int code, int ret, void *userdata);
+
+/* The queue grows as needed, size is ignored */
 pa_asyncmsgq* pa_asyncmsgq_new(unsigned size);
 pa_asyncmsgq* pa_asyncmsgq_ref(pa_asyncmsgq *q);
 
@@ -59,6 +67,7 @@ void pa_asyncmsgq_unref(pa_asyncmsgq* q);
 
 void pa_asyncmsgq_post(pa_asyncmsgq *q, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *memchunk, pa_free_cb_t userdata_free_cb);
 int pa_asyncmsgq_send(pa_asyncmsgq *q, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *memchunk);
+void pa_asyncmsgq_send_async(pa_asyncmsgq *q, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *memchunk, pa_asyncmsgq *reply_q, pa_asyncmsgq_cb_t cb, void *cb_userdata);
 
 int pa_asyncmsgq_get(pa_asyncmsgq *q, pa_msgobject **object, int *code, void **userdata, int64_t *offset, pa_memchunk *memchunk, pa_bool_t wait);
 int pa_asyncmsgq_dispatch(pa_msgobject *object, int code, void *userdata, int64_t offset, pa_memchunk *memchunk);
@@ -73,11 +82,6 @@ int pa_asyncmsgq_read_fd(pa_asyncmsgq *q);
 int pa_asyncmsgq_read_before_poll(pa_asyncmsgq *a);
 void pa_asyncmsgq_read_after_poll(pa_asyncmsgq *a);
 
-/* For the write side */
-int pa_asyncmsgq_write_fd(pa_asyncmsgq *q);
-void pa_asyncmsgq_write_before_poll(pa_asyncmsgq *a);
-void pa_asyncmsgq_write_after_poll(pa_asyncmsgq *a);
-
 pa_bool_t pa_asyncmsgq_dispatching(pa_asyncmsgq *a);
 
 #endif
@@ -404,6 +404,17 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, pa_b
                          (unsigned) pa_atomic_load(&mstat->n_allocated_by_type[k]),
                          (unsigned) pa_atomic_load(&mstat->n_accumulated_by_type[k]));
 
+    pa_strbuf_printf(buf, "Memory pool segments: %u, slots split up for small blocks: %u, allocations that found the pool full: %u.\n",
+                     (unsigned) pa_atomic_load(&mstat->n_segments),
+                     (unsigned) pa_atomic_load(&mstat->n_slabs),
+                     (unsigned) pa_atomic_load(&mstat->n_pool_full));
+
+    for (k = 0; k < PA_MEMPOOL_SIZE_CLASSES; k++)
+        pa_strbuf_printf(buf,
+                         "Memory pool objects of size %s: %u allocated.\n",
+                         pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_mempool_get_size_class(c->mempool, k)),
+                         (unsigned) pa_atomic_load(&mstat->n_allocated_by_size_class[k]));
+
     return 0;
 }
 
@@ -0,0 +1,372 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+#include "convolver.h"
+
+/* Each partition is applied by transforming the last two blocks of
+ * input, multiplying with the transform of the zero padded partition
+ * and keeping the second half of the result. The transforms of real
+ * signals of 2*block points are done with a complex FFT of block
+ * points.
+ *
+ * Spectra hold the block+1 non-redundant bins, all real parts first,
+ * then all imaginary parts. The filter spectra are scaled by
+ * 1/(2*block), which makes the inverse transform come out right
+ * without any further scaling. */
+
+struct pa_convolver {
+    unsigned block;
+    unsigned length;
+    unsigned n_parts;
+    unsigned n_inputs, n_outputs;
+
+    /* Frames of the current block we have seen already */
+    unsigned pos;
+
+    /* Slot in the delay line of the last complete block */
+    unsigned head;
+
+    /* For the complex FFT of block points */
+    unsigned *bitrev;
+    float *twiddle;
+
+    /* exp(-i*pi*k/block) for k = 0..block, to split and merge the
+     * transforms of the real signals */
+    float *split;
+
+    /* Per input, the last complete block followed by the current one */
+    float *windows;
+
+    /* Spectra, per output and input, of every partition */
+    float *filters;
+
+    /* Per input, the spectra of the last n_parts complete blocks */
+    float *delay_line;
+
+    /* Per output, the sum of all partitions but the first for the
+     * current block. It only changes once a block is complete. */
+    float *tails;
+
+    /* Per input, the spectrum of the current block */
+    float *current;
+
+    float *work;
+    float *acc;
+};
+
+static inline unsigned spectrum_size(pa_convolver *c) {
+    return 2 * (c->block + 1);
+}
+
+static inline float *filter_spectrum(pa_convolver *c, unsigned output, unsigned input, unsigned part) {
+    return c->filters + ((output * c->n_inputs + input) * c->n_parts + part) * spectrum_size(c);
+}
+
+static inline float *delay_line_spectrum(pa_convolver *c, unsigned input, unsigned slot) {
+    return c->delay_line + (input * c->n_parts + slot) * spectrum_size(c);
+}
+
+/* In place complex FFT of block points, interleaved. Not normalized. */
+static void fft(pa_convolver *c, float *z, pa_bool_t inverse) {
+    unsigned n = c->block, len, i, k;
+
+    for (i = 0; i < n; i++) {
+        unsigned j = c->bitrev[i];
+
+        if (i < j) {
+            float t;
+
+            t = z[2 * i]; z[2 * i] = z[2 * j]; z[2 * j] = t;
+            t = z[2 * i + 1]; z[2 * i + 1] = z[2 * j + 1]; z[2 * j + 1] = t;
+        }
+    }
+
+    for (len = 2; len <= n; len <<= 1) {
+        unsigned half = len / 2, step = n / len;
+
+        for (i = 0; i < n; i += len)
+            for (k = 0; k < half; k++) {
+                float *a = z + 2 * (i + k), *b = a + 2 * half;
+                float wr = c->twiddle[2 * k * step];
+                float wi = inverse ? -c->twiddle[2 * k * step + 1] : c->twiddle[2 * k * step + 1];
+                float tr = b[0] * wr - b[1] * wi;
+                float ti = b[0] * wi + b[1] * wr;
+
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+    }
+}
+
+/* Transforms 2*block real samples into a spectrum */
+static void forward(pa_convolver *c, const float *x, float *spectrum) {
+    unsigned n = c->block, k;
+    float *re = spectrum, *im = spectrum + n + 1, *z = c->work;
+
+    /* Even samples are the real, odd samples the imaginary parts */
+    memcpy(z, x, 2 * n * sizeof(float));
+    fft(c, z, FALSE);
+
+    for (k = 0; k <= n; k++) {
+        unsigned a = k % n, b = (n - k) % n;
+        float er, ei, or, oi;
+
+        /* The transforms of the even and odd samples */
+        er = 0.5f * (z[2 * a] + z[2 * b]);
+        ei = 0.5f * (z[2 * a + 1] - z[2 * b + 1]);
+        or = 0.5f * (z[2 * a + 1] + z[2 * b + 1]);
+        oi = -0.5f * (z[2 * a] - z[2 * b]);
+
+        re[k] = er + or * c->split[2 * k] - oi * c->split[2 * k + 1];
+        im[k] = ei + or * c->split[2 * k + 1] + oi * c->split[2 * k];
+    }
+}
+
+/* Transforms a spectrum back into 2*block real samples, scaled by
+ * 2*block */
+static void inverse(pa_convolver *c, const float *spectrum, float *x) {
+    unsigned n = c->block, k;
+    const float *re = spectrum, *im = spectrum + n + 1;
+
+    for (k = 0; k < n; k++) {
+        float er, ei, dr, di, or, oi;
+
+        er = re[k] + re[n - k];
+        ei = im[k] - im[n - k];
+        dr = re[k] - re[n - k];
+        di = im[k] + im[n - k];
+
+        /* Undo the twiddle of the odd samples */
+        or = dr * c->split[2 * k] + di * c->split[2 * k + 1];
+        oi = di * c->split[2 * k] - dr * c->split[2 * k + 1];
+
+        x[2 * k] = er - oi;
+        x[2 * k + 1] = ei + or;
+    }
+
+    fft(c, x, TRUE);
+}
+
+/* acc += a * b, bin by bin */
+static void multiply_add(pa_convolver *c, float *acc, const float *a, const float *b) {
+    unsigned n = c->block + 1, k;
+    float *acc_re = acc, *acc_im = acc + n;
+    const float *a_re = a, *a_im = a + n, *b_re = b, *b_im = b + n;
+
+    for (k = 0; k < n; k++) {
+        acc_re[k] += a_re[k] * b_re[k] - a_im[k] * b_im[k];
+        acc_im[k] += a_re[k] * b_im[k] + a_im[k] * b_re[k];
+    }
+}
+
+pa_convolver* pa_convolver_new(unsigned block, unsigned length, unsigned n_inputs, unsigned n_outputs) {
+    pa_convolver *c;
+    unsigned i, bits;
+
+    pa_assert(pa_is_power_of_two(block));
+    pa_assert(block >= 16);
+    pa_assert(length > 0);
+    pa_assert(n_inputs > 0);
+    pa_assert(n_outputs > 0);
+
+    c = pa_xnew0(pa_convolver, 1);
+    c->block = block;
+    c->length = length;
+    c->n_parts = (length + block - 1) / block;
+    c->n_inputs = n_inputs;
+    c->n_outputs = n_outputs;
+
+    bits = pa_ulog2(block);
+    c->bitrev = pa_xnew(unsigned, block);
+    for (i = 0; i < block; i++) {
+        unsigned j, r = 0;
+
+        for (j = 0; j < bits; j++)
+            if (i & (1U << j))
+                r |= 1U << (bits - 1 - j);
+
+        c->bitrev[i] = r;
+    }
+
+    c->twiddle = pa_xnew(float, block);
+    for (i = 0; i < block / 2; i++) {
+        c->twiddle[2 * i] = (float) cos(2.0 * M_PI * i / block);
+        c->twiddle[2 * i + 1] = (float) -sin(2.0 * M_PI * i / block);
+    }
+
+    c->split = pa_xnew(float, 2 * (block + 1));
+    for (i = 0; i <= block; i++) {
+        c->split[2 * i] = (float) cos(M_PI * i / block);
+        c->split[2 * i + 1] = (float) -sin(M_PI * i / block);
+    }
+
+    c->windows = pa_xnew0(float, n_inputs * 2 * block);
+    c->filters = pa_xnew0(float, n_outputs * n_inputs * c->n_parts * spectrum_size(c));
+    c->delay_line = pa_xnew0(float, n_inputs * c->n_parts * spectrum_size(c));
+    c->tails = pa_xnew0(float, n_outputs * spectrum_size(c));
+    c->current = pa_xnew0(float, n_inputs * spectrum_size(c));
+    c->work = pa_xnew0(float, 2 * block);
+    c->acc = pa_xnew0(float, spectrum_size(c));
+
+    return c;
+}
+
+void pa_convolver_free(pa_convolver *c) {
+    pa_assert(c);
+
+    pa_xfree(c->bitrev);
+    pa_xfree(c->twiddle);
+    pa_xfree(c->split);
+    pa_xfree(c->windows);
+    pa_xfree(c->filters);
+    pa_xfree(c->delay_line);
+    pa_xfree(c->tails);
+    pa_xfree(c->current);
+    pa_xfree(c->work);
+    pa_xfree(c->acc);
+    pa_xfree(c);
+}
+
+void pa_convolver_set_filter(pa_convolver *c, unsigned input, unsigned output, const float *h, unsigned stride) {
+    float *x, scale;
+    unsigned p, i;
+
+    pa_assert(c);
+    pa_assert(input < c->n_inputs);
+    pa_assert(output < c->n_outputs);
+    pa_assert(h);
+    pa_assert(stride > 0);
+
+    x = c->windows;
+    scale = 1.0f / (2 * c->block);
+
+    for (p = 0; p < c->n_parts; p++) {
+        memset(x, 0, 2 * c->block * sizeof(float));
+
+        for (i = 0; i < c->block && p * c->block + i < c->length; i++)
+            x[i] = h[(p * c->block + i) * stride] * scale;
+
+        forward(c, x, filter_spectrum(c, output, input, p));
+    }
+
+    /* We borrowed the windows */
+    pa_convolver_reset(c);
+}
+
+void pa_convolver_reset(pa_convolver *c) {
+    pa_assert(c);
+
+    memset(c->windows, 0, c->n_inputs * 2 * c->block * sizeof(float));
+    memset(c->delay_line, 0, c->n_inputs * c->n_parts * spectrum_size(c) * sizeof(float));
+    memset(c->tails, 0, c->n_outputs * spectrum_size(c) * sizeof(float));
+
+    c->pos = 0;
+    c->head = 0;
+}
+
+/* Called whenever a block is complete */
+static void next_block(pa_convolver *c) {
+    unsigned i, o, p;
+
+    c->head = (c->head + 1) % c->n_parts;
+
+    for (i = 0; i < c->n_inputs; i++) {
+        float *w = c->windows + i * 2 * c->block;
+
+        memcpy(delay_line_spectrum(c, i, c->head), c->current + i * spectrum_size(c), spectrum_size(c) * sizeof(float));
+
+        memcpy(w, w + c->block, c->block * sizeof(float));
+        memset(w + c->block, 0, c->block * sizeof(float));
+    }
+
+    c->pos = 0;
+
+    /* Partition p applies to the block completed p-1 blocks ago */
+    for (o = 0; o < c->n_outputs; o++) {
+        float *tail = c->tails + o * spectrum_size(c);
+
+        memset(tail, 0, spectrum_size(c) * sizeof(float));
+
+        for (p = 1; p < c->n_parts; p++) {
+            unsigned slot = (c->head + c->n_parts - (p - 1)) % c->n_parts;
+
+            for (i = 0; i < c->n_inputs; i++)
+                multiply_add(c, tail, delay_line_spectrum(c, i, slot), filter_spectrum(c, o, i, p));
+        }
+    }
+}
+
+void pa_convolver_run(pa_convolver *c, const float *src, float *dst, unsigned n) {
+    unsigned i, o, f;
+
+    pa_assert(c);
+    pa_assert(src);
+    pa_assert(dst);
+
+    while (n > 0) {
+        unsigned k = PA_MIN(n, c->block - c->pos);
+
+        for (i = 0; i < c->n_inputs; i++) {
+            float *w = c->windows + i * 2 * c->block + c->block + c->pos;
+
+            for (f = 0; f < k; f++)
+                w[f] = src[f * c->n_inputs + i];
+
+            /* The rest of the block is still zero, which doesn't
+             * matter for the frames we have */
+            forward(c, c->windows + i * 2 * c->block, c->current + i * spectrum_size(c));
+        }
+
+        for (o = 0; o < c->n_outputs; o++) {
+            float *y = c->work + c->block + c->pos;
+
+            memcpy(c->acc, c->tails + o * spectrum_size(c), spectrum_size(c) * sizeof(float));
+
+            for (i = 0; i < c->n_inputs; i++)
+                multiply_add(c, c->acc, c->current + i * spectrum_size(c), filter_spectrum(c, o, i, 0));
+
+            inverse(c, c->acc, c->work);
+
+            for (f = 0; f < k; f++)
+                dst[f * c->n_outputs + o] = y[f];
+        }
+
+        src += k * c->n_inputs;
+        dst += k * c->n_outputs;
+        n -= k;
+        c->pos += k;
+
+        if (c->pos >= c->block)
+            next_block(c);
+    }
+}
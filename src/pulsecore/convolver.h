@@ -0,0 +1,55 @@
+#ifndef foopulseconvolverhfoo
+#define foopulseconvolverhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Convolves n_inputs interleaved float channels with long FIR filters
+ * into n_outputs interleaved float channels, every input contributing
+ * to every output through its own filter. The filters are split into
+ * partitions of block frames each, which are applied in the frequency
+ * domain (uniformly partitioned overlap-save), so that the cost per
+ * frame grows with the logarithm of the block size and the number of
+ * partitions instead of with the filter length.
+ *
+ * There is no added latency: frames are passed through as they come,
+ * a partly filled block is simply transformed again on the next call.
+ * Calls with at least a block of frames are hence the cheapest.
+ *
+ * pa_convolver_run() doesn't allocate memory, and a convolver must
+ * not be used from more than one thread at a time. */
+
+typedef struct pa_convolver pa_convolver;
+
+/* block must be a power of two of at least 16. All filters start
+ * out as zero. */
+pa_convolver* pa_convolver_new(unsigned block, unsigned length, unsigned n_inputs, unsigned n_outputs);
+void pa_convolver_free(pa_convolver *c);
+
+/* Sets the filter from input to output to the length taps found
+ * stride floats apart in h. Also resets the convolver. */
+void pa_convolver_set_filter(pa_convolver *c, unsigned input, unsigned output, const float *h, unsigned stride);
+
+/* Forgets about all past input, e.g. after a rewind */
+void pa_convolver_reset(pa_convolver *c);
+
+/* Convolves n frames from src into dst. The two may not overlap. */
+void pa_convolver_run(pa_convolver *c, const float *src, float *dst, unsigned n);
+
+#endif
@@ -25,8 +25,11 @@
 
 #include <stdio.h>
 
+#include <pulse/rtclock.h>
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/flist.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 
@@ -37,30 +40,187 @@
  * register a callback function that is called whenever an event
  * matching a subscription mask happens. The execution of the callback
  * function is postponed to the next main loop iteration, i.e. is not
- * called from within the stack frame the entity was created in. */
+ * called from within the stack frame the entity was created in.
+ *
+ * Events regarding the same object are coalesced while they wait in a
+ * queue, optionally for a configurable time. A subscriber that cannot
+ * keep up may block its subscription, it then gets its own queue in
+ * which events are coalesced until it is unblocked again. */
 
 struct pa_subscription {
     pa_core *core;
-    pa_bool_t dead;
+    pa_bool_t dead:1;
+    pa_bool_t blocked:1;
+    pa_bool_t dispatched:1;
 
     pa_subscription_cb_t callback;
+    pa_subscription_flush_cb_t flush_callback;
     void *userdata;
     pa_subscription_mask_t mask;
 
+    /* The events that came in while we were blocked */
+    pa_subscription_queue *held;
+
     PA_LLIST_FIELDS(pa_subscription);
 };
 
 struct pa_subscription_event {
-    pa_core *core;
-
     pa_subscription_event_type_t type;
     uint32_t index;
 
     PA_LLIST_FIELDS(pa_subscription_event);
 };
 
+struct pa_subscription_queue {
+    PA_LLIST_HEAD(pa_subscription_event, events);
+    pa_subscription_event *last;
+
+    /* The most recently queued event of every object. Indexes are
+     * not reused, hence that is the only one queued in practice. */
+    pa_hashmap *objects;
+};
+
+PA_STATIC_FLIST_DECLARE(subscription_events, 0, pa_xfree);
+
 static void sched_event(pa_core *c);
 
+static unsigned event_hash_func(const void *p) {
+    const pa_subscription_event *e = p;
+
+    return (unsigned) (e->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) * 31U + (unsigned) e->index;
+}
+
+static int event_compare_func(const void *a, const void *b) {
+    const pa_subscription_event *x = a, *y = b;
+
+    if ((x->type ^ y->type) & PA_SUBSCRIPTION_EVENT_FACILITY_MASK)
+        return 1;
+
+    return x->index != y->index;
+}
+
+static pa_subscription_queue* queue_new(void) {
+    pa_subscription_queue *q;
+
+    q = pa_xnew(pa_subscription_queue, 1);
+    PA_LLIST_HEAD_INIT(pa_subscription_event, q->events);
+    q->last = NULL;
+    q->objects = pa_hashmap_new(event_hash_func, event_compare_func);
+
+    return q;
+}
+
+static void queue_remove(pa_subscription_queue *q, pa_subscription_event *e) {
+    pa_assert(q);
+    pa_assert(e);
+
+    if (!e->next)
+        q->last = e->prev;
+
+    if (pa_hashmap_get(q->objects, e) == e)
+        pa_hashmap_remove(q->objects, e);
+
+    PA_LLIST_REMOVE(pa_subscription_event, q->events, e);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(subscription_events), e) < 0)
+        pa_xfree(e);
+}
+
+static void queue_free(pa_subscription_queue *q) {
+    pa_assert(q);
+
+    while (q->events)
+        queue_remove(q, q->events);
+
+    pa_hashmap_free(q->objects, NULL, NULL);
+    pa_xfree(q);
+}
+
+#ifdef DEBUG
+static void dump_event(const char * prefix, pa_subscription_event*e) {
+    const char * const fac_table[] = {
+        [PA_SUBSCRIPTION_EVENT_SINK] = "SINK",
+        [PA_SUBSCRIPTION_EVENT_SOURCE] = "SOURCE",
+        [PA_SUBSCRIPTION_EVENT_SINK_INPUT] = "SINK_INPUT",
+        [PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT] = "SOURCE_OUTPUT",
+        [PA_SUBSCRIPTION_EVENT_MODULE] = "MODULE",
+        [PA_SUBSCRIPTION_EVENT_CLIENT] = "CLIENT",
+        [PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE] = "SAMPLE_CACHE",
+        [PA_SUBSCRIPTION_EVENT_SERVER] = "SERVER",
+        [PA_SUBSCRIPTION_EVENT_AUTOLOAD] = "AUTOLOAD"
+    };
+
+    const char * const type_table[] = {
+        [PA_SUBSCRIPTION_EVENT_NEW] = "NEW",
+        [PA_SUBSCRIPTION_EVENT_CHANGE] = "CHANGE",
+        [PA_SUBSCRIPTION_EVENT_REMOVE] = "REMOVE"
+    };
+
+    pa_log_debug("%s event (%s|%s|%u)",
+           prefix,
+           fac_table[e->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK],
+           type_table[e->type & PA_SUBSCRIPTION_EVENT_TYPE_MASK],
+           e->index);
+}
+#endif
+
+/* Append an event to the queue, unless it is made redundant by one
+ * that is already queued. Returns TRUE if the event was queued. */
+static pa_bool_t queue_post(pa_subscription_queue *q, pa_subscription_event_type_t t, uint32_t idx) {
+    pa_subscription_event *e, *i, key;
+
+    pa_assert(q);
+
+    key.type = t;
+    key.index = idx;
+
+    if ((i = pa_hashmap_get(q->objects, &key))) {
+
+        switch (t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) {
+
+            case PA_SUBSCRIPTION_EVENT_REMOVE:
+                /* This object is being removed, hence there is no
+                 * point in keeping the old events regarding this
+                 * entry in the queue. */
+
+                if ((i->type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_REMOVE) {
+                    queue_remove(q, i);
+                    pa_log_debug("Dropped redundant event due to remove event.");
+                }
+                break;
+
+            case PA_SUBSCRIPTION_EVENT_CHANGE:
+                /* This object has changed. If a "new" or "change" event for
+                 * this object is still in the queue we can exit. */
+
+                pa_log_debug("Dropped redundant event due to change event.");
+                return FALSE;
+
+            default:
+                break;
+        }
+
+        /* Only the most recent event of an object stays in the map */
+        pa_hashmap_remove(q->objects, &key);
+    }
+
+    if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(subscription_events))))
+        e = pa_xnew(pa_subscription_event, 1);
+
+    e->type = t;
+    e->index = idx;
+
+    PA_LLIST_INSERT_AFTER(pa_subscription_event, q->events, q->last, e);
+    q->last = e;
+    pa_assert_se(pa_hashmap_put(q->objects, e, e) == 0);
+
+#ifdef DEBUG
+    dump_event("Queued", e);
+#endif
+
+    return TRUE;
+}
+
 /* Allocate a new subscription object for the given subscription mask. Use the specified callback function and user data */
 pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m, pa_subscription_cb_t callback, void *userdata) {
     pa_subscription *s;
@@ -72,9 +232,13 @@ pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m, pa_su
     s = pa_xnew(pa_subscription, 1);
     s->core = c;
     s->dead = FALSE;
+    s->blocked = FALSE;
+    s->dispatched = FALSE;
     s->callback = callback;
+    s->flush_callback = NULL;
     s->userdata = userdata;
     s->mask = m;
+    s->held = NULL;
 
     PA_LLIST_PREPEND(pa_subscription, c->subscriptions, s);
     return s;
@@ -89,22 +253,45 @@ void pa_subscription_free(pa_subscription*s) {
     sched_event(s->core);
 }
 
-static void free_subscription(pa_subscription *s) {
+/* Set a function that is called after a batch of events has been
+ * passed to the subscription callback */
+void pa_subscription_set_flush_callback(pa_subscription *s, pa_subscription_flush_cb_t cb) {
     pa_assert(s);
-    pa_assert(s->core);
+    pa_assert(!s->dead);
 
-    PA_LLIST_REMOVE(pa_subscription, s->core->subscriptions, s);
-    pa_xfree(s);
+    s->flush_callback = cb;
+}
+
+/* While blocked the events for this subscription are queued and
+ * coalesced. They are dispatched as one batch after unblocking. */
+void pa_subscription_block(pa_subscription *s, pa_bool_t b) {
+    pa_assert(s);
+    pa_assert(!s->dead);
+
+    if (s->blocked == b)
+        return;
+
+    s->blocked = b;
+
+    if (!b && s->held && s->held->events)
+        sched_event(s->core);
+}
+
+pa_bool_t pa_subscription_is_blocked(pa_subscription *s) {
+    pa_assert(s);
+
+    return s->blocked;
 }
 
-static void free_event(pa_subscription_event *s) {
+static void free_subscription(pa_subscription *s) {
     pa_assert(s);
     pa_assert(s->core);
 
-    if (!s->next)
-        s->core->subscription_event_last = s->prev;
+    PA_LLIST_REMOVE(pa_subscription, s->core->subscriptions, s);
+
+    if (s->held)
+        queue_free(s->held);
 
-    PA_LLIST_REMOVE(pa_subscription_event, s->core->subscription_event_queue, s);
     pa_xfree(s);
 }
 
@@ -115,69 +302,90 @@ void pa_subscription_free_all(pa_core *c) {
     while (c->subscriptions)
         free_subscription(c->subscriptions);
 
-    while (c->subscription_event_queue)
-        free_event(c->subscription_event_queue);
+    if (c->subscription_queue) {
+        queue_free(c->subscription_queue);
+        c->subscription_queue = NULL;
+    }
 
     if (c->subscription_defer_event) {
         c->mainloop->defer_free(c->subscription_defer_event);
         c->subscription_defer_event = NULL;
     }
+
+    if (c->subscription_time_event) {
+        c->mainloop->time_free(c->subscription_time_event);
+        c->subscription_time_event = NULL;
+    }
 }
 
-#ifdef DEBUG
-static void dump_event(const char * prefix, pa_subscription_event*e) {
-    const char * const fac_table[] = {
-        [PA_SUBSCRIPTION_EVENT_SINK] = "SINK",
-        [PA_SUBSCRIPTION_EVENT_SOURCE] = "SOURCE",
-        [PA_SUBSCRIPTION_EVENT_SINK_INPUT] = "SINK_INPUT",
-        [PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT] = "SOURCE_OUTPUT",
-        [PA_SUBSCRIPTION_EVENT_MODULE] = "MODULE",
-        [PA_SUBSCRIPTION_EVENT_CLIENT] = "CLIENT",
-        [PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE] = "SAMPLE_CACHE",
-        [PA_SUBSCRIPTION_EVENT_SERVER] = "SERVER",
-        [PA_SUBSCRIPTION_EVENT_AUTOLOAD] = "AUTOLOAD"
-    };
+static void dispatch_event(pa_subscription *s, pa_subscription_event *e) {
+    pa_assert(s);
+    pa_assert(e);
 
-    const char * const type_table[] = {
-        [PA_SUBSCRIPTION_EVENT_NEW] = "NEW",
-        [PA_SUBSCRIPTION_EVENT_CHANGE] = "CHANGE",
-        [PA_SUBSCRIPTION_EVENT_REMOVE] = "REMOVE"
-    };
+    if (s->blocked) {
+        if (!s->held)
+            s->held = queue_new();
 
-    pa_log_debug("%s event (%s|%s|%u)",
-           prefix,
-           fac_table[e->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK],
-           type_table[e->type & PA_SUBSCRIPTION_EVENT_TYPE_MASK],
-           e->index);
+        queue_post(s->held, e->type, e->index);
+        return;
+    }
+
+    s->callback(s->core, e->type, e->index, s->userdata);
+    s->dispatched = TRUE;
 }
-#endif
 
-/* Deferred callback for dispatching subscription events */
-static void defer_cb(pa_mainloop_api *m, pa_defer_event *de, void *userdata) {
-    pa_core *c = userdata;
+/* Dispatch queued events. The main queue is left alone if main_queue
+ * is FALSE, i.e. when only held events or dead subscriptions need
+ * attention before the coalescing window is over. */
+static void dispatch(pa_core *c, pa_bool_t main_queue) {
     pa_subscription *s;
 
-    pa_assert(c->mainloop == m);
     pa_assert(c);
-    pa_assert(c->subscription_defer_event == de);
 
-    c->mainloop->defer_enable(c->subscription_defer_event, 0);
+    /* First pass on what unblocked subscriptions missed, so that the
+     * order of events is kept */
+
+    for (s = c->subscriptions; s; s = s->next) {
+
+        if (s->dead || !s->held)
+            continue;
+
+        while (s->held->events && !s->blocked) {
+            pa_subscription_event *e = s->held->events;
+
+            s->callback(c, e->type, e->index, s->userdata);
+            s->dispatched = TRUE;
 
-    /* Dispatch queued events */
+            queue_remove(s->held, e);
+        }
+    }
 
-    while (c->subscription_event_queue) {
-        pa_subscription_event *e = c->subscription_event_queue;
+    while (main_queue && c->subscription_queue && c->subscription_queue->events) {
+        pa_subscription_event *e = c->subscription_queue->events;
 
         for (s = c->subscriptions; s; s = s->next) {
 
             if (!s->dead && pa_subscription_match_flags(s->mask, e->type))
-                s->callback(c, e->type, e->index, s->userdata);
+                dispatch_event(s, e);
         }
 
 #ifdef DEBUG
         dump_event("Dispatched", e);
 #endif
-        free_event(e);
+        queue_remove(c->subscription_queue, e);
+    }
+
+    /* Tell the subscribers that the batch is complete */
+
+    for (s = c->subscriptions; s; s = s->next) {
+
+        if (!s->dispatched)
+            continue;
+
+        s->dispatched = FALSE;
+
+        if (!s->dead && s->flush_callback)
+            s->flush_callback(c, s->userdata);
     }
 
     /* Remove dead subscriptions */
@@ -191,6 +399,35 @@ static void defer_cb(pa_mainloop_api *m, pa_defer_event *de, void *userdata) {
     }
 }
 
+/* Deferred callback for dispatching subscription events */
+static void defer_cb(pa_mainloop_api *m, pa_defer_event *de, void *userdata) {
+    pa_core *c = userdata;
+
+    pa_assert(c->mainloop == m);
+    pa_assert(c);
+    pa_assert(c->subscription_defer_event == de);
+
+    c->mainloop->defer_enable(c->subscription_defer_event, 0);
+
+    /* With a coalescing window the main queue is only ever flushed by
+     * the timer, so that unblocking a subscription or freeing one
+     * doesn't cut the window short */
+    dispatch(c, c->subscription_coalesce_usec == 0);
+}
+
+/* Timer callback for dispatching subscription events after the coalescing window */
+static void time_cb(pa_mainloop_api *m, pa_time_event *te, const struct timeval *t, void *userdata) {
+    pa_core *c = userdata;
+
+    pa_assert(c->mainloop == m);
+    pa_assert(c);
+    pa_assert(c->subscription_time_event == te);
+
+    c->mainloop->time_restart(c->subscription_time_event, NULL);
+
+    dispatch(c, TRUE);
+}
+
 /* Schedule an mainloop event so that a pending subscription event is dispatched */
 static void sched_event(pa_core *c) {
     pa_assert(c);
@@ -203,61 +440,44 @@ static void sched_event(pa_core *c) {
     c->mainloop->defer_enable(c->subscription_defer_event, 1);
 }
 
+/* Schedule a timer so that the events queued within the next
+ * coalescing window are dispatched together */
+static void sched_event_delayed(pa_core *c) {
+    pa_usec_t when;
+
+    pa_assert(c);
+
+    when = pa_rtclock_now() + c->subscription_coalesce_usec;
+
+    if (!c->subscription_time_event) {
+        c->subscription_time_event = pa_core_rttime_new(c, when, time_cb, c);
+        pa_assert(c->subscription_time_event);
+    } else
+        pa_core_rttime_restart(c, c->subscription_time_event, when);
+}
+
 /* Append a new subscription event to the subscription event queue and schedule a main loop event */
 void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t idx) {
-    pa_subscription_event *e;
+    pa_bool_t was_empty;
+
     pa_assert(c);
 
     /* No need for queuing subscriptions of no one is listening */
     if (!c->subscriptions)
         return;
 
-    if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_NEW) {
-        pa_subscription_event *i, *n;
-
-        /* Check for duplicates */
-        for (i = c->subscription_event_last; i; i = n) {
-            n = i->prev;
+    if (!c->subscription_queue)
+        c->subscription_queue = queue_new();
 
-            /* not the same object type */
-            if (((t ^ i->type) & PA_SUBSCRIPTION_EVENT_FACILITY_MASK))
-                continue;
-
-            /* not the same object */
-            if (i->index != idx)
-                continue;
-
-            if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE) {
-                /* This object is being removed, hence there is no
-                 * point in keeping the old events regarding this
-                 * entry in the queue. */
-
-                free_event(i);
-                pa_log_debug("Dropped redundant event due to remove event.");
-                continue;
-            }
-
-            if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_CHANGE) {
-                /* This object has changed. If a "new" or "change" event for
-                 * this object is still in the queue we can exit. */
+    was_empty = !c->subscription_queue->events;
 
-                pa_log_debug("Dropped redundant event due to change event.");
-                return;
-            }
-        }
-    }
-
-    e = pa_xnew(pa_subscription_event, 1);
-    e->core = c;
-    e->type = t;
-    e->index = idx;
-
-    PA_LLIST_INSERT_AFTER(pa_subscription_event, c->subscription_event_queue, c->subscription_event_last, e);
-    c->subscription_event_last = e;
-
-#ifdef DEBUG
-    dump_event("Queued", e);
-#endif
+    if (!queue_post(c->subscription_queue, t, idx))
+        return;
 
-    sched_event(c);
+    /* The window starts with the first event, later events don't
+     * push the dispatching out any further */
+    if (c->subscription_coalesce_usec == 0)
+        sched_event(c);
+    else if (was_empty)
+        sched_event_delayed(c);
 }
@@ -24,16 +24,22 @@
 
 typedef struct pa_subscription pa_subscription;
 typedef struct pa_subscription_event pa_subscription_event;
+typedef struct pa_subscription_queue pa_subscription_queue;
 
 #include <pulsecore/core.h>
 #include <pulsecore/native-common.h>
 
 typedef void (*pa_subscription_cb_t)(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata);
+typedef void (*pa_subscription_flush_cb_t)(pa_core *c, void *userdata);
 
 pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m,  pa_subscription_cb_t cb, void *userdata);
 void pa_subscription_free(pa_subscription*s);
 void pa_subscription_free_all(pa_core *c);
 
+void pa_subscription_set_flush_callback(pa_subscription *s, pa_subscription_flush_cb_t cb);
+void pa_subscription_block(pa_subscription *s, pa_bool_t b);
+pa_bool_t pa_subscription_is_blocked(pa_subscription *s);
+
 void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t idx);
 
 #endif
@@ -120,13 +120,16 @@ pa_core* pa_core_new(pa_mainloop_api *m, pa_bool_t shared, size_t shm_size) {
     c->scache_auto_unload_event = NULL;
 
     c->subscription_defer_event = NULL;
+    c->subscription_time_event = NULL;
     PA_LLIST_HEAD_INIT(pa_subscription, c->subscriptions);
-    PA_LLIST_HEAD_INIT(pa_subscription_event, c->subscription_event_queue);
-    c->subscription_event_last = NULL;
+    c->subscription_queue = NULL;
+    c->subscription_coalesce_usec = 0;
 
     c->mempool = pool;
     pa_silence_cache_init(&c->silence_cache);
 
+    c->stats = NULL;
+
     c->exit_event = NULL;
 
     c->exit_idle_time = -1;
@@ -210,6 +213,9 @@ static void core_free(pa_object *o) {
     pa_silence_cache_done(&c->silence_cache);
     pa_mempool_free(c->mempool);
 
+    if (c->stats)
+        pa_stats_free(c->stats);
+
     for (j = 0; j < PA_CORE_HOOK_MAX; j++)
         pa_hook_done(&c->hooks[j]);
 
@@ -50,6 +50,7 @@ typedef enum pa_suspend_cause {
 #include <pulsecore/sink.h>
 #include <pulsecore/source.h>
 #include <pulsecore/core-subscribe.h>
+#include <pulsecore/stats.h>
 #include <pulsecore/msgobject.h>
 
 typedef enum pa_server_type {
@@ -152,13 +153,17 @@ struct pa_core {
     pa_defer_event *module_defer_unload_event;
 
     pa_defer_event *subscription_defer_event;
+    pa_time_event *subscription_time_event;
     PA_LLIST_HEAD(pa_subscription, subscriptions);
-    PA_LLIST_HEAD(pa_subscription_event, subscription_event_queue);
-    pa_subscription_event *subscription_event_last;
+    pa_subscription_queue *subscription_queue;
+    pa_usec_t subscription_coalesce_usec;
 
     pa_mempool *mempool;
     pa_silence_cache silence_cache;
 
+    /* The shared memory statistics, may be NULL */
+    pa_stats *stats;
+
     pa_time_event *exit_event;
     pa_time_event *scache_auto_unload_event;
 
@@ -135,6 +135,9 @@ pa_bool_t pa_cpu_init_arm(pa_cpu_arm_flag_t *flags) {
     if (*flags & PA_CPU_ARM_V6)
         pa_volume_func_init_arm(*flags);
 
+    if (*flags & PA_CPU_ARM_NEON)
+        pa_polyphase_func_init_arm(*flags);
+
     return TRUE;
 
 #else /* defined (__linux__) */
@@ -39,5 +39,6 @@ pa_bool_t pa_cpu_init_arm(pa_cpu_arm_flag_t *flags);
 
 /* some optimized functions */
 void pa_volume_func_init_arm(pa_cpu_arm_flag_t flags);
+void pa_polyphase_func_init_arm(pa_cpu_arm_flag_t flags);
 
 #endif /* foocpuarmhfoo */
@@ -28,17 +28,16 @@
 #include <pulse/xmalloc.h>
 #include <pulsecore/idxset.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/hashtable.h>
 #include <pulsecore/macro.h>
 
 #include "hashmap.h"
 
-#define NBUCKETS 127
-
 struct hashmap_entry {
     const void *key;
     void *value;
+    unsigned hash;
 
-    struct hashmap_entry *bucket_next, *bucket_previous;
     struct hashmap_entry *iterate_next, *iterate_previous;
 };
 
@@ -46,22 +45,29 @@ struct pa_hashmap {
     pa_hash_func_t hash_func;
     pa_compare_func_t compare_func;
 
+    /* Open addressed, see hashtable.h. Iteration goes through the
+     * linked list, so it is in insertion order regardless of where
+     * the entries end up in the table. */
+    pa_hash_slot *slots;
+    unsigned n_slots;
+
     struct hashmap_entry *iterate_list_head, *iterate_list_tail;
     unsigned n_entries;
 };
 
-#define BY_HASH(h) ((struct hashmap_entry**) ((uint8_t*) (h) + PA_ALIGN(sizeof(pa_hashmap))))
-
 PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
 
 pa_hashmap *pa_hashmap_new(pa_hash_func_t hash_func, pa_compare_func_t compare_func) {
     pa_hashmap *h;
 
-    h = pa_xmalloc0(PA_ALIGN(sizeof(pa_hashmap)) + NBUCKETS*sizeof(struct hashmap_entry*));
+    h = pa_xnew(pa_hashmap, 1);
 
     h->hash_func = hash_func ? hash_func : pa_idxset_trivial_hash_func;
     h->compare_func = compare_func ? compare_func : pa_idxset_trivial_compare_func;
 
+    h->n_slots = PA_HASH_SLOTS_MIN;
+    h->slots = pa_xnew0(pa_hash_slot, h->n_slots);
+
     h->n_entries = 0;
     h->iterate_list_head = h->iterate_list_tail = NULL;
 
@@ -83,16 +89,8 @@ static void remove_entry(pa_hashmap *h, struct hashmap_entry *e) {
     else
         h->iterate_list_head = e->iterate_next;
 
-    /* Remove from hash table bucket list */
-    if (e->bucket_next)
-        e->bucket_next->bucket_previous = e->bucket_previous;
-
-    if (e->bucket_previous)
-        e->bucket_previous->bucket_next = e->bucket_next;
-    else {
-        unsigned hash = h->hash_func(e->key) % NBUCKETS;
-        BY_HASH(h)[hash] = e->bucket_next;
-    }
+    /* Remove from hash table */
+    pa_hash_slots_delete(h->slots, h->n_slots, pa_hash_slots_find_entry(h->slots, h->n_slots, e->hash, e));
 
     if (pa_flist_push(PA_STATIC_FLIST_GET(entries), e) < 0)
         pa_xfree(e);
@@ -113,17 +111,22 @@ void pa_hashmap_free(pa_hashmap*h, pa_free2_cb_t free_cb, void *userdata) {
             free_cb(data, userdata);
     }
 
+    pa_xfree(h->slots);
     pa_xfree(h);
 }
 
 static struct hashmap_entry *hash_scan(pa_hashmap *h, unsigned hash, const void *key) {
-    struct hashmap_entry *e;
+    unsigned mask, i;
     pa_assert(h);
-    pa_assert(hash < NBUCKETS);
 
-    for (e = BY_HASH(h)[hash]; e; e = e->bucket_next)
-        if (h->compare_func(e->key, key) == 0)
+    mask = h->n_slots - 1;
+
+    for (i = hash & mask; h->slots[i].entry; i = (i + 1) & mask) {
+        struct hashmap_entry *e = h->slots[i].entry;
+
+        if (h->slots[i].hash == hash && h->compare_func(e->key, key) == 0)
             return e;
+    }
 
     return NULL;
 }
@@ -134,23 +137,25 @@ int pa_hashmap_put(pa_hashmap *h, const void *key, void *value) {
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
+    hash = pa_hash_mix(h->hash_func(key));
 
     if (hash_scan(h, hash, key))
         return -1;
 
+    if (pa_hash_slots_need_grow(h->n_entries + 1, h->n_slots)) {
+        h->slots = pa_hash_slots_resize(h->slots, h->n_slots, h->n_slots * 2);
+        h->n_slots *= 2;
+    }
+
     if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(entries))))
         e = pa_xnew(struct hashmap_entry, 1);
 
     e->key = key;
     e->value = value;
+    e->hash = hash;
 
     /* Insert into hash table */
-    e->bucket_next = BY_HASH(h)[hash];
-    e->bucket_previous = NULL;
-    if (BY_HASH(h)[hash])
-        BY_HASH(h)[hash]->bucket_previous = e;
-    BY_HASH(h)[hash] = e;
+    pa_hash_slots_insert(h->slots, h->n_slots, hash, e);
 
     /* Insert into iteration list */
     e->iterate_previous = h->iterate_list_tail;
@@ -176,7 +181,7 @@ void* pa_hashmap_get(pa_hashmap *h, const void *key) {
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
+    hash = pa_hash_mix(h->hash_func(key));
 
     if (!(e = hash_scan(h, hash, key)))
         return NULL;
@@ -191,7 +196,7 @@ void* pa_hashmap_remove(pa_hashmap *h, const void *key) {
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
+    hash = pa_hash_mix(h->hash_func(key));
 
     if (!(e = hash_scan(h, hash, key)))
         return NULL;
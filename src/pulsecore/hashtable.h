@@ -0,0 +1,142 @@
+#ifndef foohashtablehfoo
+#define foohashtablehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/macro.h>
+
+/* The slot array shared by pa_hashmap and pa_idxset: an open
+ * addressed hash table with linear probing and backward shift
+ * deletion. The number of slots is always a power of two. Each slot
+ * caches the (mixed) hash of its entry so that probing rarely has to
+ * touch the entry itself and resizing never calls the hash function
+ * again. The entries and their iteration order are maintained by the
+ * container.
+ *
+ * Tables only ever grow, i.e. stay at their high-water size. Removing
+ * entries hence never allocates or frees memory, which matters for
+ * the thread_info tables that are modified from IO threads. */
+
+#define PA_HASH_SLOTS_MIN 16U
+
+typedef struct pa_hash_slot {
+    unsigned hash;
+    void *entry;
+} pa_hash_slot;
+
+/* Spread the bits of a user supplied hash value over the whole
+ * word. Pointer hashes have their low bits clear and string hashes
+ * are weak in the high bits, but we only use the low bits to pick a
+ * slot. This is a bijection, so two different 32 bit inputs never
+ * mix to the same value. */
+static inline unsigned pa_hash_mix(unsigned hash) {
+    uint32_t h = (uint32_t) hash;
+
+    h ^= h >> 16;
+    h *= 0x7feb352dU;
+    h ^= h >> 15;
+    h *= 0x846ca68bU;
+    h ^= h >> 16;
+
+    return (unsigned) h;
+}
+
+/* TRUE if a table with n_slots slots needs to grow before it may
+ * hold n_entries entries. We keep the load factor at or below 3/4. */
+static inline pa_bool_t pa_hash_slots_need_grow(unsigned n_entries, unsigned n_slots) {
+    return n_entries > n_slots / 4 * 3;
+}
+
+/* Store entry in the first free slot of its probe sequence. The entry
+ * must not be in the table yet and there must be a free slot. */
+static inline void pa_hash_slots_insert(pa_hash_slot *slots, unsigned n_slots, unsigned hash, void *entry) {
+    unsigned mask = n_slots - 1, i;
+
+    pa_assert(entry);
+
+    for (i = hash & mask; slots[i].entry; i = (i + 1) & mask)
+        ;
+
+    slots[i].hash = hash;
+    slots[i].entry = entry;
+}
+
+/* Return the slot number entry is stored in. The entry must be in the
+ * table. */
+static inline unsigned pa_hash_slots_find_entry(pa_hash_slot *slots, unsigned n_slots, unsigned hash, void *entry) {
+    unsigned mask = n_slots - 1, i;
+
+    for (i = hash & mask; slots[i].entry != entry; i = (i + 1) & mask)
+        pa_assert(slots[i].entry);
+
+    return i;
+}
+
+/* Empty slot i, moving later entries of the same cluster back so that
+ * no probe sequence is interrupted. No tombstones are needed. */
+static inline void pa_hash_slots_delete(pa_hash_slot *slots, unsigned n_slots, unsigned i) {
+    unsigned mask = n_slots - 1, j = i;
+
+    for (;;) {
+        unsigned k;
+
+        j = (j + 1) & mask;
+
+        if (!slots[j].entry)
+            break;
+
+        /* The entry in slot j may be moved to slot i unless its home
+         * slot k lies cyclically in (i, j] */
+        k = slots[j].hash & mask;
+
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+
+        slots[i] = slots[j];
+        i = j;
+    }
+
+    slots[i].entry = NULL;
+}
+
+/* Move all entries to a newly allocated table of n_slots slots and
+ * free the old one. */
+static inline pa_hash_slot *pa_hash_slots_resize(pa_hash_slot *slots, unsigned old_n_slots, unsigned n_slots) {
+    pa_hash_slot *n;
+    unsigned i;
+
+    pa_assert(n_slots >= PA_HASH_SLOTS_MIN);
+    pa_assert((n_slots & (n_slots - 1)) == 0);
+
+    n = pa_xnew0(pa_hash_slot, n_slots);
+
+    for (i = 0; i < old_n_slots; i++)
+        if (slots[i].entry)
+            pa_hash_slots_insert(n, n_slots, slots[i].hash, slots[i].entry);
+
+    pa_xfree(slots);
+
+    return n;
+}
+
+#endif
@@ -30,18 +30,16 @@
 
 #include <pulse/xmalloc.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/hashtable.h>
 #include <pulsecore/macro.h>
 
 #include "idxset.h"
 
-#define NBUCKETS 127
-
 struct idxset_entry {
     uint32_t idx;
     void *data;
+    unsigned data_hash;
 
-    struct idxset_entry *data_next, *data_previous;
-    struct idxset_entry *index_next, *index_previous;
     struct idxset_entry *iterate_next, *iterate_previous;
 };
 
@@ -51,13 +49,17 @@ struct pa_idxset {
 
     uint32_t current_index;
 
+    /* Two open addressed tables of the same size, see
+     * hashtable.h. The index table is keyed by the mixed index, which
+     * is unique, so a matching slot hash is a match. Iteration goes
+     * through the linked list, i.e. in index order. */
+    pa_hash_slot *by_data, *by_index;
+    unsigned n_slots;
+
     struct idxset_entry *iterate_list_head, *iterate_list_tail;
     unsigned n_entries;
 };
 
-#define BY_DATA(i) ((struct idxset_entry**) ((uint8_t*) (i) + PA_ALIGN(sizeof(pa_idxset))))
-#define BY_INDEX(i) (BY_DATA(i) + NBUCKETS)
-
 PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
 
 unsigned pa_idxset_string_hash_func(const void *p) {
@@ -85,11 +87,15 @@ int pa_idxset_trivial_compare_func(const void *a, const void *b) {
 pa_idxset* pa_idxset_new(pa_hash_func_t hash_func, pa_compare_func_t compare_func) {
     pa_idxset *s;
 
-    s = pa_xmalloc0(PA_ALIGN(sizeof(pa_idxset)) + NBUCKETS*2*sizeof(struct idxset_entry*));
+    s = pa_xnew(pa_idxset, 1);
 
     s->hash_func = hash_func ? hash_func : pa_idxset_trivial_hash_func;
     s->compare_func = compare_func ? compare_func : pa_idxset_trivial_compare_func;
 
+    s->n_slots = PA_HASH_SLOTS_MIN;
+    s->by_data = pa_xnew0(pa_hash_slot, s->n_slots);
+    s->by_index = pa_xnew0(pa_hash_slot, s->n_slots);
+
     s->current_index = 0;
     s->n_entries = 0;
     s->iterate_list_head = s->iterate_list_tail = NULL;
@@ -113,24 +119,10 @@ static void remove_entry(pa_idxset *s, struct idxset_entry *e) {
         s->iterate_list_head = e->iterate_next;
 
     /* Remove from data hash table */
-    if (e->data_next)
-        e->data_next->data_previous = e->data_previous;
-
-    if (e->data_previous)
-        e->data_previous->data_next = e->data_next;
-    else {
-        unsigned hash = s->hash_func(e->data) % NBUCKETS;
-        BY_DATA(s)[hash] = e->data_next;
-    }
+    pa_hash_slots_delete(s->by_data, s->n_slots, pa_hash_slots_find_entry(s->by_data, s->n_slots, e->data_hash, e));
 
     /* Remove from index hash table */
-    if (e->index_next)
-        e->index_next->index_previous = e->index_previous;
-
-    if (e->index_previous)
-        e->index_previous->index_next = e->index_next;
-    else
-        BY_INDEX(s)[e->idx % NBUCKETS] = e->index_next;
+    pa_hash_slots_delete(s->by_index, s->n_slots, pa_hash_slots_find_entry(s->by_index, s->n_slots, pa_hash_mix(e->idx), e));
 
     if (pa_flist_push(PA_STATIC_FLIST_GET(entries), e) < 0)
         pa_xfree(e);
@@ -139,6 +131,14 @@ static void remove_entry(pa_idxset *s, struct idxset_entry *e) {
     s->n_entries--;
 }
 
+static void resize(pa_idxset *s, unsigned n_slots) {
+    pa_assert(s);
+
+    s->by_data = pa_hash_slots_resize(s->by_data, s->n_slots, n_slots);
+    s->by_index = pa_hash_slots_resize(s->by_index, s->n_slots, n_slots);
+    s->n_slots = n_slots;
+}
+
 void pa_idxset_free(pa_idxset *s, pa_free2_cb_t free_cb, void *userdata) {
     pa_assert(s);
 
@@ -151,30 +151,38 @@ void pa_idxset_free(pa_idxset *s, pa_free2_cb_t free_cb, void *userdata) {
             free_cb(data, userdata);
     }
 
+    pa_xfree(s->by_data);
+    pa_xfree(s->by_index);
     pa_xfree(s);
 }
 
 static struct idxset_entry* data_scan(pa_idxset *s, unsigned hash, const void *p) {
-    struct idxset_entry *e;
+    unsigned mask, i;
     pa_assert(s);
-    pa_assert(hash < NBUCKETS);
     pa_assert(p);
 
-    for (e = BY_DATA(s)[hash]; e; e = e->data_next)
-        if (s->compare_func(e->data, p) == 0)
+    mask = s->n_slots - 1;
+
+    for (i = hash & mask; s->by_data[i].entry; i = (i + 1) & mask) {
+        struct idxset_entry *e = s->by_data[i].entry;
+
+        if (s->by_data[i].hash == hash && s->compare_func(e->data, p) == 0)
             return e;
+    }
 
     return NULL;
 }
 
-static struct idxset_entry* index_scan(pa_idxset *s, unsigned hash, uint32_t idx) {
-    struct idxset_entry *e;
+static struct idxset_entry* index_scan(pa_idxset *s, uint32_t idx) {
+    unsigned hash, mask, i;
     pa_assert(s);
-    pa_assert(hash < NBUCKETS);
 
-    for (e = BY_INDEX(s)[hash]; e; e = e->index_next)
-        if (e->idx == idx)
-            return e;
+    hash = pa_hash_mix(idx);
+    mask = s->n_slots - 1;
+
+    for (i = hash & mask; s->by_index[i].entry; i = (i + 1) & mask)
+        if (s->by_index[i].hash == hash)
+            return s->by_index[i].entry;
 
     return NULL;
 }
@@ -185,7 +193,7 @@ int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
 
     pa_assert(s);
 
-    hash = s->hash_func(p) % NBUCKETS;
+    hash = pa_hash_mix(s->hash_func(p));
 
     if ((e = data_scan(s, hash, p))) {
         if (idx)
@@ -194,27 +202,21 @@ int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
         return -1;
     }
 
+    if (pa_hash_slots_need_grow(s->n_entries + 1, s->n_slots))
+        resize(s, s->n_slots * 2);
+
     if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(entries))))
         e = pa_xnew(struct idxset_entry, 1);
 
     e->data = p;
+    e->data_hash = hash;
     e->idx = s->current_index++;
 
     /* Insert into data hash table */
-    e->data_next = BY_DATA(s)[hash];
-    e->data_previous = NULL;
-    if (BY_DATA(s)[hash])
-        BY_DATA(s)[hash]->data_previous = e;
-    BY_DATA(s)[hash] = e;
-
-    hash = e->idx % NBUCKETS;
+    pa_hash_slots_insert(s->by_data, s->n_slots, hash, e);
 
     /* Insert into index hash table */
-    e->index_next = BY_INDEX(s)[hash];
-    e->index_previous = NULL;
-    if (BY_INDEX(s)[hash])
-        BY_INDEX(s)[hash]->index_previous = e;
-    BY_INDEX(s)[hash] = e;
+    pa_hash_slots_insert(s->by_index, s->n_slots, pa_hash_mix(e->idx), e);
 
     /* Insert into iteration list */
     e->iterate_previous = s->iterate_list_tail;
@@ -238,14 +240,11 @@ int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
 }
 
 void* pa_idxset_get_by_index(pa_idxset*s, uint32_t idx) {
-    unsigned hash;
     struct idxset_entry *e;
 
     pa_assert(s);
 
-    hash = idx % NBUCKETS;
-
-    if (!(e = index_scan(s, hash, idx)))
+    if (!(e = index_scan(s, idx)))
         return NULL;
 
     return e->data;
@@ -257,7 +256,7 @@ void* pa_idxset_get_by_data(pa_idxset*s, const void *p, uint32_t *idx) {
 
     pa_assert(s);
 
-    hash = s->hash_func(p) % NBUCKETS;
+    hash = pa_hash_mix(s->hash_func(p));
 
     if (!(e = data_scan(s, hash, p)))
         return NULL;
@@ -270,14 +269,11 @@ void* pa_idxset_get_by_data(pa_idxset*s, const void *p, uint32_t *idx) {
 
 void* pa_idxset_remove_by_index(pa_idxset*s, uint32_t idx) {
     struct idxset_entry *e;
-    unsigned hash;
     void *data;
 
     pa_assert(s);
 
-    hash = idx % NBUCKETS;
-
-    if (!(e = index_scan(s, hash, idx)))
+    if (!(e = index_scan(s, idx)))
         return NULL;
 
     data = e->data;
@@ -293,7 +289,7 @@ void* pa_idxset_remove_by_data(pa_idxset*s, const void *data, uint32_t *idx) {
 
     pa_assert(s);
 
-    hash = s->hash_func(data) % NBUCKETS;
+    hash = pa_hash_mix(s->hash_func(data));
 
     if (!(e = data_scan(s, hash, data)))
         return NULL;
@@ -309,15 +305,12 @@ void* pa_idxset_remove_by_data(pa_idxset*s, const void *data, uint32_t *idx) {
 }
 
 void* pa_idxset_rrobin(pa_idxset *s, uint32_t *idx) {
-    unsigned hash;
     struct idxset_entry *e;
 
     pa_assert(s);
     pa_assert(idx);
 
-    hash = *idx % NBUCKETS;
-
-    e = index_scan(s, hash, *idx);
+    e = index_scan(s, *idx);
 
     if (e && e->iterate_next)
         e = e->iterate_next;
@@ -399,7 +392,6 @@ void* pa_idxset_first(pa_idxset *s, uint32_t *idx) {
 
 void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
     struct idxset_entry *e;
-    unsigned hash;
 
     pa_assert(s);
     pa_assert(idx);
@@ -407,9 +399,7 @@ void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
     if (*idx == PA_IDXSET_INVALID)
         return NULL;
 
-    hash = *idx % NBUCKETS;
-
-    if ((e = index_scan(s, hash, *idx))) {
+    if ((e = index_scan(s, *idx))) {
 
         e = e->iterate_next;
 
@@ -428,9 +418,7 @@ void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
 
         for ((*idx)++; *idx < s->current_index; (*idx)++) {
 
-            hash = *idx % NBUCKETS;
-
-            if ((e = index_scan(s, hash, *idx))) {
+            if ((e = index_scan(s, *idx))) {
                 *idx = e->idx;
                 return e->data;
             }
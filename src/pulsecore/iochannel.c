@@ -231,6 +231,74 @@ ssize_t pa_iochannel_write(pa_iochannel*io, const void*data, size_t l) {
     return r;
 }
 
+ssize_t pa_iochannel_writev(pa_iochannel*io, const struct iovec *iov, unsigned n) {
+    ssize_t r;
+#ifndef HAVE_SYS_UIO_H
+    size_t sum = 0;
+    unsigned k;
+#endif
+
+    pa_assert(io);
+    pa_assert(iov);
+    pa_assert(n > 0);
+    pa_assert(io->ofd >= 0);
+
+#ifdef HAVE_SYS_UIO_H
+    for (;;) {
+
+        /* Like pa_write() we use sendmsg() on sockets to avoid
+         * SIGPIPE and fall back to writev() on everything else */
+        if (io->ofd_type == 0) {
+            struct msghdr mh;
+
+            pa_zero(mh);
+            mh.msg_iov = (struct iovec*) iov;
+            mh.msg_iovlen = n;
+
+            if ((r = sendmsg(io->ofd, &mh, MSG_NOSIGNAL)) < 0 && errno == ENOTSOCK) {
+                io->ofd_type = 1;
+                continue;
+            }
+        } else
+            r = writev(io->ofd, iov, (int) n);
+
+        if (r < 0 && errno == EINTR)
+            continue;
+
+        break;
+    }
+#else
+    /* No writev(), so write the buffers one by one, stopping at the
+     * first short write. An error after some data went out is left
+     * for the next call to report. */
+    for (k = 0; k < n; k++) {
+        if (iov[k].iov_len <= 0)
+            continue;
+
+        if ((r = pa_write(io->ofd, iov[k].iov_base, iov[k].iov_len, &io->ofd_type)) < 0) {
+            if (sum > 0)
+                break;
+
+            return r;
+        }
+
+        sum += (size_t) r;
+
+        if ((size_t) r < iov[k].iov_len)
+            break;
+    }
+
+    r = (ssize_t) sum;
+#endif
+
+    if (r >= 0) {
+        io->writable = io->hungup = FALSE;
+        enable_events(io);
+    }
+
+    return r;
+}
+
 ssize_t pa_iochannel_read(pa_iochannel*io, void*data, size_t l) {
     ssize_t r;
 
@@ -289,9 +357,22 @@ int pa_iochannel_creds_enable(pa_iochannel *io) {
 }
 
 ssize_t pa_iochannel_write_with_creds(pa_iochannel*io, const void*data, size_t l, const pa_creds *ucred) {
+    struct iovec iov;
+
+    pa_assert(io);
+    pa_assert(data);
+    pa_assert(l);
+
+    pa_zero(iov);
+    iov.iov_base = (void*) data;
+    iov.iov_len = l;
+
+    return pa_iochannel_writev_with_creds(io, &iov, 1, ucred);
+}
+
+ssize_t pa_iochannel_writev_with_creds(pa_iochannel*io, const struct iovec *iov, unsigned n, const pa_creds *ucred) {
     ssize_t r;
     struct msghdr mh;
-    struct iovec iov;
     union {
         struct cmsghdr hdr;
         uint8_t data[CMSG_SPACE(sizeof(struct ucred))];
@@ -299,14 +380,10 @@ ssize_t pa_iochannel_write_with_creds(pa_iochannel*io, const void*data, size_t l
     struct ucred *u;
 
     pa_assert(io);
-    pa_assert(data);
-    pa_assert(l);
+    pa_assert(iov);
+    pa_assert(n > 0);
     pa_assert(io->ofd >= 0);
 
-    pa_zero(iov);
-    iov.iov_base = (void*) data;
-    iov.iov_len = l;
-
     pa_zero(cmsg);
     cmsg.hdr.cmsg_len = CMSG_LEN(sizeof(struct ucred));
     cmsg.hdr.cmsg_level = SOL_SOCKET;
@@ -324,8 +401,8 @@ ssize_t pa_iochannel_write_with_creds(pa_iochannel*io, const void*data, size_t l
     }
 
     pa_zero(mh);
-    mh.msg_iov = &iov;
-    mh.msg_iovlen = 1;
+    mh.msg_iov = (struct iovec*) iov;
+    mh.msg_iovlen = n;
     mh.msg_control = &cmsg;
     mh.msg_controllen = sizeof(cmsg);
 
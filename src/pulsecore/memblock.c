@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
+#include <limits.h>
 
 #ifdef HAVE_VALGRIND_MEMCHECK_H
 #include <valgrind/memcheck.h>
@@ -49,16 +50,33 @@
 #include <pulsecore/flist.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/memtrap.h>
+#include <pulsecore/thread.h>
 
 #include "memblock.h"
 
-/* We can allocate 64*1024*1024 bytes at maximum. That's 64MB. Please
+/* A pool segment is 64*1024*1024 bytes by default. That's 64MB. Please
  * note that the footprint is usually much smaller, since the data is
  * stored in SHM and our OS does not commit the memory before we use
  * it for the first time. */
 #define PA_MEMPOOL_SLOTS_MAX 1024
 #define PA_MEMPOOL_SLOT_SIZE (64*1024)
 
+/* When a pool runs full it grows by another segment of the size of
+ * the first one, up to this many segments in total. Segments are only
+ * ever created from the thread that created the pool, once the slots
+ * in use pass the high-water mark (in quarters of the current size).
+ * IO threads never map memory, they only ask for the pool to grow. */
+#define PA_MEMPOOL_SEGMENTS_MAX 4
+#define PA_MEMPOOL_HIGH_WATER_QUARTERS 3
+
+/* Objects of the size classes below a whole slot are carved out of
+ * slots ("slabs"), see struct mempool_size_class */
+#define PA_MEMPOOL_OBJECT_SIZE_MIN (2*1024)
+
+/* How much memory a thread may keep in its cache per size class */
+#define PA_MEMPOOL_CACHE_BYTES (64*1024)
+#define PA_MEMPOOL_CACHE_OBJECTS_MAX 32
+
 #define PA_MEMEXPORT_SLOTS_MAX 128
 
 #define PA_MEMIMPORT_SLOTS_MAX 160
@@ -89,6 +107,11 @@ struct pa_memblock {
             uint32_t id;
             pa_memimport_segment *segment;
         } imported;
+
+        struct {
+            /* If type == PA_MEMBLOCK_POOL or PA_MEMBLOCK_POOL_EXTERNAL this is the size class of the pool object */
+            unsigned size_class;
+        } pool;
     } per_type;
 };
 
@@ -139,11 +162,53 @@ struct pa_memexport {
     PA_LLIST_FIELDS(pa_memexport);
 };
 
+/* The free objects of a size class smaller than a slot are kept on a
+ * lock-free stack that is linked through the first bytes of the free
+ * objects themselves. Like pa_flist the stack head is an object
+ * index tagged with a counter, to avoid the ABA problem. The last
+ * size class, whole slots, uses the free_slots flist of the pool
+ * instead.
+ *
+ * A slot that has been split up ("slab") stays with its size class
+ * for the lifetime of the pool, it is never given back to the slots
+ * of the pool. */
+struct mempool_size_class {
+    size_t size;
+    unsigned n_per_slot;
+    unsigned cache_max;
+
+    pa_atomic_t free_objects;
+    pa_atomic_t current_tag;
+    int index_mask;
+    int tag_shift;
+    int tag_mask;
+};
+
+/* Every thread keeps a few free objects of each size class of one
+ * pool, so that most allocations and frees don't touch the shared
+ * free lists at all. */
+struct mempool_cache {
+    pa_mempool *pool;
+    unsigned n_objects[PA_MEMPOOL_SIZE_CLASSES];
+    void *objects[PA_MEMPOOL_SIZE_CLASSES][PA_MEMPOOL_CACHE_OBJECTS_MAX];
+
+    PA_LLIST_FIELDS(struct mempool_cache);
+};
+
 struct pa_mempool {
     pa_semaphore *semaphore;
     pa_mutex *mutex;
 
-    pa_shm memory;
+    /* Only segments below n_segments are valid. New ones are created
+     * by the thread that created the pool, while holding the mutex;
+     * growing stops for good at n_segments_max, i.e. after a segment
+     * could not be created. Other threads set grow_requested
+     * instead. */
+    pa_shm memory[PA_MEMPOOL_SEGMENTS_MAX];
+    pa_atomic_t n_segments;
+    unsigned n_segments_max;
+    pa_thread *thread;
+    pa_atomic_t grow_requested;
     size_t block_size;
     unsigned n_blocks;
 
@@ -155,6 +220,11 @@ struct pa_mempool {
     /* A list of free slots that may be reused */
     pa_flist *free_slots;
 
+    struct mempool_size_class size_classes[PA_MEMPOOL_SIZE_CLASSES];
+
+    /* Protected by the caches mutex */
+    PA_LLIST_HEAD(struct mempool_cache, caches);
+
     pa_mempool_stat stat;
 };
 
@@ -162,6 +232,13 @@ static void segment_detach(pa_memimport_segment *seg);
 
 PA_STATIC_FLIST_DECLARE(unused_memblocks, 0, pa_xfree);
 
+static void mempool_cache_free(void *userdata);
+
+PA_STATIC_TLS_DECLARE(mempool_cache, mempool_cache_free);
+
+/* Protects the binding of caches to pools */
+static pa_static_mutex caches_mutex = PA_STATIC_MUTEX_INIT;
+
 /* No lock necessary */
 static void stat_add(pa_memblock*b) {
     pa_assert(b);
@@ -245,27 +322,97 @@ static pa_memblock *memblock_new_appended(pa_mempool *p, size_t length) {
     return b;
 }
 
+/* Self-locked. Adds a segment to the pool, unless called from
+ * another thread than the one that created the pool: mapping memory
+ * may take a while, which IO threads can't afford. Those only ask
+ * for the next allocation in the pool's thread to do it. Returns
+ * FALSE if no segment was added and none will be added in this
+ * thread. */
+static pa_bool_t mempool_grow(pa_mempool *p, unsigned n_segments) {
+    unsigned n;
+    char t[PA_BYTES_SNPRINT_MAX];
+
+    pa_assert(p);
+
+    if (n_segments >= p->n_segments_max)
+        return FALSE;
+
+    if (pa_thread_self() != p->thread) {
+        pa_atomic_store(&p->grow_requested, 1);
+        return FALSE;
+    }
+
+    pa_mutex_lock(p->mutex);
+
+    pa_atomic_store(&p->grow_requested, 0);
+
+    if ((n = (unsigned) pa_atomic_load(&p->n_segments)) > n_segments) {
+        /* Somebody else was quicker */
+        pa_mutex_unlock(p->mutex);
+        return TRUE;
+    }
+
+    if (n >= p->n_segments_max ||
+        pa_shm_create_rw(&p->memory[n], p->n_blocks * p->block_size, p->memory[0].shared, 0700) < 0) {
+
+        /* Never try again */
+        p->n_segments_max = n;
+
+        pa_mutex_unlock(p->mutex);
+        return FALSE;
+    }
+
+    pa_atomic_inc(&p->n_segments);
+    pa_atomic_inc(&p->stat.n_segments);
+
+    pa_mutex_unlock(p->mutex);
+
+    pa_log_info("Memory pool running full, added segment %u, total size is now %s.", n + 1,
+                pa_bytes_snprint(t, sizeof(t), (unsigned) ((n + 1) * p->n_blocks * p->block_size)));
+
+    return TRUE;
+}
+
 /* No lock necessary */
 static struct mempool_slot* mempool_allocate_slot(pa_mempool *p) {
     struct mempool_slot *slot;
     pa_assert(p);
 
+    if (PA_UNLIKELY(pa_atomic_load(&p->grow_requested)))
+        mempool_grow(p, (unsigned) pa_atomic_load(&p->n_segments));
+
     if (!(slot = pa_flist_pop(p->free_slots))) {
+        unsigned n_segments;
         int idx;
 
-        /* The free list was empty, we have to allocate a new entry */
+        /* The free list was empty, we have to allocate a new
+         * entry. Indexes are only handed out for segments that exist
+         * already, so that they stay unique. */
 
-        if ((unsigned) (idx = pa_atomic_inc(&p->n_init)) >= p->n_blocks)
-            pa_atomic_dec(&p->n_init);
-        else
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) idx));
+        for (;;) {
+            n_segments = (unsigned) pa_atomic_load(&p->n_segments);
+            idx = pa_atomic_load(&p->n_init);
 
-        if (!slot) {
-            if (pa_log_ratelimit(PA_LOG_DEBUG))
-                pa_log_debug("Pool full");
-            pa_atomic_inc(&p->stat.n_pool_full);
-            return NULL;
+            if ((unsigned) idx >= n_segments * p->n_blocks) {
+
+                if (mempool_grow(p, n_segments))
+                    continue;
+
+                if (pa_log_ratelimit(PA_LOG_DEBUG))
+                    pa_log_debug("Pool full");
+                pa_atomic_inc(&p->stat.n_pool_full);
+                return NULL;
+            }
+
+            if (pa_atomic_cmpxchg(&p->n_init, idx, idx + 1))
+                break;
         }
+
+        /* Grow ahead of time, so that IO threads find room */
+        if ((unsigned) idx + 1 >= n_segments * p->n_blocks * PA_MEMPOOL_HIGH_WATER_QUARTERS / 4)
+            mempool_grow(p, n_segments);
+
+        slot = (struct mempool_slot*) ((uint8_t*) p->memory[(unsigned) idx / p->n_blocks].ptr + (p->block_size * ((unsigned) idx % p->n_blocks)));
     }
 
 /* #ifdef HAVE_VALGRIND_MEMCHECK_H */
@@ -282,30 +429,244 @@ static inline void* mempool_slot_data(struct mempool_slot *slot) {
     return slot;
 }
 
+/* No lock necessary */
+static pa_shm* mempool_slot_segment(pa_mempool *p, void *ptr) {
+    unsigned i, n;
+
+    pa_assert(p);
+
+    n = (unsigned) pa_atomic_load(&p->n_segments);
+
+    for (i = 0; i < n; i++)
+        if ((uint8_t*) ptr >= (uint8_t*) p->memory[i].ptr &&
+            (uint8_t*) ptr < (uint8_t*) p->memory[i].ptr + p->memory[i].size)
+            return &p->memory[i];
+
+    return NULL;
+}
+
 /* No lock necessary */
 static unsigned mempool_slot_idx(pa_mempool *p, void *ptr) {
+    pa_shm *memory;
+
     pa_assert(p);
+    pa_assert_se(memory = mempool_slot_segment(p, ptr));
+
+    return (unsigned) (memory - p->memory) * p->n_blocks +
+        (unsigned) ((size_t) ((uint8_t*) ptr - (uint8_t*) memory->ptr) / p->block_size);
+}
 
-    pa_assert((uint8_t*) ptr >= (uint8_t*) p->memory.ptr);
-    pa_assert((uint8_t*) ptr < (uint8_t*) p->memory.ptr + p->memory.size);
+/* No lock necessary */
+static struct mempool_slot* mempool_slot_by_idx(pa_mempool *p, unsigned idx) {
+    pa_assert(p);
+    pa_assert(idx / p->n_blocks < (unsigned) pa_atomic_load(&p->n_segments));
 
-    return (unsigned) ((size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr) / p->block_size);
+    return (struct mempool_slot*) ((uint8_t*) p->memory[idx / p->n_blocks].ptr + ((idx % p->n_blocks) * p->block_size));
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr) {
-    unsigned idx;
+static unsigned mempool_size_class(pa_mempool *p, size_t size) {
+    unsigned k;
+
+    pa_assert(p);
+    pa_assert(size <= p->block_size);
+
+    for (k = 0; k < PA_MEMPOOL_SIZE_CLASSES - 1; k++)
+        if (size <= p->size_classes[k].size)
+            break;
+
+    return k;
+}
+
+/* No lock necessary */
+static void* size_class_object(pa_mempool *p, struct mempool_size_class *c, unsigned idx) {
+    return (uint8_t*) mempool_slot_data(mempool_slot_by_idx(p, idx / c->n_per_slot)) + (idx % c->n_per_slot) * c->size;
+}
+
+/* No lock necessary */
+static unsigned size_class_object_idx(pa_mempool *p, struct mempool_size_class *c, void *object) {
+    unsigned slot_idx;
+
+    slot_idx = mempool_slot_idx(p, object);
+
+    return slot_idx * c->n_per_slot +
+        (unsigned) ((size_t) ((uint8_t*) object - (uint8_t*) mempool_slot_data(mempool_slot_by_idx(p, slot_idx))) / c->size);
+}
+
+/* No lock necessary. Lock free pop from the object stack */
+static void* size_class_pop(pa_mempool *p, struct mempool_size_class *c) {
+    void *object;
+    int idx;
+
+    do {
+        if ((idx = pa_atomic_load(&c->free_objects)) < 0)
+            return NULL;
+
+        object = size_class_object(p, c, (unsigned) (idx & c->index_mask));
+    } while (!pa_atomic_cmpxchg(&c->free_objects, idx, pa_atomic_load((pa_atomic_t*) object)));
+
+    return object;
+}
+
+/* No lock necessary. Lock free push to the object stack */
+static void size_class_push(pa_mempool *p, struct mempool_size_class *c, void *object) {
+    int tag, idx, next;
+
+    tag = pa_atomic_inc(&c->current_tag);
+    idx = (int) size_class_object_idx(p, c, object);
+    pa_assert(idx <= c->index_mask);
+    idx |= (tag << c->tag_shift) & c->tag_mask;
+
+    do {
+        next = pa_atomic_load(&c->free_objects);
+        pa_atomic_store((pa_atomic_t*) object, next);
+    } while (!pa_atomic_cmpxchg(&c->free_objects, next, idx));
+}
+
+/* Thread-local, locks the caches mutex when it binds a cache to a
+ * pool. Returns NULL if this thread's cache belongs to another pool. */
+static struct mempool_cache* mempool_cache_get(pa_mempool *p) {
+    struct mempool_cache *cache;
+    pa_mutex *m;
+
+    if (PA_LIKELY((cache = PA_STATIC_TLS_GET(mempool_cache)) && cache->pool == p))
+        return cache;
 
-    if ((idx = mempool_slot_idx(p, ptr)) == (unsigned) -1)
+    if (cache && cache->pool)
         return NULL;
 
-    return (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (idx * p->block_size));
+    m = pa_static_mutex_get(&caches_mutex, FALSE, FALSE);
+    pa_mutex_lock(m);
+
+    if (!cache) {
+        cache = pa_xnew0(struct mempool_cache, 1);
+        PA_STATIC_TLS_SET(mempool_cache, cache);
+    }
+
+    cache->pool = p;
+    PA_LLIST_PREPEND(struct mempool_cache, p->caches, cache);
+
+    pa_mutex_unlock(m);
+
+    return cache;
+}
+
+/* Should be called with the caches mutex held */
+static void mempool_cache_flush(struct mempool_cache *cache) {
+    pa_mempool *p;
+    unsigned k;
+
+    pa_assert(cache);
+    pa_assert_se(p = cache->pool);
+
+    for (k = 0; k < PA_MEMPOOL_SIZE_CLASSES; k++) {
+        while (cache->n_objects[k] > 0) {
+            void *object = cache->objects[k][--cache->n_objects[k]];
+
+            if (k == PA_MEMPOOL_SIZE_CLASSES - 1)
+                while (pa_flist_push(p->free_slots, object) < 0)
+                    ;
+            else
+                size_class_push(p, &p->size_classes[k], object);
+        }
+    }
+
+    PA_LLIST_REMOVE(struct mempool_cache, p->caches, cache);
+    cache->pool = NULL;
+}
+
+/* Called when a thread exits */
+static void mempool_cache_free(void *userdata) {
+    struct mempool_cache *cache = userdata;
+    pa_mutex *m;
+
+    pa_assert(cache);
+
+    m = pa_static_mutex_get(&caches_mutex, FALSE, FALSE);
+    pa_mutex_lock(m);
+
+    if (cache->pool)
+        mempool_cache_flush(cache);
+
+    pa_mutex_unlock(m);
+
+    pa_xfree(cache);
+}
+
+/* No lock necessary. Allocates one object of size class k */
+static void* mempool_allocate(pa_mempool *p, unsigned k) {
+    struct mempool_cache *cache;
+    struct mempool_size_class *c;
+    void *object;
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(k < PA_MEMPOOL_SIZE_CLASSES);
+
+    if ((cache = mempool_cache_get(p)) && cache->n_objects[k] > 0)
+        object = cache->objects[k][--cache->n_objects[k]];
+
+    else if (k == PA_MEMPOOL_SIZE_CLASSES - 1) {
+        if (!(object = mempool_allocate_slot(p)))
+            return NULL;
+
+    } else {
+        c = &p->size_classes[k];
+
+        if (!(object = size_class_pop(p, c))) {
+
+            /* No free objects left, split up a new slot. We keep the
+             * first object and make the others available. */
+
+            if (!(object = mempool_allocate_slot(p)))
+                return NULL;
+
+            for (i = c->n_per_slot - 1; i > 0; i--)
+                size_class_push(p, c, (uint8_t*) object + i * c->size);
+
+            pa_atomic_inc(&p->stat.n_slabs);
+        }
+    }
+
+    pa_atomic_inc(&p->stat.n_allocated_by_size_class[k]);
+
+    return object;
+}
+
+/* No lock necessary. Returns an object of size class k to the pool */
+static void mempool_free_object(pa_mempool *p, unsigned k, void *object) {
+    struct mempool_cache *cache;
+
+    pa_assert(p);
+    pa_assert(k < PA_MEMPOOL_SIZE_CLASSES);
+    pa_assert(object);
+
+    pa_atomic_dec(&p->stat.n_allocated_by_size_class[k]);
+
+/* #ifdef HAVE_VALGRIND_MEMCHECK_H */
+/*     if (PA_UNLIKELY(pa_in_valgrind())) { */
+/*         VALGRIND_FREELIKE_BLOCK(object, p->size_classes[k].size); */
+/*     } */
+/* #endif */
+
+    if ((cache = mempool_cache_get(p)) && cache->n_objects[k] < p->size_classes[k].cache_max) {
+        cache->objects[k][cache->n_objects[k]++] = object;
+        return;
+    }
+
+    if (k == PA_MEMPOOL_SIZE_CLASSES - 1) {
+        /* The free list dimensions should easily allow all slots
+         * to fit in, hence try harder if pushing this slot into
+         * the free list fails */
+        while (pa_flist_push(p->free_slots, object) < 0)
+            ;
+    } else
+        size_class_push(p, &p->size_classes[k], object);
 }
 
 /* No lock necessary */
 pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
     pa_memblock *b = NULL;
-    struct mempool_slot *slot;
     static int mempool_disable = 0;
 
     pa_assert(p);
@@ -324,24 +685,27 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
         length = pa_mempool_block_size_max(p);
 
     if (p->block_size >= PA_ALIGN(sizeof(pa_memblock)) + length) {
+        unsigned k = mempool_size_class(p, PA_ALIGN(sizeof(pa_memblock)) + length);
 
-        if (!(slot = mempool_allocate_slot(p)))
+        if (!(b = mempool_allocate(p, k)))
             return NULL;
 
-        b = mempool_slot_data(slot);
         b->type = PA_MEMBLOCK_POOL;
         pa_atomic_ptr_store(&b->data, (uint8_t*) b + PA_ALIGN(sizeof(pa_memblock)));
+        b->per_type.pool.size_class = k;
 
     } else if (p->block_size >= length) {
+        void *object;
 
-        if (!(slot = mempool_allocate_slot(p)))
+        if (!(object = mempool_allocate(p, PA_MEMPOOL_SIZE_CLASSES - 1)))
             return NULL;
 
         if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
             b = pa_xnew(pa_memblock, 1);
 
         b->type = PA_MEMBLOCK_POOL_EXTERNAL;
-        pa_atomic_ptr_store(&b->data, mempool_slot_data(slot));
+        pa_atomic_ptr_store(&b->data, object);
+        b->per_type.pool.size_class = PA_MEMPOOL_SIZE_CLASSES - 1;
 
     } else {
         pa_log_debug("Memory block too large for pool: %lu > %lu", (unsigned long) length, (unsigned long) p->block_size);
@@ -559,24 +923,16 @@ static void memblock_free(pa_memblock *b) {
 
         case PA_MEMBLOCK_POOL_EXTERNAL:
         case PA_MEMBLOCK_POOL: {
-            struct mempool_slot *slot;
+            void *object;
             pa_bool_t call_free;
 
-            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data)));
-
             call_free = b->type == PA_MEMBLOCK_POOL_EXTERNAL;
 
-/* #ifdef HAVE_VALGRIND_MEMCHECK_H */
-/*             if (PA_UNLIKELY(pa_in_valgrind())) { */
-/*                 VALGRIND_FREELIKE_BLOCK(slot, b->pool->block_size); */
-/*             } */
-/* #endif */
+            /* A pool block lives at the beginning of its own object,
+             * which is reused as soon as we give it back */
+            object = call_free ? pa_atomic_ptr_load(&b->data) : (void*) b;
 
-            /* The free list dimensions should easily allow all slots
-             * to fit in, hence try harder if pushing this slot into
-             * the free list fails */
-            while (pa_flist_push(b->pool->free_slots, slot) < 0)
-                ;
+            mempool_free_object(b->pool, b->per_type.pool.size_class, object);
 
             if (call_free)
                 if (pa_flist_push(PA_STATIC_FLIST_GET(unused_memblocks), b) < 0)
@@ -627,18 +983,18 @@ static void memblock_make_local(pa_memblock *b) {
     pa_atomic_dec(&b->pool->stat.n_allocated_by_type[b->type]);
 
     if (b->length <= b->pool->block_size) {
-        struct mempool_slot *slot;
+        unsigned k = mempool_size_class(b->pool, b->length);
+        void *new_data;
 
-        if ((slot = mempool_allocate_slot(b->pool))) {
-            void *new_data;
+        if ((new_data = mempool_allocate(b->pool, k))) {
             /* We can move it into a local pool, perfect! */
 
-            new_data = mempool_slot_data(slot);
             memcpy(new_data, pa_atomic_ptr_load(&b->data), b->length);
             pa_atomic_ptr_store(&b->data, new_data);
 
             b->type = PA_MEMBLOCK_POOL_EXTERNAL;
             b->read_only = FALSE;
+            b->per_type.pool.size_class = k;
 
             goto finish;
         }
@@ -715,8 +1071,9 @@ static void memblock_replace_import(pa_memblock *b) {
 pa_mempool* pa_mempool_new(pa_bool_t shared, size_t size) {
     pa_mempool *p;
     char t1[PA_BYTES_SNPRINT_MAX], t2[PA_BYTES_SNPRINT_MAX];
+    unsigned k;
 
-    p = pa_xnew(pa_mempool, 1);
+    p = pa_xnew0(pa_mempool, 1);
 
     p->block_size = PA_PAGE_ALIGN(PA_MEMPOOL_SLOT_SIZE);
     if (p->block_size < PA_PAGE_SIZE)
@@ -731,35 +1088,78 @@ pa_mempool* pa_mempool_new(pa_bool_t shared, size_t size) {
             p->n_blocks = 2;
     }
 
-    if (pa_shm_create_rw(&p->memory, p->n_blocks * p->block_size, shared, 0700) < 0) {
+    if (pa_shm_create_rw(&p->memory[0], p->n_blocks * p->block_size, shared, 0700) < 0) {
         pa_xfree(p);
         return NULL;
     }
 
-    pa_log_debug("Using %s memory pool with %u slots of size %s each, total size is %s, maximum usable slot size is %lu",
-                 p->memory.shared ? "shared" : "private",
+    pa_log_debug("Using %s memory pool with %u slots of size %s each, total size is %s, growing up to %u times that, maximum usable slot size is %lu",
+                 p->memory[0].shared ? "shared" : "private",
                  p->n_blocks,
                  pa_bytes_snprint(t1, sizeof(t1), (unsigned) p->block_size),
                  pa_bytes_snprint(t2, sizeof(t2), (unsigned) (p->n_blocks * p->block_size)),
+                 PA_MEMPOOL_SEGMENTS_MAX,
                  (unsigned long) pa_mempool_block_size_max(p));
 
+    pa_atomic_store(&p->n_segments, 1);
+    p->n_segments_max = PA_MEMPOOL_SEGMENTS_MAX;
+    p->thread = pa_thread_self();
+    pa_atomic_store(&p->grow_requested, 0);
+
     memset(&p->stat, 0, sizeof(p->stat));
+    pa_atomic_store(&p->stat.n_segments, 1);
     pa_atomic_store(&p->n_init, 0);
 
+    for (k = 0; k < PA_MEMPOOL_SIZE_CLASSES; k++) {
+        struct mempool_size_class *c = &p->size_classes[k];
+
+        if (k < PA_MEMPOOL_SIZE_CLASSES - 1)
+            c->size = PA_MIN((size_t) PA_MEMPOOL_OBJECT_SIZE_MIN << k, p->block_size);
+        else
+            c->size = p->block_size;
+
+        c->n_per_slot = (unsigned) (p->block_size / c->size);
+        c->cache_max = PA_CLAMP((unsigned) (PA_MEMPOOL_CACHE_BYTES / c->size), 1U, (unsigned) PA_MEMPOOL_CACHE_OBJECTS_MAX);
+
+        pa_atomic_store(&c->free_objects, -1);
+        pa_atomic_store(&c->current_tag, 0);
+
+        while (1U << c->tag_shift < p->n_blocks * PA_MEMPOOL_SEGMENTS_MAX * c->n_per_slot)
+            c->tag_shift++;
+        c->index_mask = (1 << c->tag_shift) - 1;
+        c->tag_mask = INT_MAX - c->index_mask;
+    }
+
+    PA_LLIST_HEAD_INIT(struct mempool_cache, p->caches);
+
     PA_LLIST_HEAD_INIT(pa_memimport, p->imports);
     PA_LLIST_HEAD_INIT(pa_memexport, p->exports);
 
     p->mutex = pa_mutex_new(TRUE, TRUE);
     p->semaphore = pa_semaphore_new(0);
 
-    p->free_slots = pa_flist_new(p->n_blocks);
+    p->free_slots = pa_flist_new(p->n_blocks * PA_MEMPOOL_SEGMENTS_MAX);
 
     return p;
 }
 
 void pa_mempool_free(pa_mempool *p) {
+    pa_mutex *m;
+    unsigned i;
+
     pa_assert(p);
 
+    /* The objects in the caches are simply gone with the segments */
+    m = pa_static_mutex_get(&caches_mutex, FALSE, FALSE);
+    pa_mutex_lock(m);
+
+    while (p->caches) {
+        memset(p->caches->n_objects, 0, sizeof(p->caches->n_objects));
+        mempool_cache_flush(p->caches);
+    }
+
+    pa_mutex_unlock(m);
+
     pa_mutex_lock(p->mutex);
 
     while (p->imports)
@@ -777,18 +1177,17 @@ void pa_mempool_free(pa_mempool *p) {
         /* Ouch, somebody is retaining a memory block reference! */
 
 #ifdef DEBUG_REF
-        unsigned i;
         pa_flist *list;
 
         /* Let's try to find at least one of those leaked memory blocks */
 
-        list = pa_flist_new(p->n_blocks);
+        list = pa_flist_new(p->n_blocks * PA_MEMPOOL_SEGMENTS_MAX);
 
         for (i = 0; i < (unsigned) pa_atomic_load(&p->n_init); i++) {
             struct mempool_slot *slot;
             pa_memblock *b, *k;
 
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) i));
+            slot = mempool_slot_by_idx(p, i);
             b = mempool_slot_data(slot);
 
             while ((k = pa_flist_pop(p->free_slots))) {
@@ -816,7 +1215,8 @@ void pa_mempool_free(pa_mempool *p) {
 /*         PA_DEBUG_TRAP; */
     }
 
-    pa_shm_free(&p->memory);
+    for (i = 0; i < (unsigned) pa_atomic_load(&p->n_segments); i++)
+        pa_shm_free(&p->memory[i]);
 
     pa_mutex_free(p->mutex);
     pa_semaphore_free(p->semaphore);
@@ -839,20 +1239,48 @@ size_t pa_mempool_block_size_max(pa_mempool *p) {
 }
 
 /* No lock necessary */
+size_t pa_mempool_get_size_class(pa_mempool *p, unsigned k) {
+    pa_assert(p);
+    pa_assert(k < PA_MEMPOOL_SIZE_CLASSES);
+
+    return p->size_classes[k].size;
+}
+
+/* No lock necessary */
+size_t pa_mempool_block_size_fit(pa_mempool *p, size_t length) {
+    pa_assert(p);
+
+    if (p->block_size >= PA_ALIGN(sizeof(pa_memblock)) + length)
+        return p->size_classes[mempool_size_class(p, PA_ALIGN(sizeof(pa_memblock)) + length)].size - PA_ALIGN(sizeof(pa_memblock));
+
+    if (p->block_size >= length)
+        return p->block_size;
+
+    return length;
+}
+
+/* No lock necessary. Only the whole slots on the free list of the
+ * pool are given back to the OS: free objects of the smaller size
+ * classes and anything sitting in the caches of other threads stay
+ * mapped, since those are in use by, or may be touched by, other
+ * threads without locking. */
 void pa_mempool_vacuum(pa_mempool *p) {
     struct mempool_slot *slot;
     pa_flist *list;
 
     pa_assert(p);
 
-    list = pa_flist_new(p->n_blocks);
+    list = pa_flist_new(p->n_blocks * PA_MEMPOOL_SEGMENTS_MAX);
 
     while ((slot = pa_flist_pop(p->free_slots)))
         while (pa_flist_push(list, slot) < 0)
             ;
 
     while ((slot = pa_flist_pop(list))) {
-        pa_shm_punch(&p->memory, (size_t) ((uint8_t*) slot - (uint8_t*) p->memory.ptr), p->block_size);
+        pa_shm *memory;
+
+        pa_assert_se(memory = mempool_slot_segment(p, slot));
+        pa_shm_punch(memory, (size_t) ((uint8_t*) slot - (uint8_t*) memory->ptr), p->block_size);
 
         while (pa_flist_push(p->free_slots, slot))
             ;
@@ -865,10 +1293,10 @@ void pa_mempool_vacuum(pa_mempool *p) {
 int pa_mempool_get_shm_id(pa_mempool *p, uint32_t *id) {
     pa_assert(p);
 
-    if (!p->memory.shared)
+    if (!p->memory[0].shared)
         return -1;
 
-    *id = p->memory.id;
+    *id = p->memory[0].id;
 
     return 0;
 }
@@ -877,7 +1305,7 @@ int pa_mempool_get_shm_id(pa_mempool *p, uint32_t *id) {
 pa_bool_t pa_mempool_is_shared(pa_mempool *p) {
     pa_assert(p);
 
-    return !!p->memory.shared;
+    return !!p->memory[0].shared;
 }
 
 /* For receiving blocks from other nodes */
@@ -1050,7 +1478,7 @@ pa_memexport* pa_memexport_new(pa_mempool *p, pa_memexport_revoke_cb_t cb, void
     pa_assert(p);
     pa_assert(cb);
 
-    if (!p->memory.shared)
+    if (!p->memory[0].shared)
         return NULL;
 
     e = pa_xnew(pa_memexport, 1);
@@ -1214,7 +1642,7 @@ int pa_memexport_put(pa_memexport *e, pa_memblock *b, uint32_t *block_id, uint32
     } else {
         pa_assert(b->type == PA_MEMBLOCK_POOL || b->type == PA_MEMBLOCK_POOL_EXTERNAL);
         pa_assert(b->pool);
-        memory = &b->pool->memory;
+        pa_assert_se(memory = mempool_slot_segment(b->pool, data));
     }
 
     pa_assert(data >= memory->ptr);
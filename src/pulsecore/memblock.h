@@ -48,6 +48,11 @@ typedef enum pa_memblock_type {
     PA_MEMBLOCK_TYPE_MAX
 } pa_memblock_type_t;
 
+/* Pool memory is handed out in objects of a few fixed sizes: the
+ * smallest size class is 2 KiB, each following one twice as large,
+ * and the last one is a whole slot of the pool. */
+#define PA_MEMPOOL_SIZE_CLASSES 5
+
 typedef struct pa_mempool pa_mempool;
 typedef struct pa_mempool_stat pa_mempool_stat;
 typedef struct pa_memimport_segment pa_memimport_segment;
@@ -74,6 +79,10 @@ struct pa_mempool_stat {
     pa_atomic_t n_too_large_for_pool;
     pa_atomic_t n_pool_full;
 
+    pa_atomic_t n_segments;    /* SHM segments the pool has grown to */
+    pa_atomic_t n_slabs;       /* Slots split up for small blocks */
+    pa_atomic_t n_allocated_by_size_class[PA_MEMPOOL_SIZE_CLASSES];
+
     pa_atomic_t n_allocated_by_type[PA_MEMBLOCK_TYPE_MAX];
     pa_atomic_t n_accumulated_by_type[PA_MEMBLOCK_TYPE_MAX];
 };
@@ -118,7 +127,13 @@ pa_mempool * pa_memblock_get_pool(pa_memblock *b);
 
 pa_memblock *pa_memblock_will_need(pa_memblock *b);
 
-/* The memory block manager */
+/* The memory block manager. size is the size of the initial SHM
+ * segment, 0 for the default. When the pool runs full it grows by
+ * further segments of the same size. Those are only created from the
+ * thread that created the pool, allocations from other threads fall
+ * back to pa_memblock_new()'s heap blocks until then.
+ * pa_mempool_vacuum() only releases unused whole slots, not memory
+ * that has been split up for small blocks. */
 pa_mempool* pa_mempool_new(pa_bool_t shared, size_t size);
 void pa_mempool_free(pa_mempool *p);
 const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p);
@@ -126,6 +141,10 @@ void pa_mempool_vacuum(pa_mempool *p);
 int pa_mempool_get_shm_id(pa_mempool *p, uint32_t *id);
 pa_bool_t pa_mempool_is_shared(pa_mempool *p);
 size_t pa_mempool_block_size_max(pa_mempool *p);
+size_t pa_mempool_get_size_class(pa_mempool *p, unsigned k);
+/* Returns length rounded up to what a pool block of that length can
+ * hold anyway, i.e. to its size class */
+size_t pa_mempool_block_size_fit(pa_mempool *p, size_t length);
 
 /* For receiving blocks from other nodes */
 pa_memimport* pa_memimport_new(pa_mempool *p, pa_memimport_release_cb_t cb, void *userdata);
@@ -43,8 +43,13 @@ pa_memchunk* pa_memchunk_make_writable(pa_memchunk *c, size_t min) {
 
     if (pa_memblock_ref_is_one(c->memblock) &&
         !pa_memblock_is_read_only(c->memblock) &&
-        pa_memblock_get_length(c->memblock) >= c->index+min)
+        pa_memblock_get_length(c->memblock) >= c->index+min) {
+
+        /* The caller is going to modify the block, so we can no
+         * longer vouch for it being silence */
+        pa_memblock_set_is_silence(c->memblock, FALSE);
         return c;
+    }
 
     l = PA_MAX(c->length, min);
 
@@ -0,0 +1,229 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-x86.h"
+
+#include "sample-util.h"
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS)
+
+#include <immintrin.h>
+
+/* AVX2 versions of the mixers in mix_sse.c, twice as wide. Results
+ * are identical to the generic code, which is why the float mixer
+ * doesn't use FMA. */
+
+static inline __attribute__((target("avx2"))) __m256i sra_epi64_16(__m256i v) {
+    __m256i sign = _mm256_cmpgt_epi64(_mm256_setzero_si256(), v);
+
+    return _mm256_xor_si256(_mm256_srli_epi64(_mm256_xor_si256(v, sign), 16), sign);
+}
+
+static inline __attribute__((target("avx2"))) __m256i clamp_epi64_s32(__m256i v) {
+    const __m256i max = _mm256_set1_epi64x(0x7FFFFFFFLL);
+    const __m256i min = _mm256_set1_epi64x(-0x80000000LL);
+
+    v = _mm256_blendv_epi8(v, max, _mm256_cmpgt_epi64(v, max));
+    return _mm256_blendv_epi8(v, min, _mm256_cmpgt_epi64(min, v));
+}
+
+static __attribute__((target("avx2"))) void pa_mix_s16ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    int16_t *d = data;
+    unsigned n = length / sizeof(int16_t);
+    unsigned channel = 0, i;
+
+    for (; n >= 16; n -= 16, d += 16) {
+        __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            __m256i v0, v1, cv0, cv1, hi0, hi1, lo0, lo1;
+
+            v0 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) m->ptr));
+            v1 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) m->ptr + 1));
+
+            cv0 = _mm256_loadu_si256((const __m256i *) &m->linear[channel].i);
+            cv1 = _mm256_loadu_si256((const __m256i *) &m->linear[channel + 8].i);
+
+            hi0 = _mm256_srai_epi32(cv0, 16);
+            hi1 = _mm256_srai_epi32(cv1, 16);
+            lo0 = _mm256_and_si256(cv0, _mm256_set1_epi32(0xFFFF));
+            lo1 = _mm256_and_si256(cv1, _mm256_set1_epi32(0xFFFF));
+
+            sum0 = _mm256_add_epi32(sum0, _mm256_add_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(v0, lo0), 16), _mm256_mullo_epi32(v0, hi0)));
+            sum1 = _mm256_add_epi32(sum1, _mm256_add_epi32(_mm256_srai_epi32(_mm256_mullo_epi32(v1, lo1), 16), _mm256_mullo_epi32(v1, hi1)));
+
+            m->ptr = (uint8_t*) m->ptr + 16 * sizeof(int16_t);
+        }
+
+        /* The pack works within 128 bit lanes, put the quadwords back
+         * in order afterwards */
+        _mm256_storeu_si256((__m256i *) d, _mm256_permute4x64_epi64(_mm256_packs_epi32(sum0, sum1), 0xD8));
+
+        channel = (channel + 16) % channels;
+    }
+
+    for (; n > 0; n--, d++) {
+        int32_t sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t v, cv = m->linear[channel].i;
+
+            v = *((int16_t*) m->ptr);
+            sum += ((v * (cv & 0xFFFF)) >> 16) + (v * (cv >> 16));
+            m->ptr = (uint8_t*) m->ptr + sizeof(int16_t);
+        }
+
+        *d = (int16_t) PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static inline __attribute__((target("avx2"))) void mix_s32_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length, const int s24) {
+    uint32_t *d = data;
+    unsigned n = length / sizeof(int32_t);
+    unsigned channel = 0, i;
+
+    for (; n >= 8; n -= 8, d += 8) {
+        __m256i even = _mm256_setzero_si256(), odd = _mm256_setzero_si256(), r;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            __m256i v, cv;
+
+            v = _mm256_loadu_si256((const __m256i *) m->ptr);
+            if (s24)
+                v = _mm256_slli_epi32(v, 8);
+
+            cv = _mm256_loadu_si256((const __m256i *) &m->linear[channel].i);
+
+            even = _mm256_add_epi64(even, sra_epi64_16(_mm256_mul_epi32(v, cv)));
+            odd = _mm256_add_epi64(odd, sra_epi64_16(_mm256_mul_epi32(_mm256_srli_epi64(v, 32), _mm256_srli_epi64(cv, 32))));
+
+            m->ptr = (uint8_t*) m->ptr + 8 * sizeof(int32_t);
+        }
+
+        even = clamp_epi64_s32(even);
+        odd = clamp_epi64_s32(odd);
+
+        r = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+        if (s24)
+            r = _mm256_srli_epi32(r, 8);
+
+        _mm256_storeu_si256((__m256i *) d, r);
+
+        channel = (channel + 8) % channels;
+    }
+
+    for (; n > 0; n--, d++) {
+        int64_t sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int64_t v;
+
+            if (s24)
+                v = (int32_t) (*((uint32_t*) m->ptr) << 8);
+            else
+                v = *((int32_t*) m->ptr);
+
+            sum += (v * m->linear[channel].i) >> 16;
+            m->ptr = (uint8_t*) m->ptr + sizeof(int32_t);
+        }
+
+        sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+        *d = s24 ? ((uint32_t) (int32_t) sum) >> 8 : (uint32_t) (int32_t) sum;
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static __attribute__((target("avx2"))) void pa_mix_s32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    mix_s32_avx2(streams, nstreams, channels, data, length, 0);
+}
+
+static __attribute__((target("avx2"))) void pa_mix_s24_32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    mix_s32_avx2(streams, nstreams, channels, data, length, 1);
+}
+
+static __attribute__((target("avx2"))) void pa_mix_float32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    float *d = data;
+    unsigned n = length / sizeof(float);
+    unsigned channel = 0, i;
+
+    for (; n >= 8; n -= 8, d += 8) {
+        __m256 sum = _mm256_setzero_ps();
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            __m256 cv = _mm256_loadu_ps(&m->linear[channel].f);
+
+            sum = _mm256_add_ps(sum, _mm256_and_ps(_mm256_mul_ps(_mm256_loadu_ps((const float *) m->ptr), cv), _mm256_cmp_ps(cv, _mm256_setzero_ps(), _CMP_GT_OQ)));
+            m->ptr = (uint8_t*) m->ptr + 8 * sizeof(float);
+        }
+
+        _mm256_storeu_ps(d, sum);
+
+        channel = (channel + 8) % channels;
+    }
+
+    for (; n > 0; n--, d++) {
+        float sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            float cv = m->linear[channel].f;
+
+            if (PA_LIKELY(cv > 0))
+                sum += *((float*) m->ptr) * cv;
+            m->ptr = (uint8_t*) m->ptr + sizeof(float);
+        }
+
+        *d = sum;
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS) */
+
+void pa_mix_func_init_avx(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS)
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized mixing functions.");
+
+        pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) pa_mix_s16ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_S32NE, (pa_do_mix_func_t) pa_mix_s32ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_S24_32NE, (pa_do_mix_func_t) pa_mix_s24_32ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) pa_mix_float32ne_avx2);
+    }
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS) */
+}
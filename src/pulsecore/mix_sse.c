@@ -0,0 +1,249 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-x86.h"
+
+#include "sample-util.h"
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS)
+
+#include <immintrin.h>
+
+/* All of these produce exactly the same results as the generic
+ * mixers in sample-util.c. The volumes are loaded for several
+ * consecutive samples at once, relying on the padding pa_mix() adds
+ * after the last channel. */
+
+/* Arithmetic right shift of two 64 bit values */
+static inline __attribute__((target("sse4.2"))) __m128i sra_epi64_16(__m128i v) {
+    __m128i sign = _mm_cmpgt_epi64(_mm_setzero_si128(), v);
+
+    return _mm_xor_si128(_mm_srli_epi64(_mm_xor_si128(v, sign), 16), sign);
+}
+
+/* Saturate two 64 bit values to the 32 bit range */
+static inline __attribute__((target("sse4.2"))) __m128i clamp_epi64_s32(__m128i v) {
+    const __m128i max = _mm_set1_epi64x(0x7FFFFFFFLL);
+    const __m128i min = _mm_set1_epi64x(-0x80000000LL);
+
+    v = _mm_blendv_epi8(v, max, _mm_cmpgt_epi64(v, max));
+    return _mm_blendv_epi8(v, min, _mm_cmpgt_epi64(min, v));
+}
+
+static __attribute__((target("sse4.1"))) void pa_mix_s16ne_sse4(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    int16_t *d = data;
+    unsigned n = length / sizeof(int16_t);
+    unsigned channel = 0, i;
+
+    for (; n >= 8; n -= 8, d += 8) {
+        __m128i sum0 = _mm_setzero_si128(), sum1 = _mm_setzero_si128();
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            __m128i s, v0, v1, cv0, cv1, hi0, hi1, lo0, lo1;
+
+            s = _mm_loadu_si128((const __m128i *) m->ptr);
+            v0 = _mm_cvtepi16_epi32(s);
+            v1 = _mm_cvtepi16_epi32(_mm_srli_si128(s, 8));
+
+            cv0 = _mm_loadu_si128((const __m128i *) &m->linear[channel].i);
+            cv1 = _mm_loadu_si128((const __m128i *) &m->linear[channel + 4].i);
+
+            /* Same as the generic code: ((v * lo) >> 16) + (v * hi) */
+            hi0 = _mm_srai_epi32(cv0, 16);
+            hi1 = _mm_srai_epi32(cv1, 16);
+            lo0 = _mm_and_si128(cv0, _mm_set1_epi32(0xFFFF));
+            lo1 = _mm_and_si128(cv1, _mm_set1_epi32(0xFFFF));
+
+            sum0 = _mm_add_epi32(sum0, _mm_add_epi32(_mm_srai_epi32(_mm_mullo_epi32(v0, lo0), 16), _mm_mullo_epi32(v0, hi0)));
+            sum1 = _mm_add_epi32(sum1, _mm_add_epi32(_mm_srai_epi32(_mm_mullo_epi32(v1, lo1), 16), _mm_mullo_epi32(v1, hi1)));
+
+            m->ptr = (uint8_t*) m->ptr + 8 * sizeof(int16_t);
+        }
+
+        /* Packing saturates, which is the clamping we need */
+        _mm_storeu_si128((__m128i *) d, _mm_packs_epi32(sum0, sum1));
+
+        channel = (channel + 8) % channels;
+    }
+
+    for (; n > 0; n--, d++) {
+        int32_t sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int32_t v, cv = m->linear[channel].i;
+
+            v = *((int16_t*) m->ptr);
+            sum += ((v * (cv & 0xFFFF)) >> 16) + (v * (cv >> 16));
+            m->ptr = (uint8_t*) m->ptr + sizeof(int16_t);
+        }
+
+        *d = (int16_t) PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+/* Shared by S32NE and S24_32NE, the latter is just S32NE shifted by 8 bits */
+static inline __attribute__((target("sse4.2"))) void mix_s32_sse4(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length, const int s24) {
+    uint32_t *d = data;
+    unsigned n = length / sizeof(int32_t);
+    unsigned channel = 0, i;
+
+    for (; n >= 4; n -= 4, d += 4) {
+        __m128i even = _mm_setzero_si128(), odd = _mm_setzero_si128(), r;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            __m128i v, cv;
+
+            v = _mm_loadu_si128((const __m128i *) m->ptr);
+            if (s24)
+                v = _mm_slli_epi32(v, 8);
+
+            cv = _mm_loadu_si128((const __m128i *) &m->linear[channel].i);
+
+            /* (v * cv) >> 16 in 64 bit, for the even and odd samples separately */
+            even = _mm_add_epi64(even, sra_epi64_16(_mm_mul_epi32(v, cv)));
+            odd = _mm_add_epi64(odd, sra_epi64_16(_mm_mul_epi32(_mm_srli_epi64(v, 32), _mm_srli_epi64(cv, 32))));
+
+            m->ptr = (uint8_t*) m->ptr + 4 * sizeof(int32_t);
+        }
+
+        even = clamp_epi64_s32(even);
+        odd = clamp_epi64_s32(odd);
+
+        /* Interleave the low halves back into one vector */
+        r = _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xCC);
+        if (s24)
+            r = _mm_srli_epi32(r, 8);
+
+        _mm_storeu_si128((__m128i *) d, r);
+
+        channel = (channel + 4) % channels;
+    }
+
+    for (; n > 0; n--, d++) {
+        int64_t sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            int64_t v;
+
+            if (s24)
+                v = (int32_t) (*((uint32_t*) m->ptr) << 8);
+            else
+                v = *((int32_t*) m->ptr);
+
+            sum += (v * m->linear[channel].i) >> 16;
+            m->ptr = (uint8_t*) m->ptr + sizeof(int32_t);
+        }
+
+        sum = PA_CLAMP_UNLIKELY(sum, -0x80000000LL, 0x7FFFFFFFLL);
+        *d = s24 ? ((uint32_t) (int32_t) sum) >> 8 : (uint32_t) (int32_t) sum;
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+static __attribute__((target("sse4.2"))) void pa_mix_s32ne_sse4(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    mix_s32_sse4(streams, nstreams, channels, data, length, 0);
+}
+
+static __attribute__((target("sse4.2"))) void pa_mix_s24_32ne_sse4(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    mix_s32_sse4(streams, nstreams, channels, data, length, 1);
+}
+
+static __attribute__((target("sse2"))) void pa_mix_float32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length) {
+    float *d = data;
+    unsigned n = length / sizeof(float);
+    unsigned channel = 0, i;
+
+    for (; n >= 4; n -= 4, d += 4) {
+        __m128 sum = _mm_setzero_ps();
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+
+            __m128 cv = _mm_loadu_ps(&m->linear[channel].f);
+
+            /* Streams at zero volume are skipped, even if they contain NaNs */
+            sum = _mm_add_ps(sum, _mm_and_ps(_mm_mul_ps(_mm_loadu_ps((const float *) m->ptr), cv), _mm_cmpgt_ps(cv, _mm_setzero_ps())));
+            m->ptr = (uint8_t*) m->ptr + 4 * sizeof(float);
+        }
+
+        _mm_storeu_ps(d, sum);
+
+        channel = (channel + 4) % channels;
+    }
+
+    for (; n > 0; n--, d++) {
+        float sum = 0;
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+
+            float cv = m->linear[channel].f;
+
+            if (PA_LIKELY(cv > 0))
+                sum += *((float*) m->ptr) * cv;
+            m->ptr = (uint8_t*) m->ptr + sizeof(float);
+        }
+
+        *d = sum;
+
+        if (PA_UNLIKELY(++channel >= channels))
+            channel = 0;
+    }
+}
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS) */
+
+void pa_mix_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS)
+    if (flags & PA_CPU_X86_SSE2) {
+        pa_log_info("Initialising SSE2 optimized mixing functions.");
+
+        pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) pa_mix_float32ne_sse2);
+    }
+
+    if (flags & PA_CPU_X86_SSE4_1) {
+        pa_log_info("Initialising SSE4.1 optimized mixing functions.");
+
+        pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) pa_mix_s16ne_sse4);
+    }
+
+    if (flags & PA_CPU_X86_SSE4_2) {
+        pa_log_info("Initialising SSE4.2 optimized mixing functions.");
+
+        pa_set_mix_func(PA_SAMPLE_S32NE, (pa_do_mix_func_t) pa_mix_s32ne_sse4);
+        pa_set_mix_func(PA_SAMPLE_S24_32NE, (pa_do_mix_func_t) pa_mix_s24_32ne_sse4);
+    }
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS) */
+}
@@ -27,9 +27,13 @@
 
 #include <pulse/xmalloc.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/flist.h>
 
 #include "packet.h"
 
+PA_STATIC_FLIST_DECLARE(packets, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(buffers, 0, pa_xfree);
+
 pa_packet* pa_packet_new(size_t length) {
     pa_packet *p;
 
@@ -37,7 +41,7 @@ pa_packet* pa_packet_new(size_t length) {
 
     p = pa_xmalloc(PA_ALIGN(sizeof(pa_packet)) + length);
     PA_REFCNT_INIT(p);
-    p->length = length;
+    p->length = p->allocated = length;
     p->data = (uint8_t*) p + PA_ALIGN(sizeof(pa_packet));
     p->type = PA_PACKET_APPENDED;
 
@@ -45,20 +49,45 @@ pa_packet* pa_packet_new(size_t length) {
 }
 
 pa_packet* pa_packet_new_dynamic(void* data, size_t length) {
+    return pa_packet_new_buffer(data, length, 0);
+}
+
+pa_packet* pa_packet_new_buffer(void *data, size_t length, size_t allocated) {
     pa_packet *p;
 
     pa_assert(data);
     pa_assert(length > 0);
+    pa_assert(allocated == 0 || length <= allocated);
+
+    if (!(p = pa_flist_pop(PA_STATIC_FLIST_GET(packets))))
+        p = pa_xnew(pa_packet, 1);
 
-    p = pa_xnew(pa_packet, 1);
     PA_REFCNT_INIT(p);
     p->length = length;
+    p->allocated = allocated;
     p->data = data;
     p->type = PA_PACKET_DYNAMIC;
 
     return p;
 }
 
+void* pa_packet_buffer_new(void) {
+    void *b;
+
+    if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(buffers))))
+        b = pa_xmalloc(PA_PACKET_BUFFER_SIZE);
+
+    return b;
+}
+
+void pa_packet_buffer_free(void *data, size_t allocated) {
+    pa_assert(data);
+
+    if (allocated != PA_PACKET_BUFFER_SIZE ||
+        pa_flist_push(PA_STATIC_FLIST_GET(buffers), data) < 0)
+        pa_xfree(data);
+}
+
 pa_packet* pa_packet_ref(pa_packet *p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) >= 1);
@@ -72,8 +101,12 @@ void pa_packet_unref(pa_packet *p) {
     pa_assert(PA_REFCNT_VALUE(p) >= 1);
 
     if (PA_REFCNT_DEC(p) <= 0) {
-        if (p->type == PA_PACKET_DYNAMIC)
-            pa_xfree(p->data);
-        pa_xfree(p);
+        if (p->type == PA_PACKET_DYNAMIC) {
+            pa_packet_buffer_free(p->data, p->allocated);
+
+            if (pa_flist_push(PA_STATIC_FLIST_GET(packets), p) < 0)
+                pa_xfree(p);
+        } else
+            pa_xfree(p);
     }
 }
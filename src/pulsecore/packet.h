@@ -27,16 +27,31 @@
 
 #include <pulsecore/refcnt.h>
 
+/* Data buffers of this size are recycled when packets are freed */
+#define PA_PACKET_BUFFER_SIZE 1024
+
 typedef struct pa_packet {
     PA_REFCNT_DECLARE;
     enum { PA_PACKET_APPENDED, PA_PACKET_DYNAMIC } type;
-    size_t length;
+    size_t length, allocated;
     uint8_t *data;
 } pa_packet;
 
 pa_packet* pa_packet_new(size_t length);
 pa_packet* pa_packet_new_dynamic(void* data, size_t length);
 
+/* Like pa_packet_new_dynamic(), allocated is the size of the buffer,
+ * which is passed on to pa_packet_buffer_free() eventually */
+pa_packet* pa_packet_new_buffer(void *data, size_t length, size_t allocated);
+
+/* Returns a buffer of PA_PACKET_BUFFER_SIZE bytes allocated with
+ * pa_xmalloc(), from the free list if possible */
+void* pa_packet_buffer_new(void);
+
+/* Frees a buffer allocated with pa_xmalloc(), or puts it back on the
+ * free list if it has the right size */
+void pa_packet_buffer_free(void *data, size_t allocated);
+
 pa_packet* pa_packet_ref(pa_packet *p);
 void pa_packet_unref(pa_packet *p);
 
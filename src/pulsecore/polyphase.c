@@ -0,0 +1,244 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/mutex.h>
+
+#include "polyphase.h"
+
+/* Rate pairs whose exact table would have more coefficients than this
+ * get an interpolated one instead */
+#define EXACT_COEFS_MAX (256*1024)
+
+/* Rows of interpolated tables per input frame */
+#define INTERPOLATE_PHASES 256
+
+/* Interpolated tables for downsampling are shared between all ratios
+ * that round to the same multiple of 1/CUTOFF_STEPS */
+#define CUTOFF_STEPS 4096
+
+#define TAPS_MAX 1024
+
+/* Same lengths and cutoffs as the speex qualities, so that the two
+ * can be compared level by level */
+static const struct {
+    unsigned taps;
+    double rolloff;
+    double beta; /* of the Kaiser window */
+} quality_map[PA_POLYPHASE_QUALITY_MAX + 1] = {
+    {   8, 0.831,  5.0 },
+    {  16, 0.850,  5.0 },
+    {  32, 0.882,  6.0 },
+    {  48, 0.895,  6.0 },
+    {  64, 0.911,  8.0 },
+    {  80, 0.922,  8.0 },
+    {  96, 0.940,  8.0 },
+    { 128, 0.950, 10.0 },
+    { 160, 0.960, 10.0 },
+    { 192, 0.970, 12.0 },
+    { 256, 0.975, 12.0 }
+};
+
+static pa_static_mutex mutex = PA_STATIC_MUTEX_INIT;
+static PA_LLIST_HEAD(pa_polyphase_filter, filters) = NULL;
+
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    unsigned k;
+
+    for (k = 1; k < 100; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+
+        if (term < sum * 1e-12)
+            break;
+    }
+
+    return sum;
+}
+
+static double kaiser(double x, double beta) {
+    if (x <= -1.0 || x >= 1.0)
+        return 0.0;
+
+    return bessel_i0(beta * sqrt(1.0 - x * x)) / bessel_i0(beta);
+}
+
+static double sinc(double x) {
+    if (fabs(x) < 1e-9)
+        return 1.0;
+
+    return sin(M_PI * x) / (M_PI * x);
+}
+
+/* Downsampling needs a lower cutoff, and a longer filter to keep the
+ * same steepness */
+static unsigned get_taps(unsigned quality, double factor) {
+    unsigned taps;
+
+    taps = (unsigned) ceil(quality_map[quality].taps / factor);
+    taps = PA_ROUND_UP(taps, 8);
+
+    return PA_MIN(taps, (unsigned) TAPS_MAX);
+}
+
+static pa_polyphase_filter* filter_new(uint32_t num, uint32_t den, unsigned quality, double factor, pa_bool_t interpolate, unsigned n_phases) {
+    pa_polyphase_filter *f;
+    double cutoff, beta, half;
+    unsigned p, j, n_rows;
+
+    f = pa_xnew0(pa_polyphase_filter, 1);
+    PA_REFCNT_INIT(f);
+    f->num = num;
+    f->den = den;
+    f->quality = quality;
+    f->taps = get_taps(quality, factor);
+    f->interpolate = interpolate;
+    f->n_phases = n_phases;
+
+    n_rows = interpolate ? n_phases + 1 : n_phases;
+    f->coefs = pa_xnew(float, n_rows * f->taps);
+
+    cutoff = quality_map[quality].rolloff * factor;
+    beta = quality_map[quality].beta;
+    half = f->taps / 2;
+
+    for (p = 0; p < n_rows; p++)
+        for (j = 0; j < f->taps; j++) {
+            double t = (double) j - (half - 1.0) - (double) p / n_phases;
+
+            f->coefs[p * f->taps + j] = (float) (cutoff * sinc(cutoff * t) * kaiser(t / half, beta));
+        }
+
+    pa_log_debug("Built %s polyphase filter for %u/%u, quality %u: %u phases of %u taps.",
+                 interpolate ? "interpolated" : "exact", num, den, quality, n_phases, f->taps);
+
+    return f;
+}
+
+static void filter_free(pa_polyphase_filter *f) {
+    pa_assert(f);
+
+    pa_xfree(f->coefs);
+    pa_xfree(f);
+}
+
+pa_polyphase_filter* pa_polyphase_filter_get(uint32_t i_rate, uint32_t o_rate, unsigned quality, pa_bool_t interpolate) {
+    pa_polyphase_filter *f;
+    pa_mutex *m;
+    uint32_t num, den, g;
+    double factor;
+    unsigned n_phases;
+
+    pa_assert(i_rate > 0);
+    pa_assert(o_rate > 0);
+    pa_assert(quality <= PA_POLYPHASE_QUALITY_MAX);
+
+    g = pa_gcd(i_rate, o_rate);
+    num = o_rate / g;
+    den = i_rate / g;
+    factor = num < den ? (double) num / den : 1.0;
+
+    if (!interpolate && (uint64_t) num * get_taps(quality, factor) <= EXACT_COEFS_MAX)
+        n_phases = num;
+    else {
+        /* The table only depends on the cutoff then, not on the exact
+         * ratio */
+        interpolate = TRUE;
+        n_phases = INTERPOLATE_PHASES;
+
+        den = num < den ? PA_MAX((uint32_t) lrint(factor * CUTOFF_STEPS), 1U) : CUTOFF_STEPS;
+        num = 0;
+        factor = (double) den / CUTOFF_STEPS;
+    }
+
+    m = pa_static_mutex_get(&mutex, FALSE, FALSE);
+    pa_mutex_lock(m);
+
+    PA_LLIST_FOREACH(f, filters)
+        if (f->num == num && f->den == den && f->quality == quality) {
+            PA_REFCNT_INC(f);
+            goto finish;
+        }
+
+    f = filter_new(num, den, quality, factor, interpolate, n_phases);
+    PA_LLIST_PREPEND(pa_polyphase_filter, filters, f);
+
+finish:
+    pa_mutex_unlock(m);
+
+    return f;
+}
+
+void pa_polyphase_filter_unref(pa_polyphase_filter *f) {
+    pa_mutex *m;
+
+    pa_assert(f);
+    pa_assert(PA_REFCNT_VALUE(f) >= 1);
+
+    /* Under the lock, so that nobody picks it up from the cache
+     * while it goes away */
+    m = pa_static_mutex_get(&mutex, FALSE, FALSE);
+    pa_mutex_lock(m);
+
+    if (PA_REFCNT_DEC(f) <= 0) {
+        PA_LLIST_REMOVE(pa_polyphase_filter, filters, f);
+        filter_free(f);
+    }
+
+    pa_mutex_unlock(m);
+}
+
+static void dot_c(float *dst, const float *x, unsigned stride, unsigned channels, const float *h, unsigned n) {
+    unsigned c, i;
+
+    for (c = 0; c < channels; c++, x += stride) {
+        float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+        for (i = 0; i < n; i += 4) {
+            s0 += x[i] * h[i];
+            s1 += x[i + 1] * h[i + 1];
+            s2 += x[i + 2] * h[i + 2];
+            s3 += x[i + 3] * h[i + 3];
+        }
+
+        dst[c] = (s0 + s1) + (s2 + s3);
+    }
+}
+
+static pa_polyphase_dot_func_t dot_func = dot_c;
+
+pa_polyphase_dot_func_t pa_get_polyphase_dot_func(void) {
+    return dot_func;
+}
+
+void pa_set_polyphase_dot_func(pa_polyphase_dot_func_t func) {
+    pa_assert(func);
+
+    dot_func = func;
+}
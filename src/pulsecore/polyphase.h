@@ -0,0 +1,79 @@
+#ifndef foopulsepolyphasehfoo
+#define foopulsepolyphasehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/refcnt.h>
+
+/* Filter banks for the polyphase resampler. They only depend on the
+ * rate pair and the quality, so all resamplers converting between
+ * the same rates share one, which is kept in a process wide cache
+ * for as long as anybody uses it. The tables are never changed once
+ * built, hence can be used from any thread without locking. */
+
+#define PA_POLYPHASE_QUALITY_MAX 10
+
+typedef struct pa_polyphase_filter pa_polyphase_filter;
+
+struct pa_polyphase_filter {
+    PA_REFCNT_DECLARE;
+
+    /* The cache key, see pa_polyphase_filter_get() */
+    uint32_t num, den;
+    unsigned quality;
+
+    /* Coefficients per phase, always a multiple of 8 */
+    unsigned taps;
+
+    /* If TRUE the rows sample the filter at n_phases points per input
+     * frame and the resampler interpolates between two of them, there
+     * is an extra row at the end for that. Otherwise there is an exact
+     * row for every output phase of the rate pair. */
+    pa_bool_t interpolate;
+    unsigned n_phases;
+
+    /* Row i holds the filter for an output at i/n_phases of an input
+     * frame after the center tap, which is tap taps/2-1 */
+    float *coefs;
+
+    PA_LLIST_FIELDS(pa_polyphase_filter);
+};
+
+/* Returns the shared filter for resampling from i_rate to o_rate at
+ * the given quality, building it if needed. With interpolate set the
+ * filter is always an interpolated one, which works for any rate pair
+ * with the same cutoff, so that the rates can be changed later on
+ * without needing another table. */
+pa_polyphase_filter* pa_polyphase_filter_get(uint32_t i_rate, uint32_t o_rate, unsigned quality, pa_bool_t interpolate);
+void pa_polyphase_filter_unref(pa_polyphase_filter *f);
+
+/* Inner loop of the resampler, stores the dot product of h and
+ * x + c * stride in dst[c], for all channels. n is a multiple of 8,
+ * nothing needs to be aligned. */
+typedef void (*pa_polyphase_dot_func_t) (float *dst, const float *x, unsigned stride, unsigned channels, const float *h, unsigned n);
+
+pa_polyphase_dot_func_t pa_get_polyphase_dot_func(void);
+void pa_set_polyphase_dot_func(pa_polyphase_dot_func_t func);
+
+#endif
@@ -0,0 +1,93 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-arm.h"
+
+#include "polyphase.h"
+
+/* Only built if the compiler was told to use NEON, the intrinsics
+ * can't be enabled per function */
+#if defined (__arm__) && defined (__ARM_NEON__)
+
+#include <arm_neon.h>
+
+/* Like the SSE version, two channels at a time */
+static void dot_neon(float *dst, const float *x, unsigned stride, unsigned channels, const float *h, unsigned n) {
+    unsigned c, i;
+
+    for (c = 0; c + 1 < channels; c += 2, x += 2 * stride) {
+        const float *y = x + stride;
+        float32x4_t a0 = vdupq_n_f32(0), a1 = vdupq_n_f32(0);
+        float32x4_t b0 = vdupq_n_f32(0), b1 = vdupq_n_f32(0);
+        float32x2_t a, b;
+
+        for (i = 0; i < n; i += 8) {
+            float32x4_t h0 = vld1q_f32(h + i), h1 = vld1q_f32(h + i + 4);
+
+            a0 = vmlaq_f32(a0, vld1q_f32(x + i), h0);
+            a1 = vmlaq_f32(a1, vld1q_f32(x + i + 4), h1);
+            b0 = vmlaq_f32(b0, vld1q_f32(y + i), h0);
+            b1 = vmlaq_f32(b1, vld1q_f32(y + i + 4), h1);
+        }
+
+        a0 = vaddq_f32(a0, a1);
+        b0 = vaddq_f32(b0, b1);
+        a = vadd_f32(vget_low_f32(a0), vget_high_f32(a0));
+        b = vadd_f32(vget_low_f32(b0), vget_high_f32(b0));
+        a = vpadd_f32(a, b);
+
+        dst[c] = vget_lane_f32(a, 0);
+        dst[c + 1] = vget_lane_f32(a, 1);
+    }
+
+    if (c < channels) {
+        float32x4_t a0 = vdupq_n_f32(0), a1 = vdupq_n_f32(0);
+        float32x2_t a;
+
+        for (i = 0; i < n; i += 8) {
+            a0 = vmlaq_f32(a0, vld1q_f32(x + i), vld1q_f32(h + i));
+            a1 = vmlaq_f32(a1, vld1q_f32(x + i + 4), vld1q_f32(h + i + 4));
+        }
+
+        a0 = vaddq_f32(a0, a1);
+        a = vadd_f32(vget_low_f32(a0), vget_high_f32(a0));
+        a = vpadd_f32(a, a);
+
+        dst[c] = vget_lane_f32(a, 0);
+    }
+}
+
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+
+void pa_polyphase_func_init_arm(pa_cpu_arm_flag_t flags) {
+#if defined (__arm__) && defined (__ARM_NEON__)
+    if (flags & PA_CPU_ARM_NEON) {
+        pa_log_info("Initialising NEON optimized polyphase resampler.");
+
+        pa_set_polyphase_dot_func(dot_neon);
+    }
+#endif /* defined (__arm__) && defined (__ARM_NEON__) */
+}
@@ -0,0 +1,104 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-x86.h"
+
+#include "polyphase.h"
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS)
+
+#include <immintrin.h>
+
+/* Sums up the eight floats of a and b, the results are in the lower
+ * two floats */
+static inline __attribute__((target("avx"))) __m128 hsum2(__m256 a, __m256 b) {
+    __m256 t = _mm256_hadd_ps(a, b);
+    __m128 u = _mm_add_ps(_mm256_castps256_ps128(t), _mm256_extractf128_ps(t, 1));
+
+    return _mm_hadd_ps(u, u);
+}
+
+/* Like the SSE version, two channels at a time. Filters are a multiple
+ * of 8 taps long, so there is at most one half iteration left after
+ * the unrolled loop. FMA is not used, the CPU flags don't tell us
+ * whether it's there. */
+static __attribute__((target("avx"))) void dot_avx(float *dst, const float *x, unsigned stride, unsigned channels, const float *h, unsigned n) {
+    unsigned c, i;
+    float r[4];
+
+    for (c = 0; c + 1 < channels; c += 2, x += 2 * stride) {
+        const float *y = x + stride;
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+        __m256 b0 = _mm256_setzero_ps(), b1 = _mm256_setzero_ps();
+
+        for (i = 0; i + 16 <= n; i += 16) {
+            __m256 h0 = _mm256_loadu_ps(h + i), h1 = _mm256_loadu_ps(h + i + 8);
+
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(x + i), h0));
+            a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(x + i + 8), h1));
+            b0 = _mm256_add_ps(b0, _mm256_mul_ps(_mm256_loadu_ps(y + i), h0));
+            b1 = _mm256_add_ps(b1, _mm256_mul_ps(_mm256_loadu_ps(y + i + 8), h1));
+        }
+
+        if (i < n) {
+            __m256 h0 = _mm256_loadu_ps(h + i);
+
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(x + i), h0));
+            b0 = _mm256_add_ps(b0, _mm256_mul_ps(_mm256_loadu_ps(y + i), h0));
+        }
+
+        _mm_storeu_ps(r, hsum2(_mm256_add_ps(a0, a1), _mm256_add_ps(b0, b1)));
+        dst[c] = r[0];
+        dst[c + 1] = r[1];
+    }
+
+    if (c < channels) {
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+
+        for (i = 0; i + 16 <= n; i += 16) {
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(h + i)));
+            a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(h + i + 8)));
+        }
+
+        if (i < n)
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(h + i)));
+
+        _mm_storeu_ps(r, hsum2(a0, a1));
+        dst[c] = r[0] + r[1];
+    }
+}
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS) */
+
+void pa_polyphase_func_init_avx(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS)
+    if (flags & PA_CPU_X86_AVX) {
+        pa_log_info("Initialising AVX optimized polyphase resampler.");
+
+        pa_set_polyphase_dot_func(dot_avx);
+    }
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS) */
+}
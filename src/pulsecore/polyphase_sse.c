@@ -0,0 +1,91 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-x86.h"
+
+#include "polyphase.h"
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS)
+
+#include <immintrin.h>
+
+/* Sums up the four floats of a and b, the results are in the lower
+ * two floats */
+static inline __attribute__((target("sse"))) __m128 hsum2(__m128 a, __m128 b) {
+    __m128 t = _mm_add_ps(_mm_unpacklo_ps(a, b), _mm_unpackhi_ps(a, b));
+
+    return _mm_add_ps(t, _mm_movehl_ps(t, t));
+}
+
+/* Two channels at a time share the coefficient loads and give four
+ * independent chains of additions */
+static __attribute__((target("sse"))) void dot_sse(float *dst, const float *x, unsigned stride, unsigned channels, const float *h, unsigned n) {
+    unsigned c, i;
+    float r[4];
+
+    for (c = 0; c + 1 < channels; c += 2, x += 2 * stride) {
+        const float *y = x + stride;
+        __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+        __m128 b0 = _mm_setzero_ps(), b1 = _mm_setzero_ps();
+
+        for (i = 0; i < n; i += 8) {
+            __m128 h0 = _mm_loadu_ps(h + i), h1 = _mm_loadu_ps(h + i + 4);
+
+            a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + i), h0));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), h1));
+            b0 = _mm_add_ps(b0, _mm_mul_ps(_mm_loadu_ps(y + i), h0));
+            b1 = _mm_add_ps(b1, _mm_mul_ps(_mm_loadu_ps(y + i + 4), h1));
+        }
+
+        _mm_storeu_ps(r, hsum2(_mm_add_ps(a0, a1), _mm_add_ps(b0, b1)));
+        dst[c] = r[0];
+        dst[c + 1] = r[1];
+    }
+
+    if (c < channels) {
+        __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+
+        for (i = 0; i < n; i += 8) {
+            a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(h + i + 4)));
+        }
+
+        _mm_storeu_ps(r, hsum2(a0, a1));
+        dst[c] = r[0] + r[1];
+    }
+}
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS) */
+
+void pa_polyphase_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS)
+    if (flags & PA_CPU_X86_SSE) {
+        pa_log_info("Initialising SSE optimized polyphase resampler.");
+
+        pa_set_polyphase_dot_func(dot_sse);
+    }
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_X86_TARGET_INTRINSICS) */
+}
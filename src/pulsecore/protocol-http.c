@@ -28,13 +28,25 @@
 #include <string.h>
 #include <errno.h>
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #include <pulse/util.h>
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
 
 #include <pulsecore/core-util.h>
 #include <pulsecore/ioline.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/poll.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/socket.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/sample-util.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/log.h>
 #include <pulsecore/namereg.h>
@@ -45,6 +57,11 @@
 
 #include "protocol-http.h"
 
+/* Not all platforms have this */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 /* Don't allow more than this many concurrent connections */
 #define MAX_CONNECTIONS 10
 
@@ -53,6 +70,7 @@
 #define URL_STATUS "/status"
 #define URL_LISTEN "/listen"
 #define URL_LISTEN_SOURCE "/listen/source/"
+#define URL_LISTEN_ENCODED "/listen/encoded/"
 
 #define MIME_HTML "text/html; charset=utf-8"
 #define MIME_TEXT "text/plain; charset=utf-8"
@@ -75,6 +93,10 @@
 #define RECORD_BUFFER_SECONDS (5)
 #define DEFAULT_SOURCE_LATENCY (300*PA_USEC_PER_MSEC)
 
+/* Upper limits for what we hand to the kernel in one go */
+#define MAX_IOVECS 16
+#define MAX_WRITE_SIZE (64*1024)
+
 enum state {
     STATE_REQUEST_LINE,
     STATE_MIME_HEADER,
@@ -86,167 +108,661 @@ enum method {
     METHOD_HEAD
 };
 
-struct connection {
+/* All listeners of the same source with the same sample spec and
+ * encoder share one source output. Its data is sent to the streaming
+ * thread and encoded there only once and then handed to every
+ * listener's queue by reference. The tap goes away with its last
+ * listener. */
+typedef struct tap {
+    pa_msgobject parent;
+
+    pa_http_protocol *protocol;
+    pa_source_output *source_output;
+    pa_sample_spec sample_spec;
+    pa_channel_map channel_map;
+
+    /* NULL for raw PCM */
+    const pa_http_encoder *encoder;
+    void *encoder_state;
+    size_t block_size, frame_size;
+    pa_mempool *mempool;
+
+    pa_idxset *connections;
+
+    /* Longest queue of all listeners in bytes of captured data, for
+     * the latency queries */
+    pa_atomic_t max_queue_length;
+
+    struct {
+        PA_LLIST_HEAD(struct connection, connections);
+        pa_memblockq *encoder_input;
+    } thread_info;
+} tap;
+
+#define TAP(o) (tap_cast(o))
+PA_DEFINE_PRIVATE_CLASS(tap, pa_msgobject);
+
+typedef struct connection {
+    pa_msgobject parent;
+
     pa_http_protocol *protocol;
-    pa_iochannel *io;
     pa_ioline *line;
     pa_memblockq *output_memblockq;
-    pa_source_output *source_output;
+    tap *tap;
     pa_client *client;
     enum state state;
     char *url;
     enum method method;
     pa_module *module;
-};
+
+    /* Once we start streaming the socket and output_memblockq
+     * belong to the streaming thread */
+    int fd;
+
+    struct {
+        pa_rtpoll_item *rtpoll_item;
+        size_t partial;
+    } thread_info;
+
+    PA_LLIST_FIELDS(struct connection);
+} connection;
+
+#define CONNECTION(o) (connection_cast(o))
+PA_DEFINE_PRIVATE_CLASS(connection, pa_msgobject);
 
 struct pa_http_protocol {
     PA_REFCNT_DECLARE;
 
     pa_core *core;
     pa_idxset *connections;
+    pa_idxset *taps;
+    pa_hashmap *encoders;
+
+    /* Serves all streaming connections, started with the first tap */
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    pa_rtpoll *rtpoll;
 
     pa_strlist *servers;
 };
 
 enum {
-    SOURCE_OUTPUT_MESSAGE_POST_DATA = PA_SOURCE_OUTPUT_MESSAGE_MAX
+    TAP_MESSAGE_POST_DATA,              /* data from source output to streaming thread */
+    TAP_MESSAGE_ADD_CONNECTION,
+    TAP_MESSAGE_REMOVE_CONNECTION
+};
+
+enum {
+    CONNECTION_MESSAGE_UNLINK           /* the streaming thread gave up on the socket */
 };
 
+static void tap_remove_connection(tap *t, connection *c);
+
 /* Called from main context */
-static void connection_unlink(struct connection *c) {
+static void connection_unlink(connection *c) {
     pa_assert(c);
 
-    if (c->source_output) {
-        pa_source_output_unlink(c->source_output);
-        c->source_output->userdata = NULL;
-        pa_source_output_unref(c->source_output);
-    }
+    if (!c->protocol)
+        return;
 
-    if (c->client)
-        pa_client_free(c->client);
+    if (c->tap)
+        tap_remove_connection(c->tap, c);
 
-    pa_xfree(c->url);
+    if (c->client) {
+        pa_client_free(c->client);
+        c->client = NULL;
+    }
 
-    if (c->line)
+    if (c->line) {
         pa_ioline_unref(c->line);
+        c->line = NULL;
+    }
+
+    if (c->fd >= 0) {
+        pa_close(c->fd);
+        c->fd = -1;
+    }
+
+    pa_idxset_remove_by_data(c->protocol->connections, c, NULL);
+    c->protocol = NULL;
+    connection_unref(c);
+}
 
-    if (c->io)
-        pa_iochannel_free(c->io);
+static void connection_free(pa_object *o) {
+    connection *c = CONNECTION(o);
+
+    pa_assert(c);
+
+    connection_unlink(c);
+
+    pa_xfree(c->url);
 
     if (c->output_memblockq)
         pa_memblockq_free(c->output_memblockq);
 
-    pa_idxset_remove_by_data(c->protocol->connections, c, NULL);
-
     pa_xfree(c);
 }
 
 /* Called from main context */
-static int do_write(struct connection *c) {
-    pa_memchunk chunk;
+static int connection_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
+    connection *c = CONNECTION(o);
+
+    connection_assert_ref(c);
+
+    if (!c->protocol)
+        return -1;
+
+    switch (code) {
+
+        case CONNECTION_MESSAGE_UNLINK:
+            connection_unlink(c);
+            break;
+    }
+
+    return 0;
+}
+
+/* Called from streaming thread context */
+static int do_write(connection *c) {
+    struct iovec iov[MAX_IOVECS];
+    pa_memblock *mb[MAX_IOVECS];
+    struct msghdr m;
+    unsigned n = 0, i;
+    size_t length = 0, base;
     ssize_t r;
-    void *p;
 
     pa_assert(c);
 
-    if (pa_memblockq_peek(c->output_memblockq, &chunk) < 0)
+    base = pa_memblockq_get_base(c->output_memblockq);
+
+    /* Collect as many chunks as we can. We drop them right away and
+     * rewind later for whatever the kernel doesn't take. */
+    while (n < MAX_IOVECS) {
+        pa_memchunk chunk;
+        size_t k;
+
+        if (pa_memblockq_peek(c->output_memblockq, &chunk) < 0)
+            break;
+
+        pa_assert(chunk.memblock);
+        pa_assert(chunk.length > 0);
+
+        if ((k = PA_MIN(chunk.length, MAX_WRITE_SIZE - length) / base * base) <= 0) {
+            pa_memblock_unref(chunk.memblock);
+            break;
+        }
+
+        iov[n].iov_base = (uint8_t*) pa_memblock_acquire(chunk.memblock) + chunk.index;
+        iov[n].iov_len = k;
+        mb[n++] = chunk.memblock;
+
+        pa_memblockq_drop(c->output_memblockq, k);
+        length += k;
+    }
+
+    if (n <= 0)
         return 0;
 
-    pa_assert(chunk.memblock);
-    pa_assert(chunk.length > 0);
+    /* The last write might have stopped in the middle of a frame */
+    iov[0].iov_base = (uint8_t*) iov[0].iov_base + c->thread_info.partial;
+    iov[0].iov_len -= c->thread_info.partial;
 
-    p = pa_memblock_acquire(chunk.memblock);
-    r = pa_iochannel_write(c->io, (uint8_t*) p+chunk.index, chunk.length);
-    pa_memblock_release(chunk.memblock);
+    pa_zero(m);
+    m.msg_iov = iov;
+    m.msg_iovlen = n;
 
-    pa_memblock_unref(chunk.memblock);
+    r = sendmsg(c->fd, &m, MSG_NOSIGNAL);
+
+    for (i = 0; i < n; i++) {
+        pa_memblock_release(mb[i]);
+        pa_memblock_unref(mb[i]);
+    }
 
     if (r < 0) {
+        pa_memblockq_rewind(c->output_memblockq, length);
 
         if (errno == EINTR || errno == EAGAIN)
             return 0;
 
-        pa_log("write(): %s", pa_cstrerror(errno));
+        pa_log("sendmsg(): %s", pa_cstrerror(errno));
         return -1;
     }
 
-    pa_memblockq_drop(c->output_memblockq, (size_t) r);
+    /* The queue only deals in whole frames */
+    r += (ssize_t) c->thread_info.partial;
+    pa_memblockq_rewind(c->output_memblockq, length - (size_t) r / base * base);
+    c->thread_info.partial = (size_t) r % base;
 
     return 0;
 }
 
-/* Called from main context */
-static void do_work(struct connection *c) {
+/* Called from streaming thread context */
+static void connection_detach(connection *c) {
     pa_assert(c);
 
-    if (pa_iochannel_is_hungup(c->io))
+    if (!c->thread_info.rtpoll_item)
+        return;
+
+    PA_LLIST_REMOVE(struct connection, c->tap->thread_info.connections, c);
+
+    pa_rtpoll_item_free(c->thread_info.rtpoll_item);
+    c->thread_info.rtpoll_item = NULL;
+}
+
+/* Called from streaming thread context */
+static void do_work(connection *c) {
+    struct pollfd *pollfd;
+
+    pa_assert(c);
+
+    pollfd = pa_rtpoll_item_get_pollfd(c->thread_info.rtpoll_item, NULL);
+
+    if (pollfd->revents & ~POLLOUT)
         goto fail;
 
-    if (pa_iochannel_is_writable(c->io))
+    /* No point in trying while we are still waiting for the socket */
+    if (!(pollfd->events & POLLOUT) || (pollfd->revents & POLLOUT))
         if (do_write(c) < 0)
             goto fail;
 
+    pollfd->revents = 0;
+    pollfd->events = (short) (pa_memblockq_is_readable(c->output_memblockq) ? POLLOUT : 0);
+
     return;
 
 fail:
-    connection_unlink(c);
+    connection_detach(c);
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_UNLINK, NULL, 0, NULL, NULL);
 }
 
-/* Called from thread context, except when it is not */
-static int source_output_process_msg(pa_msgobject *m, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
-    pa_source_output *o = PA_SOURCE_OUTPUT(m);
-    struct connection *c;
+/* Called from streaming thread context */
+static int connection_work_cb(pa_rtpoll_item *i) {
+    connection *c;
+    struct pollfd *pollfd;
 
-    pa_source_output_assert_ref(o);
+    pa_assert(i);
+    pa_assert_se(c = pa_rtpoll_item_get_userdata(i));
+
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
 
-    if (!(c = o->userdata))
+    if (pollfd->revents)
+        do_work(c);
+
+    return 0;
+}
+
+/* Called from streaming thread context. Encodes all complete blocks
+ * of input we have. Returns -1 if there is nothing to send. */
+static int tap_encode(tap *t, const pa_memchunk *chunk, pa_memchunk *encoded) {
+    pa_memchunk input;
+    size_t length;
+    ssize_t r;
+
+    pa_assert(t);
+    pa_assert(t->encoder_state);
+    pa_assert(chunk);
+    pa_assert(encoded);
+
+    pa_memblockq_push_align(t->thread_info.encoder_input, chunk);
+
+    if ((length = pa_memblockq_get_length(t->thread_info.encoder_input) / t->block_size * t->block_size) <= 0)
         return -1;
 
+    /* This copies only if the blocks are split across memchunks */
+    pa_assert_se(pa_memblockq_peek_fixed_size(t->thread_info.encoder_input, length, &input) >= 0);
+
+    encoded->memblock = pa_memblock_new(t->mempool, length / t->block_size * t->frame_size);
+    encoded->index = 0;
+
+    r = t->encoder->encode(t->encoder_state,
+                           pa_memblock_acquire_chunk(&input),
+                           length,
+                           pa_memblock_acquire(encoded->memblock));
+
+    pa_memblock_release(encoded->memblock);
+    pa_memblock_release(input.memblock);
+    pa_memblock_unref(input.memblock);
+
+    pa_memblockq_drop(t->thread_info.encoder_input, length);
+
+    if (r <= 0) {
+        if (r < 0 && pa_log_ratelimit(PA_LOG_ERROR))
+            pa_log("Failed to encode data for %s.", t->encoder->name);
+
+        pa_memblock_unref(encoded->memblock);
+        return -1;
+    }
+
+    pa_assert((size_t) r <= pa_memblock_get_length(encoded->memblock));
+    encoded->length = (size_t) r;
+
+    return 0;
+}
+
+/* Called from streaming thread context */
+static int tap_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
+    tap *t = TAP(o);
+    connection *c, *n;
+
+    tap_assert_ref(t);
+
     switch (code) {
 
-        case SOURCE_OUTPUT_MESSAGE_POST_DATA:
-            /* While this function is usually called from IO thread
-             * context, this specific command is not! */
-            pa_memblockq_push_align(c->output_memblockq, chunk);
-            do_work(c);
+        case TAP_MESSAGE_POST_DATA: {
+            pa_memchunk encoded;
+            size_t length = 0;
+
+            /* Nobody is listening yet. This is also what keeps us off
+             * the encoder once the tap has been unlinked. */
+            if (!t->thread_info.connections)
+                break;
+
+            if (t->encoder_state) {
+                if (tap_encode(t, chunk, &encoded) < 0)
+                    break;
+
+                chunk = &encoded;
+            }
+
+            PA_LLIST_FOREACH_SAFE(c, n, t->thread_info.connections) {
+                pa_memblockq_push_align(c->output_memblockq, chunk);
+                do_work(c);
+            }
+
+            if (t->encoder_state)
+                pa_memblock_unref(encoded.memblock);
+
+            PA_LLIST_FOREACH(c, t->thread_info.connections)
+                length = PA_MAX(length, pa_memblockq_get_length(c->output_memblockq));
+
+            if (t->encoder_state)
+                length = length / t->frame_size * t->block_size;
+
+            pa_atomic_store(&t->max_queue_length, (int) length);
             break;
+        }
 
-        default:
-            return pa_source_output_process_msg(m, code, userdata, offset, chunk);
+        case TAP_MESSAGE_ADD_CONNECTION: {
+            struct pollfd *pollfd;
+
+            c = CONNECTION(userdata);
+            pa_assert(!c->thread_info.rtpoll_item);
+
+            c->thread_info.rtpoll_item = pa_rtpoll_item_new(c->protocol->rtpoll, PA_RTPOLL_NORMAL, 1);
+            pa_rtpoll_item_set_work_callback(c->thread_info.rtpoll_item, connection_work_cb);
+            pa_rtpoll_item_set_userdata(c->thread_info.rtpoll_item, c);
+
+            pollfd = pa_rtpoll_item_get_pollfd(c->thread_info.rtpoll_item, NULL);
+            pollfd->fd = c->fd;
+            pollfd->events = pollfd->revents = 0;
+
+            PA_LLIST_PREPEND(struct connection, t->thread_info.connections, c);
+            break;
+        }
+
+        case TAP_MESSAGE_REMOVE_CONNECTION:
+            connection_detach(CONNECTION(userdata));
+            break;
     }
 
     return 0;
 }
 
+/* Called from main context */
+static void tap_unlink(tap *t) {
+    pa_assert(t);
+
+    if (!t->protocol)
+        return;
+
+    pa_assert(pa_idxset_isempty(t->connections));
+
+    if (t->source_output) {
+        pa_source_output_unlink(t->source_output);
+        t->source_output->userdata = NULL;
+        pa_source_output_unref(t->source_output);
+        t->source_output = NULL;
+    }
+
+    /* The streaming thread won't touch the encoder anymore now that
+     * all connections are gone. The encoder might not be around
+     * anymore by the time the tap is freed. */
+    if (t->encoder_state) {
+        t->encoder->free(t->encoder_state);
+        t->encoder_state = NULL;
+    }
+
+    pa_assert_se(pa_idxset_remove_by_data(t->protocol->taps, t, NULL) == t);
+    t->protocol = NULL;
+    tap_unref(t);
+}
+
+static void tap_free(pa_object *o) {
+    tap *t = TAP(o);
+
+    pa_assert(t);
+
+    tap_unlink(t);
+
+    pa_assert(!t->thread_info.connections);
+    pa_idxset_free(t->connections, NULL, NULL);
+
+    if (t->thread_info.encoder_input)
+        pa_memblockq_free(t->thread_info.encoder_input);
+
+    pa_xfree(t);
+}
+
+/* Called from main context */
+static void tap_remove_connection(tap *t, connection *c) {
+    pa_assert(t);
+    pa_assert(c);
+
+    pa_assert_se(pa_idxset_remove_by_data(t->connections, c, NULL));
+
+    /* Make sure the streaming thread lets go of the connection */
+    if (c->fd >= 0)
+        pa_asyncmsgq_send(t->protocol->thread_mq.inq, PA_MSGOBJECT(t), TAP_MESSAGE_REMOVE_CONNECTION, c, 0, NULL);
+
+    c->tap = NULL;
+
+    if (pa_idxset_isempty(t->connections))
+        tap_unlink(t);
+}
+
 /* Called from thread context */
 static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
-    struct connection *c;
+    tap *t;
 
     pa_source_output_assert_ref(o);
-    pa_assert_se(c = o->userdata);
+    pa_assert_se(t = o->userdata);
     pa_assert(chunk);
 
-    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(o), SOURCE_OUTPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
+    pa_asyncmsgq_post(t->protocol->thread_mq.inq, PA_MSGOBJECT(t), TAP_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
 }
 
 /* Called from main context */
 static void source_output_kill_cb(pa_source_output *o) {
-    struct connection*c;
+    tap *t;
+    connection *c;
 
     pa_source_output_assert_ref(o);
-    pa_assert_se(c = o->userdata);
+    pa_assert_se(t = o->userdata);
 
-    connection_unlink(c);
+    /* The last connection takes the tap with it */
+    tap_ref(t);
+
+    while ((c = pa_idxset_first(t->connections, NULL)))
+        connection_unlink(c);
+
+    tap_unref(t);
 }
 
 /* Called from main context */
 static pa_usec_t source_output_get_latency_cb(pa_source_output *o) {
-    struct connection*c;
+    tap *t;
 
     pa_source_output_assert_ref(o);
-    pa_assert_se(c = o->userdata);
+    pa_assert_se(t = o->userdata);
+
+    /* Report the listener that lags behind the most */
+    return pa_bytes_to_usec((uint64_t) pa_atomic_load(&t->max_queue_length), &o->sample_spec);
+}
+
+static void thread_func(void *userdata) {
+    pa_http_protocol *p = userdata;
+
+    pa_assert(p);
+
+    pa_log_debug("Streaming thread starting up");
+
+    pa_thread_mq_install(&p->thread_mq);
+
+    for (;;) {
+        int ret;
+
+        if ((ret = pa_rtpoll_run(p->rtpoll, TRUE)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+    }
+
+fail:
+    /* If this was no regular exit from the loop we have to continue
+     * processing messages until we received PA_MESSAGE_SHUTDOWN */
+    pa_asyncmsgq_wait_for(p->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
+
+finish:
+    pa_log_debug("Streaming thread shutting down");
+}
+
+/* Called from main context */
+static int start_thread(pa_http_protocol *p) {
+    pa_assert(p);
+
+    if (p->thread)
+        return 0;
+
+    p->rtpoll = pa_rtpoll_new();
+    pa_thread_mq_init(&p->thread_mq, p->core->mainloop, p->rtpoll);
+
+    if (!(p->thread = pa_thread_new("http-streaming", thread_func, p))) {
+        pa_log("Failed to create streaming thread.");
+        pa_thread_mq_done(&p->thread_mq);
+        pa_rtpoll_free(p->rtpoll);
+        p->rtpoll = NULL;
+        return -1;
+    }
+
+    return 0;
+}
 
-    return pa_bytes_to_usec(pa_memblockq_get_length(c->output_memblockq), &c->source_output->sample_spec);
+/* Called from main context */
+static tap *tap_get(pa_http_protocol *p, pa_module *m, pa_source *source, const pa_sample_spec *ss, const pa_channel_map *cm, const pa_http_encoder *e) {
+    tap *t;
+    pa_source_output *source_output = NULL;
+    pa_source_output_new_data data;
+    void *encoder_state = NULL;
+    size_t block_size = 0, frame_size = 0;
+    uint32_t idx;
+
+    pa_assert(p);
+    pa_assert(source);
+    pa_assert(ss);
+    pa_assert(cm);
+
+    PA_IDXSET_FOREACH(t, p->taps, idx)
+        if (t->source_output->source == source &&
+            t->encoder == e &&
+            pa_sample_spec_equal(&t->sample_spec, ss) &&
+            pa_channel_map_equal(&t->channel_map, cm))
+            return t;
+
+    if (start_thread(p) < 0)
+        return NULL;
+
+    if (e && e->new) {
+        if (!(encoder_state = e->new(ss, &block_size, &frame_size))) {
+            pa_log("Failed to set up encoder %s.", e->name);
+            return NULL;
+        }
+
+        pa_assert(block_size > 0);
+        pa_assert(block_size % pa_frame_size(ss) == 0);
+        pa_assert(frame_size > 0);
+    }
+
+    pa_source_output_new_data_init(&data);
+    data.driver = __FILE__;
+    data.module = m;
+    pa_source_output_new_data_set_source(&data, source, FALSE);
+    if (e)
+        pa_proplist_setf(data.proplist, PA_PROP_MEDIA_NAME, "HTTP listeners (%s)", e->name);
+    else
+        pa_proplist_sets(data.proplist, PA_PROP_MEDIA_NAME, "HTTP listeners");
+    pa_source_output_new_data_set_sample_spec(&data, ss);
+    pa_source_output_new_data_set_channel_map(&data, cm);
+
+    pa_source_output_new(&source_output, p->core, &data);
+    pa_source_output_new_data_done(&data);
+
+    if (!source_output) {
+        if (encoder_state)
+            e->free(encoder_state);
+
+        return NULL;
+    }
+
+    t = pa_msgobject_new(tap);
+    t->parent.parent.free = tap_free;
+    t->parent.process_msg = tap_process_msg;
+    t->protocol = p;
+    t->source_output = source_output;
+    t->sample_spec = *ss;
+    t->channel_map = *cm;
+    t->encoder = e;
+    t->encoder_state = encoder_state;
+    t->block_size = block_size;
+    t->frame_size = frame_size;
+    t->mempool = p->core->mempool;
+    t->connections = pa_idxset_new(NULL, NULL);
+    pa_atomic_store(&t->max_queue_length, 0);
+    PA_LLIST_HEAD_INIT(struct connection, t->thread_info.connections);
+
+    t->thread_info.encoder_input = NULL;
+
+    if (encoder_state) {
+        pa_memchunk silence;
+
+        /* Enough to hold a second worth of input, the source hands us
+         * far less than that at a time */
+        pa_silence_memchunk_get(&p->core->silence_cache, p->core->mempool, &silence, ss, 0);
+        t->thread_info.encoder_input = pa_memblockq_new(
+                "http protocol tap encoder_input",
+                0,
+                PA_MAX(pa_bytes_per_second(ss), 2 * block_size),
+                0,
+                ss,
+                0,
+                0,
+                0,
+                &silence);
+        pa_memblock_unref(silence.memblock);
+    }
+
+    source_output->push = source_output_push_cb;
+    source_output->kill = source_output_kill_cb;
+    source_output->get_latency = source_output_get_latency_cb;
+    source_output->userdata = t;
+
+    pa_source_output_set_requested_latency(source_output, DEFAULT_SOURCE_LATENCY);
+
+    pa_idxset_put(p->taps, t, NULL);
+
+    pa_source_output_put(source_output);
+
+    return t;
 }
 
 /*** client callbacks ***/
@@ -259,16 +775,6 @@ static void client_kill_cb(pa_client *client) {
     connection_unlink(c);
 }
 
-/*** pa_iochannel callbacks ***/
-static void io_callback(pa_iochannel*io, void *userdata) {
-    struct connection *c = userdata;
-
-    pa_assert(c);
-    pa_assert(io);
-
-    do_work(c);
-}
-
 static char *escape_html(const char *t) {
     pa_strbuf *sb;
     const char *p, *e;
@@ -455,6 +961,16 @@ static void handle_status(struct connection *c) {
     pa_ioline_defer_close(c->line);
 }
 
+static void print_encoded_links(struct connection *c, pa_source *source) {
+    const pa_http_encoder *e;
+    void *state;
+
+    PA_HASHMAP_FOREACH(e, c->protocol->encoders, state)
+        pa_ioline_printf(c->line,
+                         " <a href=\"" URL_LISTEN_ENCODED "%s/%s\">[%s]</a>",
+                         e->name, source->name, e->name);
+}
+
 static void handle_listen(struct connection *c) {
     pa_source *source;
     pa_sink *sink;
@@ -479,8 +995,10 @@ static void handle_listen(struct connection *c) {
         m = pa_sample_spec_to_mime_type_mimefy(&sink->sample_spec, &sink->channel_map);
 
         pa_ioline_printf(c->line,
-                         "<a href=\"" URL_LISTEN_SOURCE "%s\" title=\"%s\">%s</a><br/>\n",
+                         "<a href=\"" URL_LISTEN_SOURCE "%s\" title=\"%s\">%s</a>",
                          sink->monitor_source->name, m, t);
+        print_encoded_links(c, sink->monitor_source);
+        pa_ioline_puts(c->line, "<br/>\n");
 
         pa_xfree(t);
         pa_xfree(m);
@@ -501,8 +1019,10 @@ static void handle_listen(struct connection *c) {
         m = pa_sample_spec_to_mime_type_mimefy(&source->sample_spec, &source->channel_map);
 
         pa_ioline_printf(c->line,
-                         "<a href=\"" URL_LISTEN_SOURCE "%s\" title=\"%s\">%s</a><br/>\n",
+                         "<a href=\"" URL_LISTEN_SOURCE "%s\" title=\"%s\">%s</a>",
                          source->name, m, t);
+        print_encoded_links(c, source);
+        pa_ioline_puts(c->line, "<br/>\n");
 
         pa_xfree(m);
         pa_xfree(t);
@@ -518,25 +1038,30 @@ static void handle_listen(struct connection *c) {
 
 static void line_drain_callback(pa_ioline *l, void *userdata) {
     struct connection *c;
+    pa_iochannel *io;
 
     pa_assert(l);
     pa_assert_se(c = userdata);
 
-    /* We don't need the line reader anymore, instead we need a real
-     * binary io channel */
-    pa_assert_se(c->io = pa_ioline_detach_iochannel(c->line));
-    pa_iochannel_set_callback(c->io, io_callback, c);
-
-    pa_iochannel_socket_set_sndbuf(c->io, pa_memblockq_get_length(c->output_memblockq));
+    /* We don't need the line reader anymore, from now on the
+     * streaming thread writes to the socket directly */
+    pa_assert_se(io = pa_ioline_detach_iochannel(c->line));
 
     pa_ioline_unref(c->line);
     c->line = NULL;
+
+    pa_iochannel_socket_set_sndbuf(io, pa_memblockq_get_maxlength(c->output_memblockq));
+
+    pa_iochannel_set_noclose(io, TRUE);
+    c->fd = pa_iochannel_get_send_fd(io);
+    pa_iochannel_free(io);
+
+    pa_asyncmsgq_send(c->protocol->thread_mq.inq, PA_MSGOBJECT(c->tap), TAP_MESSAGE_ADD_CONNECTION, c, 0, NULL);
 }
 
-static void handle_listen_prefix(struct connection *c, const char *source_name) {
+static void handle_listen_prefix(struct connection *c, const char *source_name, const pa_http_encoder *e) {
     pa_source *source;
-    pa_source_output_new_data data;
-    pa_sample_spec ss;
+    pa_sample_spec ss, queue_ss;
     pa_channel_map cm;
     char *t;
     size_t l;
@@ -545,7 +1070,7 @@ static void handle_listen_prefix(struct connection *c, const char *source_name)
     pa_assert(source_name);
 
     pa_assert(c->line);
-    pa_assert(!c->io);
+    pa_assert(c->fd < 0);
 
     if (!(source = pa_namereg_get(c->protocol->core, source_name, PA_NAMEREG_SOURCE))) {
         html_response(c, 404, "Source not found", NULL);
@@ -555,55 +1080,56 @@ static void handle_listen_prefix(struct connection *c, const char *source_name)
     ss = source->sample_spec;
     cm = source->channel_map;
 
-    pa_sample_spec_mimefy(&ss, &cm);
+    if (e)
+        e->fix_sample_spec(&ss, &cm);
+    else
+        pa_sample_spec_mimefy(&ss, &cm);
 
-    pa_source_output_new_data_init(&data);
-    data.driver = __FILE__;
-    data.module = c->module;
-    data.client = c->client;
-    pa_source_output_new_data_set_source(&data, source, FALSE);
-    pa_proplist_update(data.proplist, PA_UPDATE_MERGE, c->client->proplist);
-    pa_source_output_new_data_set_sample_spec(&data, &ss);
-    pa_source_output_new_data_set_channel_map(&data, &cm);
+    pa_assert(pa_sample_spec_valid(&ss));
+    pa_assert(pa_channel_map_compatible(&cm, &ss));
 
-    pa_source_output_new(&c->source_output, c->protocol->core, &data);
-    pa_source_output_new_data_done(&data);
+    /* No need to tap the source if nobody is going to listen */
+    if (c->method == METHOD_HEAD) {
+        t = e ? e->get_mime_type(&ss, &cm) : pa_sample_spec_to_mime_type(&ss, &cm);
+        http_response(c, 200, "OK", t);
+        pa_xfree(t);
 
-    if (!c->source_output) {
+        connection_unlink(c);
+        return;
+    }
+
+    if (!(c->tap = tap_get(c->protocol, c->module, source, &ss, &cm, e))) {
         html_response(c, 403, "Cannot create source output", NULL);
         return;
     }
 
-    c->source_output->parent.process_msg = source_output_process_msg;
-    c->source_output->push = source_output_push_cb;
-    c->source_output->kill = source_output_kill_cb;
-    c->source_output->get_latency = source_output_get_latency_cb;
-    c->source_output->userdata = c;
+    l = (size_t) (pa_bytes_per_second(&ss)*RECORD_BUFFER_SECONDS);
+    queue_ss = ss;
 
-    pa_source_output_set_requested_latency(c->source_output, DEFAULT_SOURCE_LATENCY);
+    /* Encoded data is just a stream of bytes to us */
+    if (c->tap->encoder_state) {
+        l = l / c->tap->block_size * c->tap->frame_size;
+        queue_ss.format = PA_SAMPLE_U8;
+        queue_ss.channels = 1;
+    }
 
-    l = (size_t) (pa_bytes_per_second(&ss)*RECORD_BUFFER_SECONDS);
     c->output_memblockq = pa_memblockq_new(
             "http protocol connection output_memblockq",
             0,
             l,
             0,
-            &ss,
+            &queue_ss,
             1,
             0,
-            0,
+            MAX_WRITE_SIZE,
             NULL);
 
-    pa_source_output_put(c->source_output);
+    pa_idxset_put(c->tap->connections, c, NULL);
 
-    t = pa_sample_spec_to_mime_type(&ss, &cm);
+    t = e ? e->get_mime_type(&ss, &cm) : pa_sample_spec_to_mime_type(&ss, &cm);
     http_response(c, 200, "OK", t);
     pa_xfree(t);
 
-    if(c->method == METHOD_HEAD) {
-        connection_unlink(c);
-        return;
-    }
     pa_ioline_set_callback(c->line, NULL, NULL);
 
     if (pa_ioline_is_drained(c->line))
@@ -612,6 +1138,32 @@ static void handle_listen_prefix(struct connection *c, const char *source_name)
         pa_ioline_set_drain_callback(c->line, line_drain_callback, c);
 }
 
+static void handle_listen_encoded(struct connection *c, const char *path) {
+    const pa_http_encoder *e;
+    const char *source_name;
+    char *name;
+
+    pa_assert(c);
+    pa_assert(path);
+
+    /* <encoder>/<source> */
+    if (!(source_name = strchr(path, '/'))) {
+        html_response(c, 404, "Not Found", NULL);
+        return;
+    }
+
+    name = pa_xstrndup(path, (size_t) (source_name - path));
+    e = pa_hashmap_get(c->protocol->encoders, name);
+    pa_xfree(name);
+
+    if (!e) {
+        html_response(c, 404, "Encoder not found", NULL);
+        return;
+    }
+
+    handle_listen_prefix(c, source_name + 1, e);
+}
+
 static void handle_url(struct connection *c) {
     pa_assert(c);
 
@@ -626,7 +1178,9 @@ static void handle_url(struct connection *c) {
     else if (pa_streq(c->url, URL_LISTEN))
         handle_listen(c);
     else if (pa_startswith(c->url, URL_LISTEN_SOURCE))
-        handle_listen_prefix(c, c->url + sizeof(URL_LISTEN_SOURCE)-1);
+        handle_listen_prefix(c, c->url + sizeof(URL_LISTEN_SOURCE)-1, NULL);
+    else if (pa_startswith(c->url, URL_LISTEN_ENCODED))
+        handle_listen_encoded(c, c->url + sizeof(URL_LISTEN_ENCODED)-1);
     else
         html_response(c, 404, "Not Found", NULL);
 }
@@ -697,10 +1251,22 @@ void pa_http_protocol_connect(pa_http_protocol *p, pa_iochannel *io, pa_module *
         return;
     }
 
-    c = pa_xnew0(struct connection, 1);
+    c = pa_msgobject_new(connection);
+    c->parent.parent.free = connection_free;
+    c->parent.process_msg = connection_process_msg;
     c->protocol = p;
+    c->line = NULL;
+    c->output_memblockq = NULL;
+    c->tap = NULL;
+    c->client = NULL;
     c->state = STATE_REQUEST_LINE;
+    c->url = NULL;
+    c->method = METHOD_GET;
     c->module = m;
+    c->fd = -1;
+    c->thread_info.rtpoll_item = NULL;
+    c->thread_info.partial = 0;
+    PA_LLIST_INIT(struct connection, c);
 
     c->line = pa_ioline_new(io);
     pa_ioline_set_callback(c->line, line_callback, c);
@@ -741,6 +1307,47 @@ void pa_http_protocol_disconnect(pa_http_protocol *p, pa_module *m) {
             connection_unlink(c);
 }
 
+/* G.711 is a sample format of its own, the source output does the
+ * encoding for us */
+static void g711_fix_sample_spec(pa_sample_spec *ss, pa_channel_map *cm) {
+    pa_assert(ss);
+    pa_assert(cm);
+
+    ss->rate = 8000;
+    ss->channels = 1;
+    pa_channel_map_init_mono(cm);
+}
+
+static void ulaw_fix_sample_spec(pa_sample_spec *ss, pa_channel_map *cm) {
+    g711_fix_sample_spec(ss, cm);
+    ss->format = PA_SAMPLE_ULAW;
+}
+
+static char *ulaw_get_mime_type(const pa_sample_spec *ss, const pa_channel_map *cm) {
+    return pa_xstrdup("audio/basic");
+}
+
+static void alaw_fix_sample_spec(pa_sample_spec *ss, pa_channel_map *cm) {
+    g711_fix_sample_spec(ss, cm);
+    ss->format = PA_SAMPLE_ALAW;
+}
+
+static char *alaw_get_mime_type(const pa_sample_spec *ss, const pa_channel_map *cm) {
+    return pa_xstrdup("audio/x-alaw-basic");
+}
+
+static const pa_http_encoder ulaw_encoder = {
+    .name = "ulaw",
+    .fix_sample_spec = ulaw_fix_sample_spec,
+    .get_mime_type = ulaw_get_mime_type
+};
+
+static const pa_http_encoder alaw_encoder = {
+    .name = "alaw",
+    .fix_sample_spec = alaw_fix_sample_spec,
+    .get_mime_type = alaw_get_mime_type
+};
+
 static pa_http_protocol* http_protocol_new(pa_core *c) {
     pa_http_protocol *p;
 
@@ -750,6 +1357,11 @@ static pa_http_protocol* http_protocol_new(pa_core *c) {
     PA_REFCNT_INIT(p);
     p->core = c;
     p->connections = pa_idxset_new(NULL, NULL);
+    p->taps = pa_idxset_new(NULL, NULL);
+    p->encoders = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+    pa_assert_se(pa_http_protocol_add_encoder(p, &ulaw_encoder) >= 0);
+    pa_assert_se(pa_http_protocol_add_encoder(p, &alaw_encoder) >= 0);
 
     pa_assert_se(pa_shared_set(c, "http-protocol", p) >= 0);
 
@@ -788,6 +1400,18 @@ void pa_http_protocol_unref(pa_http_protocol *p) {
 
     pa_idxset_free(p->connections, NULL, NULL);
 
+    pa_assert(pa_idxset_isempty(p->taps));
+    pa_idxset_free(p->taps, NULL, NULL);
+
+    pa_hashmap_free(p->encoders, NULL, NULL);
+
+    if (p->thread) {
+        pa_asyncmsgq_send(p->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(p->thread);
+        pa_thread_mq_done(&p->thread_mq);
+        pa_rtpoll_free(p->rtpoll);
+    }
+
     pa_strlist_free(p->servers);
 
     pa_assert_se(pa_shared_remove(p->core, "http-protocol") >= 0);
@@ -817,3 +1441,46 @@ pa_strlist *pa_http_protocol_servers(pa_http_protocol *p) {
 
     return p->servers;
 }
+
+int pa_http_protocol_add_encoder(pa_http_protocol *p, const pa_http_encoder *e) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) >= 1);
+    pa_assert(e);
+    pa_assert(e->name);
+    pa_assert(e->fix_sample_spec);
+    pa_assert(e->get_mime_type);
+    pa_assert(!e->new || (e->encode && e->free));
+
+    if (pa_hashmap_put(p->encoders, e->name, (void*) e) < 0) {
+        pa_log("Encoder %s already registered.", e->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+void pa_http_protocol_remove_encoder(pa_http_protocol *p, const pa_http_encoder *e) {
+    tap *t;
+    uint32_t idx;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) >= 1);
+    pa_assert(e);
+
+    /* Nobody may use the encoder after this */
+    PA_IDXSET_FOREACH(t, p->taps, idx) {
+        connection *c;
+
+        if (t->encoder != e)
+            continue;
+
+        tap_ref(t);
+
+        while ((c = pa_idxset_first(t->connections, NULL)))
+            connection_unlink(c);
+
+        tap_unref(t);
+    }
+
+    pa_assert_se(pa_hashmap_remove(p->encoders, e->name) == e);
+}
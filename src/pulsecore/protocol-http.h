@@ -30,6 +30,32 @@
 
 typedef struct pa_http_protocol pa_http_protocol;
 
+/* An encoder for the /listen/encoded/<encoder>/<source> URLs. A
+ * source is encoded only once per encoder, in the streaming thread,
+ * and the result is shared by all of its listeners. */
+typedef struct pa_http_encoder {
+    /* As used in the URL */
+    const char *name;
+
+    /* Adjust the sample spec and channel map the source is captured
+     * with to something the encoder accepts */
+    void (*fix_sample_spec)(pa_sample_spec *ss, pa_channel_map *cm);
+
+    /* The MIME type of the encoded stream, free with pa_xfree() */
+    char* (*get_mime_type)(const pa_sample_spec *ss, const pa_channel_map *cm);
+
+    /* Everything below is optional. If there is no new() the
+     * captured data is sent as is, for encodings that can be
+     * expressed as a sample format, like G.711. Otherwise new()
+     * returns the encoder state and the number of bytes it turns a
+     * block of input into at most. encode() is passed a multiple of
+     * the block size and returns the number of bytes written or a
+     * negative value on error. */
+    void* (*new)(const pa_sample_spec *ss, size_t *block_size, size_t *frame_size);
+    ssize_t (*encode)(void *state, const void *src, size_t length, void *dst);
+    void (*free)(void *state);
+} pa_http_encoder;
+
 pa_http_protocol* pa_http_protocol_get(pa_core *core);
 pa_http_protocol* pa_http_protocol_ref(pa_http_protocol *p);
 void pa_http_protocol_unref(pa_http_protocol *p);
@@ -40,4 +66,8 @@ void pa_http_protocol_add_server_string(pa_http_protocol *p, const char *name);
 void pa_http_protocol_remove_server_string(pa_http_protocol *p, const char *name);
 pa_strlist *pa_http_protocol_servers(pa_http_protocol *p);
 
+/* The encoder has to stay valid until it is removed again */
+int pa_http_protocol_add_encoder(pa_http_protocol *p, const pa_http_encoder *e);
+void pa_http_protocol_remove_encoder(pa_http_protocol *p, const pa_http_encoder *e);
+
 #endif
@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <pulse/mainloop.h>
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulse/version.h>
@@ -52,11 +53,16 @@
 #include <pulsecore/log.h>
 #include <pulsecore/strlist.h>
 #include <pulsecore/shared.h>
+#include <pulsecore/shm-ring.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/creds.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/ipacl.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/hashmap.h>
 
 #include "protocol-native.h"
 
@@ -73,6 +79,16 @@
 #define DEFAULT_PROCESS_MSEC 20   /* 20ms */
 #define DEFAULT_FRAGSIZE_MSEC DEFAULT_TLENGTH_MSEC
 
+/* Roughly what one entry of an info list reply takes */
+#define INFO_LIST_ENTRY_SIZE 512
+
+/* Hold back subscription events while more packets and blocks than
+ * this wait to be sent to the client */
+#define SUBSCRIPTION_BACKLOG_MAX 32
+
+/* Don't put more events than this into one subscription event packet */
+#define SUBSCRIPTION_EVENTS_MAX 128
+
 struct pa_native_protocol;
 
 typedef struct record_stream {
@@ -121,6 +137,15 @@ typedef struct playback_stream {
     pa_sink_input *sink_input;
     pa_memblockq *memblockq;
 
+    /* Audio the client writes into shared memory instead of sending
+     * it as memblocks. Only touched from IO context. */
+    pa_shm_ring *ring;
+    pa_bool_t ring_broken:1;
+
+    /* Whether the connection's I/O thread may post blocks to the sink
+     * directly. Protected by the connection's io_mutex. */
+    pa_bool_t io_direct;
+
     pa_bool_t adjust_latency:1;
     pa_bool_t early_requests:1;
 
@@ -142,6 +167,7 @@ typedef struct playback_stream {
 
     /* Only updated after SINK_INPUT_MESSAGE_UPDATE_LATENCY */
     int64_t read_index, write_index;
+    uint32_t ring_index;
     size_t render_memblockq_length;
     pa_usec_t current_sink_latency;
     uint64_t playing_for, underrun_for;
@@ -167,6 +193,25 @@ typedef struct upload_stream {
 #define UPLOAD_STREAM(o) (upload_stream_cast(o))
 PA_DEFINE_PRIVATE_CLASS(upload_stream, output_stream);
 
+/* The pstreams of the connections are served by a small pool of I/O
+ * threads, each running a main loop of its own. Control packets are
+ * handed to the main thread, audio data goes directly to the sink. */
+typedef struct io_thread {
+    pa_msgobject parent;
+
+    pa_native_protocol *protocol;
+    pa_mainloop *mainloop;
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+
+    unsigned n_connections;
+} io_thread;
+
+#define IO_THREAD(o) (io_thread_cast(o))
+PA_DEFINE_PRIVATE_CLASS(io_thread, pa_msgobject);
+
+#define IO_THREADS_MAX 4U
+
 struct pa_native_connection {
     pa_msgobject parent;
     pa_native_protocol *protocol;
@@ -181,6 +226,25 @@ struct pa_native_connection {
     uint32_t rrobin_index;
     pa_subscription *subscription;
     pa_time_event *auth_timeout_event;
+
+    /* The subscription event packet that is being filled */
+    pa_tagstruct *subscription_events;
+    unsigned n_subscription_events;
+
+    /* NULL if the pstream is served by the main loop */
+    io_thread *io_thread;
+
+    /* The playback streams by channel, for the I/O thread */
+    pa_mutex *io_mutex;
+    pa_hashmap *io_streams;
+
+    /* Packets and blocks the I/O thread handed to the main thread
+     * that have not been processed yet */
+    pa_atomic_t io_in_flight;
+
+    /* Set by the main thread when it wants to hear about the pstream
+     * running out of data to send */
+    pa_atomic_t io_drain_requested;
 };
 
 #define PA_NATIVE_CONNECTION(o) (pa_native_connection_cast(o))
@@ -192,6 +256,11 @@ struct pa_native_protocol {
     pa_core *core;
     pa_idxset *connections;
 
+    io_thread *io_threads[IO_THREADS_MAX];
+    unsigned n_io_threads;
+
+    pa_hook_slot *sink_input_move_start_slot, *sink_input_move_finish_slot;
+
     pa_strlist *servers;
     pa_hook hooks[PA_NATIVE_HOOK_MAX];
 
@@ -228,7 +297,42 @@ enum {
 
 enum {
     CONNECTION_MESSAGE_RELEASE,
-    CONNECTION_MESSAGE_REVOKE
+    CONNECTION_MESSAGE_REVOKE,
+    CONNECTION_MESSAGE_PACKET,   /* from the I/O thread to the main loop */
+    CONNECTION_MESSAGE_MEMBLOCK,
+    CONNECTION_MESSAGE_DIED,
+    CONNECTION_MESSAGE_DRAINED
+};
+
+enum {
+    IO_THREAD_MESSAGE_ATTACH,    /* from the main loop to the I/O thread */
+    IO_THREAD_MESSAGE_DETACH,
+    IO_THREAD_MESSAGE_ENABLE_SHM,
+    IO_THREAD_MESSAGE_SHUTDOWN
+};
+
+/* A packet on its way from the I/O thread to the main loop */
+struct io_packet {
+    pa_packet *packet;
+#ifdef HAVE_CREDS
+    pa_bool_t with_creds;
+    pa_creds creds;
+#endif
+};
+
+/* A block on its way from the I/O thread to the main loop. The chunk
+ * may be a hole, which pa_asyncmsgq won't carry itself. */
+struct io_memblock {
+    uint32_t channel;
+    int64_t offset;
+    pa_seek_mode_t seek;
+    pa_memchunk chunk;
+};
+
+/* The file descriptors of a new connection for the I/O thread */
+struct io_attach {
+    pa_native_connection *connection;
+    int ifd, ofd;
 };
 
 static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk);
@@ -240,7 +344,12 @@ static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_send_event_cb(pa_sink_input *i, const char *event, pa_proplist *pl);
 
+static void native_connection_unlink(pa_native_connection *c);
 static void native_connection_send_memblock(pa_native_connection *c);
+static void native_connection_drained(pa_native_connection *c);
+static void native_connection_enable_shm(pa_native_connection *c, pa_bool_t enable);
+static void native_connection_receive_packet(pa_native_connection *c, pa_packet *packet, const pa_creds *creds);
+static void native_connection_receive_memblock(pa_native_connection *c, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk);
 static void playback_stream_request_bytes(struct playback_stream*s);
 
 static void source_output_kill_cb(pa_source_output *o);
@@ -511,9 +620,18 @@ static int record_stream_process_msg(pa_msgobject *o, int code, void*userdata, i
 
             if (pa_memblockq_push_align(s->memblockq, chunk) < 0) {
 /*                 pa_log_warn("Failed to push data into output queue."); */
+                pa_stats_slot_inc(s->source_output->stats, PA_STATS_OVERRUNS);
                 return -1;
             }
 
+            pa_stats_slot_set(s->source_output->stats, PA_STATS_QUEUE_LENGTH, (uint32_t) pa_memblockq_get_length(s->memblockq));
+            pa_stats_slot_set(s->source_output->stats, PA_STATS_LATENCY, (uint32_t) pa_bytes_to_usec(pa_memblockq_get_length(s->memblockq), &s->source_output->sample_spec));
+
+            /* Ask first, so that the I/O thread cannot drain the
+             * pstream between our check and the request */
+            if (s->connection->io_thread)
+                pa_atomic_store(&s->connection->io_drain_requested, 1);
+
             if (!pa_pstream_is_pending(s->connection->pstream))
                 native_connection_send_memblock(s->connection);
 
@@ -763,6 +881,13 @@ static void playback_stream_unlink(playback_stream *s) {
     if (!s->connection)
         return;
 
+    if (s->connection->io_thread) {
+        pa_mutex_lock(s->connection->io_mutex);
+        pa_hashmap_remove(s->connection->io_streams, PA_UINT32_TO_PTR(s->index));
+        s->io_direct = FALSE;
+        pa_mutex_unlock(s->connection->io_mutex);
+    }
+
     if (s->sink_input) {
         pa_sink_input_unlink(s->sink_input);
         pa_sink_input_unref(s->sink_input);
@@ -784,6 +909,9 @@ static void playback_stream_free(pa_object* o) {
 
     playback_stream_unlink(s);
 
+    if (s->ring)
+        pa_shm_ring_free(s->ring);
+
     pa_memblockq_free(s->memblockq);
     pa_xfree(s);
 }
@@ -1076,11 +1204,12 @@ static playback_stream* playback_stream_new(
         pa_bool_t early_requests,
         pa_bool_t relative_volume,
         uint32_t syncid,
+        pa_shm_ring *ring,
         uint32_t *missing,
         int *ret) {
 
-    /* Note: This function takes ownership of the 'formats' param, so we need
-     * to take extra care to not leak it */
+    /* Note: This function takes ownership of the 'formats' and 'ring'
+     * params, so we need to take extra care to not leak them */
 
     playback_stream *ssync;
     playback_stream *s = NULL;
@@ -1160,6 +1289,9 @@ static playback_stream* playback_stream_new(
     s->connection = c;
     s->syncid = syncid;
     s->sink_input = sink_input;
+    s->ring = ring;
+    s->ring_broken = FALSE;
+    ring = NULL;
     s->is_underrun = TRUE;
     s->drain_request = FALSE;
     pa_atomic_store(&s->missing, 0);
@@ -1168,6 +1300,7 @@ static playback_stream* playback_stream_new(
     s->early_requests = early_requests;
     pa_atomic_store(&s->seek_or_post_in_queue, 0);
     s->seek_windex = -1;
+    s->io_direct = FALSE;
 
     s->sink_input->parent.process_msg = sink_input_process_msg;
     s->sink_input->pop = sink_input_pop_cb;
@@ -1220,10 +1353,20 @@ static playback_stream* playback_stream_new(
 
     pa_sink_input_put(s->sink_input);
 
+    if (c->io_thread) {
+        pa_mutex_lock(c->io_mutex);
+        s->io_direct = TRUE;
+        pa_hashmap_put(c->io_streams, PA_UINT32_TO_PTR(s->index), s);
+        pa_mutex_unlock(c->io_mutex);
+    }
+
 out:
     if (formats)
         pa_idxset_free(formats, (pa_free2_cb_t) pa_format_info_free2, NULL);
 
+    if (ring)
+        pa_shm_ring_free(ring);
+
     return s;
 }
 
@@ -1275,8 +1418,12 @@ static int native_connection_process_msg(pa_msgobject *o, int code, void*userdat
     pa_native_connection *c = PA_NATIVE_CONNECTION(o);
     pa_native_connection_assert_ref(c);
 
-    if (!c->protocol)
+    if (!c->protocol) {
+        if (code == CONNECTION_MESSAGE_PACKET || code == CONNECTION_MESSAGE_MEMBLOCK)
+            pa_atomic_dec(&c->io_in_flight);
+
         return -1;
+    }
 
     switch (code) {
 
@@ -1287,6 +1434,40 @@ static int native_connection_process_msg(pa_msgobject *o, int code, void*userdat
         case CONNECTION_MESSAGE_RELEASE:
             pa_pstream_send_release(c->pstream, PA_PTR_TO_UINT(userdata));
             break;
+
+        case CONNECTION_MESSAGE_PACKET: {
+            struct io_packet *ip = userdata;
+            const pa_creds *creds = NULL;
+
+#ifdef HAVE_CREDS
+            if (ip->with_creds)
+                creds = &ip->creds;
+#endif
+
+            native_connection_receive_packet(c, ip->packet, creds);
+
+            /* Only now the I/O thread may pass blocks to the sink
+             * again, since the command might have changed the stream */
+            pa_atomic_dec(&c->io_in_flight);
+            break;
+        }
+
+        case CONNECTION_MESSAGE_MEMBLOCK: {
+            struct io_memblock *im = userdata;
+
+            native_connection_receive_memblock(c, im->channel, im->offset, im->seek, &im->chunk);
+            pa_atomic_dec(&c->io_in_flight);
+            break;
+        }
+
+        case CONNECTION_MESSAGE_DIED:
+            native_connection_unlink(c);
+            pa_log_info("Connection died.");
+            break;
+
+        case CONNECTION_MESSAGE_DRAINED:
+            native_connection_drained(c);
+            break;
     }
 
     return 0;
@@ -1319,7 +1500,16 @@ static void native_connection_unlink(pa_native_connection *c) {
     if (c->subscription)
         pa_subscription_free(c->subscription);
 
-    if (c->pstream)
+    if (c->subscription_events) {
+        pa_tagstruct_free(c->subscription_events);
+        c->subscription_events = NULL;
+    }
+
+    if (c->io_thread) {
+        /* The pstream belongs to the I/O thread's main loop */
+        pa_asyncmsgq_send(c->io_thread->thread_mq.inq, PA_MSGOBJECT(c->io_thread), IO_THREAD_MESSAGE_DETACH, c, 0, NULL);
+        c->io_thread->n_connections--;
+    } else if (c->pstream)
         pa_pstream_unlink(c->pstream);
 
     if (c->auth_timeout_event) {
@@ -1344,7 +1534,16 @@ static void native_connection_free(pa_object *o) {
     pa_idxset_free(c->output_streams, NULL, NULL);
 
     pa_pdispatch_unref(c->pdispatch);
-    pa_pstream_unref(c->pstream);
+
+    if (c->pstream)
+        pa_pstream_unref(c->pstream);
+
+    if (c->io_streams)
+        pa_hashmap_free(c->io_streams, NULL, NULL);
+
+    if (c->io_mutex)
+        pa_mutex_free(c->io_mutex);
+
     pa_client_free(c->client);
 
     pa_xfree(c);
@@ -1383,6 +1582,36 @@ static void native_connection_send_memblock(pa_native_connection *c) {
     }
 }
 
+/* Called from main context */
+static pa_bool_t native_connection_record_data_queued(pa_native_connection *c) {
+    record_stream *r;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(r, c->record_streams, idx)
+        if (pa_memblockq_get_length(r->memblockq) > 0)
+            return TRUE;
+
+    return FALSE;
+}
+
+/* Called from main context */
+static void native_connection_drained(pa_native_connection *c) {
+    pa_native_connection_assert_ref(c);
+
+    /* We only send one fragment at a time, so have the I/O thread
+     * tell us again when it went out, as long as there is more to
+     * send. Ask first, for the same reason as in
+     * record_stream_process_msg(). */
+    if (c->io_thread && native_connection_record_data_queued(c))
+        pa_atomic_store(&c->io_drain_requested, 1);
+
+    native_connection_send_memblock(c);
+
+    /* The client caught up, let it have the events we held back */
+    if (c->subscription && pa_subscription_is_blocked(c->subscription))
+        pa_subscription_block(c->subscription, FALSE);
+}
+
 /*** sink input callbacks ***/
 
 /* Called from thread context */
@@ -1424,6 +1653,58 @@ static void handle_seek(playback_stream *s, int64_t indexw) {
     playback_stream_request_bytes(s);
 }
 
+/* Called from thread context. Moves everything the client put into
+ * the ring so far to the memblockq. Returns the write index from
+ * before, or -1 if there was nothing to move. */
+static int64_t playback_stream_read_ring(playback_stream *s) {
+    int64_t windex = -1;
+    const void *d;
+    size_t l;
+
+    playback_stream_assert_ref(s);
+
+    if (!s->ring || s->ring_broken)
+        return -1;
+
+    for (;;) {
+        pa_memchunk chunk;
+        void *p;
+
+        if (pa_shm_ring_peek(s->ring, &d, &l) < 0) {
+            pa_log_warn("Client corrupted the shared memory ring, ignoring it from now on.");
+            s->ring_broken = TRUE;
+            break;
+        }
+
+        if (l <= 0)
+            break;
+
+        if (windex < 0)
+            windex = pa_memblockq_get_write_index(s->memblockq);
+
+        chunk.index = 0;
+        chunk.length = PA_MIN(l, pa_mempool_block_size_max(s->sink_input->core->mempool));
+        chunk.memblock = pa_memblock_new(s->sink_input->core->mempool, chunk.length);
+
+        p = pa_memblock_acquire(chunk.memblock);
+        memcpy(p, d, chunk.length);
+        pa_memblock_release(chunk.memblock);
+
+        pa_shm_ring_drop(s->ring, chunk.length);
+
+        if (pa_memblockq_push_align(s->memblockq, &chunk) < 0) {
+            if (pa_log_ratelimit(PA_LOG_WARN))
+                pa_log_warn("Failed to push data into queue");
+            pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_OVERFLOW, NULL, 0, NULL, NULL);
+            pa_memblockq_seek(s->memblockq, (int64_t) chunk.length, PA_SEEK_RELATIVE, TRUE);
+        }
+
+        pa_memblock_unref(chunk.memblock);
+    }
+
+    return windex;
+}
+
 static void flush_write_no_account(pa_memblockq *q) {
     pa_memblockq_flush_write(q, FALSE);
 }
@@ -1432,11 +1713,17 @@ static void flush_write_no_account(pa_memblockq *q) {
 static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
     pa_sink_input *i = PA_SINK_INPUT(o);
     playback_stream *s;
+    int64_t ring_windex;
 
     pa_sink_input_assert_ref(i);
     s = PLAYBACK_STREAM(i->userdata);
     playback_stream_assert_ref(s);
 
+    /* The client wrote whatever is in the ring before it sent us
+     * anything that ends up here, so process that first */
+    if ((ring_windex = playback_stream_read_ring(s)) >= 0)
+        handle_seek(s, ring_windex);
+
     switch (code) {
 
         case SINK_INPUT_MESSAGE_SEEK:
@@ -1505,6 +1792,8 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
             /* Do the same for all other members in the sync group */
             for (isync = i->sync_prev; isync; isync = isync->sync_prev) {
                 playback_stream *ssync = PLAYBACK_STREAM(isync->userdata);
+                if ((ring_windex = playback_stream_read_ring(ssync)) >= 0)
+                    handle_seek(ssync, ring_windex);
                 windex = pa_memblockq_get_write_index(ssync->memblockq);
                 func(ssync->memblockq);
                 handle_seek(ssync, windex);
@@ -1512,6 +1801,8 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
 
             for (isync = i->sync_next; isync; isync = isync->sync_next) {
                 playback_stream *ssync = PLAYBACK_STREAM(isync->userdata);
+                if ((ring_windex = playback_stream_read_ring(ssync)) >= 0)
+                    handle_seek(ssync, ring_windex);
                 windex = pa_memblockq_get_write_index(ssync->memblockq);
                 func(ssync->memblockq);
                 handle_seek(ssync, windex);
@@ -1533,6 +1824,7 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
             /* Atomically get a snapshot of all timing parameters... */
             s->read_index = pa_memblockq_get_read_index(s->memblockq);
             s->write_index = pa_memblockq_get_write_index(s->memblockq);
+            s->ring_index = s->ring ? pa_shm_ring_get_index(s->ring) : 0;
             s->render_memblockq_length = pa_memblockq_get_length(s->sink_input->thread_info.render_memblockq);
             s->current_sink_latency = pa_sink_get_latency_within_thread(s->sink_input->sink);
             s->underrun_for = s->sink_input->thread_info.underrun_for;
@@ -1582,6 +1874,12 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     playback_stream_assert_ref(s);
     pa_assert(chunk);
 
+    /* There is no wakeup for data in the ring, we just pick it up
+     * whenever the sink asks for more. We are rendering right now, so
+     * there is no point in asking for a rewind. */
+    if (playback_stream_read_ring(s) >= 0)
+        playback_stream_request_bytes(s);
+
 #ifdef PROTOCOL_NATIVE_DEBUG
     pa_log("%s, pop(): %lu", pa_proplist_gets(i->proplist, PA_PROP_MEDIA_NAME), (unsigned long) pa_memblockq_get_length(s->memblockq));
 #endif
@@ -1616,6 +1914,9 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     pa_memblockq_drop(s->memblockq, chunk->length);
     playback_stream_request_bytes(s);
 
+    pa_stats_slot_set(i->stats, PA_STATS_QUEUE_LENGTH, (uint32_t) pa_memblockq_get_length(s->memblockq));
+    pa_stats_slot_set(i->stats, PA_STATS_LATENCY, (uint32_t) pa_bytes_to_usec(pa_memblockq_get_length(s->memblockq), &i->sample_spec));
+
     return 0;
 }
 
@@ -1920,15 +2221,19 @@ if (!(expression)) { \
 } \
 } while(0);
 
-static pa_tagstruct *reply_new(uint32_t tag) {
+static pa_tagstruct *reply_new_sized(uint32_t tag, size_t size_hint) {
     pa_tagstruct *reply;
 
-    reply = pa_tagstruct_new(NULL, 0);
+    reply = pa_tagstruct_new_sized(size_hint);
     pa_tagstruct_putu32(reply, PA_COMMAND_REPLY);
     pa_tagstruct_putu32(reply, tag);
     return reply;
 }
 
+static pa_tagstruct *reply_new(uint32_t tag) {
+    return reply_new_sized(tag, 0);
+}
+
 static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     playback_stream *s;
@@ -1966,6 +2271,8 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
     pa_format_info *format;
     pa_idxset *formats = NULL;
     uint32_t i;
+    uint32_t ring_id = 0, ring_size = 0;
+    pa_shm_ring *ring = NULL;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
@@ -2087,6 +2394,15 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
         }
     }
 
+    if (c->version >= 28) {
+
+        if (pa_tagstruct_getu32(t, &ring_id) < 0 ||
+            pa_tagstruct_getu32(t, &ring_size) < 0) {
+            protocol_error(c);
+            goto finish;
+        }
+    }
+
     if (n_formats == 0) {
         CHECK_VALIDITY_GOTO(c->pstream, pa_sample_spec_valid(&ss), tag, PA_ERR_INVALID, finish);
         CHECK_VALIDITY_GOTO(c->pstream, map.channels == ss.channels && volume.channels == ss.channels, tag, PA_ERR_INVALID, finish);
@@ -2134,9 +2450,15 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
      * flag. For older versions we synthesize it here */
     muted_set = muted_set || muted;
 
-    s = playback_stream_new(c, sink, &ss, &map, formats, &attr, volume_set ? &volume : NULL, muted, muted_set, flags, p, adjust_latency, early_requests, relative_volume, syncid, &missing, &ret);
-    /* We no longer own the formats idxset */
+    /* Only clients we share memory with anyway may use a ring. If
+     * attaching fails they simply keep sending memblocks. */
+    if (ring_id != 0 && pa_pstream_get_shm(c->pstream))
+        ring = pa_shm_ring_attach(ring_id, ring_size);
+
+    s = playback_stream_new(c, sink, &ss, &map, formats, &attr, volume_set ? &volume : NULL, muted, muted_set, flags, p, adjust_latency, early_requests, relative_volume, syncid, ring, &missing, &ret);
+    /* We no longer own the formats idxset and the ring */
     formats = NULL;
+    ring = NULL;
 
     CHECK_VALIDITY_GOTO(c->pstream, s, tag, ret, finish);
 
@@ -2187,6 +2509,9 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
         }
     }
 
+    if (c->version >= 28)
+        pa_tagstruct_putu32(reply, s->ring ? pa_shm_ring_get_id(s->ring) : 0);
+
     pa_pstream_send_tagstruct(c->pstream, reply);
 
 finish:
@@ -2644,7 +2969,7 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
 #endif
 
     pa_log_debug("Negotiated SHM: %s", pa_yes_no(do_shm));
-    pa_pstream_enable_shm(c->pstream, do_shm);
+    native_connection_enable_shm(c, do_shm);
 
     reply = reply_new(tag);
     pa_tagstruct_putu32(reply, PA_PROTOCOL_VERSION | (do_shm ? 0x80000000 : 0));
@@ -2833,6 +3158,13 @@ static void command_get_playback_latency(pa_pdispatch *pd, uint32_t command, uin
         pa_tagstruct_putu64(reply, s->playing_for);
     }
 
+    /* The write index includes whatever the client wrote into the
+     * ring up to this point, which might be more than it had written
+     * when it asked. Tell it where exactly we are, so that it can
+     * correct for that. */
+    if (c->version >= 28)
+        pa_tagstruct_putu32(reply, s->ring_index);
+
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
@@ -3510,24 +3842,58 @@ static void command_get_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, p
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+static pa_proplist *info_list_entry_proplist(uint32_t command, void *p) {
+    pa_assert(p);
+
+    switch (command) {
+        case PA_COMMAND_GET_SINK_INFO_LIST:
+            return ((pa_sink*) p)->proplist;
+        case PA_COMMAND_GET_SOURCE_INFO_LIST:
+            return ((pa_source*) p)->proplist;
+        case PA_COMMAND_GET_CLIENT_INFO_LIST:
+            return ((pa_client*) p)->proplist;
+        case PA_COMMAND_GET_CARD_INFO_LIST:
+            return ((pa_card*) p)->proplist;
+        case PA_COMMAND_GET_MODULE_INFO_LIST:
+            return ((pa_module*) p)->proplist;
+        case PA_COMMAND_GET_SINK_INPUT_INFO_LIST:
+            return ((pa_sink_input*) p)->proplist;
+        case PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST:
+            return ((pa_source_output*) p)->proplist;
+        default:
+            pa_assert(command == PA_COMMAND_GET_SAMPLE_INFO_LIST);
+            return ((pa_scache_entry*) p)->proplist;
+    }
+}
+
 static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_idxset *i;
-    uint32_t idx;
+    uint32_t idx, cursor = 0, max = (uint32_t) -1, n = 0;
+    const char *key = NULL, *value = NULL;
     void *p;
     pa_tagstruct *reply;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
 
-    if (!pa_tagstruct_eof(t)) {
+    /* Since 28 the list may be requested page by page, filtered by a
+     * property */
+    if (!pa_tagstruct_eof(t) &&
+        (c->version < 28 ||
+         pa_tagstruct_getu32(t, &cursor) < 0 ||
+         pa_tagstruct_getu32(t, &max) < 0 ||
+         pa_tagstruct_gets(t, &key) < 0 ||
+         pa_tagstruct_gets(t, &value) < 0 ||
+         !pa_tagstruct_eof(t))) {
         protocol_error(c);
         return;
     }
 
     CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
-
-    reply = reply_new(tag);
+    CHECK_VALIDITY(c->pstream, max > 0, tag, PA_ERR_INVALID);
+    CHECK_VALIDITY(c->pstream, !key || pa_proplist_key_valid(key), tag, PA_ERR_INVALID);
+    CHECK_VALIDITY(c->pstream, key || !value, tag, PA_ERR_INVALID);
 
     if (command == PA_COMMAND_GET_SINK_INFO_LIST)
         i = c->protocol->core->sinks;
@@ -3548,8 +3914,30 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
         i = c->protocol->core->scache;
     }
 
+    /* Saves growing the buffer over and over again for long lists */
+    reply = reply_new_sized(tag, i ? PA_MIN(pa_idxset_size(i), max) * INFO_LIST_ENTRY_SIZE : 0);
+
     if (i) {
-        PA_IDXSET_FOREACH(p, i, idx) {
+        /* The entries are in the order of their indexes, so we start
+         * with the first one at or after the cursor */
+        if (cursor == 0)
+            p = pa_idxset_first(i, &idx);
+        else {
+            idx = cursor - 1;
+            p = pa_idxset_next(i, &idx);
+        }
+
+        for (; p && n < max; p = pa_idxset_next(i, &idx)) {
+            if (key) {
+                const char *v;
+
+                if (!(v = pa_proplist_gets(info_list_entry_proplist(command, p), key)) ||
+                    (value && !pa_streq(v, value)))
+                    continue;
+            }
+
+            n++;
+
             if (command == PA_COMMAND_GET_SINK_INFO_LIST)
                 sink_fill_tagstruct(c, reply, p);
             else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST)
@@ -3620,18 +4008,56 @@ static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+static void send_subscription_events(pa_native_connection *c) {
+    pa_native_connection_assert_ref(c);
+
+    if (!c->subscription_events)
+        return;
+
+    pa_pstream_send_tagstruct(c->pstream, c->subscription_events);
+    c->subscription_events = NULL;
+    c->n_subscription_events = 0;
+}
+
 static void subscription_cb(pa_core *core, pa_subscription_event_type_t e, uint32_t idx, void *userdata) {
-    pa_tagstruct *t;
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
 
     pa_native_connection_assert_ref(c);
 
-    t = pa_tagstruct_new(NULL, 0);
-    pa_tagstruct_putu32(t, PA_COMMAND_SUBSCRIBE_EVENT);
-    pa_tagstruct_putu32(t, (uint32_t) -1);
-    pa_tagstruct_putu32(t, e);
-    pa_tagstruct_putu32(t, idx);
-    pa_pstream_send_tagstruct(c->pstream, t);
+    /* Newer clients get all events of one dispatch run in as few
+     * packets as possible */
+    if (!c->subscription_events) {
+        c->subscription_events = pa_tagstruct_new(NULL, 0);
+        pa_tagstruct_putu32(c->subscription_events, PA_COMMAND_SUBSCRIBE_EVENT);
+        pa_tagstruct_putu32(c->subscription_events, (uint32_t) -1);
+    }
+
+    pa_tagstruct_putu32(c->subscription_events, e);
+    pa_tagstruct_putu32(c->subscription_events, idx);
+
+    if (c->version < 28 || ++c->n_subscription_events >= SUBSCRIPTION_EVENTS_MAX)
+        send_subscription_events(c);
+}
+
+static void subscription_flush_cb(pa_core *core, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_native_connection_assert_ref(c);
+
+    send_subscription_events(c);
+
+    /* If the client doesn't keep up we hold further events back until
+     * it read what is queued, so that they are coalesced meanwhile */
+    if (pa_pstream_get_n_pending(c->pstream) <= SUBSCRIPTION_BACKLOG_MAX)
+        return;
+
+    /* Ask first, so that the I/O thread cannot drain the pstream
+     * between our check and the request */
+    if (c->io_thread)
+        pa_atomic_store(&c->io_drain_requested, 1);
+
+    if (pa_pstream_get_n_pending(c->pstream) > SUBSCRIPTION_BACKLOG_MAX)
+        pa_subscription_block(c->subscription, TRUE);
 }
 
 static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -3653,9 +4079,12 @@ static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag,
     if (c->subscription)
         pa_subscription_free(c->subscription);
 
+    send_subscription_events(c);
+
     if (m != 0) {
         c->subscription = pa_subscription_new(c->protocol->core, m, subscription_cb, c);
         pa_assert(c->subscription);
+        pa_subscription_set_flush_callback(c->subscription, subscription_flush_cb);
     } else
         c->subscription = NULL;
 
@@ -4767,12 +5196,10 @@ static void command_set_port_latency_offset(pa_pdispatch *pd, uint32_t command,
 
 /*** pstream callbacks ***/
 
-static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
-    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
-
-    pa_assert(p);
-    pa_assert(packet);
+/* Called from main context */
+static void native_connection_receive_packet(pa_native_connection *c, pa_packet *packet, const pa_creds *creds) {
     pa_native_connection_assert_ref(c);
+    pa_assert(packet);
 
     if (pa_pdispatch_run(c->pdispatch, packet, creds, c) < 0) {
         pa_log("invalid packet.");
@@ -4780,13 +5207,33 @@ static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, const pa_c
     }
 }
 
-static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
-    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+/* Called from main context, or from the I/O thread with the
+ * connection's io_mutex held */
+static void playback_stream_post_memblock(playback_stream *ps, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk) {
+    playback_stream_assert_ref(ps);
+    pa_assert(chunk);
+
+    pa_atomic_inc(&ps->seek_or_post_in_queue);
+    if (chunk->memblock) {
+        /* Flag blocks of pure silence now, while the data is hot
+         * in the cache. The sink input then skips them without
+         * looking at the data again. */
+        pa_memchunk_is_silence(chunk, &ps->sink_input->sample_spec);
+
+        if (seek != PA_SEEK_RELATIVE || offset != 0)
+            pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset, chunk, NULL);
+        else
+            pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
+    } else
+        pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset+chunk->length, NULL, NULL);
+}
+
+/* Called from main context */
+static void native_connection_receive_memblock(pa_native_connection *c, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk) {
     output_stream *stream;
 
-    pa_assert(p);
-    pa_assert(chunk);
     pa_native_connection_assert_ref(c);
+    pa_assert(chunk);
 
     if (!(stream = OUTPUT_STREAM(pa_idxset_get_by_index(c->output_streams, channel)))) {
         pa_log_debug("Client sent block for invalid stream.");
@@ -4798,19 +5245,9 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
     pa_log("got %lu bytes from client", (unsigned long) chunk->length);
 #endif
 
-    if (playback_stream_isinstance(stream)) {
-        playback_stream *ps = PLAYBACK_STREAM(stream);
-
-        pa_atomic_inc(&ps->seek_or_post_in_queue);
-        if (chunk->memblock) {
-            if (seek != PA_SEEK_RELATIVE || offset != 0)
-                pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset, chunk, NULL);
-            else
-                pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
-        } else
-            pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_SEEK, PA_UINT_TO_PTR(seek), offset+chunk->length, NULL, NULL);
-
-    } else {
+    if (playback_stream_isinstance(stream))
+        playback_stream_post_memblock(PLAYBACK_STREAM(stream), offset, seek, chunk);
+    else {
         upload_stream *u = UPLOAD_STREAM(stream);
         size_t l;
 
@@ -4854,6 +5291,26 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
     }
 }
 
+static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_assert(p);
+    pa_assert(packet);
+    pa_native_connection_assert_ref(c);
+
+    native_connection_receive_packet(c, packet, creds);
+}
+
+static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_assert(p);
+    pa_assert(chunk);
+    pa_native_connection_assert_ref(c);
+
+    native_connection_receive_memblock(c, channel, offset, seek, chunk);
+}
+
 static void pstream_die_callback(pa_pstream *p, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
 
@@ -4870,27 +5327,324 @@ static void pstream_drain_callback(pa_pstream *p, void *userdata) {
     pa_assert(p);
     pa_native_connection_assert_ref(c);
 
-    native_connection_send_memblock(c);
+    native_connection_drained(c);
 }
 
 static void pstream_revoke_callback(pa_pstream *p, uint32_t block_id, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_thread_mq *q;
 
-    if (!(q = pa_thread_mq_get()))
+    /* Pstreams of I/O threads may be written to from everywhere */
+    if (c->io_thread || !(q = pa_thread_mq_get()))
         pa_pstream_send_revoke(p, block_id);
     else
         pa_asyncmsgq_post(q->outq, PA_MSGOBJECT(userdata), CONNECTION_MESSAGE_REVOKE, PA_UINT_TO_PTR(block_id), 0, NULL, NULL);
 }
 
 static void pstream_release_callback(pa_pstream *p, uint32_t block_id, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_thread_mq *q;
 
-    if (!(q = pa_thread_mq_get()))
+    if (c->io_thread || !(q = pa_thread_mq_get()))
         pa_pstream_send_release(p, block_id);
     else
         pa_asyncmsgq_post(q->outq, PA_MSGOBJECT(userdata), CONNECTION_MESSAGE_RELEASE, PA_UINT_TO_PTR(block_id), 0, NULL, NULL);
 }
 
+/*** I/O thread pstream callbacks ***/
+
+static void io_packet_free(void *userdata) {
+    struct io_packet *ip = userdata;
+
+    pa_assert(ip);
+
+    pa_packet_unref(ip->packet);
+    pa_xfree(ip);
+}
+
+static void io_memblock_free(void *userdata) {
+    struct io_memblock *im = userdata;
+
+    pa_assert(im);
+
+    if (im->chunk.memblock)
+        pa_memblock_unref(im->chunk.memblock);
+
+    pa_xfree(im);
+}
+
+/* Called from I/O thread context */
+static void io_pstream_packet_callback(pa_pstream *p, pa_packet *packet, const pa_creds *creds, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    struct io_packet *ip;
+
+    pa_assert(p);
+    pa_assert(packet);
+    pa_native_connection_assert_ref(c);
+
+    ip = pa_xnew(struct io_packet, 1);
+    ip->packet = pa_packet_ref(packet);
+
+#ifdef HAVE_CREDS
+    if ((ip->with_creds = !!creds))
+        ip->creds = *creds;
+#endif
+
+    pa_atomic_inc(&c->io_in_flight);
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_PACKET, ip, 0, NULL, io_packet_free);
+}
+
+/* Called from I/O thread context */
+static void io_pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    struct io_memblock *im;
+
+    pa_assert(p);
+    pa_assert(chunk);
+    pa_native_connection_assert_ref(c);
+
+    /* Only we increase the counter, hence if it is zero now the main
+     * thread has nothing left that needs to reach the sink before
+     * this block does */
+    if (pa_atomic_load(&c->io_in_flight) == 0) {
+        playback_stream *ps;
+
+        pa_mutex_lock(c->io_mutex);
+
+        if ((ps = pa_hashmap_get(c->io_streams, PA_UINT32_TO_PTR(channel))) && ps->io_direct) {
+            playback_stream_post_memblock(ps, offset, seek, chunk);
+            pa_mutex_unlock(c->io_mutex);
+            return;
+        }
+
+        pa_mutex_unlock(c->io_mutex);
+    }
+
+    /* Upload streams, streams being moved, and blocks that have to
+     * wait for a command go the long way */
+    im = pa_xnew(struct io_memblock, 1);
+    im->channel = channel;
+    im->offset = offset;
+    im->seek = seek;
+    im->chunk = *chunk;
+
+    if (im->chunk.memblock)
+        pa_memblock_ref(im->chunk.memblock);
+
+    pa_atomic_inc(&c->io_in_flight);
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_MEMBLOCK, im, 0, NULL, io_memblock_free);
+}
+
+/* Called from I/O thread context */
+static void io_pstream_die_callback(pa_pstream *p, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_assert(p);
+    pa_native_connection_assert_ref(c);
+
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_DIED, NULL, 0, NULL, NULL);
+}
+
+/* Called from I/O thread context */
+static void io_pstream_drain_callback(pa_pstream *p, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_assert(p);
+    pa_native_connection_assert_ref(c);
+
+    if (pa_atomic_cmpxchg(&c->io_drain_requested, 1, 0))
+        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_DRAINED, NULL, 0, NULL, NULL);
+}
+
+/*** I/O threads ***/
+
+/* Called from I/O thread context */
+static void io_thread_attach(io_thread *t, struct io_attach *a) {
+    pa_native_connection *c;
+    pa_iochannel *io;
+
+    pa_assert(t);
+    pa_assert(a);
+    pa_assert_se(c = a->connection);
+
+    io = pa_iochannel_new(pa_mainloop_get_api(t->mainloop), a->ifd, a->ofd);
+
+    c->pstream = pa_pstream_new(pa_mainloop_get_api(t->mainloop), io, t->protocol->core->mempool);
+    pa_pstream_set_receive_packet_callback(c->pstream, io_pstream_packet_callback, c);
+    pa_pstream_set_receive_memblock_callback(c->pstream, io_pstream_memblock_callback, c);
+    pa_pstream_set_die_callback(c->pstream, io_pstream_die_callback, c);
+    pa_pstream_set_drain_callback(c->pstream, io_pstream_drain_callback, c);
+    pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
+    pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+    pa_pstream_enable_foreign_send(c->pstream);
+
+#ifdef HAVE_CREDS
+    if (pa_iochannel_creds_supported(io))
+        pa_iochannel_creds_enable(io);
+#endif
+}
+
+/* Called from I/O thread context */
+static int io_thread_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
+    io_thread *t = IO_THREAD(o);
+
+    pa_assert(t);
+
+    switch (code) {
+
+        case IO_THREAD_MESSAGE_ATTACH:
+            io_thread_attach(t, userdata);
+            break;
+
+        case IO_THREAD_MESSAGE_DETACH:
+            pa_pstream_unlink(PA_NATIVE_CONNECTION(userdata)->pstream);
+            break;
+
+        case IO_THREAD_MESSAGE_ENABLE_SHM:
+            pa_pstream_enable_shm(PA_NATIVE_CONNECTION(userdata)->pstream, !!offset);
+            break;
+
+        case IO_THREAD_MESSAGE_SHUTDOWN:
+            pa_mainloop_quit(t->mainloop, 0);
+            break;
+    }
+
+    return 0;
+}
+
+static void io_thread_func(void *userdata) {
+    io_thread *t = userdata;
+
+    pa_assert(t);
+
+    pa_log_debug("I/O thread starting up");
+
+    pa_thread_mq_install(&t->thread_mq);
+
+    if (pa_mainloop_run(t->mainloop, NULL) < 0)
+        pa_log_error("I/O thread main loop failed.");
+
+    pa_log_debug("I/O thread shutting down");
+}
+
+/* Called from main context */
+static void io_thread_free(pa_object *o) {
+    io_thread *t = IO_THREAD(o);
+
+    pa_assert(t);
+    pa_assert(!t->thread);
+
+    pa_xfree(t);
+}
+
+/* Called from main context */
+static io_thread* io_thread_new(pa_native_protocol *p) {
+    io_thread *t;
+
+    pa_assert(p);
+
+    t = pa_msgobject_new(io_thread);
+    t->parent.parent.free = io_thread_free;
+    t->parent.process_msg = io_thread_process_msg;
+    t->protocol = p;
+    t->n_connections = 0;
+    t->mainloop = pa_mainloop_new();
+    pa_thread_mq_init_thread_mainloop(&t->thread_mq, p->core->mainloop, pa_mainloop_get_api(t->mainloop));
+
+    if (!(t->thread = pa_thread_new("native-io", io_thread_func, t))) {
+        pa_log("Failed to create I/O thread.");
+        pa_thread_mq_done(&t->thread_mq);
+        pa_mainloop_free(t->mainloop);
+        io_thread_unref(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+/* Called from main context */
+static void io_thread_shutdown(io_thread *t) {
+    pa_assert(t);
+    pa_assert(t->n_connections == 0);
+
+    pa_asyncmsgq_send(t->thread_mq.inq, PA_MSGOBJECT(t), IO_THREAD_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+    pa_thread_free(t->thread);
+    t->thread = NULL;
+
+    pa_thread_mq_done(&t->thread_mq);
+    pa_mainloop_free(t->mainloop);
+    t->mainloop = NULL;
+
+    io_thread_unref(t);
+}
+
+/* Called from main context. Picks the thread with the fewest
+ * connections, and starts a new one as long as all have some. */
+static io_thread* native_protocol_get_io_thread(pa_native_protocol *p) {
+    io_thread *t = NULL;
+    unsigned i, n_max = 1;
+    int ncpus;
+
+    pa_assert(p);
+
+    if ((ncpus = pa_ncpus()) > 1)
+        n_max = PA_MIN((unsigned) ncpus, IO_THREADS_MAX);
+
+    for (i = 0; i < p->n_io_threads; i++)
+        if (!t || p->io_threads[i]->n_connections < t->n_connections)
+            t = p->io_threads[i];
+
+    if ((!t || t->n_connections > 0) && p->n_io_threads < n_max) {
+        io_thread *n;
+
+        if ((n = io_thread_new(p)))
+            t = p->io_threads[p->n_io_threads++] = n;
+    }
+
+    return t;
+}
+
+/* Called from main context */
+static void native_connection_enable_shm(pa_native_connection *c, pa_bool_t enable) {
+    pa_native_connection_assert_ref(c);
+
+    if (c->io_thread)
+        pa_asyncmsgq_send(c->io_thread->thread_mq.inq, PA_MSGOBJECT(c->io_thread), IO_THREAD_MESSAGE_ENABLE_SHM, c, enable, NULL);
+    else
+        pa_pstream_enable_shm(c->pstream, enable);
+}
+
+/* While a stream is being moved it has no sink, so the I/O thread
+ * has to leave it to the main thread until the move is complete */
+static void playback_stream_set_io_direct(pa_sink_input *i, pa_bool_t direct) {
+    playback_stream *s;
+
+    pa_sink_input_assert_ref(i);
+
+    if (i->parent.process_msg != sink_input_process_msg)
+        return;
+
+    s = PLAYBACK_STREAM(i->userdata);
+    playback_stream_assert_ref(s);
+
+    if (!s->connection || !s->connection->io_thread)
+        return;
+
+    pa_mutex_lock(s->connection->io_mutex);
+    s->io_direct = direct;
+    pa_mutex_unlock(s->connection->io_mutex);
+}
+
+static pa_hook_result_t sink_input_move_start_hook_cb(pa_core *core, pa_sink_input *i, pa_native_protocol *p) {
+    playback_stream_set_io_direct(i, FALSE);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_move_finish_hook_cb(pa_core *core, pa_sink_input *i, pa_native_protocol *p) {
+    playback_stream_set_io_direct(i, TRUE);
+    return PA_HOOK_OK;
+}
+
 /*** client callbacks ***/
 
 static void client_kill_cb(pa_client *c) {
@@ -4995,13 +5749,43 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     c->client->send_event = client_send_event_cb;
     c->client->userdata = c;
 
-    c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
-    pa_pstream_set_receive_packet_callback(c->pstream, pstream_packet_callback, c);
-    pa_pstream_set_receive_memblock_callback(c->pstream, pstream_memblock_callback, c);
-    pa_pstream_set_die_callback(c->pstream, pstream_die_callback, c);
-    pa_pstream_set_drain_callback(c->pstream, pstream_drain_callback, c);
-    pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
-    pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+    c->pstream = NULL;
+    c->io_mutex = NULL;
+    c->io_streams = NULL;
+    pa_atomic_store(&c->io_in_flight, 0);
+    pa_atomic_store(&c->io_drain_requested, 0);
+
+    if ((c->io_thread = native_protocol_get_io_thread(p))) {
+        struct io_attach a;
+
+        c->io_mutex = pa_mutex_new(FALSE, FALSE);
+        c->io_streams = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+        c->io_thread->n_connections++;
+
+        /* The I/O thread sets up its own channel on the same sockets */
+        a.connection = c;
+        a.ifd = pa_iochannel_get_recv_fd(io);
+        a.ofd = pa_iochannel_get_send_fd(io);
+        pa_iochannel_set_noclose(io, TRUE);
+        pa_iochannel_free(io);
+
+        pa_asyncmsgq_send(c->io_thread->thread_mq.inq, PA_MSGOBJECT(c->io_thread), IO_THREAD_MESSAGE_ATTACH, &a, 0, NULL);
+        pa_assert(c->pstream);
+
+    } else {
+        c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
+        pa_pstream_set_receive_packet_callback(c->pstream, pstream_packet_callback, c);
+        pa_pstream_set_receive_memblock_callback(c->pstream, pstream_memblock_callback, c);
+        pa_pstream_set_die_callback(c->pstream, pstream_die_callback, c);
+        pa_pstream_set_drain_callback(c->pstream, pstream_drain_callback, c);
+        pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
+        pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+
+#ifdef HAVE_CREDS
+        if (pa_iochannel_creds_supported(io))
+            pa_iochannel_creds_enable(io);
+#endif
+    }
 
     c->pdispatch = pa_pdispatch_new(p->core->mainloop, TRUE, command_table, PA_COMMAND_MAX);
 
@@ -5010,14 +5794,11 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
 
     c->rrobin_index = PA_IDXSET_INVALID;
     c->subscription = NULL;
+    c->subscription_events = NULL;
+    c->n_subscription_events = 0;
 
     pa_idxset_put(p->connections, c, NULL);
 
-#ifdef HAVE_CREDS
-    if (pa_iochannel_creds_supported(io))
-        pa_iochannel_creds_enable(io);
-#endif
-
     pa_hook_fire(&p->hooks[PA_NATIVE_HOOK_CONNECTION_PUT], c);
 }
 
@@ -5044,6 +5825,10 @@ static pa_native_protocol* native_protocol_new(pa_core *c) {
     p->core = c;
     p->connections = pa_idxset_new(NULL, NULL);
 
+    p->n_io_threads = 0;
+    p->sink_input_move_start_slot = pa_hook_connect(&c->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_START], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_start_hook_cb, p);
+    p->sink_input_move_finish_slot = pa_hook_connect(&c->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_FINISH], PA_HOOK_EARLY, (pa_hook_cb_t) sink_input_move_finish_hook_cb, p);
+
     p->servers = NULL;
 
     p->extensions = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
@@ -5077,6 +5862,7 @@ pa_native_protocol* pa_native_protocol_ref(pa_native_protocol *p) {
 void pa_native_protocol_unref(pa_native_protocol *p) {
     pa_native_connection *c;
     pa_native_hook_t h;
+    unsigned i;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) >= 1);
@@ -5089,6 +5875,12 @@ void pa_native_protocol_unref(pa_native_protocol *p) {
 
     pa_idxset_free(p->connections, NULL, NULL);
 
+    for (i = 0; i < p->n_io_threads; i++)
+        io_thread_shutdown(p->io_threads[i]);
+
+    pa_hook_slot_free(p->sink_input_move_start_slot);
+    pa_hook_slot_free(p->sink_input_move_finish_slot);
+
     pa_strlist_free(p->servers);
 
     for (h = 0; h < PA_NATIVE_HOOK_MAX; h++)
@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #ifdef HAVE_NETINET_IN_H
@@ -41,6 +42,10 @@
 #include <pulsecore/refcnt.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/atomic.h>
 
 #include "pstream.h"
 
@@ -79,6 +84,14 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
  */
 #define FRAME_SIZE_MAX_ALLOW (1024*1024*16)
 
+/* How many queued frames we hand to the kernel in one go */
+#define WRITE_ITEMS_MAX 32
+
+/* Frames arriving in pieces smaller than this are read through a
+ * buffer, so that we can parse more than one frame per syscall. Larger
+ * payloads are read directly into their destination. */
+#define READ_BUFFER_SIZE (16*1024)
+
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
 struct item_info {
@@ -104,6 +117,11 @@ struct item_info {
 
     /* release/revoke info */
     uint32_t block_id;
+
+    /* Wire format, filled in by prepare_write_item() */
+    pa_pstream_descriptor descriptor;
+    uint32_t shm_info[PA_PSTREAM_SHM_MAX];
+    void *data;
 };
 
 struct pa_pstream {
@@ -115,15 +133,27 @@ struct pa_pstream {
 
     pa_queue *send_queue;
 
+    /* Frames queued but not completely written yet */
+    pa_atomic_t n_pending;
+
+    /* Only set up by pa_pstream_enable_foreign_send(). Frames from
+     * other threads are queued here and picked up by ours. */
+    struct {
+        pa_thread *thread;
+        pa_mutex *mutex;
+        pa_queue *queue;
+        pa_fdsem *fdsem;
+        pa_io_event *io_event;
+    } foreign;
+
     pa_bool_t dead;
 
     struct {
-        pa_pstream_descriptor descriptor;
-        struct item_info* current;
-        uint32_t shm_info[PA_PSTREAM_SHM_MAX];
-        void *data;
+        /* The frames currently being written, index counts the bytes
+         * of the first one that already went out */
+        struct item_info* items[WRITE_ITEMS_MAX];
+        unsigned n_items;
         size_t index;
-        pa_memchunk memchunk;
     } write;
 
     struct {
@@ -133,6 +163,14 @@ struct pa_pstream {
         uint32_t shm_info[PA_PSTREAM_SHM_MAX];
         void *data;
         size_t index;
+
+        /* Data read from the socket but not yet parsed */
+        uint8_t buffer[READ_BUFFER_SIZE];
+        size_t buffer_index, buffer_length;
+#ifdef HAVE_CREDS
+        pa_creds buffer_creds;
+        pa_bool_t buffer_creds_valid;
+#endif
     } read;
 
     pa_bool_t use_shm;
@@ -160,8 +198,8 @@ struct pa_pstream {
     pa_mempool *mempool;
 
 #ifdef HAVE_CREDS
-    pa_creds read_creds, write_creds;
-    pa_bool_t read_creds_valid, send_creds_now;
+    pa_creds read_creds;
+    pa_bool_t read_creds_valid;
 #endif
 };
 
@@ -240,13 +278,15 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     m->defer_enable(p->defer_event, 0);
 
     p->send_queue = pa_queue_new();
+    pa_atomic_store(&p->n_pending, 0);
+    memset(&p->foreign, 0, sizeof(p->foreign));
 
-    p->write.current = NULL;
+    p->write.n_items = 0;
     p->write.index = 0;
-    pa_memchunk_reset(&p->write.memchunk);
     p->read.memblock = NULL;
     p->read.packet = NULL;
     p->read.index = 0;
+    p->read.buffer_index = p->read.buffer_length = 0;
 
     p->receive_packet_callback = NULL;
     p->receive_packet_callback_userdata = NULL;
@@ -273,8 +313,8 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     pa_iochannel_socket_set_sndbuf(io, pa_mempool_block_size_max(p->mempool));
 
 #ifdef HAVE_CREDS
-    p->send_creds_now = FALSE;
     p->read_creds_valid = FALSE;
+    p->read.buffer_creds_valid = FALSE;
 #endif
     return p;
 }
@@ -296,17 +336,22 @@ static void item_free(void *item) {
 }
 
 static void pstream_free(pa_pstream *p) {
+    unsigned k;
+
     pa_assert(p);
 
     pa_pstream_unlink(p);
 
     pa_queue_free(p->send_queue, item_free);
 
-    if (p->write.current)
-        item_free(p->write.current);
+    if (p->foreign.queue) {
+        pa_queue_free(p->foreign.queue, item_free);
+        pa_mutex_free(p->foreign.mutex);
+        pa_fdsem_free(p->foreign.fdsem);
+    }
 
-    if (p->write.memchunk.memblock)
-        pa_memblock_unref(p->write.memchunk.memblock);
+    for (k = 0; k < p->write.n_items; k++)
+        item_free(p->write.items[k]);
 
     if (p->read.memblock)
         pa_memblock_unref(p->read.memblock);
@@ -317,6 +362,78 @@ static void pstream_free(pa_pstream *p) {
     pa_xfree(p);
 }
 
+/* Moves what other threads queued over to our own send queue */
+static pa_bool_t take_foreign_items(pa_pstream *p) {
+    struct item_info *i;
+    pa_bool_t taken = FALSE;
+
+    pa_assert(p);
+
+    if (!p->foreign.queue)
+        return FALSE;
+
+    pa_mutex_lock(p->foreign.mutex);
+
+    while ((i = pa_queue_pop(p->foreign.queue))) {
+        pa_queue_push(p->send_queue, i);
+        taken = TRUE;
+    }
+
+    pa_mutex_unlock(p->foreign.mutex);
+
+    return taken;
+}
+
+/* Called from any thread if foreign sending is enabled */
+static void queue_item(pa_pstream *p, struct item_info *i) {
+    pa_assert(p);
+    pa_assert(i);
+
+    pa_atomic_inc(&p->n_pending);
+
+    if (p->foreign.queue && pa_thread_self() != p->foreign.thread) {
+        pa_mutex_lock(p->foreign.mutex);
+        pa_queue_push(p->foreign.queue, i);
+        pa_mutex_unlock(p->foreign.mutex);
+
+        pa_fdsem_post(p->foreign.fdsem);
+        return;
+    }
+
+    pa_queue_push(p->send_queue, i);
+    p->mainloop->defer_enable(p->defer_event, 1);
+}
+
+static void foreign_io_callback(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_pstream *p = userdata;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->foreign.io_event == e);
+
+    pa_fdsem_after_poll(p->foreign.fdsem);
+
+    do {
+        if (take_foreign_items(p))
+            p->mainloop->defer_enable(p->defer_event, 1);
+    } while (pa_fdsem_before_poll(p->foreign.fdsem) < 0);
+}
+
+void pa_pstream_enable_foreign_send(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(!p->foreign.queue);
+    pa_assert(!p->dead);
+
+    p->foreign.thread = pa_thread_self();
+    p->foreign.mutex = pa_mutex_new(FALSE, FALSE);
+    p->foreign.queue = pa_queue_new();
+    pa_assert_se(p->foreign.fdsem = pa_fdsem_new());
+
+    pa_assert_se(pa_fdsem_before_poll(p->foreign.fdsem) == 0);
+    p->foreign.io_event = p->mainloop->io_new(p->mainloop, pa_fdsem_get(p->foreign.fdsem), PA_IO_EVENT_INPUT, foreign_io_callback, p);
+}
+
 void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, const pa_creds *creds) {
     struct item_info *i;
 
@@ -338,9 +455,7 @@ void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, const pa_creds *cre
         i->creds = *creds;
 #endif
 
-    pa_queue_push(p->send_queue, i);
-
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, i);
 }
 
 void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa_seek_mode_t seek_mode, const pa_memchunk *chunk) {
@@ -380,13 +495,11 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
         i->with_creds = FALSE;
 #endif
 
-        pa_queue_push(p->send_queue, i);
+        queue_item(p, i);
 
         idx += n;
         length -= n;
     }
-
-    p->mainloop->defer_enable(p->defer_event, 1);
 }
 
 void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
@@ -407,8 +520,7 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
     item->with_creds = FALSE;
 #endif
 
-    pa_queue_push(p->send_queue, item);
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, item);
 }
 
 /* might be called from thread context */
@@ -444,8 +556,7 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
     item->with_creds = FALSE;
 #endif
 
-    pa_queue_push(p->send_queue, item);
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, item);
 }
 
 /* might be called from thread context */
@@ -461,53 +572,47 @@ static void memexport_revoke_cb(pa_memexport *e, uint32_t block_id, void *userda
         pa_pstream_send_revoke(p, block_id);
 }
 
-static void prepare_next_write_item(pa_pstream *p) {
+static void prepare_write_item(pa_pstream *p, struct item_info *i) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(i);
 
-    p->write.current = pa_queue_pop(p->send_queue);
-
-    if (!p->write.current)
-        return;
-
-    p->write.index = 0;
-    p->write.data = NULL;
-    pa_memchunk_reset(&p->write.memchunk);
+    i->data = NULL;
 
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+    i->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
+    i->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
+    i->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
+    i->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
+    i->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
 
-    if (p->write.current->type == PA_PSTREAM_ITEM_PACKET) {
+    if (i->type == PA_PSTREAM_ITEM_PACKET) {
 
-        pa_assert(p->write.current->packet);
-        p->write.data = p->write.current->packet->data;
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->packet->length);
+        pa_assert(i->packet);
+        i->data = i->packet->data;
+        i->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) i->packet->length);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
+    } else if (i->type == PA_PSTREAM_ITEM_SHMRELEASE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        i->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
+        i->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(i->block_id);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
+    } else if (i->type == PA_PSTREAM_ITEM_SHMREVOKE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        i->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
+        i->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(i->block_id);
 
     } else {
         uint32_t flags;
         pa_bool_t send_payload = TRUE;
 
-        pa_assert(p->write.current->type == PA_PSTREAM_ITEM_MEMBLOCK);
-        pa_assert(p->write.current->chunk.memblock);
+        pa_assert(i->type == PA_PSTREAM_ITEM_MEMBLOCK);
+        pa_assert(i->chunk.memblock);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(p->write.current->channel);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) p->write.current->offset) >> 32));
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) p->write.current->offset));
+        i->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(i->channel);
+        i->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) i->offset) >> 32));
+        i->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) i->offset));
 
-        flags = (uint32_t) (p->write.current->seek_mode & PA_FLAG_SEEKMASK);
+        flags = (uint32_t) (i->seek_mode & PA_FLAG_SEEKMASK);
 
         if (p->use_shm) {
             uint32_t block_id, shm_id;
@@ -516,7 +621,7 @@ static void prepare_next_write_item(pa_pstream *p) {
             pa_assert(p->export);
 
             if (pa_memexport_put(p->export,
-                                 p->write.current->chunk.memblock,
+                                 i->chunk.memblock,
                                  &block_id,
                                  &shm_id,
                                  &offset,
@@ -525,110 +630,199 @@ static void prepare_next_write_item(pa_pstream *p) {
                 flags |= PA_FLAG_SHMDATA;
                 send_payload = FALSE;
 
-                p->write.shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
-                p->write.shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
-                p->write.shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + p->write.current->chunk.index));
-                p->write.shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
+                i->shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
+                i->shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
+                i->shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + i->chunk.index));
+                i->shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) i->chunk.length);
 
-                p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(sizeof(p->write.shm_info));
-                p->write.data = p->write.shm_info;
+                i->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(sizeof(i->shm_info));
+                i->data = i->shm_info;
             }
 /*             else */
 /*                 pa_log_warn("Failed to export memory block."); */
         }
 
-        if (send_payload) {
-            p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
-            p->write.memchunk = p->write.current->chunk;
-            pa_memblock_ref(p->write.memchunk.memblock);
-            p->write.data = NULL;
-        }
+        /* The payload is taken from i->chunk when data is NULL */
+        if (send_payload)
+            i->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) i->chunk.length);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
+        i->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
     }
+}
+
+static size_t item_frame_size(struct item_info *i) {
+    pa_assert(i);
+
+    return PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(i->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+}
+
+static pa_bool_t item_with_creds(struct item_info *i) {
+    pa_assert(i);
 
 #ifdef HAVE_CREDS
-    if ((p->send_creds_now = p->write.current->with_creds))
-        p->write_creds = p->write.current->creds;
+    return i->with_creds;
+#else
+    return FALSE;
 #endif
 }
 
+/* Pull frames from the send queue until we have enough to fill the
+ * socket buffer. Credentials are attached to a whole sendmsg() call,
+ * hence a frame carrying them always ends the batch. */
+static void fill_write_items(pa_pstream *p) {
+    size_t length = 0;
+    unsigned k;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    take_foreign_items(p);
+
+    for (k = 0; k < p->write.n_items; k++)
+        length += item_frame_size(p->write.items[k]);
+
+    while (p->write.n_items < WRITE_ITEMS_MAX &&
+           length < p->write.index + pa_mempool_block_size_max(p->mempool)) {
+        struct item_info *i;
+
+        if (p->write.n_items > 0 && item_with_creds(p->write.items[p->write.n_items-1]))
+            break;
+
+        if (!(i = pa_queue_pop(p->send_queue)))
+            break;
+
+        prepare_write_item(p, i);
+        p->write.items[p->write.n_items++] = i;
+        length += item_frame_size(i);
+    }
+}
+
 static int do_write(pa_pstream *p) {
-    void *d;
-    size_t l;
+    struct iovec iov[WRITE_ITEMS_MAX * 2];
+    pa_memblock *release_memblocks[WRITE_ITEMS_MAX];
+    unsigned n_iov = 0, n_release = 0, k;
+    size_t skip;
     ssize_t r;
-    pa_memblock *release_memblock = NULL;
+    pa_bool_t done = FALSE;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    if (!p->write.current)
-        prepare_next_write_item(p);
+    fill_write_items(p);
 
-    if (!p->write.current)
+    if (p->write.n_items <= 0)
         return 0;
 
-    if (p->write.index < PA_PSTREAM_DESCRIPTOR_SIZE) {
-        d = (uint8_t*) p->write.descriptor + p->write.index;
-        l = PA_PSTREAM_DESCRIPTOR_SIZE - p->write.index;
-    } else {
-        pa_assert(p->write.data || p->write.memchunk.memblock);
+    /* Descriptor and payload of every frame go out in one syscall */
+    skip = p->write.index;
 
-        if (p->write.data)
-            d = p->write.data;
-        else {
-            d = pa_memblock_acquire_chunk(&p->write.memchunk);
-            release_memblock = p->write.memchunk.memblock;
-        }
+    for (k = 0; k < p->write.n_items; k++) {
+        struct item_info *i = p->write.items[k];
+        size_t l;
 
-        d = (uint8_t*) d + p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE;
-        l = ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE);
-    }
+        if (k > 0 && item_with_creds(i))
+            break;
 
-    pa_assert(l > 0);
+        if (skip < PA_PSTREAM_DESCRIPTOR_SIZE) {
+            iov[n_iov].iov_base = (uint8_t*) i->descriptor + skip;
+            iov[n_iov].iov_len = PA_PSTREAM_DESCRIPTOR_SIZE - skip;
+            n_iov++;
+            skip = 0;
+        } else
+            skip -= PA_PSTREAM_DESCRIPTOR_SIZE;
 
-#ifdef HAVE_CREDS
-    if (p->send_creds_now) {
+        if ((l = ntohl(i->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) > 0) {
+            void *d;
 
-        if ((r = pa_iochannel_write_with_creds(p->io, d, l, &p->write_creds)) < 0)
-            goto fail;
+            pa_assert(skip < l);
 
-        p->send_creds_now = FALSE;
-    } else
+            if (i->data)
+                d = i->data;
+            else {
+                d = pa_memblock_acquire_chunk(&i->chunk);
+                release_memblocks[n_release++] = i->chunk.memblock;
+            }
+
+            iov[n_iov].iov_base = (uint8_t*) d + skip;
+            iov[n_iov].iov_len = l - skip;
+            n_iov++;
+            skip = 0;
+        }
+    }
+
+    pa_assert(n_iov > 0);
+
+#ifdef HAVE_CREDS
+    if (p->write.items[0]->with_creds && p->write.index == 0)
+        r = pa_iochannel_writev_with_creds(p->io, iov, n_iov, &p->write.items[0]->creds);
+    else
 #endif
+        r = pa_iochannel_writev(p->io, iov, n_iov);
 
-    if ((r = pa_iochannel_write(p->io, d, l)) < 0)
-        goto fail;
+    for (k = 0; k < n_release; k++)
+        pa_memblock_release(release_memblocks[k]);
 
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
+    if (r < 0)
+        return -1;
 
     p->write.index += (size_t) r;
 
-    if (p->write.index >= PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) {
-        pa_assert(p->write.current);
-        item_free(p->write.current);
-        p->write.current = NULL;
-
-        if (p->write.memchunk.memblock)
-            pa_memblock_unref(p->write.memchunk.memblock);
+    while (p->write.n_items > 0 && p->write.index >= item_frame_size(p->write.items[0])) {
+        p->write.index -= item_frame_size(p->write.items[0]);
+        item_free(p->write.items[0]);
+        pa_atomic_dec(&p->n_pending);
 
-        pa_memchunk_reset(&p->write.memchunk);
+        p->write.n_items--;
+        memmove(p->write.items, p->write.items + 1, p->write.n_items * sizeof(struct item_info*));
 
-        if (p->drain_callback && !pa_pstream_is_pending(p))
-            p->drain_callback(p, p->drain_callback_userdata);
+        done = TRUE;
     }
 
+    if (done && p->drain_callback && !pa_pstream_is_pending(p))
+        p->drain_callback(p, p->drain_callback_userdata);
+
     return 0;
+}
 
-fail:
+/* Returns how many bytes are missing to complete the descriptor
+ * resp. the payload of the frame currently being read */
+static size_t read_missing(pa_pstream *p) {
+    pa_assert(p);
 
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
+    if (p->read.index < PA_PSTREAM_DESCRIPTOR_SIZE)
+        return PA_PSTREAM_DESCRIPTOR_SIZE - p->read.index;
 
-    return -1;
+    return ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE);
+}
+
+/* Returns where the next bytes of the current frame belong. If a
+ * memblock had to be acquired for that it is returned in
+ * *release_memblock. */
+static void *read_target(pa_pstream *p, pa_memblock **release_memblock) {
+    void *d;
+
+    pa_assert(p);
+    pa_assert(release_memblock);
+
+    *release_memblock = NULL;
+
+    if (p->read.index < PA_PSTREAM_DESCRIPTOR_SIZE)
+        return (uint8_t*) p->read.descriptor + p->read.index;
+
+    pa_assert(p->read.data || p->read.memblock);
+
+    if (p->read.data)
+        d = p->read.data;
+    else {
+        d = pa_memblock_acquire(p->read.memblock);
+        *release_memblock = p->read.memblock;
+    }
+
+    return (uint8_t*) d + p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE;
 }
 
+static int read_frame(pa_pstream *p, size_t r);
+
 static int do_read(pa_pstream *p) {
     void *d;
     size_t l;
@@ -637,41 +831,88 @@ static int do_read(pa_pstream *p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    if (p->read.index < PA_PSTREAM_DESCRIPTOR_SIZE) {
-        d = (uint8_t*) p->read.descriptor + p->read.index;
-        l = PA_PSTREAM_DESCRIPTOR_SIZE - p->read.index;
-    } else {
-        pa_assert(p->read.data || p->read.memblock);
+    if (p->read.buffer_index >= p->read.buffer_length) {
 
-        if (p->read.data)
-            d = p->read.data;
+        if ((l = read_missing(p)) >= READ_BUFFER_SIZE)
+            d = read_target(p, &release_memblock);
         else {
-            d = pa_memblock_acquire(p->read.memblock);
-            release_memblock = p->read.memblock;
+            d = p->read.buffer;
+            l = READ_BUFFER_SIZE;
         }
 
-        d = (uint8_t*) d + p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE;
-        l = ntohl(p->read.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE);
-    }
-
 #ifdef HAVE_CREDS
-    {
-        pa_bool_t b = 0;
-
-        if ((r = pa_iochannel_read_with_creds(p->io, d, l, &p->read_creds, &b)) <= 0)
+        {
+            pa_creds creds;
+            pa_bool_t b = FALSE;
+
+            if ((r = pa_iochannel_read_with_creds(p->io, d, l, &creds, &b)) <= 0)
+                goto fail;
+
+            if (d == p->read.buffer) {
+                p->read.buffer_creds = creds;
+                p->read.buffer_creds_valid = b;
+            } else if (b) {
+                p->read_creds = creds;
+                p->read_creds_valid = TRUE;
+            }
+        }
+#else
+        if ((r = pa_iochannel_read(p->io, d, l)) <= 0)
             goto fail;
+#endif
 
-        p->read_creds_valid = p->read_creds_valid || b;
+        if (release_memblock)
+            pa_memblock_release(release_memblock);
+
+        if (d != p->read.buffer)
+            return read_frame(p, (size_t) r);
+
+        p->read.buffer_index = 0;
+        p->read.buffer_length = (size_t) r;
     }
-#else
-    if ((r = pa_iochannel_read(p->io, d, l)) <= 0)
-        goto fail;
+
+    /* Hand out everything we have buffered, frame by frame. The
+     * callbacks might kill us while we do that. */
+    while (!p->dead && p->read.buffer_index < p->read.buffer_length) {
+
+        l = PA_MIN(read_missing(p), p->read.buffer_length - p->read.buffer_index);
+        d = read_target(p, &release_memblock);
+
+        memcpy(d, p->read.buffer + p->read.buffer_index, l);
+
+        if (release_memblock)
+            pa_memblock_release(release_memblock);
+
+        p->read.buffer_index += l;
+
+#ifdef HAVE_CREDS
+        if (p->read.buffer_creds_valid) {
+            p->read_creds = p->read.buffer_creds;
+            p->read_creds_valid = TRUE;
+        }
 #endif
 
+        if (read_frame(p, l) < 0)
+            return -1;
+    }
+
+    return 0;
+
+fail:
     if (release_memblock)
         pa_memblock_release(release_memblock);
 
-    p->read.index += (size_t) r;
+    return -1;
+}
+
+/* Processes r bytes that just arrived for the current frame */
+static int read_frame(pa_pstream *p, size_t r) {
+    size_t l;
+
+    pa_assert(p);
+    pa_assert(r > 0);
+
+    p->read.index += r;
 
     if (p->read.index == PA_PSTREAM_DESCRIPTOR_SIZE) {
         uint32_t flags, length, channel;
@@ -765,7 +1006,7 @@ static int do_read(pa_pstream *p) {
         if (p->read.memblock && p->receive_memblock_callback) {
 
             /* Is this memblock data? Than pass it to the user */
-            l = (p->read.index - (size_t) r) < PA_PSTREAM_DESCRIPTOR_SIZE ? (size_t) (p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE) : (size_t) r;
+            l = (p->read.index - r) < PA_PSTREAM_DESCRIPTOR_SIZE ? (size_t) (p->read.index - PA_PSTREAM_DESCRIPTOR_SIZE) : r;
 
             if (l > 0) {
                 pa_memchunk chunk;
@@ -874,12 +1115,6 @@ frame_done:
 #endif
 
     return 0;
-
-fail:
-    if (release_memblock)
-        pa_memblock_release(release_memblock);
-
-    return -1;
 }
 
 void pa_pstream_set_die_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void *userdata) {
@@ -939,11 +1174,21 @@ pa_bool_t pa_pstream_is_pending(pa_pstream *p) {
     if (p->dead)
         b = FALSE;
     else
-        b = p->write.current || !pa_queue_isempty(p->send_queue);
+        b = pa_atomic_load(&p->n_pending) > 0;
 
     return b;
 }
 
+unsigned pa_pstream_get_n_pending(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    if (p->dead)
+        return 0;
+
+    return (unsigned) pa_atomic_load(&p->n_pending);
+}
+
 void pa_pstream_unref(pa_pstream*p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
@@ -988,6 +1233,11 @@ void pa_pstream_unlink(pa_pstream *p) {
         p->defer_event = NULL;
     }
 
+    if (p->foreign.io_event) {
+        p->mainloop->io_free(p->foreign.io_event);
+        p->foreign.io_event = NULL;
+    }
+
     p->die_callback = NULL;
     p->drain_callback = NULL;
     p->receive_packet_callback = NULL;
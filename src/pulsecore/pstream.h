@@ -63,6 +63,15 @@ void pa_pstream_set_revoke_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb,
 
 pa_bool_t pa_pstream_is_pending(pa_pstream *p);
 
+/* The number of packets and memory blocks queued for sending */
+unsigned pa_pstream_get_n_pending(pa_pstream *p);
+
+/* Allow the send functions, pa_pstream_is_pending() and
+ * pa_pstream_get_n_pending() to be called from other threads than the
+ * one running the pstream's main loop. Has to be called from that
+ * thread. */
+void pa_pstream_enable_foreign_send(pa_pstream *p);
+
 void pa_pstream_enable_shm(pa_pstream *p, pa_bool_t enable);
 pa_bool_t pa_pstream_get_shm(pa_pstream *p);
 
@@ -39,6 +39,7 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/remap.h>
+#include <pulsecore/polyphase.h>
 #include <pulsecore/core-util.h>
 #include "ffmpeg/avcodec.h"
 
@@ -47,6 +48,13 @@
 /* Number of samples of extra space we allow the resamplers to return */
 #define EXTRA_FRAMES 128
 
+/* Frames the single pass pipeline pushes through all stages at once,
+ * small enough for the intermediate data to stay in the cache */
+#define FUSED_BLOCK_FRAMES 256U
+
+/* Output blocks the single pass pipeline keeps around for reuse */
+#define FUSED_OUT_BLOCKS 2
+
 struct pa_resampler {
     pa_resample_method_t method;
     pa_resample_flags_t flags;
@@ -74,6 +82,16 @@ struct pa_resampler {
     pa_remap_t remap;
     pa_bool_t map_required;
 
+    struct { /* the single pass pipeline */
+        pa_bool_t enabled;
+
+        /* Scratch space for one block, never handed out */
+        pa_memblock *work_buf, *remap_buf, *resample_buf;
+
+        pa_memblock *out_buf[FUSED_OUT_BLOCKS];
+        unsigned next_out_buf;
+    } fused;
+
     void (*impl_free)(pa_resampler *r);
     void (*impl_update_rates)(pa_resampler *r);
     void (*impl_resample)(pa_resampler *r, const pa_memchunk *in, unsigned in_samples, pa_memchunk *out, unsigned *out_samples);
@@ -109,6 +127,26 @@ struct pa_resampler {
         struct AVResampleContext *state;
         pa_memchunk buf[PA_CHANNELS_MAX];
     } ffmpeg;
+
+    struct { /* data specific to the polyphase resampler */
+        pa_polyphase_filter *filter;
+        unsigned quality;
+
+        /* The rate pair, reduced. The next output is at phase/num
+         * input frames after the center tap of the filter starting
+         * at input frame pos. */
+        uint32_t num, den;
+        uint32_t phase;
+        unsigned pos;
+
+        /* Input frames kept for the filter, planar with room for
+         * capacity frames per channel */
+        float *buf;
+        unsigned length, capacity;
+
+        /* The current filter row, if interpolated */
+        float *row;
+    } polyphase;
 };
 
 static int copy_init(pa_resampler *r);
@@ -118,6 +156,7 @@ static int speex_init(pa_resampler*r);
 #endif
 static int ffmpeg_init(pa_resampler*r);
 static int peaks_init(pa_resampler*r);
+static int polyphase_init(pa_resampler*r);
 #ifdef HAVE_LIBSAMPLERATE
 static int libsamplerate_init(pa_resampler*r);
 #endif
@@ -190,6 +229,17 @@ static int (* const init_table[])(pa_resampler*r) = {
     [PA_RESAMPLER_AUTO]                    = NULL,
     [PA_RESAMPLER_COPY]                    = copy_init,
     [PA_RESAMPLER_PEAKS]                   = peaks_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+0]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+1]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+2]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+3]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+4]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+5]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+6]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+7]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+8]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+9]        = polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_BASE+10]       = polyphase_init,
 };
 
 pa_resampler* pa_resampler_new(
@@ -327,6 +377,13 @@ pa_resampler* pa_resampler_new(
     if (init_table[method](r) < 0)
         goto fail;
 
+    /* libsamplerate and ffmpeg might not consume all of their input,
+     * the staged pipeline keeps the rest in remap_buf for the next
+     * run. All the others can work block by block in a single pass. */
+    r->fused.enabled =
+        method > PA_RESAMPLER_SRC_LINEAR && method != PA_RESAMPLER_FFMPEG &&
+        (r->to_work_format_func || r->map_required || r->impl_resample || r->from_work_format_func);
+
     return r;
 
 fail:
@@ -335,11 +392,10 @@ fail:
     return NULL;
 }
 
-void pa_resampler_free(pa_resampler *r) {
-    pa_assert(r);
+static void free_buffers(pa_resampler *r) {
+    unsigned i;
 
-    if (r->impl_free)
-        r->impl_free(r);
+    pa_assert(r);
 
     if (r->to_work_format_buf.memblock)
         pa_memblock_unref(r->to_work_format_buf.memblock);
@@ -350,6 +406,40 @@ void pa_resampler_free(pa_resampler *r) {
     if (r->from_work_format_buf.memblock)
         pa_memblock_unref(r->from_work_format_buf.memblock);
 
+    pa_memchunk_reset(&r->to_work_format_buf);
+    pa_memchunk_reset(&r->remap_buf);
+    pa_memchunk_reset(&r->resample_buf);
+    pa_memchunk_reset(&r->from_work_format_buf);
+
+    r->to_work_format_buf_samples = 0;
+    r->remap_buf_size = 0;
+    r->resample_buf_samples = 0;
+    r->from_work_format_buf_samples = 0;
+
+    if (r->fused.work_buf)
+        pa_memblock_unref(r->fused.work_buf);
+    if (r->fused.remap_buf)
+        pa_memblock_unref(r->fused.remap_buf);
+    if (r->fused.resample_buf)
+        pa_memblock_unref(r->fused.resample_buf);
+
+    r->fused.work_buf = r->fused.remap_buf = r->fused.resample_buf = NULL;
+
+    for (i = 0; i < FUSED_OUT_BLOCKS; i++)
+        if (r->fused.out_buf[i]) {
+            pa_memblock_unref(r->fused.out_buf[i]);
+            r->fused.out_buf[i] = NULL;
+        }
+}
+
+void pa_resampler_free(pa_resampler *r) {
+    pa_assert(r);
+
+    if (r->impl_free)
+        r->impl_free(r);
+
+    free_buffers(r);
+
     pa_xfree(r);
 }
 
@@ -446,6 +536,22 @@ void pa_resampler_reset(pa_resampler *r) {
     r->remap_buf_contains_leftover_data = FALSE;
 }
 
+void pa_resampler_trim(pa_resampler *r) {
+    pa_assert(r);
+
+    /* Any leftover data is lost here, hence this implies a reset */
+    pa_resampler_reset(r);
+    free_buffers(r);
+}
+
+pa_bool_t pa_resampler_passes_silence(pa_resampler *r) {
+    pa_assert(r);
+
+    /* Only 'copy' is stateless. Everything else keeps filter history
+     * or a fractional position that skipping would corrupt. */
+    return r->method == PA_RESAMPLER_COPY && !r->remap_buf_contains_leftover_data;
+}
+
 pa_resample_method_t pa_resampler_get_method(pa_resampler *r) {
     pa_assert(r);
 
@@ -508,7 +614,18 @@ static const char * const resample_methods[] = {
     "ffmpeg",
     "auto",
     "copy",
-    "peaks"
+    "peaks",
+    "polyphase-0",
+    "polyphase-1",
+    "polyphase-2",
+    "polyphase-3",
+    "polyphase-4",
+    "polyphase-5",
+    "polyphase-6",
+    "polyphase-7",
+    "polyphase-8",
+    "polyphase-9",
+    "polyphase-10"
 };
 
 const char *pa_resample_method_to_string(pa_resample_method_t m) {
@@ -554,6 +671,9 @@ pa_resample_method_t pa_parse_resample_method(const char *string) {
     if (pa_streq(string, "speex-float"))
         return PA_RESAMPLER_SPEEX_FLOAT_BASE + 3;
 
+    if (pa_streq(string, "polyphase"))
+        return PA_RESAMPLER_POLYPHASE_BASE + 3;
+
     return PA_RESAMPLER_INVALID;
 }
 
@@ -1279,6 +1399,182 @@ static pa_memchunk *convert_from_work_format(pa_resampler *r, pa_memchunk *input
     return &r->from_work_format_buf;
 }
 
+/* Makes sure the scratch block is at least length bytes large */
+static void *acquire_scratch(pa_resampler *r, pa_memblock **b, size_t length) {
+    pa_assert(r);
+    pa_assert(b);
+
+    if (!*b || pa_memblock_get_length(*b) < length) {
+        if (*b)
+            pa_memblock_unref(*b);
+
+        *b = pa_memblock_new(r->mempool, length);
+    }
+
+    return pa_memblock_acquire(*b);
+}
+
+/* Returns a block of at least length bytes for the output. Blocks
+ * handed out earlier are reused once the consumer is done with them,
+ * as long as they are of the size class length needs, so in the
+ * steady state nothing needs to be allocated. */
+static pa_memblock *get_out_buf(pa_resampler *r, size_t length) {
+    pa_memblock *b;
+    size_t size;
+    unsigned i, j;
+
+    pa_assert(r);
+
+    size = pa_mempool_block_size_fit(r->mempool, length);
+
+    for (i = 0; i < FUSED_OUT_BLOCKS; i++) {
+        b = r->fused.out_buf[i];
+
+        if (b && pa_memblock_ref_is_one(b) &&
+            pa_memblock_get_length(b) >= length &&
+            pa_memblock_get_length(b) <= size)
+            return pa_memblock_ref(b);
+    }
+
+    /* Replace one that isn't in use anymore, or else the oldest
+     * one. The block gets all of its size class, so that it can be
+     * reused for somewhat longer output too. */
+    i = r->fused.next_out_buf;
+    for (j = 0; j < FUSED_OUT_BLOCKS; j++)
+        if (!r->fused.out_buf[j] || pa_memblock_ref_is_one(r->fused.out_buf[j])) {
+            i = j;
+            break;
+        }
+
+    r->fused.next_out_buf = (i + 1) % FUSED_OUT_BLOCKS;
+
+    if (r->fused.out_buf[i])
+        pa_memblock_unref(r->fused.out_buf[i]);
+
+    r->fused.out_buf[i] = pa_memblock_new(r->mempool, size);
+
+    return pa_memblock_ref(r->fused.out_buf[i]);
+}
+
+/* Converts, remaps and resamples FUSED_BLOCK_FRAMES at a time, instead
+ * of making a full pass over all data for each step. The last step
+ * writes straight into the output block. */
+static void fused_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+    unsigned in_n_frames, max_out_frames, out_n_frames = 0, i, n, m;
+    unsigned i_channels = r->i_ss.channels, o_channels = r->o_ss.channels;
+    uint8_t *src, *dst;
+    void *work = NULL, *remapped = NULL, *resampled = NULL;
+
+    pa_assert(r);
+    pa_assert(in);
+    pa_assert(out);
+
+    in_n_frames = (unsigned) (in->length / r->i_fz);
+
+    if (r->impl_resample)
+        max_out_frames = ((in_n_frames * r->o_ss.rate) / r->i_ss.rate) + EXTRA_FRAMES;
+    else
+        max_out_frames = in_n_frames;
+
+    out->memblock = get_out_buf(r, max_out_frames * r->o_fz);
+    out->index = 0;
+
+    src = pa_memblock_acquire_chunk(in);
+    dst = pa_memblock_acquire(out->memblock);
+
+    if (r->to_work_format_func)
+        work = acquire_scratch(r, &r->fused.work_buf, FUSED_BLOCK_FRAMES * i_channels * r->w_sz);
+
+    if (r->map_required)
+        remapped = acquire_scratch(r, &r->fused.remap_buf, FUSED_BLOCK_FRAMES * o_channels * r->w_sz);
+
+    if (r->impl_resample && r->from_work_format_func)
+        resampled = acquire_scratch(r, &r->fused.resample_buf,
+                                    (((FUSED_BLOCK_FRAMES * r->o_ss.rate) / r->i_ss.rate) + EXTRA_FRAMES) * o_channels * r->w_sz);
+
+    for (i = 0; i < in_n_frames; i += n) {
+        pa_memchunk chunk;
+        void *p;
+
+        n = PA_MIN(in_n_frames - i, FUSED_BLOCK_FRAMES);
+        m = n;
+
+        chunk.memblock = in->memblock;
+        chunk.index = in->index + i * r->i_fz;
+        chunk.length = n * r->i_fz;
+        p = src + i * r->i_fz;
+
+        if (r->to_work_format_func) {
+            r->to_work_format_func(n * i_channels, p, work);
+
+            chunk.memblock = r->fused.work_buf;
+            chunk.index = 0;
+            chunk.length = n * i_channels * r->w_sz;
+            p = work;
+        }
+
+        if (r->map_required) {
+            pa_assert(r->remap.do_remap);
+            r->remap.do_remap(&r->remap, remapped, p, n);
+
+            chunk.memblock = r->fused.remap_buf;
+            chunk.index = 0;
+            chunk.length = n * o_channels * r->w_sz;
+            p = remapped;
+        }
+
+        if (r->impl_resample) {
+            pa_memchunk result;
+
+            if (resampled) {
+                result.memblock = r->fused.resample_buf;
+                result.index = 0;
+                m = (unsigned) (pa_memblock_get_length(result.memblock) / (o_channels * r->w_sz));
+            } else {
+                result.memblock = out->memblock;
+                result.index = out_n_frames * r->o_fz;
+                m = max_out_frames - out_n_frames;
+            }
+
+            result.length = m * o_channels * r->w_sz;
+            r->impl_resample(r, &chunk, n, &result, &m);
+
+            if (!resampled) {
+                out_n_frames += m;
+                continue;
+            }
+
+            p = resampled;
+        }
+
+        pa_assert(out_n_frames + m <= max_out_frames);
+
+        if (r->from_work_format_func)
+            r->from_work_format_func(m * o_channels, p, dst + out_n_frames * r->o_fz);
+        else
+            memcpy(dst + out_n_frames * r->o_fz, p, m * r->o_fz);
+
+        out_n_frames += m;
+    }
+
+    if (resampled)
+        pa_memblock_release(r->fused.resample_buf);
+    if (remapped)
+        pa_memblock_release(r->fused.remap_buf);
+    if (work)
+        pa_memblock_release(r->fused.work_buf);
+
+    pa_memblock_release(out->memblock);
+    pa_memblock_release(in->memblock);
+
+    out->length = out_n_frames * r->o_fz;
+
+    if (!out->length) {
+        pa_memblock_unref(out->memblock);
+        pa_memchunk_reset(out);
+    }
+}
+
 void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
     pa_memchunk *buf;
 
@@ -1289,6 +1585,11 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
     pa_assert(in->memblock);
     pa_assert(in->length % r->i_fz == 0);
 
+    if (r->fused.enabled) {
+        fused_run(r, in, out);
+        return;
+    }
+
     buf = (pa_memchunk*) in;
     buf = convert_to_work_format(r, buf);
     buf = remap_channels(r, buf);
@@ -1607,7 +1908,7 @@ static void peaks_resample(pa_resampler *r, const pa_memchunk *input, unsigned i
                 o_index++, r->peaks.o_counter++;
             }
         } else if (r->work_format == PA_SAMPLE_S16NE) {
-            int16_t *s = (int16_t*) src + r->i_ss.channels * i;
+            int16_t *s = (int16_t*) src + r->o_ss.channels * i;
             int16_t *d = (int16_t*) dst + r->o_ss.channels * o_index;
 
             for (; i < i_end && i < in_n_frames; i++)
@@ -1626,7 +1927,7 @@ static void peaks_resample(pa_resampler *r, const pa_memchunk *input, unsigned i
                 o_index++, r->peaks.o_counter++;
             }
         } else {
-            float *s = (float*) src + r->i_ss.channels * i;
+            float *s = (float*) src + r->o_ss.channels * i;
             float *d = (float*) dst + r->o_ss.channels * o_index;
 
             for (; i < i_end && i < in_n_frames; i++)
@@ -1802,3 +2103,198 @@ static int copy_init(pa_resampler *r) {
 
     return 0;
 }
+
+/*** polyphase implementation ***/
+
+/* Makes room for at least frames input frames per channel */
+static void polyphase_reserve(pa_resampler *r, unsigned frames) {
+    float *buf;
+    unsigned c;
+
+    pa_assert(r);
+
+    if (frames <= r->polyphase.capacity)
+        return;
+
+    frames = PA_MAX(frames, 2 * r->polyphase.capacity);
+    buf = pa_xnew(float, r->o_ss.channels * frames);
+
+    if (r->polyphase.buf) {
+        for (c = 0; c < r->o_ss.channels; c++)
+            memcpy(buf + c * frames, r->polyphase.buf + c * r->polyphase.capacity, r->polyphase.length * sizeof(float));
+
+        pa_xfree(r->polyphase.buf);
+    }
+
+    r->polyphase.buf = buf;
+    r->polyphase.capacity = frames;
+}
+
+static void polyphase_resample(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames, pa_memchunk *output, unsigned *out_n_frames) {
+    pa_polyphase_filter *f;
+    pa_polyphase_dot_func_t dot;
+    unsigned channels, taps, capacity, length, pos, c, i, o;
+    uint32_t phase, num, den;
+    const float *src;
+    float *buf, *dst;
+
+    pa_assert(r);
+    pa_assert(input);
+    pa_assert(output);
+    pa_assert(out_n_frames);
+
+    f = r->polyphase.filter;
+    taps = f->taps;
+    channels = r->o_ss.channels;
+
+    polyphase_reserve(r, r->polyphase.length + in_n_frames);
+    buf = r->polyphase.buf;
+    capacity = r->polyphase.capacity;
+
+    /* Deinterleave, so that the filter runs over consecutive floats */
+    src = pa_memblock_acquire_chunk(input);
+
+    for (c = 0; c < channels; c++) {
+        float *d = buf + c * capacity + r->polyphase.length;
+
+        for (i = 0; i < in_n_frames; i++)
+            d[i] = src[i * channels + c];
+    }
+
+    pa_memblock_release(input->memblock);
+
+    length = r->polyphase.length + in_n_frames;
+    pos = r->polyphase.pos;
+    phase = r->polyphase.phase;
+    num = r->polyphase.num;
+    den = r->polyphase.den;
+
+    dot = pa_get_polyphase_dot_func();
+    dst = pa_memblock_acquire_chunk(output);
+
+    if (!f->interpolate) {
+        for (o = 0; o < *out_n_frames && pos + taps <= length; o++, dst += channels) {
+            dot(dst, buf + pos, capacity, channels, f->coefs + phase * taps, taps);
+
+            phase += den;
+            pos += phase / num;
+            phase %= num;
+        }
+    } else {
+        double scale = (double) f->n_phases / num;
+        float *row = r->polyphase.row;
+
+        for (o = 0; o < *out_n_frames && pos + taps <= length; o++, dst += channels) {
+            double x = phase * scale;
+            unsigned p = (unsigned) x;
+            float frac = (float) (x - p);
+            const float *h = f->coefs + p * taps;
+
+            /* Linear interpolation between the two nearest rows */
+            for (i = 0; i < taps; i++)
+                row[i] = h[i] + frac * (h[i + taps] - h[i]);
+
+            dot(dst, buf + pos, capacity, channels, row, taps);
+
+            phase += den;
+            pos += phase / num;
+            phase %= num;
+        }
+    }
+
+    pa_memblock_release(output->memblock);
+
+    *out_n_frames = o;
+
+    /* Forget what no filter will need anymore. When downsampling by a
+     * large factor the next output might start beyond what we have,
+     * the rest is skipped on the next run then. */
+    i = PA_MIN(pos, length);
+
+    if (i > 0)
+        for (c = 0; c < channels; c++)
+            memmove(buf + c * capacity, buf + c * capacity + i, (length - i) * sizeof(float));
+
+    r->polyphase.length = length - i;
+    r->polyphase.pos = pos - i;
+    r->polyphase.phase = phase;
+}
+
+/* Starts with silence as history, so that there is output right
+ * away. Like with speex, everything is delayed by half the filter
+ * length then. */
+static void polyphase_reset(pa_resampler *r) {
+    unsigned c;
+
+    pa_assert(r);
+
+    r->polyphase.phase = 0;
+    r->polyphase.pos = 0;
+    r->polyphase.length = r->polyphase.filter->taps - 1;
+
+    polyphase_reserve(r, r->polyphase.length);
+
+    for (c = 0; c < r->o_ss.channels; c++)
+        memset(r->polyphase.buf + c * r->polyphase.capacity, 0, r->polyphase.length * sizeof(float));
+}
+
+/* Called from the IO thread, hence doesn't touch the filter: with
+ * variable rates it is an interpolated one, which has a row for any
+ * phase. Its cutoff stays what it was for the rates the resampler was
+ * created with. */
+static void polyphase_update_rates(pa_resampler *r) {
+    uint32_t g, num;
+
+    pa_assert(r);
+    pa_assert(r->polyphase.filter->interpolate);
+
+    g = pa_gcd(r->i_ss.rate, r->o_ss.rate);
+    num = r->o_ss.rate / g;
+
+    /* Keep the next output where it is in time */
+    r->polyphase.phase = (uint32_t) (((uint64_t) r->polyphase.phase * num) / r->polyphase.num);
+    r->polyphase.num = num;
+    r->polyphase.den = r->i_ss.rate / g;
+}
+
+static void polyphase_free(pa_resampler *r) {
+    pa_assert(r);
+
+    if (r->polyphase.filter)
+        pa_polyphase_filter_unref(r->polyphase.filter);
+
+    pa_xfree(r->polyphase.buf);
+    pa_xfree(r->polyphase.row);
+}
+
+static int polyphase_init(pa_resampler *r) {
+    uint32_t g;
+
+    pa_assert(r);
+    pa_assert(r->method >= PA_RESAMPLER_POLYPHASE_BASE && r->method <= PA_RESAMPLER_POLYPHASE_MAX);
+
+    r->polyphase.quality = r->method - PA_RESAMPLER_POLYPHASE_BASE;
+
+    pa_log_info("Choosing polyphase quality setting %u.", r->polyphase.quality);
+
+    g = pa_gcd(r->i_ss.rate, r->o_ss.rate);
+    r->polyphase.num = r->o_ss.rate / g;
+    r->polyphase.den = r->i_ss.rate / g;
+
+    /* Rate changes must not need a new table, see
+     * polyphase_update_rates() */
+    r->polyphase.filter = pa_polyphase_filter_get(r->i_ss.rate, r->o_ss.rate, r->polyphase.quality,
+                                                  !!(r->flags & PA_RESAMPLER_VARIABLE_RATE));
+
+    r->polyphase.row = pa_xnew(float, r->polyphase.filter->taps);
+
+    polyphase_reserve(r, r->polyphase.filter->taps + FUSED_BLOCK_FRAMES);
+    polyphase_reset(r);
+
+    r->impl_free = polyphase_free;
+    r->impl_update_rates = polyphase_update_rates;
+    r->impl_resample = polyphase_resample;
+    r->impl_reset = polyphase_reset;
+
+    return 0;
+}
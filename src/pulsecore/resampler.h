@@ -45,6 +45,8 @@ typedef enum pa_resample_method {
     PA_RESAMPLER_AUTO, /* automatic select based on sample format */
     PA_RESAMPLER_COPY,
     PA_RESAMPLER_PEAKS,
+    PA_RESAMPLER_POLYPHASE_BASE,
+    PA_RESAMPLER_POLYPHASE_MAX = PA_RESAMPLER_POLYPHASE_BASE + 10,
     PA_RESAMPLER_MAX
 } pa_resample_method_t;
 
@@ -87,6 +89,14 @@ void pa_resampler_set_output_rate(pa_resampler *r, uint32_t rate);
 /* Reinitialize state of the resampler, possibly due to seeking or other discontinuities */
 void pa_resampler_reset(pa_resampler *r);
 
+/* Reset the resampler and release the buffers it keeps around between runs. They are reallocated on the next run */
+void pa_resampler_trim(pa_resampler *r);
+
+/* Return TRUE if silence passed to the resampler would come out as
+ * pa_resampler_result() bytes of silence without affecting any later
+ * output, so that running it on silence may be skipped */
+pa_bool_t pa_resampler_passes_silence(pa_resampler *r);
+
 /* Return the resampling method of the resampler object */
 pa_resample_method_t pa_resampler_get_method(pa_resampler *r);
 
@@ -590,41 +590,6 @@ pa_rtpoll_item *pa_rtpoll_item_new_asyncmsgq_read(pa_rtpoll *p, pa_rtpoll_priori
     return i;
 }
 
-static int asyncmsgq_write_before(pa_rtpoll_item *i) {
-    pa_assert(i);
-
-    pa_asyncmsgq_write_before_poll(i->userdata);
-    return 0;
-}
-
-static void asyncmsgq_write_after(pa_rtpoll_item *i) {
-    pa_assert(i);
-
-    pa_assert((i->pollfd[0].revents & ~POLLIN) == 0);
-    pa_asyncmsgq_write_after_poll(i->userdata);
-}
-
-pa_rtpoll_item *pa_rtpoll_item_new_asyncmsgq_write(pa_rtpoll *p, pa_rtpoll_priority_t prio, pa_asyncmsgq *q) {
-    pa_rtpoll_item *i;
-    struct pollfd *pollfd;
-
-    pa_assert(p);
-    pa_assert(q);
-
-    i = pa_rtpoll_item_new(p, prio, 1);
-
-    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
-    pollfd->fd = pa_asyncmsgq_write_fd(q);
-    pollfd->events = POLLIN;
-
-    i->before_cb = asyncmsgq_write_before;
-    i->after_cb = asyncmsgq_write_after;
-    i->work_cb = NULL;
-    i->userdata = q;
-
-    return i;
-}
-
 void pa_rtpoll_quit(pa_rtpoll *p) {
     pa_assert(p);
 
@@ -44,6 +44,15 @@ pa_memblock* pa_silence_memblock(pa_memblock *b, const pa_sample_spec *spec);
 
 pa_memchunk* pa_silence_memchunk_get(pa_silence_cache *cache, pa_mempool *pool, pa_memchunk* ret, const pa_sample_spec *spec, size_t length);
 
+/* Returns TRUE if the chunk contains only silence. If it covers its
+ * whole memblock, the block is marked as silence too. */
+pa_bool_t pa_memchunk_is_silence(const pa_memchunk *c, const pa_sample_spec *spec);
+
+/* The per-channel volumes of a stream are repeated this many times
+ * past the last channel, so that vectorized mixers can load the
+ * volumes for consecutive samples without wrapping around */
+#define PA_MIX_VOLUME_PADDING 16
+
 typedef struct pa_mix_info {
     pa_memchunk chunk;
     pa_cvolume volume;
@@ -55,7 +64,7 @@ typedef struct pa_mix_info {
     union {
         int32_t i;
         float f;
-    } linear[PA_CHANNELS_MAX];
+    } linear[PA_CHANNELS_MAX + PA_MIX_VOLUME_PADDING];
 } pa_mix_info;
 
 size_t pa_mix(
@@ -93,6 +102,13 @@ typedef void (*pa_do_volume_func_t) (void *samples, const void *volumes, unsigne
 pa_do_volume_func_t pa_get_volume_func(pa_sample_format_t f);
 void pa_set_volume_func(pa_sample_format_t f, pa_do_volume_func_t func);
 
+/* Mixes length bytes of all streams into data, the streams' ptr and
+ * linear fields have already been set up by pa_mix() */
+typedef void (*pa_do_mix_func_t) (pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length);
+
+pa_do_mix_func_t pa_get_mix_func(pa_sample_format_t f);
+void pa_set_mix_func(pa_sample_format_t f, pa_do_mix_func_t func);
+
 size_t pa_convert_size(size_t size, const pa_sample_spec *from, const pa_sample_spec *to);
 
 #define PA_CHANNEL_POSITION_MASK_LEFT                                   \
@@ -0,0 +1,258 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/shm.h>
+
+#include "shm-ring.h"
+
+#define RING_SIZE_MIN (PA_PAGE_SIZE)
+#define RING_SIZE_MAX (16*1024*1024)
+
+/* Both segments start with this, the data follows the producer's
+ * header. The index is a byte counter that wraps around at 2^32,
+ * which works out since the ring size is a power of two. */
+struct ring_header {
+    pa_atomic_t index;
+};
+
+#define RING_HEADER_SIZE 64
+
+struct pa_shm_ring {
+    pa_bool_t producer;
+
+    pa_shm local, remote;
+    pa_bool_t connected;
+
+    /* Our copy of our own index, and a pointer to the other side's */
+    unsigned index;
+    struct ring_header *local_header;
+    const struct ring_header *remote_header;
+
+    uint8_t *data;
+    size_t size;
+};
+
+pa_shm_ring* pa_shm_ring_new(size_t size) {
+    pa_shm_ring *r;
+    size_t s;
+
+    pa_assert(size > 0);
+
+    if (size > RING_SIZE_MAX)
+        return NULL;
+
+    for (s = RING_SIZE_MIN; s < size; s <<= 1)
+        ;
+
+    r = pa_xnew0(pa_shm_ring, 1);
+    r->producer = TRUE;
+    r->size = s;
+
+    if (pa_shm_create_rw(&r->local, RING_HEADER_SIZE + s, TRUE, 0700) < 0) {
+        pa_xfree(r);
+        return NULL;
+    }
+
+    r->local_header = r->local.ptr;
+    pa_atomic_store(&r->local_header->index, 0);
+    r->data = (uint8_t*) r->local.ptr + RING_HEADER_SIZE;
+
+    return r;
+}
+
+pa_shm_ring* pa_shm_ring_attach(unsigned id, size_t size) {
+    pa_shm_ring *r;
+
+    if (size < RING_SIZE_MIN || size > RING_SIZE_MAX || (size & (size - 1)) != 0) {
+        pa_log_warn("Invalid shared memory ring size %lu.", (unsigned long) size);
+        return NULL;
+    }
+
+    r = pa_xnew0(pa_shm_ring, 1);
+    r->producer = FALSE;
+    r->size = size;
+
+    if (pa_shm_attach_ro(&r->remote, id) < 0) {
+        pa_xfree(r);
+        return NULL;
+    }
+
+    if (r->remote.size < RING_HEADER_SIZE + size) {
+        pa_log_warn("Shared memory ring segment too small.");
+        pa_shm_free(&r->remote);
+        pa_xfree(r);
+        return NULL;
+    }
+
+    if (pa_shm_create_rw(&r->local, RING_HEADER_SIZE, TRUE, 0700) < 0) {
+        pa_shm_free(&r->remote);
+        pa_xfree(r);
+        return NULL;
+    }
+
+    r->remote_header = r->remote.ptr;
+    r->data = (uint8_t*) r->remote.ptr + RING_HEADER_SIZE;
+
+    /* We start reading wherever the producer is right now */
+    r->index = (unsigned) pa_atomic_load(&r->remote_header->index);
+    r->local_header = r->local.ptr;
+    pa_atomic_store(&r->local_header->index, (int) r->index);
+
+    r->connected = TRUE;
+
+    return r;
+}
+
+int pa_shm_ring_connect(pa_shm_ring *r, unsigned id) {
+    pa_assert(r);
+    pa_assert(r->producer);
+    pa_assert(!r->connected);
+
+    if (pa_shm_attach_ro(&r->remote, id) < 0)
+        return -1;
+
+    if (r->remote.size < RING_HEADER_SIZE) {
+        pa_log_warn("Shared memory ring segment too small.");
+        pa_shm_free(&r->remote);
+        return -1;
+    }
+
+    r->remote_header = r->remote.ptr;
+    r->connected = TRUE;
+
+    return 0;
+}
+
+void pa_shm_ring_free(pa_shm_ring *r) {
+    pa_assert(r);
+
+    if (r->remote.ptr)
+        pa_shm_free(&r->remote);
+
+    pa_shm_free(&r->local);
+    pa_xfree(r);
+}
+
+unsigned pa_shm_ring_get_id(pa_shm_ring *r) {
+    pa_assert(r);
+
+    return r->local.id;
+}
+
+size_t pa_shm_ring_get_size(pa_shm_ring *r) {
+    pa_assert(r);
+
+    return r->size;
+}
+
+uint32_t pa_shm_ring_get_index(pa_shm_ring *r) {
+    pa_assert(r);
+
+    return (uint32_t) r->index;
+}
+
+size_t pa_shm_ring_writable(pa_shm_ring *r) {
+    unsigned used;
+
+    pa_assert(r);
+    pa_assert(r->producer);
+
+    if (!r->connected)
+        return 0;
+
+    used = r->index - (unsigned) pa_atomic_load(&r->remote_header->index);
+
+    /* A consumer that reads ahead of us is broken, we stop writing
+     * then */
+    if (used > r->size)
+        return 0;
+
+    return r->size - used;
+}
+
+size_t pa_shm_ring_write(pa_shm_ring *r, const void *data, size_t length) {
+    size_t n, offset, l;
+
+    pa_assert(r);
+    pa_assert(data);
+
+    n = length = PA_MIN(length, pa_shm_ring_writable(r));
+
+    while (n > 0) {
+        offset = r->index & (r->size - 1);
+        l = PA_MIN(n, r->size - offset);
+
+        memcpy(r->data + offset, data, l);
+
+        data = (const uint8_t*) data + l;
+        n -= l;
+        r->index += (unsigned) l;
+    }
+
+    /* The atomic add acts as barrier, the data is in place before the
+     * consumer sees the new index */
+    if (length > 0)
+        pa_atomic_add(&r->local_header->index, (int) length);
+
+    return length;
+}
+
+int pa_shm_ring_peek(pa_shm_ring *r, const void **data, size_t *length) {
+    unsigned available, offset;
+
+    pa_assert(r);
+    pa_assert(!r->producer);
+    pa_assert(data);
+    pa_assert(length);
+
+    available = (unsigned) pa_atomic_load(&r->remote_header->index) - r->index;
+
+    if (available > r->size) {
+        *data = NULL;
+        *length = 0;
+        return -1;
+    }
+
+    offset = r->index & (unsigned) (r->size - 1);
+
+    *data = r->data + offset;
+    *length = PA_MIN((size_t) available, r->size - offset);
+
+    return 0;
+}
+
+void pa_shm_ring_drop(pa_shm_ring *r, size_t length) {
+    pa_assert(r);
+    pa_assert(!r->producer);
+    pa_assert(length <= r->size);
+
+    r->index += (unsigned) length;
+    pa_atomic_add(&r->local_header->index, (int) length);
+}
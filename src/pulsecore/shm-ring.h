@@ -0,0 +1,66 @@
+#ifndef foopulseshmringhfoo
+#define foopulseshmringhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <pulsecore/macro.h>
+
+/* A lock-free single producer, single consumer byte ring between two
+ * processes. Each side owns one shared memory segment which only it
+ * writes to and which the other side maps read-only: the producer's
+ * segment holds the write index and the data, the consumer's holds
+ * the read index. Neither side trusts the indexes of the other. */
+
+typedef struct pa_shm_ring pa_shm_ring;
+
+/* Producer side. The size is rounded up to a power of two. */
+pa_shm_ring* pa_shm_ring_new(size_t size);
+
+/* Consumer side, attach to the segment of a producer */
+pa_shm_ring* pa_shm_ring_attach(unsigned id, size_t size);
+
+/* Producer side, attach to the segment of the consumer. Until this
+ * succeeded nothing can be written. */
+int pa_shm_ring_connect(pa_shm_ring *r, unsigned id);
+
+void pa_shm_ring_free(pa_shm_ring *r);
+
+/* The id of our own segment, to be passed to the other side */
+unsigned pa_shm_ring_get_id(pa_shm_ring *r);
+size_t pa_shm_ring_get_size(pa_shm_ring *r);
+
+/* Our own index, i.e. how many bytes we have written or read so far,
+ * wrapped around at 2^32 */
+uint32_t pa_shm_ring_get_index(pa_shm_ring *r);
+
+/* Producer side */
+size_t pa_shm_ring_writable(pa_shm_ring *r);
+size_t pa_shm_ring_write(pa_shm_ring *r, const void *data, size_t length);
+
+/* Consumer side. Returns the next contiguous piece of readable data,
+ * with *length set to 0 if there is nothing to read. Returns a
+ * negative value if the producer corrupted the ring. */
+int pa_shm_ring_peek(pa_shm_ring *r, const void **data, size_t *length);
+void pa_shm_ring_drop(pa_shm_ring *r, size_t length);
+
+#endif
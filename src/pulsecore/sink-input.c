@@ -57,6 +57,12 @@ static int check_passthrough_connection(pa_bool_t passthrough, pa_sink *dest) {
         return -PA_ERR_BUSY;
     }
 
+    /* Passthrough data can't be converted to the sink's mix format */
+    if (passthrough && !pa_sample_spec_equal(&dest->mix_spec, &dest->sample_spec)) {
+        pa_log_warn("Sink mixes in a different sample format, cannot accept PASSTHROUGH input");
+        return -PA_ERR_NOTSUPPORTED;
+    }
+
     /* If current input(s) exist, check new input is not PASSTHROUGH */
     if (pa_idxset_size(dest->inputs) > 0 && passthrough) {
         pa_log_warn("Sink is already connected, cannot accept new PASSTHROUGH INPUT");
@@ -400,7 +406,7 @@ int pa_sink_input_new(
     }
 
     if ((data->flags & PA_SINK_INPUT_VARIABLE_RATE) ||
-        !pa_sample_spec_equal(&data->sample_spec, &data->sink->sample_spec) ||
+        !pa_sample_spec_equal(&data->sample_spec, &data->sink->mix_spec) ||
         !pa_channel_map_equal(&data->channel_map, &data->sink->channel_map)) {
 
         /* Note: for passthrough content we need to adjust the output rate to that of the current sink-input */
@@ -408,7 +414,7 @@ int pa_sink_input_new(
             if (!(resampler = pa_resampler_new(
                           core->mempool,
                           &data->sample_spec, &data->channel_map,
-                          &data->sink->sample_spec, &data->sink->channel_map,
+                          &data->sink->mix_spec, &data->sink->channel_map,
                           data->resample_method,
                           ((data->flags & PA_SINK_INPUT_VARIABLE_RATE) ? PA_RESAMPLER_VARIABLE_RATE : 0) |
                           ((data->flags & PA_SINK_INPUT_NO_REMAP) ? PA_RESAMPLER_NO_REMAP : 0) |
@@ -504,11 +510,11 @@ int pa_sink_input_new(
             0,
             MEMBLOCKQ_MAXLENGTH,
             0,
-            &i->sink->sample_spec,
+            &i->sink->mix_spec,
             0,
             1,
             0,
-            &i->sink->silence);
+            &i->sink->mix_silence);
     pa_xfree(memblockq_name);
 
     pt = pa_proplist_to_string_sep(i->proplist, "\n    ");
@@ -700,6 +706,8 @@ static void sink_input_free(pa_object *o) {
     if (i->thread_info.direct_outputs)
         pa_hashmap_free(i->thread_info.direct_outputs, NULL, NULL);
 
+    pa_stats_slot_free(i->stats);
+
     pa_xfree(i->driver);
     pa_xfree(i);
 }
@@ -741,6 +749,8 @@ void pa_sink_input_put(pa_sink_input *i) {
     i->thread_info.soft_volume = i->soft_volume;
     i->thread_info.muted = i->muted;
 
+    i->stats = pa_stats_slot_new(i->core->stats, PA_STATS_OBJECT_SINK_INPUT, i->index, pa_proplist_gets(i->proplist, PA_PROP_MEDIA_NAME));
+
     pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_ADD_INPUT, i, 0, NULL) == 0);
 
     pa_subscription_post(i->core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_NEW, i->index);
@@ -778,7 +788,7 @@ pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency) {
 }
 
 /* Called from thread context */
-void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, pa_memchunk *chunk, pa_cvolume *volume) {
+void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in the sink's mix spec */, pa_memchunk *chunk, pa_cvolume *volume) {
     pa_bool_t do_volume_adj_here, need_volume_factor_sink;
     pa_bool_t volume_is_norm;
     size_t block_size_max_sink, block_size_max_sink_input;
@@ -787,7 +797,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
     pa_assert(PA_SINK_INPUT_IS_LINKED(i->thread_info.state));
-    pa_assert(pa_frame_aligned(slength, &i->sink->sample_spec));
+    pa_assert(pa_frame_aligned(slength, &i->sink->mix_spec));
     pa_assert(chunk);
     pa_assert(volume);
 
@@ -799,11 +809,11 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
         pa_resampler_max_block_size(i->thread_info.resampler) :
         pa_frame_align(pa_mempool_block_size_max(i->core->mempool), &i->sample_spec);
 
-    block_size_max_sink = pa_frame_align(pa_mempool_block_size_max(i->core->mempool), &i->sink->sample_spec);
+    block_size_max_sink = pa_frame_align(pa_mempool_block_size_max(i->core->mempool), &i->sink->mix_spec);
 
     /* Default buffer size */
     if (slength <= 0)
-        slength = pa_frame_align(CONVERT_BUFFER_LENGTH, &i->sink->sample_spec);
+        slength = pa_frame_align(CONVERT_BUFFER_LENGTH, &i->sink->mix_spec);
 
     if (slength > block_size_max_sink)
         slength = block_size_max_sink;
@@ -842,6 +852,11 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
 
             pa_memblockq_seek(i->thread_info.render_memblockq, (int64_t) slength, PA_SEEK_RELATIVE, TRUE);
             i->thread_info.playing_for = 0;
+
+            /* Only count the moment we run dry after having played */
+            if (i->thread_info.underrun_for == 0 && i->thread_info.state != PA_SINK_INPUT_CORKED)
+                pa_stats_slot_inc(i->stats, PA_STATS_UNDERRUNS);
+
             if (i->thread_info.underrun_for != (uint64_t) -1)
                 i->thread_info.underrun_for += ilength;
             break;
@@ -857,7 +872,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
 
         while (tchunk.length > 0) {
             pa_memchunk wchunk;
-            pa_bool_t nvfs = need_volume_factor_sink;
+            pa_bool_t nvfs = need_volume_factor_sink, silent;
 
             wchunk = tchunk;
             pa_memblock_ref(wchunk.memblock);
@@ -865,8 +880,25 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
             if (wchunk.length > block_size_max_sink_input)
                 wchunk.length = block_size_max_sink_input;
 
+            silent = pa_frame_aligned(wchunk.length, &i->thread_info.sample_spec) &&
+                pa_memchunk_is_silence(&wchunk, &i->thread_info.sample_spec);
+
+            /* Silence needs no volume adjustment, and if it also
+             * needs no resampling we can leave a hole in the render
+             * queue, which reads back as the sink's cached silence */
+            if (silent && (!i->thread_info.resampler || pa_resampler_passes_silence(i->thread_info.resampler))) {
+                size_t rlength = i->thread_info.resampler ? pa_resampler_result(i->thread_info.resampler, wchunk.length) : wchunk.length;
+
+                pa_memblockq_seek(i->thread_info.render_memblockq, (int64_t) rlength, PA_SEEK_RELATIVE, TRUE);
+                pa_memblock_unref(wchunk.memblock);
+
+                tchunk.index += wchunk.length;
+                tchunk.length -= wchunk.length;
+                continue;
+            }
+
             /* It might be necessary to adjust the volume here */
-            if (do_volume_adj_here && !volume_is_norm) {
+            if (do_volume_adj_here && !volume_is_norm && !silent) {
                 pa_memchunk_make_writable(&wchunk, 0);
 
                 if (i->thread_info.muted) {
@@ -891,7 +923,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
 
                 if (nvfs) {
                     pa_memchunk_make_writable(&wchunk, 0);
-                    pa_volume_memchunk(&wchunk, &i->sink->sample_spec, &i->volume_factor_sink);
+                    pa_volume_memchunk(&wchunk, &i->sink->mix_spec, &i->volume_factor_sink);
                 }
 
                 pa_memblockq_push_align(i->thread_info.render_memblockq, &wchunk);
@@ -905,12 +937,19 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
 
                 if (rchunk.memblock) {
 
-                    if (nvfs) {
-                        pa_memchunk_make_writable(&rchunk, 0);
-                        pa_volume_memchunk(&rchunk, &i->sink->sample_spec, &i->volume_factor_sink);
+                    /* Once the resampler's history has drained, silence
+                     * comes out as silence again */
+                    if (silent && pa_memchunk_is_silence(&rchunk, &i->sink->mix_spec))
+                        pa_memblockq_seek(i->thread_info.render_memblockq, (int64_t) rchunk.length, PA_SEEK_RELATIVE, TRUE);
+                    else {
+                        if (nvfs) {
+                            pa_memchunk_make_writable(&rchunk, 0);
+                            pa_volume_memchunk(&rchunk, &i->sink->mix_spec, &i->volume_factor_sink);
+                        }
+
+                        pa_memblockq_push_align(i->thread_info.render_memblockq, &rchunk);
                     }
 
-                    pa_memblockq_push_align(i->thread_info.render_memblockq, &rchunk);
                     pa_memblock_unref(rchunk.memblock);
                 }
             }
@@ -950,12 +989,12 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
 }
 
 /* Called from thread context */
-void pa_sink_input_drop(pa_sink_input *i, size_t nbytes /* in sink sample spec */) {
+void pa_sink_input_drop(pa_sink_input *i, size_t nbytes /* in the sink's mix spec */) {
 
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
     pa_assert(PA_SINK_INPUT_IS_LINKED(i->thread_info.state));
-    pa_assert(pa_frame_aligned(nbytes, &i->sink->sample_spec));
+    pa_assert(pa_frame_aligned(nbytes, &i->sink->mix_spec));
     pa_assert(nbytes > 0);
 
 #ifdef SINK_INPUT_DEBUG
@@ -966,14 +1005,14 @@ void pa_sink_input_drop(pa_sink_input *i, size_t nbytes /* in sink sample spec *
 }
 
 /* Called from thread context */
-void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sample spec */) {
+void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in the sink's mix spec */) {
     size_t lbq;
     pa_bool_t called = FALSE;
 
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
     pa_assert(PA_SINK_INPUT_IS_LINKED(i->thread_info.state));
-    pa_assert(pa_frame_aligned(nbytes, &i->sink->sample_spec));
+    pa_assert(pa_frame_aligned(nbytes, &i->sink->mix_spec));
 
 #ifdef SINK_INPUT_DEBUG
     pa_log_debug("rewind(%lu, %lu)", (unsigned long) nbytes, (unsigned long) i->thread_info.rewrite_nbytes);
@@ -983,6 +1022,7 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
 
     if (nbytes > 0 && !i->thread_info.dont_rewind_render) {
         pa_log_debug("Have to rewind %lu bytes on render memblockq.", (unsigned long) nbytes);
+        pa_stats_slot_inc(i->stats, PA_STATS_REWINDS);
         pa_memblockq_rewind(i->thread_info.render_memblockq, nbytes);
     }
 
@@ -1042,29 +1082,37 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
 
 /* Called from thread context */
 size_t pa_sink_input_get_max_rewind(pa_sink_input *i) {
+    size_t nbytes;
+
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
 
-    return i->thread_info.resampler ? pa_resampler_request(i->thread_info.resampler, i->sink->thread_info.max_rewind) : i->sink->thread_info.max_rewind;
+    nbytes = pa_sink_bytes_to_mix(i->sink, i->sink->thread_info.max_rewind);
+
+    return i->thread_info.resampler ? pa_resampler_request(i->thread_info.resampler, nbytes) : nbytes;
 }
 
 /* Called from thread context */
 size_t pa_sink_input_get_max_request(pa_sink_input *i) {
+    size_t nbytes;
+
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
 
     /* We're not verifying the status here, to allow this to be called
      * in the state change handler between _INIT and _RUNNING */
 
-    return i->thread_info.resampler ? pa_resampler_request(i->thread_info.resampler, i->sink->thread_info.max_request) : i->sink->thread_info.max_request;
+    nbytes = pa_sink_bytes_to_mix(i->sink, i->sink->thread_info.max_request);
+
+    return i->thread_info.resampler ? pa_resampler_request(i->thread_info.resampler, nbytes) : nbytes;
 }
 
 /* Called from thread context */
-void pa_sink_input_update_max_rewind(pa_sink_input *i, size_t nbytes  /* in the sink's sample spec */) {
+void pa_sink_input_update_max_rewind(pa_sink_input *i, size_t nbytes  /* in the sink's mix spec */) {
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
     pa_assert(PA_SINK_INPUT_IS_LINKED(i->thread_info.state));
-    pa_assert(pa_frame_aligned(nbytes, &i->sink->sample_spec));
+    pa_assert(pa_frame_aligned(nbytes, &i->sink->mix_spec));
 
     pa_memblockq_set_maxrewind(i->thread_info.render_memblockq, nbytes);
 
@@ -1073,16 +1121,30 @@ void pa_sink_input_update_max_rewind(pa_sink_input *i, size_t nbytes  /* in the
 }
 
 /* Called from thread context */
-void pa_sink_input_update_max_request(pa_sink_input *i, size_t nbytes  /* in the sink's sample spec */) {
+void pa_sink_input_update_max_request(pa_sink_input *i, size_t nbytes  /* in the sink's mix spec */) {
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
     pa_assert(PA_SINK_INPUT_IS_LINKED(i->thread_info.state));
-    pa_assert(pa_frame_aligned(nbytes, &i->sink->sample_spec));
+    pa_assert(pa_frame_aligned(nbytes, &i->sink->mix_spec));
 
     if (i->update_max_request)
         i->update_max_request(i, i->thread_info.resampler ? pa_resampler_request(i->thread_info.resampler, nbytes) : nbytes);
 }
 
+/* Called from thread context */
+void pa_sink_input_drop_caches(pa_sink_input *i) {
+    pa_sink_input_assert_ref(i);
+    pa_sink_input_assert_io_context(i);
+    pa_assert(PA_SINK_INPUT_IS_LINKED(i->thread_info.state));
+
+    /* The indexes are left as they are, so that a later rewind will
+     * just find silence where the dropped data used to be */
+    pa_memblockq_silence(i->thread_info.render_memblockq);
+
+    if (i->thread_info.resampler)
+        pa_resampler_trim(i->thread_info.resampler);
+}
+
 /* Called from thread context */
 pa_usec_t pa_sink_input_set_requested_latency_within_thread(pa_sink_input *i, pa_usec_t usec) {
     pa_sink_input_assert_ref(i);
@@ -1821,7 +1883,7 @@ int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t
         case PA_SINK_INPUT_MESSAGE_GET_LATENCY: {
             pa_usec_t *r = userdata;
 
-            r[0] += pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec);
+            r[0] += pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->mix_spec);
             r[1] += pa_sink_get_latency_within_thread(i->sink);
 
             return 0;
@@ -1938,7 +2000,7 @@ void pa_sink_input_request_rewind(
     if (nbytes <= 0) {
 
         /* Calculate maximum number of bytes that could be rewound in theory */
-        nbytes = i->sink->thread_info.max_rewind + lbq;
+        nbytes = pa_sink_bytes_to_mix(i->sink, i->sink->thread_info.max_rewind) + lbq;
 
         /* Transform from sink domain */
         if (i->thread_info.resampler)
@@ -1972,7 +2034,7 @@ void pa_sink_input_request_rewind(
             nbytes = pa_resampler_result(i->thread_info.resampler, nbytes);
 
         if (nbytes > lbq)
-            pa_sink_request_rewind(i->sink, nbytes - lbq);
+            pa_sink_request_rewind(i->sink, pa_sink_bytes_from_mix(i->sink, nbytes - lbq));
         else
             /* This call will make sure process_rewind() is called later */
             pa_sink_request_rewind(i->sink, 0);
@@ -2037,19 +2099,19 @@ int pa_sink_input_update_rate(pa_sink_input *i) {
     pa_assert_ctl_context();
 
     if (i->thread_info.resampler &&
-        pa_sample_spec_equal(pa_resampler_output_sample_spec(i->thread_info.resampler), &i->sink->sample_spec) &&
+        pa_sample_spec_equal(pa_resampler_output_sample_spec(i->thread_info.resampler), &i->sink->mix_spec) &&
         pa_channel_map_equal(pa_resampler_output_channel_map(i->thread_info.resampler), &i->sink->channel_map))
 
         new_resampler = i->thread_info.resampler;
 
     else if (!pa_sink_input_is_passthrough(i) &&
         ((i->flags & PA_SINK_INPUT_VARIABLE_RATE) ||
-         !pa_sample_spec_equal(&i->sample_spec, &i->sink->sample_spec) ||
+         !pa_sample_spec_equal(&i->sample_spec, &i->sink->mix_spec) ||
          !pa_channel_map_equal(&i->channel_map, &i->sink->channel_map))) {
 
         new_resampler = pa_resampler_new(i->core->mempool,
                                      &i->sample_spec, &i->channel_map,
-                                     &i->sink->sample_spec, &i->sink->channel_map,
+                                     &i->sink->mix_spec, &i->sink->channel_map,
                                      i->requested_resample_method,
                                      ((i->flags & PA_SINK_INPUT_VARIABLE_RATE) ? PA_RESAMPLER_VARIABLE_RATE : 0) |
                                      ((i->flags & PA_SINK_INPUT_NO_REMAP) ? PA_RESAMPLER_NO_REMAP : 0) |
@@ -2078,11 +2140,11 @@ int pa_sink_input_update_rate(pa_sink_input *i) {
             0,
             MEMBLOCKQ_MAXLENGTH,
             0,
-            &i->sink->sample_spec,
+            &i->sink->mix_spec,
             0,
             1,
             0,
-            &i->sink->silence);
+            &i->sink->mix_silence);
     pa_xfree(memblockq_name);
 
     i->actual_resample_method = new_resampler ? pa_resampler_get_method(new_resampler) : PA_RESAMPLER_INVALID;
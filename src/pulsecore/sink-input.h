@@ -35,6 +35,7 @@ typedef struct pa_sink_input pa_sink_input;
 #include <pulsecore/client.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/core.h>
+#include <pulsecore/stats.h>
 
 typedef enum pa_sink_input_state {
     PA_SINK_INPUT_INIT,         /*< The stream is not active yet, because pa_sink_input_put() has not been called yet */
@@ -117,6 +118,10 @@ struct pa_sink_input {
 
     pa_resample_method_t requested_resample_method, actual_resample_method;
 
+    /* Our slot in the statistics, may be NULL. Set up before the
+     * sink's IO thread gets to see us. */
+    pa_stats_slot *stats;
+
     /* Returns the chunk of audio data and drops it from the
      * queue. Returns -1 on failure. Called from IO thread context. If
      * data needs to be generated from scratch then please in the
@@ -388,6 +393,11 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in the sink
 void pa_sink_input_update_max_rewind(pa_sink_input *i, size_t nbytes  /* in the sink's sample spec */);
 void pa_sink_input_update_max_request(pa_sink_input *i, size_t nbytes  /* in the sink's sample spec */);
 
+/* Release the rendered data and resampler buffers cached for this
+ * stream. Only to be used when what is cached is silence anyway,
+ * e.g. while the stream is starved or corked. */
+void pa_sink_input_drop_caches(pa_sink_input *i);
+
 void pa_sink_input_set_state_within_thread(pa_sink_input *i, pa_sink_input_state_t state);
 
 int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk);
@@ -42,6 +42,7 @@
 #include <pulsecore/namereg.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/sconv.h>
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -262,6 +263,10 @@ pa_sink* pa_sink_new(
     s->channel_map = data->channel_map;
     s->default_sample_rate = s->sample_spec.rate;
 
+    s->mix_spec = s->sample_spec;
+    if (data->float_mixing)
+        s->mix_spec.format = PA_SAMPLE_FLOAT32NE;
+
     if (data->alternate_sample_rate_is_set)
         s->alternate_sample_rate = data->alternate_sample_rate;
     else
@@ -324,6 +329,13 @@ pa_sink* pa_sink_new(
             &s->sample_spec,
             0);
 
+    pa_silence_memchunk_get(
+            &core->silence_cache,
+            core->mempool,
+            &s->mix_silence,
+            &s->mix_spec,
+            0);
+
     s->thread_info.rtpoll = NULL;
     s->thread_info.inputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     s->thread_info.soft_volume =  s->soft_volume;
@@ -650,6 +662,9 @@ void pa_sink_put(pa_sink* s) {
     pa_assert(s->monitor_source->thread_info.min_latency == s->thread_info.min_latency);
     pa_assert(s->monitor_source->thread_info.max_latency == s->thread_info.max_latency);
 
+    /* The state change below makes sure the IO thread sees this */
+    s->stats = pa_stats_slot_new(s->core->stats, PA_STATS_OBJECT_SINK, s->index, s->name);
+
     pa_assert_se(sink_set_state(s, PA_SINK_IDLE) == 0);
 
     pa_source_put(s->monitor_source);
@@ -737,6 +752,11 @@ static void sink_free(pa_object *o) {
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
 
+    if (s->mix_silence.memblock)
+        pa_memblock_unref(s->mix_silence.memblock);
+
+    pa_stats_slot_free(s->stats);
+
     pa_xfree(s->name);
     pa_xfree(s->driver);
 
@@ -940,13 +960,14 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
 
     if (nbytes > 0) {
         pa_log_debug("Processing rewind...");
+        pa_stats_slot_inc(s->stats, PA_STATS_REWINDS);
         if (s->flags & PA_SINK_DEFERRED_VOLUME)
             pa_sink_volume_change_rewind(s, nbytes);
     }
 
     PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state) {
         pa_sink_input_assert_ref(i);
-        pa_sink_input_process_rewind(i, nbytes);
+        pa_sink_input_process_rewind(i, pa_sink_bytes_to_mix(s, nbytes));
     }
 
     if (nbytes > 0) {
@@ -955,6 +976,35 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
     }
 }
 
+/* Called from IO thread context */
+static inline pa_bool_t mix_needs_conversion(pa_sink *s) {
+    return s->mix_spec.format != s->sample_spec.format;
+}
+
+/* Called from IO thread context */
+static void convert_from_mix(pa_sink *s, const pa_memchunk *src, pa_memchunk *dst) {
+    pa_convert_func_t convert;
+    unsigned n;
+    void *sptr, *dptr;
+
+    pa_assert(src->memblock);
+    pa_assert(dst->memblock);
+
+    convert = pa_get_convert_from_float32ne_function(s->sample_spec.format);
+    pa_assert(convert);
+
+    n = (unsigned) (src->length / sizeof(float));
+    dst->length = n * pa_sample_size(&s->sample_spec);
+
+    sptr = pa_memblock_acquire_chunk(src);
+    dptr = pa_memblock_acquire_chunk(dst);
+
+    convert(n, sptr, dptr);
+
+    pa_memblock_release(dst->memblock);
+    pa_memblock_release(src->memblock);
+}
+
 /* Called from IO thread context */
 static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, unsigned maxinfo) {
     pa_sink_input *i;
@@ -1030,7 +1080,7 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
         }
 
         /* Drop read data */
-        pa_sink_input_drop(i, result->length);
+        pa_sink_input_drop(i, pa_sink_bytes_to_mix(s, result->length));
 
         if (s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->thread_info.state)) {
 
@@ -1042,11 +1092,22 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
                 if (m && m->chunk.memblock) {
                     c = m->chunk;
                     pa_memblock_ref(c.memblock);
-                    pa_assert(result->length <= c.length);
-                    c.length = result->length;
+                    pa_assert(pa_sink_bytes_to_mix(s, result->length) <= c.length);
+                    c.length = pa_sink_bytes_to_mix(s, result->length);
 
                     pa_memchunk_make_writable(&c, 0);
-                    pa_volume_memchunk(&c, &s->sample_spec, &m->volume);
+                    pa_volume_memchunk(&c, &s->mix_spec, &m->volume);
+
+                    if (mix_needs_conversion(s)) {
+                        pa_memchunk converted;
+
+                        converted.memblock = pa_memblock_new(s->core->mempool, result->length);
+                        converted.index = 0;
+                        convert_from_mix(s, &c, &converted);
+
+                        pa_memblock_unref(c.memblock);
+                        c = converted;
+                    }
                 } else {
                     c = s->silence;
                     pa_memblock_ref(c.memblock);
@@ -1092,11 +1153,63 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
         pa_source_post(s->monitor_source, result);
 }
 
+/* Called from IO thread context */
+static void mix_inputs(pa_sink *s, pa_mix_info *info, unsigned n, size_t length /* in mix spec */, pa_memchunk *result) {
+    pa_assert(n > 0);
+
+    if (n == 1) {
+        pa_cvolume volume;
+
+        *result = info[0].chunk;
+        pa_memblock_ref(result->memblock);
+
+        if (result->length > length)
+            result->length = length;
+
+        pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info[0].volume);
+
+        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume)) {
+            pa_memblock_unref(result->memblock);
+            pa_silence_memchunk_get(&s->core->silence_cache,
+                                    s->core->mempool,
+                                    result,
+                                    &s->mix_spec,
+                                    result->length);
+        } else if (!pa_cvolume_is_norm(&volume)) {
+            pa_memchunk_make_writable(result, 0);
+            pa_volume_memchunk(result, &s->mix_spec, &volume);
+        }
+    } else {
+        void *ptr;
+        result->memblock = pa_memblock_new(s->core->mempool, length);
+
+        ptr = pa_memblock_acquire(result->memblock);
+        result->length = pa_mix(info, n,
+                                ptr, length,
+                                &s->mix_spec,
+                                &s->thread_info.soft_volume,
+                                s->thread_info.soft_muted);
+        pa_memblock_release(result->memblock);
+
+        result->index = 0;
+    }
+}
+
+/* Called from IO thread context */
+static void count_render(pa_sink *s, pa_usec_t start) {
+    if (!s->stats)
+        return;
+
+    pa_stats_slot_inc(s->stats, PA_STATS_RENDERS);
+    pa_stats_slot_add_render_time(s->stats, pa_rtclock_now() - start);
+}
+
 /* Called from IO thread context */
 void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
     pa_mix_info info[MAX_MIX_CHANNELS];
     unsigned n;
-    size_t block_size_max;
+    size_t block_size_max, mix_length;
+    pa_usec_t start;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1116,6 +1229,8 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     pa_sink_ref(s);
 
+    start = s->stats ? pa_rtclock_now() : 0;
+
     if (length <= 0)
         length = pa_frame_align(MIX_BUFFER_LENGTH, &s->sample_spec);
 
@@ -1125,55 +1240,41 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    mix_length = pa_sink_bytes_to_mix(s, length);
+    if (mix_length > block_size_max)
+        mix_length = pa_frame_align(block_size_max, &s->mix_spec);
+
+    n = fill_mix_info(s, &mix_length, info, MAX_MIX_CHANNELS);
 
     if (n == 0) {
 
         *result = s->silence;
         pa_memblock_ref(result->memblock);
 
+        length = pa_sink_bytes_from_mix(s, mix_length);
         if (result->length > length)
             result->length = length;
 
-    } else if (n == 1) {
-        pa_cvolume volume;
-
-        *result = info[0].chunk;
-        pa_memblock_ref(result->memblock);
-
-        if (result->length > length)
-            result->length = length;
-
-        pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info[0].volume);
-
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume)) {
-            pa_memblock_unref(result->memblock);
-            pa_silence_memchunk_get(&s->core->silence_cache,
-                                    s->core->mempool,
-                                    result,
-                                    &s->sample_spec,
-                                    result->length);
-        } else if (!pa_cvolume_is_norm(&volume)) {
-            pa_memchunk_make_writable(result, 0);
-            pa_volume_memchunk(result, &s->sample_spec, &volume);
-        }
-    } else {
-        void *ptr;
-        result->memblock = pa_memblock_new(s->core->mempool, length);
+    } else if (!mix_needs_conversion(s))
+        mix_inputs(s, info, n, mix_length, result);
+    else {
+        pa_memchunk mixed;
 
-        ptr = pa_memblock_acquire(result->memblock);
-        result->length = pa_mix(info, n,
-                                ptr, length,
-                                &s->sample_spec,
-                                &s->thread_info.soft_volume,
-                                s->thread_info.soft_muted);
-        pa_memblock_release(result->memblock);
+        mix_inputs(s, info, n, mix_length, &mixed);
 
+        /* This is the only place the mixed data is converted to the
+         * sink's sample format */
+        result->memblock = pa_memblock_new(s->core->mempool, pa_sink_bytes_from_mix(s, mixed.length));
         result->index = 0;
+        convert_from_mix(s, &mixed, result);
+
+        pa_memblock_unref(mixed.memblock);
     }
 
     inputs_drop(s, info, n, result);
 
+    count_render(s, start);
+
     pa_sink_unref(s);
 }
 
@@ -1182,6 +1283,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
     pa_mix_info info[MAX_MIX_CHANNELS];
     unsigned n;
     size_t length, block_size_max;
+    pa_usec_t start;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1201,6 +1303,8 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     pa_sink_ref(s);
 
+    start = s->stats ? pa_rtclock_now() : 0;
+
     length = target->length;
     block_size_max = pa_mempool_block_size_max(s->core->mempool);
     if (length > block_size_max)
@@ -1208,6 +1312,39 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     pa_assert(length > 0);
 
+    if (mix_needs_conversion(s)) {
+        size_t mix_length;
+
+        mix_length = pa_sink_bytes_to_mix(s, length);
+        if (mix_length > block_size_max)
+            mix_length = pa_frame_align(block_size_max, &s->mix_spec);
+
+        n = fill_mix_info(s, &mix_length, info, MAX_MIX_CHANNELS);
+
+        if (n == 0) {
+            length = pa_sink_bytes_from_mix(s, mix_length);
+            if (target->length > length)
+                target->length = length;
+
+            pa_silence_memchunk(target, &s->sample_spec);
+        } else {
+            pa_memchunk mixed;
+
+            /* Convert straight into the target, this is the only
+             * conversion the mixed data goes through */
+            mix_inputs(s, info, n, mix_length, &mixed);
+            convert_from_mix(s, &mixed, target);
+            pa_memblock_unref(mixed.memblock);
+        }
+
+        inputs_drop(s, info, n, target);
+
+        count_render(s, start);
+
+        pa_sink_unref(s);
+        return;
+    }
+
     n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
 
     if (n == 0) {
@@ -1259,6 +1396,8 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     inputs_drop(s, info, n, target);
 
+    count_render(s, start);
+
     pa_sink_unref(s);
 }
 
@@ -1395,6 +1534,8 @@ pa_bool_t pa_sink_update_rate(pa_sink *s, uint32_t rate, pa_bool_t passthrough)
         pa_sink_suspend(s, TRUE, PA_SUSPEND_IDLE); /* needed before rate update, will be resumed automatically */
 
         if (s->update_rate(s, desired_rate) == TRUE) {
+            s->mix_spec.rate = s->sample_spec.rate;
+
             /* update monitor source as well */
             if (s->monitor_source && !passthrough)
                 pa_source_update_rate(s->monitor_source, desired_rate, FALSE);
@@ -1473,6 +1614,26 @@ pa_usec_t pa_sink_get_latency_within_thread(pa_sink *s) {
     return usec;
 }
 
+/* Called from any context */
+size_t pa_sink_bytes_to_mix(pa_sink *s, size_t nbytes) {
+    pa_sink_assert_ref(s);
+
+    if (nbytes == (size_t) -1 || s->mix_spec.format == s->sample_spec.format)
+        return nbytes;
+
+    return (nbytes / pa_frame_size(&s->sample_spec)) * pa_frame_size(&s->mix_spec);
+}
+
+/* Called from any context */
+size_t pa_sink_bytes_from_mix(pa_sink *s, size_t nbytes) {
+    pa_sink_assert_ref(s);
+
+    if (nbytes == (size_t) -1 || s->mix_spec.format == s->sample_spec.format)
+        return nbytes;
+
+    return (nbytes / pa_frame_size(&s->mix_spec)) * pa_frame_size(&s->sample_spec);
+}
+
 /* Called from the main thread (and also from the IO thread while the main
  * thread is waiting).
  *
@@ -2432,8 +2593,8 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             if (i->thread_info.requested_sink_latency != (pa_usec_t) -1)
                 pa_sink_input_set_requested_latency_within_thread(i, i->thread_info.requested_sink_latency);
 
-            pa_sink_input_update_max_rewind(i, s->thread_info.max_rewind);
-            pa_sink_input_update_max_request(i, s->thread_info.max_request);
+            pa_sink_input_update_max_rewind(i, pa_sink_bytes_to_mix(s, s->thread_info.max_rewind));
+            pa_sink_input_update_max_request(i, pa_sink_bytes_to_mix(s, s->thread_info.max_request));
 
             /* We don't rewind here automatically. This is left to the
              * sink input implementor because some sink inputs need a
@@ -2555,7 +2716,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
 
                 /* Get the latency of the sink */
                 usec = pa_sink_get_latency_within_thread(s);
-                sink_nbytes = pa_usec_to_bytes(usec, &s->sample_spec);
+                sink_nbytes = pa_usec_to_bytes(usec, &s->mix_spec);
                 total_nbytes = sink_nbytes + pa_memblockq_get_length(i->thread_info.render_memblockq);
 
                 if (total_nbytes > 0) {
@@ -2629,7 +2790,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
                 nbytes = pa_usec_to_bytes(usec, &s->sample_spec);
 
                 if (nbytes > 0)
-                    pa_sink_input_drop(i, nbytes);
+                    pa_sink_input_drop(i, pa_sink_bytes_to_mix(s, nbytes));
 
                 pa_log_debug("Requesting rewind due to finished move");
                 pa_sink_request_rewind(s, nbytes);
@@ -2643,8 +2804,8 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             if (i->thread_info.requested_sink_latency != (pa_usec_t) -1)
                 pa_sink_input_set_requested_latency_within_thread(i, i->thread_info.requested_sink_latency);
 
-            pa_sink_input_update_max_rewind(i, s->thread_info.max_rewind);
-            pa_sink_input_update_max_request(i, s->thread_info.max_request);
+            pa_sink_input_update_max_rewind(i, pa_sink_bytes_to_mix(s, s->thread_info.max_rewind));
+            pa_sink_input_update_max_request(i, pa_sink_bytes_to_mix(s, s->thread_info.max_request));
 
             return o->process_msg(o, PA_SINK_MESSAGE_SET_SHARED_VOLUME, NULL, 0, NULL);
         }
@@ -3012,7 +3173,7 @@ void pa_sink_set_max_rewind_within_thread(pa_sink *s, size_t max_rewind) {
 
     if (PA_SINK_IS_LINKED(s->thread_info.state))
         PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state)
-            pa_sink_input_update_max_rewind(i, s->thread_info.max_rewind);
+            pa_sink_input_update_max_rewind(i, pa_sink_bytes_to_mix(s, s->thread_info.max_rewind));
 
     if (s->monitor_source)
         pa_source_set_max_rewind_within_thread(s->monitor_source, s->thread_info.max_rewind);
@@ -3045,7 +3206,7 @@ void pa_sink_set_max_request_within_thread(pa_sink *s, size_t max_request) {
         pa_sink_input *i;
 
         PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state)
-            pa_sink_input_update_max_request(i, s->thread_info.max_request);
+            pa_sink_input_update_max_request(i, pa_sink_bytes_to_mix(s, s->thread_info.max_request));
     }
 }
 
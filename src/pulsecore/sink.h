@@ -46,6 +46,7 @@ typedef struct pa_sink_volume_change pa_sink_volume_change;
 #include <pulsecore/card.h>
 #include <pulsecore/queue.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/stats.h>
 #include <pulsecore/sink-input.h>
 
 #define PA_MAX_INPUTS_PER_SINK 32
@@ -78,6 +79,11 @@ struct pa_sink {
     pa_sample_spec sample_spec;
     pa_channel_map channel_map;
     uint32_t default_sample_rate;
+
+    /* The sample spec the inputs are rendered and mixed in. Differs
+     * from sample_spec only in the format, and only if the sink was
+     * created with float_mixing set. */
+    pa_sample_spec mix_spec;
     uint32_t alternate_sample_rate;
 
     pa_idxset *inputs;
@@ -108,6 +114,11 @@ struct pa_sink {
     pa_asyncmsgq *asyncmsgq;
 
     pa_memchunk silence;
+    pa_memchunk mix_silence;
+
+    /* Our slot in the statistics, may be NULL. Set up before the IO
+     * thread renders anything. */
+    pa_stats_slot *stats;
 
     pa_hashmap *ports;
     pa_device_port *active_port;
@@ -355,6 +366,10 @@ typedef struct pa_sink_new_data {
     pa_bool_t save_port:1;
     pa_bool_t save_volume:1;
     pa_bool_t save_muted:1;
+
+    /* Mix all inputs as FLOAT32NE and convert to the sink format only
+     * once, after mixing */
+    pa_bool_t float_mixing:1;
 } pa_sink_new_data;
 
 pa_sink_new_data* pa_sink_new_data_init(pa_sink_new_data *data);
@@ -498,6 +513,10 @@ void pa_sink_invalidate_requested_latency(pa_sink *s, pa_bool_t dynamic);
 
 pa_usec_t pa_sink_get_latency_within_thread(pa_sink *s);
 
+/* Convert byte counts between the sink's sample spec and its mix spec */
+size_t pa_sink_bytes_to_mix(pa_sink *s, size_t nbytes);
+size_t pa_sink_bytes_from_mix(pa_sink *s, size_t nbytes);
+
 /* Verify that we called in IO context (aka 'thread context), or that
  * the sink is not yet set up, i.e. the thread not set up yet. See
  * pa_assert_io_context() in thread-mq.h for more information. */
@@ -619,6 +619,8 @@ static void source_output_free(pa_object* mo) {
     if (o->proplist)
         pa_proplist_free(o->proplist);
 
+    pa_stats_slot_free(o->stats);
+
     pa_xfree(o->driver);
     pa_xfree(o);
 }
@@ -659,6 +661,8 @@ void pa_source_output_put(pa_source_output *o) {
     o->thread_info.soft_volume = o->soft_volume;
     o->thread_info.muted = o->muted;
 
+    o->stats = pa_stats_slot_new(o->core->stats, PA_STATS_OBJECT_SOURCE_OUTPUT, o->index, pa_proplist_gets(o->proplist, PA_PROP_MEDIA_NAME));
+
     pa_assert_se(pa_asyncmsgq_send(o->source->asyncmsgq, PA_MSGOBJECT(o->source), PA_SOURCE_MESSAGE_ADD_OUTPUT, o, 0, NULL) == 0);
 
     pa_subscription_post(o->core, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT|PA_SUBSCRIPTION_EVENT_NEW, o->index);
@@ -715,6 +719,7 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
 
     if (pa_memblockq_push(o->thread_info.delay_memblockq, chunk) < 0) {
         pa_log_debug("Delay queue overflow!");
+        pa_stats_slot_inc(o->stats, PA_STATS_OVERRUNS);
         pa_memblockq_seek(o->thread_info.delay_memblockq, (int64_t) chunk->length, PA_SEEK_RELATIVE, TRUE);
     }
 
@@ -34,6 +34,7 @@ typedef struct pa_source_output pa_source_output;
 #include <pulsecore/client.h>
 #include <pulsecore/source.h>
 #include <pulsecore/core.h>
+#include <pulsecore/stats.h>
 #include <pulsecore/sink-input.h>
 
 typedef enum pa_source_output_state {
@@ -108,6 +109,10 @@ struct pa_source_output {
 
     pa_resample_method_t requested_resample_method, actual_resample_method;
 
+    /* Our slot in the statistics, may be NULL. Set up before the
+     * source's IO thread gets to see us. */
+    pa_stats_slot *stats;
+
     /* Pushes a new memchunk into the output. Called from IO thread
      * context. */
     void (*push)(pa_source_output *o, const pa_memchunk *chunk); /* may NOT be NULL */
@@ -595,6 +595,9 @@ void pa_source_put(pa_source *s) {
     pa_assert(!(s->flags & PA_SOURCE_DECIBEL_VOLUME) || s->n_volume_steps == PA_VOLUME_NORM+1);
     pa_assert(!(s->flags & PA_SOURCE_DYNAMIC_LATENCY) == (s->thread_info.fixed_latency != 0));
 
+    /* The state change below makes sure the IO thread sees this */
+    s->stats = pa_stats_slot_new(s->core->stats, PA_STATS_OBJECT_SOURCE, s->index, s->name);
+
     pa_assert_se(source_set_state(s, PA_SOURCE_IDLE) == 0);
 
     pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SOURCE | PA_SUBSCRIPTION_EVENT_NEW, s->index);
@@ -667,6 +670,8 @@ static void source_free(pa_object *o) {
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
 
+    pa_stats_slot_free(s->stats);
+
     pa_xfree(s->name);
     pa_xfree(s->driver);
 
@@ -869,6 +874,7 @@ void pa_source_process_rewind(pa_source *s, size_t nbytes) {
         return;
 
     pa_log_debug("Processing rewind...");
+    pa_stats_slot_inc(s->stats, PA_STATS_REWINDS);
 
     PA_HASHMAP_FOREACH(o, s->thread_info.outputs, state) {
         pa_source_output_assert_ref(o);
@@ -880,6 +886,7 @@ void pa_source_process_rewind(pa_source *s, size_t nbytes) {
 void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
     pa_source_output *o;
     void *state = NULL;
+    pa_usec_t start;
 
     pa_source_assert_ref(s);
     pa_source_assert_io_context(s);
@@ -889,6 +896,8 @@ void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
     if (s->thread_info.state == PA_SOURCE_SUSPENDED)
         return;
 
+    start = s->stats ? pa_rtclock_now() : 0;
+
     if (s->thread_info.soft_muted || !pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
         pa_memchunk vchunk = *chunk;
 
@@ -917,6 +926,11 @@ void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
                 pa_source_output_push(o, chunk);
         }
     }
+
+    if (s->stats) {
+        pa_stats_slot_inc(s->stats, PA_STATS_RENDERS);
+        pa_stats_slot_add_render_time(s->stats, pa_rtclock_now() - start);
+    }
 }
 
 /* Called from IO thread context */
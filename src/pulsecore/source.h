@@ -46,6 +46,7 @@ typedef struct pa_source_volume_change pa_source_volume_change;
 #include <pulsecore/device-port.h>
 #include <pulsecore/queue.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/stats.h>
 #include <pulsecore/source-output.h>
 
 #define PA_MAX_OUTPUTS_PER_SOURCE 32
@@ -109,6 +110,10 @@ struct pa_source {
 
     pa_memchunk silence;
 
+    /* Our slot in the statistics, may be NULL. Set up before the IO
+     * thread posts anything. */
+    pa_stats_slot *stats;
+
     pa_hashmap *ports;
     pa_device_port *active_port;
     pa_atomic_t mixer_dirty;
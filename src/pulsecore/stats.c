@@ -0,0 +1,169 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/shm.h>
+
+#include "stats.h"
+
+/* Slots are cache line aligned, so that IO threads updating
+ * different objects don't get into each other's way */
+#define STATS_ALIGN 64
+#define STATS_SLOT_SIZE (((sizeof(pa_stats_slot) + STATS_ALIGN - 1) / STATS_ALIGN) * STATS_ALIGN)
+#define STATS_SLOTS_OFFSET STATS_ALIGN
+
+#define STATS_SLOTS_MAX 65536
+
+struct pa_stats {
+    pa_shm memory;
+    pa_stats_header *header;
+    unsigned n_slots;
+
+    /* Where to start looking for a free slot */
+    unsigned next;
+};
+
+static pa_stats_slot* get_slot(pa_stats *s, unsigned i) {
+    pa_assert(s);
+    pa_assert(i < s->n_slots);
+
+    return (pa_stats_slot*) ((uint8_t*) s->memory.ptr + STATS_SLOTS_OFFSET + i * STATS_SLOT_SIZE);
+}
+
+pa_stats* pa_stats_new(unsigned n_slots) {
+    pa_stats *s;
+
+    pa_assert(n_slots > 0);
+    pa_assert(sizeof(pa_stats_header) <= STATS_SLOTS_OFFSET);
+
+    if (n_slots > STATS_SLOTS_MAX)
+        n_slots = STATS_SLOTS_MAX;
+
+    s = pa_xnew(pa_stats, 1);
+    s->n_slots = n_slots;
+    s->next = 0;
+
+    /* Only we may write to it, everybody else maps it read-only */
+    if (pa_shm_create_rw(&s->memory, STATS_SLOTS_OFFSET + n_slots * STATS_SLOT_SIZE, TRUE, 0700) < 0) {
+        pa_xfree(s);
+        return NULL;
+    }
+
+    /* Fresh segments are zeroed, i.e. all slots are unused */
+    s->header = s->memory.ptr;
+    s->header->magic = PA_STATS_MAGIC;
+    s->header->version = PA_STATS_VERSION;
+    s->header->n_slots = n_slots;
+    s->header->slot_size = (uint32_t) STATS_SLOT_SIZE;
+    s->header->slots_offset = (uint32_t) STATS_SLOTS_OFFSET;
+
+    pa_log_info("Statistics for %u objects are in shared memory segment %u.", n_slots, s->memory.id);
+
+    return s;
+}
+
+void pa_stats_free(pa_stats *s) {
+    pa_assert(s);
+
+    pa_shm_free(&s->memory);
+    pa_xfree(s);
+}
+
+unsigned pa_stats_get_id(pa_stats *s) {
+    pa_assert(s);
+
+    return s->memory.id;
+}
+
+pa_stats_slot* pa_stats_slot_new(pa_stats *s, pa_stats_object_t object, uint32_t idx, const char *name) {
+    pa_stats_slot *slot;
+    unsigned i, k;
+
+    if (!s)
+        return NULL;
+
+    for (i = 0; i < s->n_slots; i++) {
+        slot = get_slot(s, (s->next + i) % s->n_slots);
+
+        if (pa_atomic_load(&slot->generation) & 1)
+            continue;
+
+        slot->object = object;
+        slot->index = idx;
+        pa_strlcpy(slot->name, name ? name : "", sizeof(slot->name));
+
+        for (k = 0; k < PA_STATS_FIELD_MAX; k++)
+            pa_atomic_store(&slot->fields[k], 0);
+
+        /* Publish it, the increment acts as barrier */
+        pa_atomic_inc(&slot->generation);
+
+        s->next = (s->next + i + 1) % s->n_slots;
+        return slot;
+    }
+
+    pa_log_debug("No free statistics slot left.");
+    return NULL;
+}
+
+void pa_stats_slot_free(pa_stats_slot *slot) {
+    if (!slot)
+        return;
+
+    pa_assert(pa_atomic_load(&slot->generation) & 1);
+
+    pa_atomic_inc(&slot->generation);
+}
+
+int pa_stats_slot_snapshot(const pa_stats_slot *slot, pa_stats_slot *copy) {
+    int generation;
+    unsigned i;
+
+    pa_assert(slot);
+    pa_assert(copy);
+
+    generation = pa_atomic_load(&slot->generation);
+
+    if (!(generation & 1))
+        return -1;
+
+    copy->object = slot->object;
+    copy->index = slot->index;
+    memcpy(copy->name, slot->name, sizeof(copy->name));
+    copy->name[sizeof(copy->name) - 1] = 0;
+
+    for (i = 0; i < PA_STATS_FIELD_MAX; i++)
+        pa_atomic_store(&copy->fields[i], pa_atomic_load(&slot->fields[i]));
+
+    if (pa_atomic_load(&slot->generation) != generation)
+        return -1;
+
+    pa_atomic_store(&copy->generation, generation);
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+#ifndef foopulsestatshfoo
+#define foopulsestatshfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+/* Counters of all sinks, sources and streams, kept in a shared memory
+ * segment that monitoring tools can map read-only and scrape as often
+ * as they like without talking to the daemon.
+ *
+ * The segment starts with a pa_stats_header. The n_slots slots of
+ * slot_size bytes each follow at slots_offset bytes from the start of
+ * the segment, which is past the header. All integers are in host byte
+ * order. A slot is in use while its generation is odd, and it gets a
+ * new generation whenever it is reused. Readers should hence check
+ * that the generation didn't change while they copied a slot, see
+ * pa_stats_slot_snapshot(). The fields are updated atomically from
+ * whatever thread the event happens in, but not all at once. */
+
+#define PA_STATS_MAGIC 0x53544150U /* "PATS" */
+#define PA_STATS_VERSION 1
+#define PA_STATS_SLOTS_DEFAULT 512
+#define PA_STATS_NAME_MAX 64
+
+/* The daemon writes the segment id in decimal to this file in its
+ * runtime directory */
+#define PA_STATS_ID_FILE "stats-shm-id"
+
+/* Render times are counted in buckets of powers of two, bucket i
+ * holds those taking at least 2^i and less than 2^(i+1) usec, the
+ * first also those below 1 usec, the last all above. */
+#define PA_STATS_RENDER_BUCKETS 16
+
+typedef enum pa_stats_object {
+    PA_STATS_OBJECT_SINK = 1,
+    PA_STATS_OBJECT_SOURCE,
+    PA_STATS_OBJECT_SINK_INPUT,
+    PA_STATS_OBJECT_SOURCE_OUTPUT
+} pa_stats_object_t;
+
+typedef enum pa_stats_field {
+    PA_STATS_UNDERRUNS,
+    PA_STATS_OVERRUNS,
+    PA_STATS_REWINDS,
+    PA_STATS_RENDERS,     /* for sources: posts */
+    PA_STATS_LATENCY,     /* current value, usec */
+    PA_STATS_QUEUE_LENGTH, /* current value, bytes */
+    PA_STATS_RENDER_USEC, /* first of PA_STATS_RENDER_BUCKETS */
+    PA_STATS_FIELD_MAX = PA_STATS_RENDER_USEC + PA_STATS_RENDER_BUCKETS
+} pa_stats_field_t;
+
+typedef struct pa_stats_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n_slots;
+    uint32_t slot_size;
+    uint32_t slots_offset;
+} pa_stats_header;
+
+typedef struct pa_stats_slot {
+    pa_atomic_t generation;
+    uint32_t object; /* pa_stats_object_t */
+    uint32_t index;
+    char name[PA_STATS_NAME_MAX];
+    pa_atomic_t fields[PA_STATS_FIELD_MAX];
+} pa_stats_slot;
+
+typedef struct pa_stats pa_stats;
+
+pa_stats* pa_stats_new(unsigned n_slots);
+void pa_stats_free(pa_stats *s);
+
+/* The id of the shared memory segment */
+unsigned pa_stats_get_id(pa_stats *s);
+
+/* Called from main context. Returns NULL if s is NULL or if all
+ * slots are taken, all functions below accept that. */
+pa_stats_slot* pa_stats_slot_new(pa_stats *s, pa_stats_object_t object, uint32_t idx, const char *name);
+void pa_stats_slot_free(pa_stats_slot *slot);
+
+/* Called from any context */
+static inline void pa_stats_slot_inc(pa_stats_slot *slot, pa_stats_field_t f) {
+    if (slot)
+        pa_atomic_inc(&slot->fields[f]);
+}
+
+static inline void pa_stats_slot_set(pa_stats_slot *slot, pa_stats_field_t f, uint32_t v) {
+    if (slot)
+        pa_atomic_store(&slot->fields[f], (int) v);
+}
+
+static inline void pa_stats_slot_add_render_time(pa_stats_slot *slot, pa_usec_t usec) {
+    unsigned i;
+
+    if (!slot)
+        return;
+
+    i = pa_ulog2((unsigned) PA_MIN(usec, (pa_usec_t) 1U << (PA_STATS_RENDER_BUCKETS - 1)));
+    pa_atomic_inc(&slot->fields[PA_STATS_RENDER_USEC + i]);
+}
+
+/* Reader side. Copies a slot, returns a negative value if it is
+ * unused or was reused while it was copied. */
+int pa_stats_slot_snapshot(const pa_stats_slot *slot, pa_stats_slot *copy);
+
+#endif
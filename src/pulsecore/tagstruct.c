@@ -37,6 +37,7 @@
 
 #include <pulsecore/socket.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/flist.h>
 
 #include "tagstruct.h"
 
@@ -50,12 +51,16 @@ struct pa_tagstruct {
     pa_bool_t dynamic;
 };
 
+PA_STATIC_FLIST_DECLARE(tagstructs, 0, pa_xfree);
+
 pa_tagstruct *pa_tagstruct_new(const uint8_t* data, size_t length) {
     pa_tagstruct*t;
 
     pa_assert(!data || (data && length));
 
-    t = pa_xnew(pa_tagstruct, 1);
+    if (!(t = pa_flist_pop(PA_STATIC_FLIST_GET(tagstructs))))
+        t = pa_xnew(pa_tagstruct, 1);
+
     t->data = (uint8_t*) data;
     t->allocated = t->length = data ? length : 0;
     t->rindex = 0;
@@ -64,12 +69,30 @@ pa_tagstruct *pa_tagstruct_new(const uint8_t* data, size_t length) {
     return t;
 }
 
+pa_tagstruct *pa_tagstruct_new_sized(size_t size_hint) {
+    pa_tagstruct *t;
+
+    t = pa_tagstruct_new(NULL, 0);
+
+    /* Small ones are taken from the packet buffer free list later */
+    if (size_hint > PA_PACKET_BUFFER_SIZE)
+        t->data = pa_xmalloc(t->allocated = size_hint);
+
+    return t;
+}
+
+static void tagstruct_free(pa_tagstruct *t) {
+    if (pa_flist_push(PA_STATIC_FLIST_GET(tagstructs), t) < 0)
+        pa_xfree(t);
+}
+
 void pa_tagstruct_free(pa_tagstruct*t) {
     pa_assert(t);
 
-    if (t->dynamic)
-        pa_xfree(t->data);
-    pa_xfree(t);
+    if (t->dynamic && t->data)
+        pa_packet_buffer_free(t->data, t->allocated);
+
+    tagstruct_free(t);
 }
 
 uint8_t* pa_tagstruct_free_data(pa_tagstruct*t, size_t *l) {
@@ -81,18 +104,44 @@ uint8_t* pa_tagstruct_free_data(pa_tagstruct*t, size_t *l) {
 
     p = t->data;
     *l = t->length;
-    pa_xfree(t);
+    tagstruct_free(t);
+    return p;
+}
+
+pa_packet* pa_tagstruct_free_packet(pa_tagstruct *t) {
+    pa_packet *p;
+
+    pa_assert(t);
+    pa_assert(t->dynamic);
+
+    /* The packet takes over our buffer as it is */
+    p = pa_packet_new_buffer(t->data, t->length, t->allocated);
+    tagstruct_free(t);
     return p;
 }
 
 static void extend(pa_tagstruct*t, size_t l) {
+    size_t n;
+
     pa_assert(t);
     pa_assert(t->dynamic);
 
     if (t->length+l <= t->allocated)
         return;
 
-    t->data = pa_xrealloc(t->data, t->allocated = t->length+l+100);
+    if (!t->data && l <= PA_PACKET_BUFFER_SIZE) {
+        t->data = pa_packet_buffer_new();
+        t->allocated = PA_PACKET_BUFFER_SIZE;
+        return;
+    }
+
+    /* Grow exponentially, so that long lists aren't copied around
+     * over and over again. The buffers are from pa_xmalloc(), the
+     * recycled ones too. */
+    for (n = PA_MAX(t->allocated, (size_t) PA_PACKET_BUFFER_SIZE); n < t->length+l; n *= 2)
+        ;
+
+    t->data = pa_xrealloc(t->data, t->allocated = n);
 }
 
 void pa_tagstruct_puts(pa_tagstruct*t, const char *s) {
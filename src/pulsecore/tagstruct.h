@@ -33,6 +33,7 @@
 #include <pulse/proplist.h>
 
 #include <pulsecore/macro.h>
+#include <pulsecore/packet.h>
 
 typedef struct pa_tagstruct pa_tagstruct;
 
@@ -63,9 +64,17 @@ enum {
 };
 
 pa_tagstruct *pa_tagstruct_new(const uint8_t* data, size_t length);
+
+/* A tagstruct for writing, with room for about size_hint bytes */
+pa_tagstruct *pa_tagstruct_new_sized(size_t size_hint);
+
 void pa_tagstruct_free(pa_tagstruct*t);
 uint8_t* pa_tagstruct_free_data(pa_tagstruct*t, size_t *l);
 
+/* Frees the tagstruct and returns a packet that owns its data, without
+ * copying it */
+pa_packet* pa_tagstruct_free_packet(pa_tagstruct *t);
+
 int pa_tagstruct_eof(pa_tagstruct*t);
 const uint8_t* pa_tagstruct_data(pa_tagstruct*t, size_t *l);
 
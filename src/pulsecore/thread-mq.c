@@ -34,14 +34,8 @@
 
 PA_STATIC_TLS_DECLARE_NO_FREE(thread_mq);
 
-static void asyncmsgq_read_cb(pa_mainloop_api*api, pa_io_event* e, int fd, pa_io_event_flags_t events, void *userdata) {
-    pa_thread_mq *q = userdata;
-    pa_asyncmsgq *aq;
-
-    pa_assert(pa_asyncmsgq_read_fd(q->outq) == fd);
-    pa_assert(events == PA_IO_EVENT_INPUT);
-
-    pa_asyncmsgq_ref(aq = q->outq);
+static void asyncmsgq_dispatch_all(pa_asyncmsgq *aq) {
+    pa_asyncmsgq_ref(aq);
     pa_asyncmsgq_read_after_poll(aq);
 
     for (;;) {
@@ -66,14 +60,22 @@ static void asyncmsgq_read_cb(pa_mainloop_api*api, pa_io_event* e, int fd, pa_io
     pa_asyncmsgq_unref(aq);
 }
 
-static void asyncmsgq_write_cb(pa_mainloop_api*api, pa_io_event* e, int fd, pa_io_event_flags_t events, void *userdata) {
+static void asyncmsgq_read_cb(pa_mainloop_api*api, pa_io_event* e, int fd, pa_io_event_flags_t events, void *userdata) {
     pa_thread_mq *q = userdata;
 
-    pa_assert(pa_asyncmsgq_write_fd(q->inq) == fd);
+    pa_assert(pa_asyncmsgq_read_fd(q->outq) == fd);
     pa_assert(events == PA_IO_EVENT_INPUT);
 
-    pa_asyncmsgq_write_after_poll(q->inq);
-    pa_asyncmsgq_write_before_poll(q->inq);
+    asyncmsgq_dispatch_all(q->outq);
+}
+
+static void asyncmsgq_read_inq_cb(pa_mainloop_api*api, pa_io_event* e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_thread_mq *q = userdata;
+
+    pa_assert(pa_asyncmsgq_read_fd(q->inq) == fd);
+    pa_assert(events == PA_IO_EVENT_INPUT);
+
+    asyncmsgq_dispatch_all(q->inq);
 }
 
 void pa_thread_mq_init(pa_thread_mq *q, pa_mainloop_api *mainloop, pa_rtpoll *rtpoll) {
@@ -81,17 +83,32 @@ void pa_thread_mq_init(pa_thread_mq *q, pa_mainloop_api *mainloop, pa_rtpoll *rt
     pa_assert(mainloop);
 
     q->mainloop = mainloop;
+    q->thread_mainloop = NULL;
+    q->inq_read_event = NULL;
     pa_assert_se(q->inq = pa_asyncmsgq_new(0));
     pa_assert_se(q->outq = pa_asyncmsgq_new(0));
 
     pa_assert_se(pa_asyncmsgq_read_before_poll(q->outq) == 0);
     pa_assert_se(q->read_event = mainloop->io_new(mainloop, pa_asyncmsgq_read_fd(q->outq), PA_IO_EVENT_INPUT, asyncmsgq_read_cb, q));
 
-    pa_asyncmsgq_write_before_poll(q->inq);
-    pa_assert_se(q->write_event = mainloop->io_new(mainloop, pa_asyncmsgq_write_fd(q->inq), PA_IO_EVENT_INPUT, asyncmsgq_write_cb, q));
-
     pa_rtpoll_item_new_asyncmsgq_read(rtpoll, PA_RTPOLL_EARLY, q->inq);
-    pa_rtpoll_item_new_asyncmsgq_write(rtpoll, PA_RTPOLL_LATE, q->outq);
+}
+
+void pa_thread_mq_init_thread_mainloop(pa_thread_mq *q, pa_mainloop_api *mainloop, pa_mainloop_api *thread_mainloop) {
+    pa_assert(q);
+    pa_assert(mainloop);
+    pa_assert(thread_mainloop);
+
+    q->mainloop = mainloop;
+    q->thread_mainloop = thread_mainloop;
+    pa_assert_se(q->inq = pa_asyncmsgq_new(0));
+    pa_assert_se(q->outq = pa_asyncmsgq_new(0));
+
+    pa_assert_se(pa_asyncmsgq_read_before_poll(q->outq) == 0);
+    pa_assert_se(q->read_event = mainloop->io_new(mainloop, pa_asyncmsgq_read_fd(q->outq), PA_IO_EVENT_INPUT, asyncmsgq_read_cb, q));
+
+    pa_assert_se(pa_asyncmsgq_read_before_poll(q->inq) == 0);
+    pa_assert_se(q->inq_read_event = thread_mainloop->io_new(thread_mainloop, pa_asyncmsgq_read_fd(q->inq), PA_IO_EVENT_INPUT, asyncmsgq_read_inq_cb, q));
 }
 
 void pa_thread_mq_done(pa_thread_mq *q) {
@@ -107,14 +124,20 @@ void pa_thread_mq_done(pa_thread_mq *q) {
         pa_asyncmsgq_flush(q->outq, TRUE);
 
     q->mainloop->io_free(q->read_event);
-    q->mainloop->io_free(q->write_event);
-    q->read_event = q->write_event = NULL;
+    q->read_event = NULL;
+
+    /* The thread is gone by now, so we may touch its main loop */
+    if (q->inq_read_event) {
+        q->thread_mainloop->io_free(q->inq_read_event);
+        q->inq_read_event = NULL;
+    }
 
     pa_asyncmsgq_unref(q->inq);
     pa_asyncmsgq_unref(q->outq);
     q->inq = q->outq = NULL;
 
     q->mainloop = NULL;
+    q->thread_mainloop = NULL;
 }
 
 void pa_thread_mq_install(pa_thread_mq *q) {
@@ -32,11 +32,16 @@
 
 typedef struct pa_thread_mq {
     pa_mainloop_api *mainloop;
+    pa_mainloop_api *thread_mainloop;
     pa_asyncmsgq *inq, *outq;
-    pa_io_event *read_event, *write_event;
+    pa_io_event *read_event, *inq_read_event;
 } pa_thread_mq;
 
 void pa_thread_mq_init(pa_thread_mq *q, pa_mainloop_api *mainloop, pa_rtpoll *rtpoll);
+
+/* Like pa_thread_mq_init(), for threads that run a main loop of
+ * their own instead of an rtpoll */
+void pa_thread_mq_init_thread_mainloop(pa_thread_mq *q, pa_mainloop_api *mainloop, pa_mainloop_api *thread_mainloop);
 void pa_thread_mq_done(pa_thread_mq *q);
 
 /* Install the specified pa_thread_mq object for the current thread */
@@ -39,6 +39,9 @@ enum {
     QUIT
 };
 
+#define N_WRITERS 4
+#define N_MESSAGES 10000
+
 static void the_thread(void *_q) {
     pa_asyncmsgq *q = _q;
     int quit = 0;
@@ -107,6 +110,134 @@ START_TEST (asyncmsgq_test) {
 }
 END_TEST
 
+struct writer {
+    pa_asyncmsgq *q;
+    unsigned id;
+};
+
+static void writer_thread(void *userdata) {
+    struct writer *w = userdata;
+    unsigned i;
+
+    for (i = 0; i < N_MESSAGES; i++)
+        pa_asyncmsgq_post(w->q, NULL, (int) w->id, PA_UINT_TO_PTR(i), 0, NULL, NULL);
+}
+
+START_TEST (asyncmsgq_multi_writer_test) {
+    pa_asyncmsgq *q;
+    pa_thread *t[N_WRITERS];
+    struct writer w[N_WRITERS];
+    unsigned next[N_WRITERS], n;
+
+    q = pa_asyncmsgq_new(0);
+    fail_unless(q != NULL);
+
+    for (n = 0; n < N_WRITERS; n++) {
+        w[n].q = q;
+        w[n].id = n;
+        next[n] = 0;
+
+        t[n] = pa_thread_new("writer", writer_thread, &w[n]);
+        fail_unless(t[n] != NULL);
+    }
+
+    /* Everything arrives, and in order for every single writer */
+    for (n = 0; n < N_WRITERS * N_MESSAGES; n++) {
+        int code;
+        void *data;
+
+        fail_unless(pa_asyncmsgq_get(q, NULL, &code, &data, NULL, NULL, TRUE) == 0);
+        fail_unless(code >= 0 && code < N_WRITERS);
+        fail_unless(PA_PTR_TO_UINT(data) == next[code]);
+        next[code]++;
+
+        pa_asyncmsgq_done(q, 0);
+    }
+
+    fail_unless(pa_asyncmsgq_get(q, NULL, NULL, NULL, NULL, NULL, FALSE) < 0);
+
+    for (n = 0; n < N_WRITERS; n++)
+        pa_thread_free(t[n]);
+
+    pa_asyncmsgq_unref(q);
+}
+END_TEST
+
+struct replies {
+    pa_asyncmsgq *inq, *outq;
+    unsigned n, n_failed;
+};
+
+static void reply_thread(void *userdata) {
+    struct replies *r = userdata;
+    int code;
+
+    do {
+        pa_assert_se(pa_asyncmsgq_get(r->inq, NULL, &code, NULL, NULL, NULL, TRUE) == 0);
+        pa_asyncmsgq_done(r->inq, code * 2);
+    } while (code != QUIT);
+
+    pa_asyncmsgq_post(r->outq, NULL, QUIT, NULL, 0, NULL, NULL);
+}
+
+static void reply_cb(pa_msgobject *object, int code, int ret, void *userdata) {
+    struct replies *r = userdata;
+
+    fail_unless(object == NULL);
+
+    if (ret < 0) {
+        r->n_failed++;
+        return;
+    }
+
+    fail_unless(ret == code * 2);
+
+    /* Replies come in the order the messages were sent */
+    fail_unless(code == (int) r->n || code == QUIT);
+    r->n++;
+}
+
+START_TEST (asyncmsgq_send_async_test) {
+    struct replies r;
+    pa_thread *t;
+    int code;
+
+    r.inq = pa_asyncmsgq_new(0);
+    r.outq = pa_asyncmsgq_new(0);
+    r.n = r.n_failed = 0;
+
+    t = pa_thread_new("test", reply_thread, &r);
+    fail_unless(t != NULL);
+
+    pa_asyncmsgq_send_async(r.inq, NULL, OPERATION_A, NULL, 0, NULL, r.outq, reply_cb, &r);
+    pa_asyncmsgq_send_async(r.inq, NULL, OPERATION_B, NULL, 0, NULL, r.outq, reply_cb, &r);
+    pa_asyncmsgq_send_async(r.inq, NULL, OPERATION_C, NULL, 0, NULL, r.outq, reply_cb, &r);
+    pa_asyncmsgq_send_async(r.inq, NULL, QUIT, NULL, 0, NULL, r.outq, reply_cb, &r);
+
+    /* The callbacks are run while we wait for the final message */
+    fail_unless(pa_asyncmsgq_get(r.outq, NULL, &code, NULL, NULL, NULL, TRUE) == 0);
+    fail_unless(code == QUIT);
+    pa_asyncmsgq_done(r.outq, 0);
+
+    fail_unless(r.n == 4);
+    fail_unless(r.n_failed == 0);
+
+    pa_thread_free(t);
+
+    /* Messages nobody handled come back as failed once their queue is
+     * gone, and their replies keep the reply queue alive */
+    pa_asyncmsgq_send_async(r.inq, NULL, OPERATION_A, NULL, 0, NULL, r.outq, reply_cb, &r);
+    pa_asyncmsgq_send_async(r.inq, NULL, OPERATION_B, NULL, 0, NULL, r.outq, reply_cb, &r);
+    pa_asyncmsgq_unref(r.inq);
+
+    fail_unless(r.n_failed == 0);
+    pa_asyncmsgq_flush(r.outq, TRUE);
+    fail_unless(r.n_failed == 2);
+
+    pa_asyncmsgq_unref(r.outq);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -116,6 +247,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("Async Message Queue");
     tc = tcase_create("asyncmsgq");
     tcase_add_test(tc, asyncmsgq_test);
+    tcase_add_test(tc, asyncmsgq_multi_writer_test);
+    tcase_add_test(tc, asyncmsgq_send_async_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
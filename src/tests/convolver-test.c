@@ -0,0 +1,153 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/convolver.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#define N_FRAMES 3000
+#define N_INPUTS 3
+#define N_OUTPUTS 2
+
+static float *h, *src, *ref;
+
+static float random_sample(void) {
+    return (float) rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+/* The filter from input i to output o is tap (i * N_OUTPUTS + o) of
+ * every frame of h */
+static void reference(unsigned length, unsigned start) {
+    unsigned f, i, o, j;
+
+    for (f = 0; f < N_FRAMES; f++)
+        for (o = 0; o < N_OUTPUTS; o++) {
+            double sum = 0;
+
+            if (f < start) {
+                ref[f * N_OUTPUTS + o] = 0;
+                continue;
+            }
+
+            for (j = 0; j < length && j <= f - start; j++)
+                for (i = 0; i < N_INPUTS; i++)
+                    sum += src[(f - j) * N_INPUTS + i] * h[j * N_INPUTS * N_OUTPUTS + i * N_OUTPUTS + o];
+
+            ref[f * N_OUTPUTS + o] = (float) sum;
+        }
+}
+
+static void run_test(unsigned block, unsigned length, unsigned chunk) {
+    pa_convolver *c;
+    float *dst;
+    unsigned i, o, f;
+    double max_error = 0;
+
+    h = pa_xnew(float, length * N_INPUTS * N_OUTPUTS);
+    src = pa_xnew(float, N_FRAMES * N_INPUTS);
+    ref = pa_xnew(float, N_FRAMES * N_OUTPUTS);
+    dst = pa_xnew(float, N_FRAMES * N_OUTPUTS);
+
+    for (f = 0; f < length * N_INPUTS * N_OUTPUTS; f++)
+        h[f] = random_sample() / length;
+    for (f = 0; f < N_FRAMES * N_INPUTS; f++)
+        src[f] = random_sample();
+
+    c = pa_convolver_new(block, length, N_INPUTS, N_OUTPUTS);
+    for (i = 0; i < N_INPUTS; i++)
+        for (o = 0; o < N_OUTPUTS; o++)
+            pa_convolver_set_filter(c, i, o, h + i * N_OUTPUTS + o, N_INPUTS * N_OUTPUTS);
+
+    /* Chunks of varying size, to hit partial blocks */
+    for (f = 0; f < N_FRAMES; ) {
+        unsigned n = PA_MIN(chunk + f % 7, N_FRAMES - f);
+
+        pa_convolver_run(c, src + f * N_INPUTS, dst + f * N_OUTPUTS, n);
+        f += n;
+    }
+
+    reference(length, 0);
+    for (f = 0; f < N_FRAMES * N_OUTPUTS; f++)
+        max_error = PA_MAX(max_error, fabs(dst[f] - ref[f]));
+
+    pa_log_debug("block %u, length %u, chunk %u: max error %g", block, length, chunk, max_error);
+    fail_unless(max_error < 1e-5);
+
+    /* After a reset, everything before is forgotten */
+    pa_convolver_run(c, src, dst, N_FRAMES / 2);
+    pa_convolver_reset(c);
+    pa_convolver_run(c, src + N_FRAMES / 2 * N_INPUTS, dst + N_FRAMES / 2 * N_OUTPUTS, N_FRAMES - N_FRAMES / 2);
+
+    reference(length, N_FRAMES / 2);
+    max_error = 0;
+    for (f = N_FRAMES / 2 * N_OUTPUTS; f < N_FRAMES * N_OUTPUTS; f++)
+        max_error = PA_MAX(max_error, fabs(dst[f] - ref[f]));
+
+    fail_unless(max_error < 1e-5);
+
+    pa_convolver_free(c);
+    pa_xfree(h);
+    pa_xfree(src);
+    pa_xfree(ref);
+    pa_xfree(dst);
+}
+
+START_TEST (convolver_test) {
+    /* One partition, exactly filled and not */
+    run_test(64, 64, 64);
+    run_test(64, 50, 13);
+    /* Several partitions, the last one partly used */
+    run_test(32, 200, 1);
+    run_test(64, 300, 100);
+    run_test(128, 1024, 512);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Convolver");
+    tc = tcase_create("convolver");
+    tcase_add_test(tc, convolver_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,237 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/util.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-subscribe.h>
+#include <pulsecore/macro.h>
+
+#define N_EVENTS_MAX 16
+
+static pa_subscription_event_type_t types[N_EVENTS_MAX];
+static uint32_t indexes[N_EVENTS_MAX];
+static unsigned n_events, n_flushes;
+
+static void subscription_cb(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
+    fail_unless(n_events < N_EVENTS_MAX);
+
+    types[n_events] = t;
+    indexes[n_events] = idx;
+    n_events++;
+}
+
+static void flush_cb(pa_core *c, void *userdata) {
+    n_flushes++;
+}
+
+static void check_event(unsigned i, pa_subscription_event_type_t t, uint32_t idx) {
+    fail_unless(i < n_events);
+    fail_unless(types[i] == t);
+    fail_unless(indexes[i] == idx);
+}
+
+static void reset(void) {
+    n_events = n_flushes = 0;
+}
+
+static void iterate(pa_mainloop *m) {
+    while (pa_mainloop_iterate(m, 0, NULL) > 0)
+        ;
+}
+
+START_TEST (coalesce_test) {
+    pa_mainloop *m;
+    pa_core *c;
+    pa_subscription *s;
+
+    fail_unless((m = pa_mainloop_new()) != NULL);
+    fail_unless((c = pa_core_new(pa_mainloop_get_api(m), FALSE, 0)) != NULL);
+
+    s = pa_subscription_new(c, PA_SUBSCRIPTION_MASK_SINK|PA_SUBSCRIPTION_MASK_SOURCE, subscription_cb, NULL);
+    pa_subscription_set_flush_callback(s, flush_cb);
+    reset();
+
+    /* A change after the creation is redundant */
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_NEW, 1);
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 1);
+
+    /* Repeated changes are merged, but only for the same object */
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 2);
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_CHANGE, 2);
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 2);
+
+    /* The removal makes the change redundant */
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 3);
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_REMOVE, 3);
+
+    /* Not subscribed to */
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_CLIENT|PA_SUBSCRIPTION_EVENT_NEW, 4);
+
+    iterate(m);
+
+    fail_unless(n_events == 4);
+    check_event(0, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_NEW, 1);
+    check_event(1, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 2);
+    check_event(2, PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_CHANGE, 2);
+    check_event(3, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_REMOVE, 3);
+    fail_unless(n_flushes == 1);
+
+    pa_subscription_free(s);
+    pa_core_unref(c);
+    pa_mainloop_free(m);
+}
+END_TEST
+
+START_TEST (block_test) {
+    pa_mainloop *m;
+    pa_core *c;
+    pa_subscription *s, *other;
+
+    fail_unless((m = pa_mainloop_new()) != NULL);
+    fail_unless((c = pa_core_new(pa_mainloop_get_api(m), FALSE, 0)) != NULL);
+
+    s = pa_subscription_new(c, PA_SUBSCRIPTION_MASK_SINK, subscription_cb, NULL);
+    pa_subscription_set_flush_callback(s, flush_cb);
+    other = pa_subscription_new(c, PA_SUBSCRIPTION_MASK_SOURCE, subscription_cb, NULL);
+    reset();
+
+    pa_subscription_block(s, TRUE);
+    fail_unless(pa_subscription_is_blocked(s));
+
+    /* Nothing reaches a blocked subscription, while events keep being
+     * coalesced across several dispatch runs */
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 1);
+    iterate(m);
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 1);
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_NEW, 2);
+    iterate(m);
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 2);
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_REMOVE, 1);
+
+    /* Others are not affected */
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_NEW, 3);
+    iterate(m);
+
+    fail_unless(n_events == 1);
+    check_event(0, PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_NEW, 3);
+    fail_unless(n_flushes == 0);
+    reset();
+
+    /* Unblocking delivers what was held back as one batch */
+    pa_subscription_block(s, FALSE);
+    iterate(m);
+
+    fail_unless(n_events == 2);
+    check_event(0, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_NEW, 2);
+    check_event(1, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_REMOVE, 1);
+    fail_unless(n_flushes == 1);
+
+    pa_subscription_free(other);
+    pa_subscription_free(s);
+    pa_core_unref(c);
+    pa_mainloop_free(m);
+}
+END_TEST
+
+START_TEST (window_test) {
+    pa_mainloop *m;
+    pa_core *c;
+    pa_subscription *s;
+    pa_usec_t start;
+
+    fail_unless((m = pa_mainloop_new()) != NULL);
+    fail_unless((c = pa_core_new(pa_mainloop_get_api(m), FALSE, 0)) != NULL);
+    c->subscription_coalesce_usec = 50 * PA_USEC_PER_MSEC;
+
+    s = pa_subscription_new(c, PA_SUBSCRIPTION_MASK_SINK, subscription_cb, NULL);
+    reset();
+
+    start = pa_rtclock_now();
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 1);
+    iterate(m);
+    fail_unless(n_events == 0);
+
+    while (n_events == 0) {
+        pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 1);
+        fail_unless(pa_mainloop_iterate(m, 1, NULL) >= 0);
+    }
+
+    fail_unless(n_events == 1);
+    fail_unless(pa_rtclock_now() - start >= 50 * PA_USEC_PER_MSEC);
+
+    /* Unblocking a subscription hands it what it missed right away,
+     * but doesn't cut the window for the others short */
+    pa_subscription_block(s, TRUE);
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 2);
+    pa_msleep(60);
+    iterate(m);
+    fail_unless(n_events == 1);
+    reset();
+
+    pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 3);
+    pa_subscription_block(s, FALSE);
+    iterate(m);
+
+    fail_unless(n_events == 1);
+    check_event(0, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 2);
+
+    while (n_events == 1)
+        fail_unless(pa_mainloop_iterate(m, 1, NULL) >= 0);
+
+    fail_unless(n_events == 2);
+    check_event(1, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, 3);
+
+    pa_subscription_free(s);
+    pa_core_unref(c);
+    pa_mainloop_free(m);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Core subscriptions");
+    tc = tcase_create("core-subscribe");
+    tcase_add_test(tc, coalesce_test);
+    tcase_add_test(tc, block_test);
+    tcase_add_test(tc, window_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -14,6 +14,7 @@
 #include <pulsecore/endianmacros.h>
 #include <pulsecore/sconv.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/polyphase.h>
 
 /* Common defines for svolume tests */
 #define CHANNELS 2
@@ -223,6 +224,236 @@ START_TEST (sconv_sse_test) {
 }
 END_TEST
 
+/* End sconv tests */
+
+#define CHANNELS 6
+#define STREAMS 4
+#define SAMPLES 1021
+#define TIMES 1000
+
+/* Mixes STREAMS streams of random data with random volumes, the
+ * samples are int32_t sized so that all formats fit */
+static void run_mix_test(pa_do_mix_func_t func, pa_do_mix_func_t orig_func, pa_sample_format_t f) {
+    int32_t samples[STREAMS][SAMPLES];
+    int32_t out[SAMPLES], out_ref[SAMPLES];
+    pa_mix_info streams[STREAMS];
+    unsigned length = (unsigned) (SAMPLES / CHANNELS * CHANNELS * pa_sample_size_of_format(f));
+    unsigned i, c, padding;
+    pa_usec_t start, stop;
+    int j;
+
+    for (i = 0; i < STREAMS; i++) {
+        pa_random(samples[i], sizeof(samples[i]));
+
+        if (f == PA_SAMPLE_FLOAT32NE)
+            for (j = 0; j < SAMPLES; j++)
+                ((float *) samples[i])[j] = 2.1f * (rand()/(float) RAND_MAX - 0.5f);
+
+        for (c = 0; c < CHANNELS; c++) {
+            if (f == PA_SAMPLE_FLOAT32NE)
+                streams[i].linear[c].f = 2.0f * rand()/(float) RAND_MAX;
+            else
+                streams[i].linear[c].i = rand() % 0x20000;
+        }
+        for (padding = 0; padding < PA_MIX_VOLUME_PADDING; padding++, c++)
+            streams[i].linear[c] = streams[i].linear[padding];
+    }
+
+    memset(out, 0, sizeof(out));
+    memset(out_ref, 0, sizeof(out_ref));
+
+    for (i = 0; i < STREAMS; i++)
+        streams[i].ptr = samples[i];
+    orig_func(streams, STREAMS, CHANNELS, out_ref, length);
+
+    for (i = 0; i < STREAMS; i++)
+        streams[i].ptr = samples[i];
+    func(streams, STREAMS, CHANNELS, out, length);
+
+    for (j = 0; j < SAMPLES; j++) {
+        if (out[j] != out_ref[j]) {
+            printf("%d: %08x != %08x\n", j, out[j], out_ref[j]);
+            fail();
+        }
+    }
+
+    start = pa_rtclock_now();
+    for (j = 0; j < TIMES; j++) {
+        for (i = 0; i < STREAMS; i++)
+            streams[i].ptr = samples[i];
+        func(streams, STREAMS, CHANNELS, out, length);
+    }
+    stop = pa_rtclock_now();
+    pa_log_debug("func: %llu usec.", (long long unsigned int)(stop - start));
+
+    start = pa_rtclock_now();
+    for (j = 0; j < TIMES; j++) {
+        for (i = 0; i < STREAMS; i++)
+            streams[i].ptr = samples[i];
+        orig_func(streams, STREAMS, CHANNELS, out_ref, length);
+    }
+    stop = pa_rtclock_now();
+    pa_log_debug("orig: %llu usec.", (long long unsigned int)(stop - start));
+}
+
+static const pa_sample_format_t mix_formats[] = {
+    PA_SAMPLE_S16NE,
+    PA_SAMPLE_S32NE,
+    PA_SAMPLE_S24_32NE,
+    PA_SAMPLE_FLOAT32NE
+};
+
+START_TEST (mix_sse_test) {
+    pa_do_mix_func_t orig_func[PA_ELEMENTSOF(mix_formats)];
+    pa_cpu_x86_flag_t flags = 0;
+    unsigned i;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    for (i = 0; i < PA_ELEMENTSOF(mix_formats); i++)
+        orig_func[i] = pa_get_mix_func(mix_formats[i]);
+
+    pa_mix_func_init_sse(flags);
+
+    for (i = 0; i < PA_ELEMENTSOF(mix_formats); i++) {
+        pa_log_debug("Checking SSE mix (%s)", pa_sample_format_to_string(mix_formats[i]));
+        run_mix_test(pa_get_mix_func(mix_formats[i]), orig_func[i], mix_formats[i]);
+        pa_set_mix_func(mix_formats[i], orig_func[i]);
+    }
+}
+END_TEST
+
+START_TEST (mix_avx_test) {
+    pa_do_mix_func_t orig_func[PA_ELEMENTSOF(mix_formats)];
+    pa_cpu_x86_flag_t flags = 0;
+    unsigned i;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    for (i = 0; i < PA_ELEMENTSOF(mix_formats); i++)
+        orig_func[i] = pa_get_mix_func(mix_formats[i]);
+
+    pa_mix_func_init_avx(flags);
+
+    for (i = 0; i < PA_ELEMENTSOF(mix_formats); i++) {
+        pa_log_debug("Checking AVX2 mix (%s)", pa_sample_format_to_string(mix_formats[i]));
+        run_mix_test(pa_get_mix_func(mix_formats[i]), orig_func[i], mix_formats[i]);
+        pa_set_mix_func(mix_formats[i], orig_func[i]);
+    }
+}
+END_TEST
+
+#undef CHANNELS
+#undef STREAMS
+#undef SAMPLES
+#undef TIMES
+/* End mix tests */
+
+#define CHANNELS 3
+#define TAPS 1024
+#define TIMES 10000
+
+/* The vectorized versions add up in a different order, so they may
+ * differ in the last bits. The inputs are off by one float from any
+ * alignment, like most of the time in the resampler. */
+static void run_polyphase_test(pa_polyphase_dot_func_t func, pa_polyphase_dot_func_t orig_func) {
+    static const unsigned lengths[] = { 8, 16, 24, 48, 256, TAPS };
+    float x[CHANNELS * TAPS + 1], h[TAPS + 1];
+    float out[CHANNELS], out_ref[CHANNELS];
+    unsigned i, j, c, channels;
+    pa_usec_t start, stop;
+
+    for (i = 0; i < CHANNELS * TAPS + 1; i++)
+        x[i] = 2.0f * (rand()/(float) RAND_MAX - 0.5f);
+    for (i = 0; i < TAPS + 1; i++)
+        h[i] = 2.0f * (rand()/(float) RAND_MAX - 0.5f);
+
+    for (channels = 1; channels <= CHANNELS; channels++)
+        for (i = 0; i < PA_ELEMENTSOF(lengths); i++) {
+            func(out, x + 1, TAPS, channels, h + 1, lengths[i]);
+            orig_func(out_ref, x + 1, TAPS, channels, h + 1, lengths[i]);
+
+            for (c = 0; c < channels; c++) {
+                float bound = 0;
+
+                for (j = 0; j < lengths[i]; j++)
+                    bound += fabsf(x[c * TAPS + j + 1] * h[j + 1]);
+
+                if (fabsf(out[c] - out_ref[c]) > bound * 1e-5f) {
+                    printf("%u taps, channel %u of %u: %g != %g\n", lengths[i], c, channels, out[c], out_ref[c]);
+                    fail();
+                }
+            }
+        }
+
+    start = pa_rtclock_now();
+    for (i = 0; i < TIMES; i++)
+        func(out, x + 1, TAPS, 2, h + 1, 48);
+    stop = pa_rtclock_now();
+    pa_log_debug("func: %llu usec.", (long long unsigned int)(stop - start));
+
+    start = pa_rtclock_now();
+    for (i = 0; i < TIMES; i++)
+        orig_func(out_ref, x + 1, TAPS, 2, h + 1, 48);
+    stop = pa_rtclock_now();
+    pa_log_debug("orig: %llu usec.", (long long unsigned int)(stop - start));
+}
+
+START_TEST (polyphase_sse_test) {
+    pa_polyphase_dot_func_t orig_func;
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE)) {
+        pa_log_info("SSE not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_polyphase_dot_func();
+    pa_polyphase_func_init_sse(flags);
+
+    pa_log_debug("Checking SSE polyphase resampler");
+    run_polyphase_test(pa_get_polyphase_dot_func(), orig_func);
+    pa_set_polyphase_dot_func(orig_func);
+}
+END_TEST
+
+START_TEST (polyphase_avx_test) {
+    pa_polyphase_dot_func_t orig_func;
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX)) {
+        pa_log_info("AVX not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_polyphase_dot_func();
+    pa_polyphase_func_init_avx(flags);
+
+    pa_log_debug("Checking AVX polyphase resampler");
+    run_polyphase_test(pa_get_polyphase_dot_func(), orig_func);
+    pa_set_polyphase_dot_func(orig_func);
+}
+END_TEST
+
+#undef CHANNELS
+#undef TAPS
+#undef TIMES
+/* End polyphase tests */
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -238,6 +469,10 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, svolume_sse_test);
     tcase_add_test(tc, svolume_orc_test);
     tcase_add_test(tc, sconv_sse_test);
+    tcase_add_test(tc, mix_sse_test);
+    tcase_add_test(tc, mix_avx_test);
+    tcase_add_test(tc, polyphase_sse_test);
+    tcase_add_test(tc, polyphase_avx_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
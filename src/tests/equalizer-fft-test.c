@@ -0,0 +1,149 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* module-equalizer-sink transforms all channels at once, in place, in
+ * rows that are padded to whole SSE vectors, and filters them with a
+ * vectorized loop that runs over the row padding too. This checks,
+ * with the module's own helpers from equalizer-fft.h, that this layout
+ * filters every channel independently and correctly. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include <modules/equalizer-fft.h>
+
+#define FFT_SIZE 256
+#define FILTER_SIZE (FFT_SIZE / 2 + 1)
+#define WINDOW_SIZE (FFT_SIZE * 3 / 4)
+#define CHANNELS 3
+
+/* Circular convolution with the zero phase filter H, the slow way */
+static void reference(const float *src, const float *H, float X, double *dst) {
+    unsigned k, j;
+
+    for (j = 0; j < FFT_SIZE; j++)
+        dst[j] = 0;
+
+    for (k = 0; k < FFT_SIZE; k++) {
+        double re = 0, im = 0, h;
+
+        for (j = 0; j < FFT_SIZE; j++) {
+            re += src[j] * cos(2 * M_PI * j * k / FFT_SIZE);
+            im -= src[j] * sin(2 * M_PI * j * k / FFT_SIZE);
+        }
+
+        h = X * H[k <= FFT_SIZE / 2 ? k : FFT_SIZE - k];
+
+        for (j = 0; j < FFT_SIZE; j++)
+            dst[j] += h * (re * cos(2 * M_PI * j * k / FFT_SIZE) - im * sin(2 * M_PI * j * k / FFT_SIZE));
+    }
+}
+
+START_TEST (equalizer_fft_test) {
+    size_t work_size, c, j;
+    float *work, *src, *H[CHANNELS], W[WINDOW_SIZE];
+    double ref[FFT_SIZE], max_error = 0;
+    fftwf_plan forward, inverse;
+
+    work_size = eq_work_size(FILTER_SIZE);
+
+    work = fftwf_malloc(work_size * CHANNELS * sizeof(float));
+    src = fftwf_malloc(FFT_SIZE * CHANNELS * sizeof(float));
+
+    eq_plans_new(work, FFT_SIZE, CHANNELS, work_size, &forward, &inverse);
+    fail_unless(forward != NULL);
+    fail_unless(inverse != NULL);
+
+    /* Garbage that eq_window_input() has to clear */
+    for (j = 0; j < work_size * CHANNELS; j++)
+        work[j] = 1000.0f;
+
+    for (j = 0; j < WINDOW_SIZE; j++)
+        W[j] = 1.0f;
+
+    for (c = 0; c < CHANNELS; c++) {
+        H[c] = fftwf_malloc(PA_ROUND_UP(FILTER_SIZE, EQ_V_SIZE) * sizeof(float));
+        memset(H[c], 0, PA_ROUND_UP(FILTER_SIZE, EQ_V_SIZE) * sizeof(float));
+
+        /* A different low pass for every channel */
+        for (j = 0; j < FILTER_SIZE; j++)
+            H[c][j] = 1.0f / (1.0f + (float) j / (8 * (c + 1)));
+
+        /* Zero past the window, the reference transforms all of it */
+        for (j = 0; j < FFT_SIZE; j++)
+            src[c * FFT_SIZE + j] = j < WINDOW_SIZE ? (float) rand() / RAND_MAX * 2.0f - 1.0f : 0.0f;
+
+        eq_window_input(work + c * work_size, src + c * FFT_SIZE, W, WINDOW_SIZE, work_size);
+    }
+
+    fftwf_execute(forward);
+    for (c = 0; c < CHANNELS; c++)
+        eq_apply_filter(work + c * work_size, 1.0f / FFT_SIZE, H[c], FILTER_SIZE);
+    fftwf_execute(inverse);
+
+    for (c = 0; c < CHANNELS; c++) {
+        reference(src + c * FFT_SIZE, H[c], 1.0f / FFT_SIZE, ref);
+
+        for (j = 0; j < FFT_SIZE; j++)
+            max_error = PA_MAX(max_error, fabs(work[c * work_size + j] - ref[j]));
+    }
+
+    pa_log_debug("max error %g", max_error);
+    fail_unless(max_error < 1e-4);
+
+    for (c = 0; c < CHANNELS; c++)
+        fftwf_free(H[c]);
+    fftwf_destroy_plan(forward);
+    fftwf_destroy_plan(inverse);
+    fftwf_free(work);
+    fftwf_free(src);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Equalizer FFT");
+    tc = tcase_create("equalizer-fft");
+    tcase_add_test(tc, equalizer_fft_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,135 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+/* Lookup benchmark for pa_idxset and pa_hashmap. For every container
+ * size from 16 entries up to the maximum (default 65536, may be
+ * passed as the only argument) the average cost of a successful
+ * lookup is printed as one comma separated line:
+ *
+ *   container,operation,entries,ns_per_lookup
+ *
+ * With tables that grow along with their contents the numbers should
+ * stay flat as the number of entries increases. */
+
+#define N_LOOKUPS (1U << 20)
+
+static volatile void *sink;
+
+static void report(const char *container, const char *operation, unsigned n, pa_usec_t start) {
+    printf("%s,%s,%u,%0.2f\n", container, operation, n,
+           (double) (pa_rtclock_now() - start) * 1000.0 / N_LOOKUPS);
+}
+
+static void bench_idxset(unsigned n) {
+    pa_idxset *s;
+    uint32_t *indexes;
+    void **data;
+    unsigned i;
+    pa_usec_t start;
+
+    s = pa_idxset_new(NULL, NULL);
+    data = pa_xnew(void*, n);
+    indexes = pa_xnew(uint32_t, n);
+
+    /* Real pointers, so that the hash sees the usual alignment */
+    for (i = 0; i < n; i++) {
+        data[i] = pa_xmalloc(16);
+        pa_assert_se(pa_idxset_put(s, data[i], &indexes[i]) == 0);
+    }
+
+    start = pa_rtclock_now();
+    for (i = 0; i < N_LOOKUPS; i++)
+        sink = pa_idxset_get_by_index(s, indexes[(i * 7919U) % n]);
+    report("idxset", "get_by_index", n, start);
+
+    start = pa_rtclock_now();
+    for (i = 0; i < N_LOOKUPS; i++)
+        sink = pa_idxset_get_by_data(s, data[(i * 7919U) % n], NULL);
+    report("idxset", "get_by_data", n, start);
+
+    pa_idxset_free(s, NULL, NULL);
+
+    for (i = 0; i < n; i++)
+        pa_xfree(data[i]);
+
+    pa_xfree(data);
+    pa_xfree(indexes);
+}
+
+static void bench_hashmap(unsigned n) {
+    pa_hashmap *h;
+    char **keys;
+    unsigned i;
+    pa_usec_t start;
+
+    h = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    keys = pa_xnew(char*, n);
+
+    /* Keys shaped like the property names of a proplist */
+    for (i = 0; i < n; i++) {
+        keys[i] = pa_sprintf_malloc("application.process.id.%u", i);
+        pa_assert_se(pa_hashmap_put(h, keys[i], keys[i]) == 0);
+    }
+
+    start = pa_rtclock_now();
+    for (i = 0; i < N_LOOKUPS; i++)
+        sink = pa_hashmap_get(h, keys[(i * 7919U) % n]);
+    report("hashmap", "get", n, start);
+
+    pa_hashmap_free(h, NULL, NULL);
+
+    for (i = 0; i < n; i++)
+        pa_xfree(keys[i]);
+
+    pa_xfree(keys);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned n, max = 65536;
+
+    if (argc > 1 && (max = (unsigned) atoi(argv[1])) < 16) {
+        pa_log("Invalid number of entries '%s'.", argv[1]);
+        return 1;
+    }
+
+    printf("container,operation,entries,ns_per_lookup\n");
+
+    for (n = 16; n <= max; n *= 4) {
+        bench_idxset(n);
+        bench_hashmap(n);
+    }
+
+    return 0;
+}
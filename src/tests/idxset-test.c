@@ -0,0 +1,191 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/macro.h>
+
+/* Enough entries to make the tables grow a couple of times. They
+ * never shrink, removing entries only leaves more slots empty. */
+#define N_ENTRIES 20000
+
+static void *entry_ptr(unsigned i) {
+    return PA_UINT_TO_PTR(i + 1);
+}
+
+START_TEST (idxset_test) {
+    pa_idxset *s;
+    unsigned i;
+    uint32_t idx, previous;
+    void *p;
+
+    s = pa_idxset_new(NULL, NULL);
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        fail_unless(pa_idxset_put(s, entry_ptr(i), &idx) == 0);
+        fail_unless(idx == i);
+    }
+
+    /* Duplicates are refused and report the existing index */
+    fail_unless(pa_idxset_put(s, entry_ptr(42), &idx) < 0);
+    fail_unless(idx == 42);
+    fail_unless(pa_idxset_size(s) == N_ENTRIES);
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        fail_unless(pa_idxset_get_by_index(s, i) == entry_ptr(i));
+        fail_unless(pa_idxset_get_by_data(s, entry_ptr(i), &idx) == entry_ptr(i));
+        fail_unless(idx == i);
+    }
+
+    fail_unless(pa_idxset_get_by_index(s, N_ENTRIES) == NULL);
+    fail_unless(pa_idxset_get_by_data(s, entry_ptr(N_ENTRIES), NULL) == NULL);
+
+    /* Remove every entry not divisible by three while iterating */
+    i = 0;
+    PA_IDXSET_FOREACH(p, s, idx) {
+        fail_unless(p == entry_ptr(idx));
+        fail_unless(idx == i);
+
+        if (idx % 3 != 0)
+            fail_unless(pa_idxset_remove_by_index(s, idx) == p);
+
+        i++;
+    }
+    fail_unless(i == N_ENTRIES);
+    fail_unless(pa_idxset_size(s) == (N_ENTRIES + 2) / 3);
+
+    /* Iteration order stays the index order */
+    previous = 0;
+    i = 0;
+    PA_IDXSET_FOREACH(p, s, idx) {
+        fail_unless(idx % 3 == 0);
+        fail_unless(i == 0 || idx > previous);
+        fail_unless(pa_idxset_get_by_data(s, p, NULL) == p);
+        previous = idx;
+        i++;
+    }
+    fail_unless(i == pa_idxset_size(s));
+
+    /* Indexes are never reused */
+    fail_unless(pa_idxset_put(s, entry_ptr(1), &idx) == 0);
+    fail_unless(idx == N_ENTRIES);
+
+    while ((p = pa_idxset_steal_first(s, &idx)))
+        fail_unless(p == entry_ptr(idx) || idx == N_ENTRIES);
+
+    fail_unless(pa_idxset_isempty(s));
+    fail_unless(pa_idxset_first(s, &idx) == NULL);
+    fail_unless(idx == PA_IDXSET_INVALID);
+
+    pa_idxset_free(s, NULL, NULL);
+}
+END_TEST
+
+START_TEST (hashmap_test) {
+    pa_hashmap *h;
+    char **keys;
+    unsigned i;
+    void *state, *p;
+    const void *key;
+
+    h = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    keys = pa_xnew(char*, N_ENTRIES);
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        keys[i] = pa_sprintf_malloc("key-%u", i);
+        fail_unless(pa_hashmap_put(h, keys[i], entry_ptr(i)) == 0);
+    }
+
+    fail_unless(pa_hashmap_put(h, "key-42", NULL) < 0);
+    fail_unless(pa_hashmap_size(h) == N_ENTRIES);
+
+    for (i = 0; i < N_ENTRIES; i++)
+        fail_unless(pa_hashmap_get(h, keys[i]) == entry_ptr(i));
+
+    fail_unless(pa_hashmap_get(h, "key-none") == NULL);
+    fail_unless(pa_hashmap_first(h) == entry_ptr(0));
+    fail_unless(pa_hashmap_last(h) == entry_ptr(N_ENTRIES - 1));
+
+    /* Remove the odd entries while iterating, insertion order is kept */
+    i = 0;
+    state = NULL;
+    while ((p = pa_hashmap_iterate(h, &state, &key))) {
+        fail_unless(p == entry_ptr(i));
+        fail_unless(key == keys[i]);
+
+        if (i % 2 != 0)
+            fail_unless(pa_hashmap_remove(h, key) == p);
+
+        i++;
+    }
+    fail_unless(i == N_ENTRIES);
+    fail_unless(pa_hashmap_size(h) == N_ENTRIES / 2);
+
+    i = N_ENTRIES;
+    PA_HASHMAP_FOREACH_BACKWARDS(p, h, state) {
+        i -= 2;
+        fail_unless(p == entry_ptr(i));
+        fail_unless(pa_hashmap_get(h, keys[i]) == p);
+    }
+    fail_unless(i == 0);
+
+    for (i = 0; i < N_ENTRIES; i += 2)
+        fail_unless(pa_hashmap_steal_first(h) == entry_ptr(i));
+
+    fail_unless(pa_hashmap_isempty(h));
+    fail_unless(pa_hashmap_get(h, keys[0]) == NULL);
+
+    pa_hashmap_free(h, NULL, NULL);
+
+    for (i = 0; i < N_ENTRIES; i++)
+        pa_xfree(keys[i]);
+    pa_xfree(keys);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Idxset");
+    tc = tcase_create("idxset");
+    tcase_add_test(tc, idxset_test);
+    tcase_add_test(tc, hashmap_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -22,6 +22,7 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <check.h>
@@ -31,6 +32,7 @@
 #include <pulsecore/log.h>
 #include <pulsecore/memblock.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
 
 static void release_cb(pa_memimport *i, uint32_t block_id, void *userdata) {
     pa_log("%s: Imported block %u is released.", (char*) userdata, block_id);
@@ -54,6 +56,8 @@ static void print_stats(pa_mempool *p, const char *text) {
                  "\texported_size = %u\n"
                  "\tn_too_large_for_pool = %u\n"
                  "\tn_pool_full = %u\n"
+                 "\tn_segments = %u\n"
+                 "\tn_slabs = %u\n"
                  "}",
            text,
            (unsigned) pa_atomic_load(&s->n_allocated),
@@ -65,7 +69,9 @@ static void print_stats(pa_mempool *p, const char *text) {
            (unsigned) pa_atomic_load(&s->imported_size),
            (unsigned) pa_atomic_load(&s->exported_size),
            (unsigned) pa_atomic_load(&s->n_too_large_for_pool),
-           (unsigned) pa_atomic_load(&s->n_pool_full));
+           (unsigned) pa_atomic_load(&s->n_pool_full),
+           (unsigned) pa_atomic_load(&s->n_segments),
+           (unsigned) pa_atomic_load(&s->n_slabs));
 }
 
 START_TEST (memblock_test) {
@@ -177,6 +183,208 @@ START_TEST (memblock_test) {
 }
 END_TEST
 
+/* Fill a block with a pattern derived from its number */
+static void fill_block(pa_memblock *b, unsigned n) {
+    uint8_t *d = pa_memblock_acquire(b);
+
+    memset(d, (int) (n & 0xFF), pa_memblock_get_length(b));
+    pa_memblock_release(b);
+}
+
+static pa_bool_t check_block(pa_memblock *b, unsigned n) {
+    uint8_t *d = pa_memblock_acquire(b);
+    size_t i, length = pa_memblock_get_length(b);
+
+    for (i = 0; i < length; i++)
+        if (d[i] != (n & 0xFF))
+            break;
+
+    pa_memblock_release(b);
+
+    return i == length;
+}
+
+#define N_SLAB_BLOCKS 256
+
+START_TEST (memblock_slab_test) {
+    pa_mempool *pool;
+    const pa_mempool_stat *stat;
+    pa_memblock *blocks[N_SLAB_BLOCKS];
+    unsigned i;
+
+    pool = pa_mempool_new(FALSE, 0);
+    fail_unless(pool != NULL);
+    stat = pa_mempool_get_stat(pool);
+
+    /* Small blocks share slots, whatever their size class */
+    for (i = 0; i < N_SLAB_BLOCKS; i++) {
+        blocks[i] = pa_memblock_new_pool(pool, 200 + (i % 4) * 1000);
+        fail_unless(blocks[i] != NULL);
+        fill_block(blocks[i], i);
+    }
+
+    print_stats(pool, "slabs");
+
+    fail_unless(pa_atomic_load(&stat->n_pool_full) == 0);
+    fail_unless(pa_atomic_load(&stat->n_slabs) > 0);
+    fail_unless(pa_atomic_load(&stat->n_slabs) < N_SLAB_BLOCKS / 8);
+
+    for (i = 0; i < N_SLAB_BLOCKS; i++)
+        fail_unless(check_block(blocks[i], i));
+
+    /* Every other one is given back and reused */
+    for (i = 0; i < N_SLAB_BLOCKS; i += 2)
+        pa_memblock_unref(blocks[i]);
+
+    for (i = 0; i < N_SLAB_BLOCKS; i += 2) {
+        blocks[i] = pa_memblock_new_pool(pool, 200 + (i % 4) * 1000);
+        fail_unless(blocks[i] != NULL);
+        fill_block(blocks[i], i);
+    }
+
+    for (i = 0; i < N_SLAB_BLOCKS; i++)
+        fail_unless(check_block(blocks[i], i));
+
+    for (i = 0; i < N_SLAB_BLOCKS; i++)
+        pa_memblock_unref(blocks[i]);
+
+    fail_unless(pa_atomic_load(&stat->n_allocated) == 0);
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
+struct grow_thread_data {
+    pa_mempool *pool;
+    pa_memblock *blocks[8];
+    unsigned n;
+};
+
+/* Takes whole slots until the pool is full */
+static void grow_thread_func(void *userdata) {
+    struct grow_thread_data *d = userdata;
+
+    for (d->n = 0; d->n < PA_ELEMENTSOF(d->blocks); d->n++)
+        if (!(d->blocks[d->n] = pa_memblock_new_pool(d->pool, (size_t) -1)))
+            break;
+}
+
+START_TEST (memblock_grow_test) {
+    pa_mempool *pool;
+    const pa_mempool_stat *stat;
+    pa_memblock *blocks[8];
+    unsigned i;
+
+    /* A tiny pool of four slots, so that it has to grow */
+    pool = pa_mempool_new(FALSE, 4 * 64 * 1024);
+    fail_unless(pool != NULL);
+    stat = pa_mempool_get_stat(pool);
+
+    /* Whole slots, more than the first segment has */
+    for (i = 0; i < 8; i++) {
+        blocks[i] = pa_memblock_new_pool(pool, (size_t) -1);
+        fail_unless(blocks[i] != NULL);
+        fill_block(blocks[i], i);
+    }
+
+    print_stats(pool, "grown");
+
+    fail_unless(pa_atomic_load(&stat->n_segments) > 1);
+    fail_unless(pa_atomic_load(&stat->n_pool_full) == 0);
+
+    for (i = 0; i < 8; i++) {
+        fail_unless(check_block(blocks[i], i));
+        pa_memblock_unref(blocks[i]);
+    }
+
+    fail_unless(pa_atomic_load(&stat->n_allocated) == 0);
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
+START_TEST (memblock_grow_thread_test) {
+    pa_mempool *pool;
+    const pa_mempool_stat *stat;
+    struct grow_thread_data d;
+    pa_thread *t;
+    pa_memblock *b;
+    unsigned i;
+
+    pool = pa_mempool_new(FALSE, 4 * 64 * 1024);
+    fail_unless(pool != NULL);
+    stat = pa_mempool_get_stat(pool);
+
+    /* Other threads don't grow the pool themselves */
+    d.pool = pool;
+    fail_unless((t = pa_thread_new("memblock-test", grow_thread_func, &d)) != NULL);
+    pa_thread_free(t);
+
+    fail_unless(d.n == 4);
+    fail_unless(pa_atomic_load(&stat->n_segments) == 1);
+    fail_unless(pa_atomic_load(&stat->n_pool_full) == 1);
+
+    /* But the next allocation in the thread of the pool does */
+    fail_unless((b = pa_memblock_new_pool(pool, (size_t) -1)) != NULL);
+    fail_unless(pa_atomic_load(&stat->n_segments) == 2);
+
+    pa_memblock_unref(b);
+    for (i = 0; i < d.n; i++)
+        pa_memblock_unref(d.blocks[i]);
+
+    fail_unless(pa_atomic_load(&stat->n_allocated) == 0);
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
+#define N_THREADS 4
+#define N_THREAD_ITERATIONS 20000
+
+static void thread_func(void *pool) {
+    pa_memblock *blocks[16];
+    unsigned i, j;
+
+    memset(blocks, 0, sizeof(blocks));
+
+    for (i = 0; i < N_THREAD_ITERATIONS; i++) {
+        j = (i * 7) % PA_ELEMENTSOF(blocks);
+
+        if (blocks[j]) {
+            pa_assert_se(check_block(blocks[j], i - PA_ELEMENTSOF(blocks)));
+            pa_memblock_unref(blocks[j]);
+        }
+
+        pa_assert_se(blocks[j] = pa_memblock_new(pool, 100 + (i % 37) * 500));
+        fill_block(blocks[j], i);
+    }
+
+    for (j = 0; j < PA_ELEMENTSOF(blocks); j++)
+        pa_memblock_unref(blocks[j]);
+}
+
+START_TEST (memblock_thread_test) {
+    pa_mempool *pool;
+    pa_thread *threads[N_THREADS];
+    unsigned i;
+
+    pool = pa_mempool_new(FALSE, 0);
+    fail_unless(pool != NULL);
+
+    for (i = 0; i < N_THREADS; i++)
+        fail_unless((threads[i] = pa_thread_new("memblock-test", thread_func, pool)) != NULL);
+
+    for (i = 0; i < N_THREADS; i++)
+        pa_thread_free(threads[i]);
+
+    print_stats(pool, "threads");
+
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_allocated) == 0);
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -189,6 +397,10 @@ int main(int argc, char *argv[]) {
     s = suite_create("Memblock");
     tc = tcase_create("memblock");
     tcase_add_test(tc, memblock_test);
+    tcase_add_test(tc, memblock_slab_test);
+    tcase_add_test(tc, memblock_grow_test);
+    tcase_add_test(tc, memblock_grow_thread_test);
+    tcase_add_test(tc, memblock_thread_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -126,7 +126,7 @@ static const uint32_t s24_32le_result[3][10] = {
 static const uint32_t s24_32be_result[3][10] = {
 { 0x00000001, 0xffff0002, 0x7fff0003, 0x80000004, 0x9fff0005, 0x3fff0006, 0x00010007, 0xf0000008, 0x00200009, 0x0021000a },
 { 0x00000000, 0x65e60000, 0xf1e50000, 0x73000000, 0x0ee60000, 0xb8e50000, 0xe6000000, 0xd7000000, 0xcc1c0000, 0xb31d0000 },
-{ 0x00000000, 0xe5010200, 0x00036400, 0x0470e500, 0xf3000000, 0xe5010500, 0x0006ad00, 0x07f7e400, 0xe6010000, 0x00000800 },
+{ 0x00000000, 0x64e60100, 0x70e50100, 0xf3000000, 0xade50100, 0xf7e40100, 0xe6010000, 0xc7010000, 0xcc3c0000, 0xb33e0000 },
 };
 
 static void compare_block(const pa_sample_spec *ss, const pa_memchunk *chunk, int iter) {
@@ -465,6 +465,59 @@ START_TEST (mix_test) {
 }
 END_TEST
 
+START_TEST (silence_test) {
+    pa_mempool *pool;
+    pa_sample_spec a;
+
+    fail_unless((pool = pa_mempool_new(FALSE, 0)) != NULL, NULL);
+
+    a.channels = 2;
+    a.rate = 44100;
+
+    for (a.format = 0; a.format < PA_SAMPLE_MAX; a.format ++) {
+        pa_memchunk c, part;
+        size_t offset;
+        uint8_t *ptr;
+
+        c.memblock = pa_memblock_new(pool, 1031 * pa_frame_size(&a));
+        c.index = 0;
+        c.length = pa_memblock_get_length(c.memblock);
+
+        pa_silence_memchunk(&c, &a);
+
+        /* A partial chunk must not mark the whole block */
+        part = c;
+        part.index = pa_frame_size(&a);
+        part.length = c.length - part.index;
+        fail_unless(pa_memchunk_is_silence(&part, &a), NULL);
+        fail_unless(!pa_memblock_is_silence(c.memblock), NULL);
+
+        fail_unless(pa_memchunk_is_silence(&c, &a), NULL);
+        fail_unless(pa_memblock_is_silence(c.memblock), NULL);
+
+        /* Any differing byte, wherever it is, has to be noticed */
+        for (offset = 0; offset < c.length; offset += 97) {
+            pa_memblock_set_is_silence(c.memblock, FALSE);
+
+            ptr = pa_memblock_acquire(c.memblock);
+            ptr[offset] ^= 0x01;
+            pa_memblock_release(c.memblock);
+
+            fail_unless(!pa_memchunk_is_silence(&c, &a), NULL);
+            fail_unless(!pa_memblock_is_silence(c.memblock), NULL);
+
+            ptr = pa_memblock_acquire(c.memblock);
+            ptr[offset] ^= 0x01;
+            pa_memblock_release(c.memblock);
+        }
+
+        pa_memblock_unref(c.memblock);
+    }
+
+    pa_mempool_free(pool);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -474,6 +527,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Mix");
     tc = tcase_create("mix");
     tcase_add_test(tc, mix_test);
+    tcase_add_test(tc, silence_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,197 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+#include <pulse/mainloop.h>
+
+/* Records with a fragment size much smaller than what the source posts
+ * at once (we don't ask for the source latency to be adjusted), and
+ * checks that the server keeps sending fragments until its queue is
+ * empty, instead of one or two per post. */
+
+#define SAMPLE_HZ 44100
+#define FRAGSIZE_MSEC 5
+#define RECORD_SEC 1
+#define TIMEOUT_SEC 10
+
+static pa_context *context = NULL;
+static pa_stream *stream = NULL;
+static pa_mainloop_api *mainloop_api = NULL;
+static const char *bname = NULL;
+
+static size_t n_received = 0;
+static int done = 0;
+
+static const pa_sample_spec sample_spec = {
+    .format = PA_SAMPLE_S16LE,
+    .rate = SAMPLE_HZ,
+    .channels = 2
+};
+
+static void read_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    const void *data;
+
+    while (pa_stream_readable_size(s) > 0) {
+        fail_unless(pa_stream_peek(s, &data, &nbytes) == 0);
+
+        if (nbytes == 0)
+            break;
+
+        n_received += nbytes;
+        pa_stream_drop(s);
+    }
+
+    if (!done && n_received >= pa_usec_to_bytes(RECORD_SEC * PA_USEC_PER_SEC, &sample_spec)) {
+        done = 1;
+        fprintf(stderr, "Received %lu bytes.\n", (unsigned long) n_received);
+        mainloop_api->quit(mainloop_api, 0);
+    }
+}
+
+static void timeout_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    fprintf(stderr, "Only received %lu bytes in time.\n", (unsigned long) n_received);
+    mainloop_api->quit(mainloop_api, 1);
+}
+
+static void stream_state_callback(pa_stream *s, void *userdata) {
+    fail_unless(s != NULL);
+
+    switch (pa_stream_get_state(s)) {
+        case PA_STREAM_UNCONNECTED:
+        case PA_STREAM_CREATING:
+        case PA_STREAM_TERMINATED:
+        case PA_STREAM_READY:
+            break;
+
+        default:
+        case PA_STREAM_FAILED:
+            fprintf(stderr, "Stream error: %s\n", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+            fail();
+    }
+}
+
+static void context_state_callback(pa_context *c, void *userdata) {
+    fail_unless(c != NULL);
+
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_CONNECTING:
+        case PA_CONTEXT_AUTHORIZING:
+        case PA_CONTEXT_SETTING_NAME:
+            break;
+
+        case PA_CONTEXT_READY: {
+            pa_buffer_attr buffer_attr;
+
+            fprintf(stderr, "Connection established.\n");
+
+            buffer_attr.maxlength = (uint32_t) -1;
+            buffer_attr.tlength = (uint32_t) -1;
+            buffer_attr.prebuf = (uint32_t) -1;
+            buffer_attr.minreq = (uint32_t) -1;
+            buffer_attr.fragsize = (uint32_t) pa_usec_to_bytes(FRAGSIZE_MSEC * PA_USEC_PER_MSEC, &sample_spec);
+
+            stream = pa_stream_new(c, "record", &sample_spec, NULL);
+            fail_unless(stream != NULL);
+            pa_stream_set_state_callback(stream, stream_state_callback, NULL);
+            pa_stream_set_read_callback(stream, read_cb, NULL);
+            fail_unless(pa_stream_connect_record(stream, NULL, &buffer_attr, 0) == 0);
+
+            break;
+        }
+
+        case PA_CONTEXT_TERMINATED:
+            mainloop_api->quit(mainloop_api, 0);
+            break;
+
+        case PA_CONTEXT_FAILED:
+        default:
+            fprintf(stderr, "Context error: %s\n", pa_strerror(pa_context_errno(c)));
+            fail();
+    }
+}
+
+START_TEST (record_fragsize_test) {
+    pa_mainloop* m = NULL;
+    pa_time_event *e;
+    struct timeval tv;
+    int ret = 1;
+
+    m = pa_mainloop_new();
+    fail_unless(m != NULL);
+
+    mainloop_api = pa_mainloop_get_api(m);
+
+    context = pa_context_new(mainloop_api, bname);
+    fail_unless(context != NULL);
+
+    pa_context_set_state_callback(context, context_state_callback, NULL);
+
+    if (pa_context_connect(context, NULL, 0, NULL) < 0) {
+        fprintf(stderr, "pa_context_connect() failed.\n");
+        goto quit;
+    }
+
+    e = mainloop_api->time_new(mainloop_api, pa_timeval_add(pa_gettimeofday(&tv), TIMEOUT_SEC * PA_USEC_PER_SEC), timeout_cb, NULL);
+
+    if (pa_mainloop_run(m, &ret) < 0)
+        fprintf(stderr, "pa_mainloop_run() failed.\n");
+
+    mainloop_api->time_free(e);
+
+quit:
+    if (stream)
+        pa_stream_unref(stream);
+
+    pa_context_unref(context);
+    pa_mainloop_free(m);
+
+    fail_unless(ret == 0);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    bname = argv[0];
+
+    s = suite_create("Record Fragment Size");
+    tc = tcase_create("recordfragsize");
+    tcase_add_test(tc, record_fragsize_test);
+    tcase_set_timeout(tc, 2 * TIMEOUT_SEC);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,947 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <locale.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/sample.h>
+#include <pulse/volume.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/i18n.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/cpu.h>
+#include <pulsecore/cpu-orc.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/polyphase.h>
+#include <pulsecore/remap.h>
+#include <pulsecore/resampler.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/sample-util.h>
+#include <pulsecore/sconv.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+
+/* Throughput benchmark for the render path. Every result is printed
+ * as one comma separated line:
+ *
+ *   kernel,impl,variant,format,channels,inputs,ns_per_frame,cycles_per_sample,allocs_per_call
+ *
+ * "impl" is the set of optimized functions installed while running
+ * (c, mmx, sse, avx2, orc or auto for whatever the daemon would pick
+ * on this host). Implementations that would just run the generic code
+ * again are not reported. Cycles are read from the time stamp counter
+ * and are reported as "-" where there is none. Allocations are the
+ * memory blocks created per call, as counted by the memory pool. */
+
+enum {
+    KERNEL_MIX      = 1 << 0,
+    KERNEL_VOLUME   = 1 << 1,
+    KERNEL_REMAP    = 1 << 2,
+    KERNEL_RESAMPLE = 1 << 3,
+    KERNEL_RENDER   = 1 << 4,
+    KERNEL_ALL      = (1 << 5) - 1
+};
+
+typedef enum bench_impl {
+    IMPL_C,
+    IMPL_MMX,
+    IMPL_SSE,
+    IMPL_AVX2,
+    IMPL_ORC,
+    IMPL_AUTO,
+    IMPL_MAX
+} bench_impl_t;
+
+static const char * const impl_names[IMPL_MAX] = {
+    [IMPL_C]    = "c",
+    [IMPL_MMX]  = "mmx",
+    [IMPL_SSE]  = "sse",
+    [IMPL_AVX2] = "avx2",
+    [IMPL_ORC]  = "orc",
+    [IMPL_AUTO] = "auto"
+};
+
+static const pa_sample_format_t default_formats[] = {
+    PA_SAMPLE_S16NE,
+    PA_SAMPLE_S24_32NE,
+    PA_SAMPLE_S32NE,
+    PA_SAMPLE_FLOAT32NE
+};
+
+static const unsigned default_channels[] = { 1, 2, 6 };
+static const unsigned default_inputs[] = { 1, 2, 4, 8 };
+
+static const struct {
+    unsigned from, to;
+} remap_variants[] = {
+    { 1, 2 },
+    { 2, 1 },
+    { 2, 6 },
+    { 6, 2 }
+};
+
+#define BENCH_RATE 48000
+#define BENCH_RESAMPLE_RATE 44100
+
+/* The generic functions, saved before anything else gets installed */
+static pa_do_volume_func_t c_volume_funcs[PA_SAMPLE_MAX];
+static pa_do_mix_func_t c_mix_funcs[PA_SAMPLE_MAX];
+static pa_convert_func_t c_from_float32ne_funcs[PA_SAMPLE_MAX];
+static pa_init_remap_func_t c_init_remap_func;
+static pa_polyphase_dot_func_t c_polyphase_dot_func;
+
+static pa_cpu_info cpu_info;
+
+/* All kernels allocate from this one */
+static pa_mempool *bench_pool;
+
+static unsigned bench_frames = 1024;
+static unsigned bench_iterations = 1000;
+
+static inline uint64_t read_cycles(void) {
+#if defined (__i386__) || defined (__amd64__)
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+
+    return ((uint64_t) hi << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+typedef struct bench_timer {
+    pa_usec_t usec;
+    uint64_t cycles;
+    unsigned allocs;
+} bench_timer;
+
+static unsigned n_allocs(void) {
+    return (unsigned) pa_atomic_load(&pa_mempool_get_stat(bench_pool)->n_accumulated);
+}
+
+static void timer_start(bench_timer *t) {
+    t->allocs = n_allocs();
+    t->usec = pa_rtclock_now();
+    t->cycles = read_cycles();
+}
+
+static void timer_stop(bench_timer *t) {
+    t->cycles = read_cycles() - t->cycles;
+    t->usec = pa_rtclock_now() - t->usec;
+    t->allocs = n_allocs() - t->allocs;
+}
+
+static void report(const char *kernel, bench_impl_t impl, const char *variant, pa_sample_format_t format, unsigned channels, unsigned inputs, const bench_timer *t) {
+    uint64_t frames = (uint64_t) bench_frames * bench_iterations;
+
+    printf("%s,%s,%s,%s,%u,%u,%.3f,", kernel, impl_names[impl], variant, pa_sample_format_to_string(format), channels, inputs,
+           (double) t->usec * 1000.0 / (double) frames);
+
+    if (t->cycles > 0)
+        printf("%.3f,", (double) t->cycles / (double) (frames * channels));
+    else
+        printf("-,");
+
+    printf("%.2f\n", (double) t->allocs / (double) bench_iterations);
+
+    fflush(stdout);
+}
+
+static void save_c_functions(void) {
+    pa_sample_format_t f;
+
+    for (f = 0; f < PA_SAMPLE_MAX; f++) {
+        c_volume_funcs[f] = pa_get_volume_func(f);
+        c_mix_funcs[f] = pa_get_mix_func(f);
+        c_from_float32ne_funcs[f] = pa_get_convert_from_float32ne_function(f);
+    }
+
+    c_init_remap_func = pa_get_init_remap_func();
+    c_polyphase_dot_func = pa_get_polyphase_dot_func();
+}
+
+static void restore_c_functions(void) {
+    pa_sample_format_t f;
+
+    for (f = 0; f < PA_SAMPLE_MAX; f++) {
+        pa_set_volume_func(f, c_volume_funcs[f]);
+        pa_set_mix_func(f, c_mix_funcs[f]);
+        pa_set_convert_from_float32ne_function(f, c_from_float32ne_funcs[f]);
+    }
+
+    pa_set_init_remap_func(c_init_remap_func);
+    pa_set_polyphase_dot_func(c_polyphase_dot_func);
+}
+
+/* Same order as the daemon's startup code */
+static void init_cpu(void) {
+    cpu_info.cpu_type = PA_CPU_UNDEFINED;
+
+    if (pa_cpu_init_x86(&cpu_info.flags.x86))
+        cpu_info.cpu_type = PA_CPU_X86;
+    else if (pa_cpu_init_arm(&cpu_info.flags.arm))
+        cpu_info.cpu_type = PA_CPU_ARM;
+
+    pa_cpu_init_orc(cpu_info);
+}
+
+/* Installs the functions of one implementation on top of the generic
+ * ones. Returns FALSE if this CPU can't run it. */
+static pa_bool_t install_impl(bench_impl_t impl) {
+    restore_c_functions();
+
+    switch (impl) {
+        case IMPL_C:
+            return TRUE;
+
+#if defined (__i386__) || defined (__amd64__)
+        case IMPL_MMX:
+            if (cpu_info.cpu_type != PA_CPU_X86 || !(cpu_info.flags.x86 & PA_CPU_X86_MMX))
+                return FALSE;
+
+            pa_volume_func_init_mmx(cpu_info.flags.x86);
+            pa_remap_func_init_mmx(cpu_info.flags.x86);
+            return TRUE;
+
+        case IMPL_SSE:
+            if (cpu_info.cpu_type != PA_CPU_X86 || !(cpu_info.flags.x86 & (PA_CPU_X86_SSE | PA_CPU_X86_SSE2)))
+                return FALSE;
+
+            pa_volume_func_init_sse(cpu_info.flags.x86);
+            pa_remap_func_init_sse(cpu_info.flags.x86);
+            pa_convert_func_init_sse(cpu_info.flags.x86);
+            pa_mix_func_init_sse(cpu_info.flags.x86);
+            pa_polyphase_func_init_sse(cpu_info.flags.x86);
+            return TRUE;
+
+        case IMPL_AVX2:
+            if (cpu_info.cpu_type != PA_CPU_X86 || !(cpu_info.flags.x86 & PA_CPU_X86_AVX2))
+                return FALSE;
+
+            pa_mix_func_init_avx(cpu_info.flags.x86);
+            pa_polyphase_func_init_avx(cpu_info.flags.x86);
+            return TRUE;
+#endif
+
+        case IMPL_ORC:
+            return pa_cpu_init_orc(cpu_info);
+
+        case IMPL_AUTO:
+            init_cpu();
+            return TRUE;
+
+        default:
+            return FALSE;
+    }
+}
+
+static pa_memblock *generate_block(pa_mempool *pool, const pa_sample_spec *ss, unsigned frames) {
+    pa_memblock *b;
+    unsigned n = frames * ss->channels, i;
+    float *f;
+    void *d;
+
+    f = pa_xnew(float, n);
+
+    /* Something that neither clips nor decays into denormals */
+    for (i = 0; i < n; i++)
+        f[i] = (float) ((i * 7919) % 2000) / 2000.0f - 0.5f;
+
+    b = pa_memblock_new(pool, n * pa_sample_size(ss));
+    d = pa_memblock_acquire(b);
+    c_from_float32ne_funcs[ss->format](n, f, d);
+    pa_memblock_release(b);
+
+    pa_xfree(f);
+
+    return b;
+}
+
+static void bench_mix(pa_mempool *pool, bench_impl_t impl, const pa_sample_spec *ss, unsigned ninputs) {
+    pa_mix_info info[PA_MAX_INPUTS_PER_SINK];
+    pa_memblock *in, *out;
+    pa_cvolume volume;
+    bench_timer t;
+    size_t length;
+    unsigned i;
+    void *d;
+
+    if (impl != IMPL_C && pa_get_mix_func(ss->format) == c_mix_funcs[ss->format])
+        return;
+
+    in = generate_block(pool, ss, bench_frames);
+    length = pa_memblock_get_length(in);
+
+    for (i = 0; i < ninputs; i++) {
+        info[i].chunk.memblock = in;
+        info[i].chunk.index = 0;
+        info[i].chunk.length = length;
+        pa_cvolume_set(&info[i].volume, ss->channels, pa_sw_volume_from_linear(0.5));
+        info[i].userdata = NULL;
+    }
+
+    pa_cvolume_reset(&volume, ss->channels);
+
+    out = pa_memblock_new(pool, length);
+    d = pa_memblock_acquire(out);
+
+    pa_mix(info, ninputs, d, length, ss, &volume, FALSE);
+
+    timer_start(&t);
+    for (i = 0; i < bench_iterations; i++)
+        pa_mix(info, ninputs, d, length, ss, &volume, FALSE);
+    timer_stop(&t);
+
+    pa_memblock_release(out);
+
+    report("mix", impl, "-", ss->format, ss->channels, ninputs, &t);
+
+    pa_memblock_unref(out);
+    pa_memblock_unref(in);
+}
+
+static void bench_volume(pa_mempool *pool, bench_impl_t impl, const pa_sample_spec *ss) {
+    pa_memchunk chunk;
+    pa_cvolume volume[2];
+    bench_timer t;
+    unsigned i;
+
+    if (impl != IMPL_C && pa_get_volume_func(ss->format) == c_volume_funcs[ss->format])
+        return;
+
+    chunk.memblock = generate_block(pool, ss, bench_frames);
+    chunk.index = 0;
+    chunk.length = pa_memblock_get_length(chunk.memblock);
+
+    /* Alternate between halving and doubling so that the data stays
+     * in range no matter how many iterations we do */
+    pa_cvolume_set(&volume[0], ss->channels, pa_sw_volume_from_linear(0.5));
+    pa_cvolume_set(&volume[1], ss->channels, pa_sw_volume_from_linear(2.0));
+
+    pa_volume_memchunk(&chunk, ss, &volume[0]);
+    pa_volume_memchunk(&chunk, ss, &volume[1]);
+
+    timer_start(&t);
+    for (i = 0; i < bench_iterations; i++)
+        pa_volume_memchunk(&chunk, ss, &volume[i & 1]);
+    timer_stop(&t);
+
+    report("volume", impl, "-", ss->format, ss->channels, 1, &t);
+
+    pa_memblock_unref(chunk.memblock);
+}
+
+static void setup_remap(pa_remap_t *m, pa_sample_format_t *format, pa_sample_spec *iss, pa_sample_spec *oss) {
+    unsigned ic, oc;
+
+    memset(m->map_table_f, 0, sizeof(m->map_table_f));
+    memset(m->map_table_i, 0, sizeof(m->map_table_i));
+
+    /* Upmixing copies the input channels round robin, downmixing
+     * averages them */
+    if (iss->channels <= oss->channels)
+        for (oc = 0; oc < oss->channels; oc++)
+            m->map_table_f[oc][oc % iss->channels] = 1.0f;
+    else
+        for (ic = 0; ic < iss->channels; ic++)
+            m->map_table_f[ic % oss->channels][ic] = (float) oss->channels / (float) iss->channels;
+
+    for (oc = 0; oc < oss->channels; oc++)
+        for (ic = 0; ic < iss->channels; ic++)
+            m->map_table_i[oc][ic] = (int32_t) (m->map_table_f[oc][ic] * 0x10000);
+
+    m->format = format;
+    m->i_ss = iss;
+    m->o_ss = oss;
+
+    pa_init_remap(m);
+}
+
+static void bench_remap(pa_mempool *pool, bench_impl_t impl, pa_sample_format_t format, unsigned from, unsigned to) {
+    pa_remap_t m;
+    pa_sample_format_t remap_format = format;
+    pa_sample_spec iss, oss;
+    pa_init_remap_func_t init_func;
+    pa_do_remap_func_t c_remap;
+    pa_memblock *in, *out;
+    bench_timer t;
+    char variant[32];
+    void *s, *d;
+    unsigned i;
+
+    iss.format = oss.format = format;
+    iss.rate = oss.rate = BENCH_RATE;
+    iss.channels = (uint8_t) from;
+    oss.channels = (uint8_t) to;
+
+    /* Find out what the generic code would do for this remapping */
+    init_func = pa_get_init_remap_func();
+    pa_set_init_remap_func(c_init_remap_func);
+    setup_remap(&m, &remap_format, &iss, &oss);
+    c_remap = m.do_remap;
+
+    pa_set_init_remap_func(init_func);
+    setup_remap(&m, &remap_format, &iss, &oss);
+
+    if (impl != IMPL_C && m.do_remap == c_remap)
+        return;
+
+    in = generate_block(pool, &iss, bench_frames);
+    out = pa_memblock_new(pool, bench_frames * pa_frame_size(&oss));
+
+    s = pa_memblock_acquire(in);
+    d = pa_memblock_acquire(out);
+
+    m.do_remap(&m, d, s, bench_frames);
+
+    timer_start(&t);
+    for (i = 0; i < bench_iterations; i++)
+        m.do_remap(&m, d, s, bench_frames);
+    timer_stop(&t);
+
+    pa_memblock_release(out);
+    pa_memblock_release(in);
+
+    pa_snprintf(variant, sizeof(variant), "%u-%u", from, to);
+    report("remap", impl, variant, format, from, 1, &t);
+
+    pa_memblock_unref(out);
+    pa_memblock_unref(in);
+}
+
+static void bench_resample(pa_mempool *pool, bench_impl_t impl, const pa_sample_spec *ss, pa_resample_method_t method) {
+    pa_resampler *r;
+    pa_sample_spec iss, oss;
+    pa_memchunk in, out;
+    bench_timer t;
+    unsigned i;
+
+    iss = oss = *ss;
+
+    /* The peaks resampler can only downsample */
+    if (method == PA_RESAMPLER_PEAKS)
+        oss.rate = BENCH_RESAMPLE_RATE;
+    else
+        iss.rate = BENCH_RESAMPLE_RATE;
+
+    if (!(r = pa_resampler_new(pool, &iss, NULL, &oss, NULL, method, 0)))
+        return;
+
+    /* Don't report methods that were replaced by a fallback */
+    if (pa_resampler_get_method(r) != method) {
+        pa_resampler_free(r);
+        return;
+    }
+
+    in.memblock = generate_block(pool, &iss, bench_frames);
+    in.index = 0;
+    in.length = pa_memblock_get_length(in.memblock);
+
+    pa_resampler_run(r, &in, &out);
+    if (out.memblock)
+        pa_memblock_unref(out.memblock);
+
+    timer_start(&t);
+    for (i = 0; i < bench_iterations; i++) {
+        pa_resampler_run(r, &in, &out);
+        if (out.memblock)
+            pa_memblock_unref(out.memblock);
+    }
+    timer_stop(&t);
+
+    report("resample", impl, pa_resample_method_to_string(method), ss->format, ss->channels, 1, &t);
+
+    pa_memblock_unref(in.memblock);
+    pa_resampler_free(r);
+}
+
+/* pa_sink_render() has to be called from the IO thread of a linked
+ * sink, so we set up a minimal one, similar to module-null-sink but
+ * without any timing. The main thread asks the IO thread to run the
+ * benchmark with a message. */
+
+enum {
+    SINK_MESSAGE_RUN_BENCHMARK = PA_SINK_MESSAGE_MAX
+};
+
+struct render_bench {
+    pa_sink *sink;
+    pa_sink_input *inputs[PA_MAX_INPUTS_PER_SINK];
+    unsigned ninputs;
+
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    pa_rtpoll *rtpoll;
+
+    pa_memchunk data;
+    size_t length;
+
+    bench_timer timer;
+};
+
+static int render_sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct render_bench *b = PA_SINK(o)->userdata;
+
+    switch (code) {
+        case PA_SINK_MESSAGE_GET_LATENCY:
+            *((pa_usec_t*) data) = 0;
+            return 0;
+
+        case SINK_MESSAGE_RUN_BENCHMARK: {
+            pa_memchunk result;
+            unsigned i;
+
+            if (b->sink->thread_info.rewind_requested)
+                pa_sink_process_rewind(b->sink, 0);
+
+            pa_sink_render_full(b->sink, b->length, &result);
+            pa_memblock_unref(result.memblock);
+
+            timer_start(&b->timer);
+            for (i = 0; i < bench_iterations; i++) {
+                pa_sink_render_full(b->sink, b->length, &result);
+                pa_memblock_unref(result.memblock);
+            }
+            timer_stop(&b->timer);
+
+            return 0;
+        }
+    }
+
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+static void render_thread_func(void *userdata) {
+    struct render_bench *b = userdata;
+
+    pa_assert(b);
+
+    pa_thread_mq_install(&b->thread_mq);
+
+    for (;;) {
+        int ret;
+
+        if (PA_UNLIKELY(b->sink->thread_info.rewind_requested))
+            pa_sink_process_rewind(b->sink, 0);
+
+        if ((ret = pa_rtpoll_run(b->rtpoll, TRUE)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            return;
+    }
+
+fail:
+    pa_asyncmsgq_wait_for(b->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
+}
+
+/* Every input plays the same block over and over again */
+static int render_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    struct render_bench *b = i->userdata;
+
+    *chunk = b->data;
+    pa_memblock_ref(chunk->memblock);
+
+    if (chunk->length > nbytes)
+        chunk->length = nbytes;
+
+    return 0;
+}
+
+static void render_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
+}
+
+static void render_input_kill_cb(pa_sink_input *i) {
+}
+
+static void dispatch_pending(pa_mainloop *m) {
+    while (pa_mainloop_iterate(m, FALSE, NULL) > 0)
+        ;
+}
+
+static void render_bench_done(pa_mainloop *m, struct render_bench *b) {
+    unsigned i;
+
+    for (i = 0; i < b->ninputs; i++) {
+        pa_sink_input_unlink(b->inputs[i]);
+        pa_sink_input_unref(b->inputs[i]);
+    }
+
+    if (b->sink)
+        pa_sink_unlink(b->sink);
+
+    if (b->thread) {
+        pa_asyncmsgq_send(b->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(b->thread);
+    }
+
+    pa_thread_mq_done(&b->thread_mq);
+
+    if (b->sink)
+        pa_sink_unref(b->sink);
+
+    pa_rtpoll_free(b->rtpoll);
+
+    if (b->data.memblock)
+        pa_memblock_unref(b->data.memblock);
+
+    dispatch_pending(m);
+}
+
+static void bench_render(pa_mainloop *m, pa_core *core, bench_impl_t impl, const pa_sample_spec *ss, unsigned ninputs, pa_bool_t float_mixing) {
+    struct render_bench b;
+    pa_sink_new_data data;
+    pa_channel_map map;
+    unsigned i;
+
+    pa_zero(b);
+    b.length = bench_frames * pa_frame_size(ss);
+
+    pa_channel_map_init_extend(&map, ss->channels, PA_CHANNEL_MAP_DEFAULT);
+
+    b.rtpoll = pa_rtpoll_new();
+    pa_thread_mq_init(&b.thread_mq, core->mainloop, b.rtpoll);
+
+    pa_sink_new_data_init(&data);
+    data.driver = __FILE__;
+    pa_sink_new_data_set_name(&data, "render-bench");
+    pa_sink_new_data_set_sample_spec(&data, ss);
+    pa_sink_new_data_set_channel_map(&data, &map);
+    data.float_mixing = float_mixing;
+
+    b.sink = pa_sink_new(core, &data, PA_SINK_LATENCY|PA_SINK_DYNAMIC_LATENCY);
+    pa_sink_new_data_done(&data);
+
+    if (!b.sink) {
+        pa_log("Failed to create sink object.");
+        goto finish;
+    }
+
+    b.sink->parent.process_msg = render_sink_process_msg;
+    b.sink->userdata = &b;
+
+    pa_sink_set_asyncmsgq(b.sink, b.thread_mq.inq);
+    pa_sink_set_rtpoll(b.sink, b.rtpoll);
+    pa_sink_set_max_request(b.sink, b.length);
+    pa_sink_set_latency_range(b.sink, 0, pa_bytes_to_usec(b.length, ss));
+
+    if (!(b.thread = pa_thread_new("render-bench", render_thread_func, &b))) {
+        pa_log("Failed to create thread.");
+        goto finish;
+    }
+
+    pa_sink_put(b.sink);
+
+    b.data.memblock = generate_block(core->mempool, ss, bench_frames);
+    b.data.index = 0;
+    b.data.length = b.length;
+
+    for (i = 0; i < ninputs; i++) {
+        pa_sink_input_new_data input_data;
+        pa_cvolume volume;
+
+        pa_sink_input_new_data_init(&input_data);
+        pa_sink_input_new_data_set_sink(&input_data, b.sink, FALSE);
+        input_data.driver = __FILE__;
+        pa_sink_input_new_data_set_sample_spec(&input_data, ss);
+        pa_sink_input_new_data_set_channel_map(&input_data, &map);
+        pa_sink_input_new_data_set_volume(&input_data, pa_cvolume_set(&volume, ss->channels, pa_sw_volume_from_linear(0.5)));
+
+        pa_sink_input_new(&b.inputs[i], core, &input_data);
+        pa_sink_input_new_data_done(&input_data);
+
+        if (!b.inputs[i]) {
+            pa_log("Failed to create sink input.");
+            goto finish;
+        }
+
+        b.inputs[i]->pop = render_input_pop_cb;
+        b.inputs[i]->process_rewind = render_input_process_rewind_cb;
+        b.inputs[i]->kill = render_input_kill_cb;
+        b.inputs[i]->userdata = &b;
+
+        pa_sink_input_put(b.inputs[i]);
+        b.ninputs++;
+    }
+
+    dispatch_pending(m);
+
+    pa_assert_se(pa_asyncmsgq_send(b.sink->asyncmsgq, PA_MSGOBJECT(b.sink), SINK_MESSAGE_RUN_BENCHMARK, NULL, 0, NULL) == 0);
+
+    report("render", impl, float_mixing ? "float" : "native", ss->format, ss->channels, ninputs, &b.timer);
+
+finish:
+    render_bench_done(m, &b);
+}
+
+static void help(const char *argv0) {
+    printf(_("%s [options]\n\n"
+             "-h, --help                            Show this help\n"
+             "-v, --verbose                         Print debug messages\n"
+             "      --kernel=KERNEL                 Only run one of mix, volume, remap, resample, render\n"
+             "      --format=SAMPLEFORMAT           Only use this sample type\n"
+             "      --channels=CHANNELS             Only use this number of channels\n"
+             "      --inputs=INPUTS                 Only mix this number of streams\n"
+             "      --resample-method=METHOD        Only benchmark this resample method\n"
+             "      --frames=FRAMES                 Frames processed per call (defaults to 1024)\n"
+             "      --iterations=ITERATIONS         Calls per measurement (defaults to 1000)\n"
+             "\n"
+             "Results are printed one per line as:\n"
+             "kernel,impl,variant,format,channels,inputs,ns_per_frame,cycles_per_sample,allocs_per_call\n"),
+             argv0);
+}
+
+enum {
+    ARG_VERSION = 256,
+    ARG_KERNEL,
+    ARG_FORMAT,
+    ARG_CHANNELS,
+    ARG_INPUTS,
+    ARG_RESAMPLE_METHOD,
+    ARG_FRAMES,
+    ARG_ITERATIONS
+};
+
+static int parse_kernel(const char *name) {
+    if (pa_streq(name, "mix"))
+        return KERNEL_MIX;
+    if (pa_streq(name, "volume"))
+        return KERNEL_VOLUME;
+    if (pa_streq(name, "remap"))
+        return KERNEL_REMAP;
+    if (pa_streq(name, "resample"))
+        return KERNEL_RESAMPLE;
+    if (pa_streq(name, "render"))
+        return KERNEL_RENDER;
+    if (pa_streq(name, "all"))
+        return KERNEL_ALL;
+
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    pa_mainloop *m = NULL;
+    pa_core *core = NULL;
+    int ret = 1, c, kernels = KERNEL_ALL;
+    pa_sample_format_t formats[PA_SAMPLE_MAX];
+    unsigned channels[PA_ELEMENTSOF(default_channels)], inputs[PA_ELEMENTSOF(default_inputs)];
+    unsigned n_formats, n_channels, n_inputs, f, ch, in, v;
+    pa_resample_method_t method = PA_RESAMPLER_INVALID;
+    bench_impl_t impl;
+
+    static const struct option long_options[] = {
+        {"help",            0, NULL, 'h'},
+        {"verbose",         0, NULL, 'v'},
+        {"version",         0, NULL, ARG_VERSION},
+        {"kernel",          1, NULL, ARG_KERNEL},
+        {"format",          1, NULL, ARG_FORMAT},
+        {"channels",        1, NULL, ARG_CHANNELS},
+        {"inputs",          1, NULL, ARG_INPUTS},
+        {"resample-method", 1, NULL, ARG_RESAMPLE_METHOD},
+        {"frames",          1, NULL, ARG_FRAMES},
+        {"iterations",      1, NULL, ARG_ITERATIONS},
+        {NULL,              0, NULL, 0}
+    };
+
+    setlocale(LC_ALL, "");
+#ifdef ENABLE_NLS
+    bindtextdomain(GETTEXT_PACKAGE, PULSE_LOCALEDIR);
+#endif
+
+    pa_log_set_level(PA_LOG_WARN);
+
+    n_formats = PA_ELEMENTSOF(default_formats);
+    memcpy(formats, default_formats, sizeof(default_formats));
+    n_channels = PA_ELEMENTSOF(default_channels);
+    memcpy(channels, default_channels, sizeof(default_channels));
+    n_inputs = PA_ELEMENTSOF(default_inputs);
+    memcpy(inputs, default_inputs, sizeof(default_inputs));
+
+    while ((c = getopt_long(argc, argv, "hv", long_options, NULL)) != -1) {
+
+        switch (c) {
+            case 'h' :
+                help(argv[0]);
+                ret = 0;
+                goto quit;
+
+            case 'v':
+                pa_log_set_level(PA_LOG_DEBUG);
+                break;
+
+            case ARG_VERSION:
+                printf(_("%s %s\n"), argv[0], PACKAGE_VERSION);
+                ret = 0;
+                goto quit;
+
+            case ARG_KERNEL:
+                if ((kernels = parse_kernel(optarg)) < 0) {
+                    pa_log(_("Invalid kernel '%s'."), optarg);
+                    goto quit;
+                }
+                break;
+
+            case ARG_FORMAT:
+                if ((formats[0] = pa_parse_sample_format(optarg)) == PA_SAMPLE_INVALID) {
+                    pa_log(_("Invalid sample format '%s'."), optarg);
+                    goto quit;
+                }
+                n_formats = 1;
+                break;
+
+            case ARG_CHANNELS:
+                channels[0] = (unsigned) atoi(optarg);
+                if (channels[0] < 1 || channels[0] > PA_CHANNELS_MAX) {
+                    pa_log(_("Invalid number of channels '%s'."), optarg);
+                    goto quit;
+                }
+                n_channels = 1;
+                break;
+
+            case ARG_INPUTS:
+                inputs[0] = (unsigned) atoi(optarg);
+                if (inputs[0] < 1 || inputs[0] > PA_MAX_INPUTS_PER_SINK) {
+                    pa_log(_("Invalid number of inputs '%s'."), optarg);
+                    goto quit;
+                }
+                n_inputs = 1;
+                break;
+
+            case ARG_RESAMPLE_METHOD:
+                if ((method = pa_parse_resample_method(optarg)) == PA_RESAMPLER_INVALID) {
+                    pa_log(_("Invalid resample method '%s'."), optarg);
+                    goto quit;
+                }
+                break;
+
+            case ARG_FRAMES:
+                if ((bench_frames = (unsigned) atoi(optarg)) < 1) {
+                    pa_log(_("Invalid number of frames '%s'."), optarg);
+                    goto quit;
+                }
+                break;
+
+            case ARG_ITERATIONS:
+                if ((bench_iterations = (unsigned) atoi(optarg)) < 1) {
+                    pa_log(_("Invalid number of iterations '%s'."), optarg);
+                    goto quit;
+                }
+                break;
+
+            default:
+                goto quit;
+        }
+    }
+
+    save_c_functions();
+    init_cpu();
+    restore_c_functions();
+
+#ifdef SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    pa_assert_se(m = pa_mainloop_new());
+    pa_assert_se(core = pa_core_new(pa_mainloop_get_api(m), FALSE, 0));
+    bench_pool = core->mempool;
+
+    printf("# kernel,impl,variant,format,channels,inputs,ns_per_frame,cycles_per_sample,allocs_per_call\n");
+
+    for (impl = 0; impl < IMPL_MAX; impl++) {
+
+        if (!install_impl(impl))
+            continue;
+
+        for (f = 0; f < n_formats; f++) {
+            for (ch = 0; ch < n_channels; ch++) {
+                pa_sample_spec ss;
+
+                ss.format = formats[f];
+                ss.rate = BENCH_RATE;
+                ss.channels = (uint8_t) channels[ch];
+
+                if (kernels & KERNEL_MIX)
+                    for (in = 0; in < n_inputs; in++)
+                        bench_mix(core->mempool, impl, &ss, inputs[in]);
+
+                if (kernels & KERNEL_VOLUME)
+                    bench_volume(core->mempool, impl, &ss);
+
+                /* The optimized functions below only differ as a
+                 * whole, so only compare the generic code against
+                 * what this host would use */
+                if (impl != IMPL_C && impl != IMPL_AUTO)
+                    continue;
+
+                if (kernels & KERNEL_RESAMPLE) {
+                    pa_resample_method_t r;
+
+                    for (r = 0; r < PA_RESAMPLER_MAX; r++) {
+                        if (r == PA_RESAMPLER_AUTO || !pa_resample_method_supported(r))
+                            continue;
+                        if (method != PA_RESAMPLER_INVALID && r != method)
+                            continue;
+
+                        bench_resample(core->mempool, impl, &ss, r);
+                    }
+                }
+
+                if (kernels & KERNEL_RENDER)
+                    for (in = 0; in < n_inputs; in++) {
+                        bench_render(m, core, impl, &ss, inputs[in], FALSE);
+
+                        if (ss.format != PA_SAMPLE_FLOAT32NE)
+                            bench_render(m, core, impl, &ss, inputs[in], TRUE);
+                    }
+            }
+
+            /* Remapping is only implemented for these two formats */
+            if ((kernels & KERNEL_REMAP) && (formats[f] == PA_SAMPLE_S16NE || formats[f] == PA_SAMPLE_FLOAT32NE))
+                for (v = 0; v < PA_ELEMENTSOF(remap_variants); v++)
+                    bench_remap(core->mempool, impl, formats[f], remap_variants[v].from, remap_variants[v].to);
+        }
+    }
+
+    ret = 0;
+
+quit:
+    if (core)
+        pa_core_unref(core);
+
+    if (m)
+        pa_mainloop_free(m);
+
+    return ret;
+}
@@ -0,0 +1,176 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/shm.h>
+#include <pulsecore/shm-ring.h>
+
+/* Odd sized writes, so that they wrap around at all kinds of
+ * positions */
+#define WRITE_SIZE 1001
+#define N_WRITES 1000
+
+static uint8_t pattern(unsigned i) {
+    return (uint8_t) (i * 7 + i / 251);
+}
+
+/* Reads everything there is and checks it against the pattern */
+static unsigned read_all(pa_shm_ring *r, unsigned n) {
+    const void *d;
+    size_t l, k;
+
+    for (;;) {
+        fail_unless(pa_shm_ring_peek(r, &d, &l) == 0);
+
+        if (l <= 0)
+            break;
+
+        for (k = 0; k < l; k++)
+            fail_unless(((const uint8_t*) d)[k] == pattern(n + (unsigned) k));
+
+        pa_shm_ring_drop(r, l);
+        n += (unsigned) l;
+    }
+
+    return n;
+}
+
+START_TEST (shm_ring_test) {
+    pa_shm_ring *producer, *consumer;
+    uint8_t buf[WRITE_SIZE];
+    unsigned written = 0, read = 0, i, k;
+    size_t size;
+
+    fail_unless((producer = pa_shm_ring_new(10000)) != NULL);
+    size = pa_shm_ring_get_size(producer);
+    fail_unless(size == 16384);
+
+    /* The size has to be exactly what the producer made */
+    fail_unless(pa_shm_ring_attach(pa_shm_ring_get_id(producer), size / 2 + 1) == NULL);
+    fail_unless((consumer = pa_shm_ring_attach(pa_shm_ring_get_id(producer), size)) != NULL);
+
+    /* Nothing can be written before we know where the consumer is */
+    fail_unless(pa_shm_ring_writable(producer) == 0);
+    fail_unless(pa_shm_ring_write(producer, buf, sizeof(buf)) == 0);
+
+    fail_unless(pa_shm_ring_connect(producer, pa_shm_ring_get_id(consumer)) == 0);
+    fail_unless(pa_shm_ring_writable(producer) == size);
+
+    for (i = 0; i < N_WRITES; i++) {
+        size_t n;
+
+        for (k = 0; k < sizeof(buf); k++)
+            buf[k] = pattern(written + k);
+
+        n = pa_shm_ring_write(producer, buf, sizeof(buf));
+        written += (unsigned) n;
+
+        /* Only read every couple of writes, so that the ring fills
+         * up now and then */
+        if (n < sizeof(buf) || i % 3 == 0) {
+            read = read_all(consumer, read);
+            fail_unless(read == written);
+            fail_unless(pa_shm_ring_writable(producer) == size);
+
+            if (n < sizeof(buf)) {
+                fail_unless(pa_shm_ring_write(producer, buf + n, sizeof(buf) - n) == sizeof(buf) - n);
+                written += (unsigned) (sizeof(buf) - n);
+            }
+        }
+
+        fail_unless(pa_shm_ring_writable(producer) == size - (written - read));
+    }
+
+    read = read_all(consumer, read);
+    fail_unless(read == written);
+    fail_unless(written == N_WRITES * WRITE_SIZE);
+    fail_unless(pa_shm_ring_get_index(producer) == written);
+    fail_unless(pa_shm_ring_get_index(consumer) == read);
+
+    pa_shm_ring_free(consumer);
+    pa_shm_ring_free(producer);
+}
+END_TEST
+
+START_TEST (shm_ring_corrupt_test) {
+    pa_shm_ring *consumer;
+    pa_shm segment;
+    pa_atomic_t *index;
+    const void *d;
+    size_t l;
+
+    /* Play a producer that messes up its index */
+    fail_unless(pa_shm_create_rw(&segment, 64 + PA_PAGE_SIZE, TRUE, 0700) == 0);
+    index = segment.ptr;
+    pa_atomic_store(index, -100);
+
+    fail_unless((consumer = pa_shm_ring_attach(segment.id, PA_PAGE_SIZE)) != NULL);
+
+    /* Wrapping around at 2^32 is fine */
+    pa_atomic_add(index, 200);
+    fail_unless(pa_shm_ring_peek(consumer, &d, &l) == 0);
+    fail_unless(l == 100);
+    pa_shm_ring_drop(consumer, l);
+    fail_unless(pa_shm_ring_peek(consumer, &d, &l) == 0);
+    fail_unless(l == 100);
+    pa_shm_ring_drop(consumer, l);
+
+    /* More data than fits into the ring is not */
+    pa_atomic_add(index, PA_PAGE_SIZE + 1);
+    fail_unless(pa_shm_ring_peek(consumer, &d, &l) < 0);
+    fail_unless(l == 0);
+
+    /* Neither is going backwards */
+    pa_atomic_store(index, 0);
+    fail_unless(pa_shm_ring_peek(consumer, &d, &l) < 0);
+
+    pa_shm_ring_free(consumer);
+    pa_shm_free(&segment);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Shared memory ring");
+    tc = tcase_create("shm-ring");
+    tcase_add_test(tc, shm_ring_test);
+    tcase_add_test(tc, shm_ring_corrupt_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
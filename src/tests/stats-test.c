@@ -0,0 +1,147 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/shm.h>
+#include <pulsecore/stats.h>
+
+#define N_SLOTS 4
+
+/* Does what a monitoring tool would do: map the segment and look for
+ * the slot of the given object */
+static const pa_stats_slot* find_slot(const pa_shm *segment, uint32_t object, uint32_t idx) {
+    const pa_stats_header *header = segment->ptr;
+    unsigned i;
+
+    for (i = 0; i < header->n_slots; i++) {
+        const pa_stats_slot *slot;
+        pa_stats_slot copy;
+
+        slot = (const pa_stats_slot*) ((const uint8_t*) segment->ptr + header->slots_offset + i * header->slot_size);
+
+        if (pa_stats_slot_snapshot(slot, &copy) < 0)
+            continue;
+
+        if (copy.object == object && copy.index == idx)
+            return slot;
+    }
+
+    return NULL;
+}
+
+START_TEST (stats_test) {
+    pa_stats *s;
+    pa_stats_slot *slots[N_SLOTS], *a;
+    const pa_stats_slot *reader;
+    const pa_stats_header *header;
+    pa_stats_slot copy;
+    pa_shm segment;
+    unsigned i;
+
+    /* Everything is fine without statistics */
+    fail_unless(pa_stats_slot_new(NULL, PA_STATS_OBJECT_SINK, 0, "foo") == NULL);
+    pa_stats_slot_inc(NULL, PA_STATS_UNDERRUNS);
+    pa_stats_slot_free(NULL);
+
+    fail_unless((s = pa_stats_new(N_SLOTS)) != NULL);
+    fail_unless(pa_shm_attach_ro(&segment, pa_stats_get_id(s)) == 0);
+
+    header = segment.ptr;
+    fail_unless(header->magic == PA_STATS_MAGIC);
+    fail_unless(header->version == PA_STATS_VERSION);
+    fail_unless(header->n_slots == N_SLOTS);
+    fail_unless(header->slot_size >= sizeof(pa_stats_slot));
+    fail_unless(header->slot_size % 64 == 0);
+    fail_unless(header->slots_offset >= sizeof(pa_stats_header));
+    fail_unless(header->slots_offset % 64 == 0);
+
+    for (i = 0; i < N_SLOTS; i++)
+        fail_unless((slots[i] = pa_stats_slot_new(s, PA_STATS_OBJECT_SINK_INPUT, i, "stream")) != NULL);
+
+    /* All taken */
+    fail_unless(pa_stats_slot_new(s, PA_STATS_OBJECT_SINK, 100, "sink") == NULL);
+
+    pa_stats_slot_inc(slots[2], PA_STATS_UNDERRUNS);
+    pa_stats_slot_inc(slots[2], PA_STATS_UNDERRUNS);
+    pa_stats_slot_set(slots[2], PA_STATS_LATENCY, 25000);
+    pa_stats_slot_add_render_time(slots[2], 0);
+    pa_stats_slot_add_render_time(slots[2], 300);
+    pa_stats_slot_add_render_time(slots[2], 10000000);
+
+    fail_unless((reader = find_slot(&segment, PA_STATS_OBJECT_SINK_INPUT, 2)) != NULL);
+    fail_unless(pa_stats_slot_snapshot(reader, &copy) == 0);
+    fail_unless(strcmp(copy.name, "stream") == 0);
+    fail_unless(pa_atomic_load(&copy.fields[PA_STATS_UNDERRUNS]) == 2);
+    fail_unless(pa_atomic_load(&copy.fields[PA_STATS_OVERRUNS]) == 0);
+    fail_unless(pa_atomic_load(&copy.fields[PA_STATS_LATENCY]) == 25000);
+    fail_unless(pa_atomic_load(&copy.fields[PA_STATS_RENDER_USEC]) == 1);
+    fail_unless(pa_atomic_load(&copy.fields[PA_STATS_RENDER_USEC + 8]) == 1);
+    fail_unless(pa_atomic_load(&copy.fields[PA_STATS_RENDER_USEC + PA_STATS_RENDER_BUCKETS - 1]) == 1);
+
+    /* A freed slot is gone for readers, and comes back with a new
+     * generation and fresh counters */
+    pa_stats_slot_free(slots[2]);
+    fail_unless(pa_stats_slot_snapshot(reader, &copy) < 0);
+    fail_unless(find_slot(&segment, PA_STATS_OBJECT_SINK_INPUT, 2) == NULL);
+
+    fail_unless((a = pa_stats_slot_new(s, PA_STATS_OBJECT_SOURCE, 7, NULL)) == slots[2]);
+    fail_unless(find_slot(&segment, PA_STATS_OBJECT_SOURCE, 7) == reader);
+    fail_unless(pa_stats_slot_snapshot(reader, &copy) == 0);
+    fail_unless(pa_atomic_load(&copy.generation) == 3);
+    fail_unless(copy.name[0] == 0);
+    fail_unless(pa_atomic_load(&copy.fields[PA_STATS_UNDERRUNS]) == 0);
+
+    pa_stats_slot_free(a);
+    for (i = 0; i < N_SLOTS; i++)
+        if (i != 2)
+            pa_stats_slot_free(slots[i]);
+
+    pa_shm_free(&segment);
+    pa_stats_free(s);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Statistics");
+    tc = tcase_create("stats");
+    tcase_add_test(tc, stats_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}